@@ -24,9 +24,10 @@ LOCAL_SRC_FILES := audio-ril-interface.c
 LOCAL_C_INCLUDES := \
 	hardware/ril/samsung-ril/include \
 	hardware/ril/samsung-ril/srs-client/include \
-	hardware/tinyalsa-audio/include/
+	hardware/tinyalsa-audio/include/ \
+	$(TARGET_YAMAHA_MC1N2_AUDIO_PATH)/include
 
-LOCAL_SHARED_LIBRARIES := liblog libcutils libsrs-client
+LOCAL_SHARED_LIBRARIES := liblog libcutils libsrs-client libyamaha-mc1n2-audio
 LOCAL_PRELINK_MODULE := false
 
 LOCAL_MODULE := libaudio-ril-interface
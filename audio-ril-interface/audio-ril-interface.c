@@ -26,8 +26,26 @@
 #include <samsung-ril-socket.h>
 #include <srs-client.h>
 
+#include <yamaha-mc1n2-audio.h>
+
 int galaxys2_mic_mute(void *pdata, int mute)
 {
+	struct yamaha_mc1n2_audio_pdata *mc1n2_pdata;
+	int rc;
+
+	ALOGD("%s(%d)", __func__, mute);
+
+	// The mics are gated on the codec, started by the audio HAL
+	mc1n2_pdata = yamaha_mc1n2_audio_get_started();
+	if (mc1n2_pdata == NULL) {
+		ALOGE("%s: Codec is not started", __func__);
+		return -1;
+	}
+
+	rc = yamaha_mc1n2_audio_set_mic_mute(mc1n2_pdata, mute);
+	if (rc < 0)
+		return -1;
+
 	return 0;
 }
 
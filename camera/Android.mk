@@ -18,9 +18,13 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
+	smdk4210_burst.c \
 	smdk4210_camera.c \
 	smdk4210_exif.c \
+	smdk4210_face.c \
+	smdk4210_jpeg.c \
 	smdk4210_param.c \
+	smdk4210_transform.c.neon \
 	smdk4210_utils.c \
 	smdk4210_v4l2.c
 
@@ -35,3 +39,177 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Simulated V4L2 backend, only linked in the host tools
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	smdk4210_v4l2_sim.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	hardware/samsung/exynos4/hal/include
+
+LOCAL_MULTILIB := 32
+
+LOCAL_MODULE := libsmdk4210_v4l2_sim
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# Host benchmark, running the HAL on the simulated V4L2 backend
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	smdk4210_burst.c \
+	smdk4210_camera.c \
+	smdk4210_exif.c \
+	smdk4210_face.c \
+	smdk4210_jpeg.c \
+	smdk4210_param.c \
+	smdk4210_transform.c \
+	smdk4210_utils.c \
+	smdk4210_v4l2.c \
+	bench/jpeg_api_sim.c \
+	bench/smdk4210_camera_bench.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	hardware/samsung/exynos4/hal/include \
+	hardware/samsung/exynos4/hal/libs5pjpeg
+
+LOCAL_STATIC_LIBRARIES := libsmdk4210_v4l2_sim libutils libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+
+# The HAL stores pointers in ints
+LOCAL_MULTILIB := 32
+
+LOCAL_MODULE := smdk4210_camera_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Face detection benchmark, on a synthetic preview frame
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	smdk4210_face.c \
+	bench/smdk4210_face_bench.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	hardware/samsung/exynos4/hal/include
+
+LOCAL_STATIC_LIBRARIES := libutils libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MULTILIB := 32
+
+LOCAL_MODULE := smdk4210_face_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Software transform benchmark, rotation and zoom on a synthetic frame
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	smdk4210_transform.c \
+	bench/smdk4210_transform_bench.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	hardware/samsung/exynos4/hal/include
+
+LOCAL_STATIC_LIBRARIES := libutils libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MULTILIB := 32
+
+LOCAL_MODULE := smdk4210_transform_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	smdk4210_transform.c.neon \
+	bench/smdk4210_transform_bench.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	hardware/samsung/exynos4/hal/include
+
+LOCAL_SHARED_LIBRARIES := libutils libcutils liblog
+
+LOCAL_MODULE := smdk4210_transform_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# V4L2 trace replay, on the simulated backend or the kernel driver
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	smdk4210_utils.c \
+	smdk4210_v4l2.c \
+	bench/smdk4210_v4l2_replay.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	hardware/samsung/exynos4/hal/include
+
+LOCAL_STATIC_LIBRARIES := libsmdk4210_v4l2_sim libutils libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MULTILIB := 32
+
+LOCAL_MODULE := smdk4210_v4l2_replay
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# JPEG encoder benchmark, software against libs5pjpeg (its stand-in on the host)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	smdk4210_jpeg.c \
+	bench/jpeg_api_sim.c \
+	bench/smdk4210_jpeg_bench.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	hardware/samsung/exynos4/hal/include \
+	hardware/samsung/exynos4/hal/libs5pjpeg
+
+LOCAL_STATIC_LIBRARIES := libutils libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MODULE := smdk4210_jpeg_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	smdk4210_jpeg.c \
+	bench/smdk4210_jpeg_bench.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	hardware/samsung/exynos4/hal/include
+
+LOCAL_SHARED_LIBRARIES := libutils libcutils liblog libs5pjpeg
+
+LOCAL_MODULE := smdk4210_jpeg_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,565 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <utils/Timers.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * Host benchmark: drives camera.smdk4210 through the HAL ops, with the
+ * simulated V4L2 backend, a fake preview window and fake gralloc.
+ */
+
+extern struct camera_module HAL_MODULE_INFO_SYM;
+extern struct exynox_camera_config *smdk4210_camera_config;
+
+// Exposure compensation goes from -4 to 4
+#define BENCH_EXPOSURES_COUNT	9
+
+struct smdk4210_camera_bench {
+	struct camera_device *device;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	int window_frames;
+	nsecs_t window_first;
+	nsecs_t window_last;
+
+	int recording_frames;
+	nsecs_t recording_first;
+	nsecs_t recording_last;
+	nsecs_t recording_latency_sum;
+	nsecs_t recording_latency_max;
+
+	int pictures;
+	nsecs_t picture_start;
+	nsecs_t picture_duration;
+
+	int requests_completed;
+	int requests_matched;
+	unsigned int requests_frame;
+};
+
+struct smdk4210_camera_bench_memory {
+	camera_memory_t memory;
+	size_t length;
+	int mapped;
+};
+
+static struct smdk4210_camera_bench bench;
+
+static buffer_handle_t bench_window_handle;
+static void *bench_window_data;
+static int bench_window_size;
+
+/*
+ * Gralloc
+ */
+
+static int bench_gralloc_lock(struct gralloc_module_t const *module, buffer_handle_t handle,
+	int usage, int l, int t, int w, int h, void **vaddr)
+{
+	*vaddr = bench_window_data;
+
+	return 0;
+}
+
+static int bench_gralloc_unlock(struct gralloc_module_t const *module, buffer_handle_t handle)
+{
+	return 0;
+}
+
+static gralloc_module_t bench_gralloc_module = {
+	.lock = bench_gralloc_lock,
+	.unlock = bench_gralloc_unlock,
+};
+
+int hw_get_module(const char *id, const struct hw_module_t **module)
+{
+	if (id == NULL || module == NULL || strcmp(id, GRALLOC_HARDWARE_MODULE_ID) != 0)
+		return -ENOENT;
+
+	*module = (const struct hw_module_t *) &bench_gralloc_module;
+
+	return 0;
+}
+
+/*
+ * Preview window
+ */
+
+static int bench_window_dequeue_buffer(struct preview_stream_ops *w, buffer_handle_t **buffer, int *stride)
+{
+	*buffer = &bench_window_handle;
+	*stride = 0;
+
+	return 0;
+}
+
+static int bench_window_enqueue_buffer(struct preview_stream_ops *w, buffer_handle_t *buffer)
+{
+	nsecs_t t = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	if (bench.window_frames == 0)
+		bench.window_first = t;
+
+	bench.window_last = t;
+	bench.window_frames++;
+
+	return 0;
+}
+
+static int bench_window_cancel_buffer(struct preview_stream_ops *w, buffer_handle_t *buffer)
+{
+	return 0;
+}
+
+static int bench_window_set_buffer_count(struct preview_stream_ops *w, int count)
+{
+	return 0;
+}
+
+static int bench_window_set_buffers_geometry(struct preview_stream_ops *pw, int w, int h, int format)
+{
+	int size = w * h * 4;
+
+	if (size > bench_window_size) {
+		free(bench_window_data);
+		bench_window_data = malloc(size);
+		bench_window_size = size;
+	}
+
+	return bench_window_data != NULL ? 0 : -ENOMEM;
+}
+
+static int bench_window_set_crop(struct preview_stream_ops *w, int left, int top, int right, int bottom)
+{
+	return 0;
+}
+
+static int bench_window_set_usage(struct preview_stream_ops *w, int usage)
+{
+	return 0;
+}
+
+static int bench_window_set_swap_interval(struct preview_stream_ops *w, int interval)
+{
+	return 0;
+}
+
+static int bench_window_get_min_undequeued_buffer_count(const struct preview_stream_ops *w, int *count)
+{
+	*count = 1;
+
+	return 0;
+}
+
+static int bench_window_lock_buffer(struct preview_stream_ops *w, buffer_handle_t *buffer)
+{
+	return 0;
+}
+
+static int bench_window_set_timestamp(struct preview_stream_ops *w, int64_t timestamp)
+{
+	return 0;
+}
+
+static struct preview_stream_ops bench_window = {
+	.dequeue_buffer = bench_window_dequeue_buffer,
+	.enqueue_buffer = bench_window_enqueue_buffer,
+	.cancel_buffer = bench_window_cancel_buffer,
+	.set_buffer_count = bench_window_set_buffer_count,
+	.set_buffers_geometry = bench_window_set_buffers_geometry,
+	.set_crop = bench_window_set_crop,
+	.set_usage = bench_window_set_usage,
+	.set_swap_interval = bench_window_set_swap_interval,
+	.get_min_undequeued_buffer_count = bench_window_get_min_undequeued_buffer_count,
+	.lock_buffer = bench_window_lock_buffer,
+	.set_timestamp = bench_window_set_timestamp,
+};
+
+/*
+ * Callbacks
+ */
+
+static void bench_memory_release(camera_memory_t *memory)
+{
+	struct smdk4210_camera_bench_memory *bench_memory;
+
+	if (memory == NULL)
+		return;
+
+	bench_memory = (struct smdk4210_camera_bench_memory *) memory;
+
+	if (bench_memory->mapped)
+		munmap(memory->data, bench_memory->length);
+	else
+		free(memory->data);
+
+	free(bench_memory);
+}
+
+static camera_memory_t *bench_request_memory(int fd, size_t buf_size, unsigned int num_bufs, void *user)
+{
+	struct smdk4210_camera_bench_memory *bench_memory;
+	void *data;
+
+	bench_memory = calloc(1, sizeof(struct smdk4210_camera_bench_memory));
+	if (bench_memory == NULL)
+		return NULL;
+
+	bench_memory->length = buf_size * num_bufs;
+
+	if (fd >= 0) {
+		data = mmap(NULL, bench_memory->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+
+		bench_memory->mapped = 1;
+	} else {
+		data = calloc(1, bench_memory->length);
+	}
+
+	if (data == NULL) {
+		free(bench_memory);
+		return NULL;
+	}
+
+	bench_memory->memory.data = data;
+	bench_memory->memory.size = bench_memory->length;
+	bench_memory->memory.release = bench_memory_release;
+
+	return &bench_memory->memory;
+}
+
+static void bench_notify(int32_t msg_type, int32_t ext1, int32_t ext2, void *user)
+{
+	if (msg_type == CAMERA_MSG_ERROR)
+		fprintf(stderr, "Camera error: %d\n", ext1);
+}
+
+static void bench_data(int32_t msg_type, const camera_memory_t *data, unsigned int index,
+	camera_frame_metadata_t *metadata, void *user)
+{
+	if (msg_type != CAMERA_MSG_COMPRESSED_IMAGE)
+		return;
+
+	pthread_mutex_lock(&bench.mutex);
+	bench.picture_duration = systemTime(SYSTEM_TIME_MONOTONIC) - bench.picture_start;
+	bench.pictures++;
+	pthread_cond_signal(&bench.cond);
+	pthread_mutex_unlock(&bench.mutex);
+}
+
+static void bench_data_timestamp(int64_t timestamp, int32_t msg_type, const camera_memory_t *data,
+	unsigned int index, void *user)
+{
+	nsecs_t t = systemTime(SYSTEM_TIME_MONOTONIC);
+	nsecs_t latency = t - timestamp;
+	void *opaque;
+
+	if (bench.recording_frames == 0)
+		bench.recording_first = timestamp;
+
+	bench.recording_last = timestamp;
+	bench.recording_frames++;
+	bench.recording_latency_sum += latency;
+	if (latency > bench.recording_latency_max)
+		bench.recording_latency_max = latency;
+
+	// Like an encoder, release the frame right away
+	opaque = (void *) ((unsigned char *) data->data + index * sizeof(struct smdk4210_camera_addrs));
+	bench.device->ops->release_recording_frame(bench.device, opaque);
+}
+
+/*
+ * Requests
+ */
+
+static void bench_request_callback(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_request_result *result, void *data)
+{
+	unsigned char *output;
+
+	if (result->status < 0 || result->output == NULL)
+		return;
+
+	output = (unsigned char *) result->output;
+
+	pthread_mutex_lock(&bench.mutex);
+
+	// The simulated sensor stamps the exposure it used on the frame
+	bench.requests_completed++;
+	if (result->controls_count > 0 && output[0] == (unsigned char) result->controls[0].value)
+		bench.requests_matched++;
+
+	bench.requests_frame = result->frame;
+	pthread_cond_broadcast(&bench.cond);
+
+	pthread_mutex_unlock(&bench.mutex);
+}
+
+static int bench_requests(int count)
+{
+	struct smdk4210_camera *smdk4210_camera;
+	struct smdk4210_camera_request request;
+	struct timespec ts;
+	void *outputs[BENCH_EXPOSURES_COUNT];
+	int rc = 0;
+	int i;
+
+	smdk4210_camera = (struct smdk4210_camera *) bench.device->priv;
+
+	if (count > BENCH_EXPOSURES_COUNT)
+		count = BENCH_EXPOSURES_COUNT;
+
+	// Exposure sweep, one value per frame
+	for (i = 0; i < count; i++) {
+		outputs[i] = malloc(smdk4210_camera->preview_frame_size);
+
+		memset(&request, 0, sizeof(request));
+		request.controls[0].id = V4L2_CID_CAMERA_BRIGHTNESS;
+		request.controls[0].value = i - BENCH_EXPOSURES_COUNT / 2;
+		request.controls_count = 1;
+		request.output = outputs[i];
+		request.output_size = outputs[i] != NULL ? smdk4210_camera->preview_frame_size : 0;
+		request.callback = bench_request_callback;
+
+		if (smdk4210_camera_request_submit(smdk4210_camera, &request) < 0)
+			rc = -1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 2;
+
+	pthread_mutex_lock(&bench.mutex);
+	while (bench.requests_completed < count && rc == 0)
+		rc = pthread_cond_timedwait(&bench.cond, &bench.mutex, &ts);
+	pthread_mutex_unlock(&bench.mutex);
+
+	// The exposure goes back to the session one by itself once the sweep retires
+
+	for (i = 0; i < count; i++)
+		free(outputs[i]);
+
+	return rc == 0 ? 0 : -1;
+}
+
+/*
+ * Benchmark
+ */
+
+static int bench_picture(int timeout)
+{
+	struct timespec ts;
+	int pictures;
+	int rc = 0;
+
+	pthread_mutex_lock(&bench.mutex);
+	pictures = bench.pictures;
+	bench.picture_start = systemTime(SYSTEM_TIME_MONOTONIC);
+	pthread_mutex_unlock(&bench.mutex);
+
+	if (bench.device->ops->take_picture(bench.device) < 0)
+		return -1;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout;
+
+	pthread_mutex_lock(&bench.mutex);
+	while (bench.pictures == pictures && rc == 0)
+		rc = pthread_cond_timedwait(&bench.cond, &bench.mutex, &ts);
+	pthread_mutex_unlock(&bench.mutex);
+
+	return rc == 0 ? 0 : -1;
+}
+
+static void bench_usage(char *name)
+{
+	printf("Usage: %s [-c camera] [-d seconds] [-f fps] [-j jitter_us] [-p WxH] [-F format] [-r rotation] [-v WxH] [-t trace] [-z zoom]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct hw_device_t *hw_device = NULL;
+	char *preview_size = NULL;
+	char *preview_format = NULL;
+	char *video_size = NULL;
+	char camera_id[4];
+	char *parameters;
+	char *p;
+	int duration = 3;
+	int zoom = -1;
+	int rotation = -1;
+	int id = 0;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "c:d:f:j:p:r:t:v:z:F:h")) != -1) {
+		switch (opt) {
+			case 'c':
+				id = atoi(optarg);
+				break;
+			case 'd':
+				duration = atoi(optarg);
+				break;
+			case 'f':
+				smdk4210_v4l2_sim_config.fps = atoi(optarg);
+				break;
+			case 'j':
+				smdk4210_v4l2_sim_config.jitter = atoi(optarg);
+				break;
+			case 'p':
+				preview_size = optarg;
+				break;
+			case 'F':
+				preview_format = optarg;
+				break;
+			case 'r':
+				rotation = atoi(optarg);
+				break;
+			case 't':
+				smdk4210_camera_config->v4l2_trace_path = optarg;
+				break;
+			case 'v':
+				video_size = optarg;
+				break;
+			case 'z':
+				zoom = atoi(optarg);
+				break;
+			default:
+				bench_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	memset(&bench, 0, sizeof(bench));
+	pthread_mutex_init(&bench.mutex, NULL);
+	pthread_cond_init(&bench.cond, NULL);
+
+	smdk4210_camera_config->v4l2_ops = &smdk4210_v4l2_sim_ops;
+
+	snprintf(camera_id, sizeof(camera_id), "%d", id);
+
+	rc = HAL_MODULE_INFO_SYM.common.methods->open((const struct hw_module_t *) &HAL_MODULE_INFO_SYM,
+		camera_id, &hw_device);
+	if (rc < 0 || hw_device == NULL) {
+		fprintf(stderr, "Unable to open camera %s\n", camera_id);
+		return 1;
+	}
+
+	bench.device = (struct camera_device *) hw_device;
+
+	bench.device->ops->set_callbacks(bench.device, bench_notify, bench_data, bench_data_timestamp,
+		bench_request_memory, NULL);
+	bench.device->ops->enable_msg_type(bench.device, CAMERA_MSG_ERROR | CAMERA_MSG_SHUTTER |
+		CAMERA_MSG_VIDEO_FRAME | CAMERA_MSG_COMPRESSED_IMAGE);
+
+	if (preview_size != NULL || preview_format != NULL || video_size != NULL || zoom >= 0 || rotation >= 0) {
+		parameters = bench.device->ops->get_parameters(bench.device);
+		p = malloc(strlen(parameters) + 160);
+		if (p != NULL) {
+			sprintf(p, "%s;preview-size=%s;video-size=%s", parameters,
+				preview_size != NULL ? preview_size : "640x480",
+				video_size != NULL ? video_size : "720x480");
+			if (preview_format != NULL)
+				sprintf(p + strlen(p), ";preview-format=%.16s", preview_format);
+			if (rotation >= 0)
+				sprintf(p + strlen(p), ";rotation=%d", rotation);
+			if (zoom >= 0)
+				sprintf(p + strlen(p), ";zoom=%d", zoom);
+			bench.device->ops->set_parameters(bench.device, p);
+			free(p);
+		}
+
+		bench.device->ops->put_parameters(bench.device, parameters);
+	}
+
+	// Preview
+
+	bench.device->ops->set_preview_window(bench.device, &bench_window);
+
+	rc = bench.device->ops->start_preview(bench.device);
+	if (rc < 0) {
+		fprintf(stderr, "Unable to start preview\n");
+		goto complete;
+	}
+
+	sleep(duration);
+
+	printf("Preview: %d frames displayed, %.2f fps\n", bench.window_frames,
+		bench.window_frames > 1 ? (float) (bench.window_frames - 1) * 1000000000.0f /
+		(float) (bench.window_last - bench.window_first) : 0.0f);
+
+	// Requests
+
+	rc = bench_requests(BENCH_EXPOSURES_COUNT);
+	printf("Requests: %s, %d completed, %d with the requested exposure, last on frame %u\n",
+		rc < 0 ? "timed out" : "ok", bench.requests_completed, bench.requests_matched,
+		bench.requests_frame);
+
+	// Recording
+
+	rc = bench.device->ops->start_recording(bench.device);
+	if (rc < 0) {
+		fprintf(stderr, "Unable to start recording\n");
+		goto complete;
+	}
+
+	sleep(duration);
+
+	rc = bench_picture(5);
+	printf("Video snapshot: %s, %lld ms\n", rc < 0 ? "failed" : "ok",
+		bench.picture_duration / 1000000LL);
+
+	sleep(1);
+
+	bench.device->ops->stop_recording(bench.device);
+
+	printf("Recording: %d frames, %.2f fps, latency avg %lld us, max %lld us\n",
+		bench.recording_frames, bench.recording_frames > 1 ?
+		(float) (bench.recording_frames - 1) * 1000000000.0f /
+		(float) (bench.recording_last - bench.recording_first) : 0.0f,
+		bench.recording_frames > 0 ? bench.recording_latency_sum / bench.recording_frames / 1000LL : 0LL,
+		bench.recording_latency_max / 1000LL);
+
+	// Capture
+
+	rc = bench_picture(5);
+	printf("Capture: %s, %lld ms\n", rc < 0 ? "failed" : "ok",
+		bench.picture_duration / 1000000LL);
+
+	bench.device->ops->dump(bench.device, 1);
+
+	bench.device->ops->stop_preview(bench.device);
+
+	rc = 0;
+
+complete:
+	hw_device->close(hw_device);
+
+	return rc < 0 ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Timers.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * Face detection benchmark: runs the detector on a synthetic NV21 frame
+ * holding a single face and reports the time spent per frame.
+ */
+
+static void bench_ellipse(unsigned char *data, int width, int height,
+	int cx, int cy, int rx, int ry, int luma, int cr, int cb)
+{
+	unsigned char *chroma;
+	int x, y;
+
+	chroma = data + width * height;
+
+	for (y = cy - ry; y <= cy + ry; y++) {
+		for (x = cx - rx; x <= cx + rx; x++) {
+			if (x < 0 || y < 0 || x >= width || y >= height)
+				continue;
+
+			if ((x - cx) * (x - cx) * ry * ry + (y - cy) * (y - cy) * rx * rx > rx * rx * ry * ry)
+				continue;
+
+			data[y * width + x] = luma;
+
+			if (cr >= 0 && (x & 1) == 0 && (y & 1) == 0) {
+				chroma[(y / 2) * width + x] = cr;
+				chroma[(y / 2) * width + x + 1] = cb;
+			}
+		}
+	}
+}
+
+static void bench_frame(unsigned char *data, int width, int height,
+	int cx, int cy, int size)
+{
+	int x, y;
+
+	// Textured background with neutral chroma
+	for (y = 0; y < height; y++)
+		for (x = 0; x < width; x++)
+			data[y * width + x] = 60 + ((x * 7 + y * 3) & 0x3f) + (rand() & 0x0f);
+
+	memset(data + width * height, 128, width * height / 2);
+
+	// Face, with skin tone chroma
+	bench_ellipse(data, width, height, cx, cy, size / 2, (size * 6) / 10, 170, 150, 105);
+
+	// Eyes and brows
+	bench_ellipse(data, width, height, cx - (size * 22) / 100, cy - (size * 12) / 100,
+		size / 9, size / 14, 45, -1, -1);
+	bench_ellipse(data, width, height, cx + (size * 22) / 100, cy - (size * 12) / 100,
+		size / 9, size / 14, 45, -1, -1);
+	bench_ellipse(data, width, height, cx - (size * 22) / 100, cy - (size * 24) / 100,
+		size / 7, size / 30, 70, -1, -1);
+	bench_ellipse(data, width, height, cx + (size * 22) / 100, cy - (size * 24) / 100,
+		size / 7, size / 30, 70, -1, -1);
+
+	// Mouth
+	bench_ellipse(data, width, height, cx, cy + (size * 28) / 100,
+		size / 5, size / 16, 90, -1, -1);
+}
+
+static void bench_usage(char *name)
+{
+	printf("Usage: %s [-s WxH] [-f face_size] [-n iterations] [-b budget_ms]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct smdk4210_face_detector detector;
+	struct smdk4210_face faces[SMDK4210_FACE_MAX_COUNT];
+	unsigned char *data;
+	nsecs_t budget = SMDK4210_FACE_BUDGET;
+	nsecs_t decimate_duration = 0;
+	nsecs_t detect_duration = 0;
+	nsecs_t detect_max = 0;
+	nsecs_t t;
+	int width = 640;
+	int height = 480;
+	int face_size = 160;
+	int iterations = 100;
+	int count = 0;
+	int opt;
+	int rc;
+	int i;
+
+	while ((opt = getopt(argc, argv, "b:f:n:s:h")) != -1) {
+		switch (opt) {
+			case 'b':
+				budget = atoi(optarg) * 1000000LL;
+				break;
+			case 'f':
+				face_size = atoi(optarg);
+				break;
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 's':
+				sscanf(optarg, "%dx%d", &width, &height);
+				break;
+			default:
+				bench_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (width <= 0 || height <= 0 || iterations <= 0) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	data = (unsigned char *) malloc(width * height * 3 / 2);
+	if (data == NULL)
+		return 1;
+
+	bench_frame(data, width, height, width / 2, height / 2, face_size);
+
+	rc = smdk4210_face_detector_init(&detector, width, height);
+	if (rc < 0) {
+		fprintf(stderr, "Unable to init face detector\n");
+		free(data);
+		return 1;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		smdk4210_face_decimate(&detector, data, V4L2_PIX_FMT_NV21);
+		decimate_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		count = smdk4210_face_detect(&detector, faces, SMDK4210_FACE_MAX_COUNT, budget);
+		t = systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		detect_duration += t;
+		if (t > detect_max)
+			detect_max = t;
+	}
+
+	printf("Frame: %dx%d, decimated by %d to %dx%d, %d windows\n", width, height,
+		detector.decimation, detector.width, detector.height, detector.windows_count);
+	printf("Decimate: %.3f ms per frame\n", (float) decimate_duration / iterations / 1000000.0f);
+	printf("Detect: %.3f ms per frame, max %.3f ms%s\n", (float) detect_duration / iterations / 1000000.0f,
+		(float) detect_max / 1000000.0f, detector.budget_exceeded ? " (over budget)" : "");
+
+	for (i = 0; i < count; i++)
+		printf("Face %d: %dx%d at %d,%d, score %d\n", i, faces[i].size, faces[i].size,
+			faces[i].x, faces[i].y, faces[i].score);
+
+	if (count == 0)
+		printf("No face found\n");
+
+	smdk4210_face_detector_deinit(&detector);
+	free(data);
+
+	return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Timers.h>
+
+#include <jpeg_api.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * JPEG encoder benchmark: encodes a synthetic frame with the software
+ * encoder and with the libs5pjpeg interface (the hardware encoder on the
+ * device, its stand-in on the host) and reports the time spent per frame.
+ */
+
+static void bench_frame(unsigned char *data, int width, int height, int format)
+{
+	unsigned char *chroma;
+	int luma, u, v;
+	int x, y;
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			// Gradients, with a sharp edged checkerboard in the middle
+			luma = (x * 255) / width;
+			if (x > width / 4 && x < (width * 3) / 4 && y > height / 4 && y < (height * 3) / 4)
+				luma = ((x / 16) + (y / 16)) & 1 ? 220 : 30;
+
+			u = (y * 255) / height;
+			v = 255 - u;
+
+			if (format == V4L2_PIX_FMT_YUYV) {
+				data[(y * width + x) * 2] = luma;
+				data[(y * width + x) * 2 + 1] = x & 1 ? v : u;
+			} else {
+				data[y * width + x] = luma;
+
+				if ((x & 1) == 0 && (y & 1) == 0) {
+					chroma = data + width * height + (y / 2) * width + x;
+					chroma[0] = v;
+					chroma[1] = u;
+				}
+			}
+		}
+	}
+}
+
+static int bench_hardware(void *data, int width, int height, int format, int quality,
+	int *size)
+{
+	struct jpeg_enc_param params;
+	void *in_buffer;
+	void *out_buffer;
+	int in_size;
+	int fd;
+	int rc = -1;
+
+	fd = api_jpeg_encode_init();
+	if (fd < 0)
+		return -1;
+
+	memset(&params, 0, sizeof(params));
+	params.width = width;
+	params.height = height;
+	params.in_fmt = format == V4L2_PIX_FMT_YUYV ? YUV_422 : YUV_420;
+	params.out_fmt = format == V4L2_PIX_FMT_YUYV ? JPEG_422 : JPEG_420;
+	params.quality = quality >= 90 ? QUALITY_LEVEL_1 : quality >= 80 ? QUALITY_LEVEL_2 :
+		quality >= 70 ? QUALITY_LEVEL_3 : QUALITY_LEVEL_4;
+
+	api_jpeg_set_encode_param(&params);
+
+	in_size = format == V4L2_PIX_FMT_YUYV ? width * height * 2 : (width * height * 3) / 2;
+
+	in_buffer = api_jpeg_get_encode_in_buf(fd, in_size);
+	out_buffer = api_jpeg_get_encode_out_buf(fd);
+	if (in_buffer == NULL || out_buffer == NULL)
+		goto complete;
+
+	memcpy(in_buffer, data, in_size);
+
+	if (api_jpeg_encode_exe(fd, &params) != JPEG_ENCODE_OK)
+		goto complete;
+
+	*size = params.size;
+	rc = 0;
+
+complete:
+	api_jpeg_encode_deinit(fd);
+
+	return rc;
+}
+
+static void bench_usage(char *name)
+{
+	printf("Usage: %s [-s WxH] [-f yuyv|nv21] [-q quality] [-n iterations] [-o output.jpg]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char *data;
+	unsigned char *buffer;
+	char *output = NULL;
+	FILE *file;
+	nsecs_t software_duration = 0;
+	nsecs_t hardware_duration = 0;
+	nsecs_t t;
+	int format = V4L2_PIX_FMT_YUYV;
+	int width = 640;
+	int height = 480;
+	int quality = 90;
+	int iterations = 10;
+	int software_size = 0;
+	int hardware_size = 0;
+	int hardware = 1;
+	int length;
+	int opt;
+	int rc;
+	int i;
+
+	while ((opt = getopt(argc, argv, "f:n:o:q:s:h")) != -1) {
+		switch (opt) {
+			case 'f':
+				if (strcmp(optarg, "nv21") == 0) {
+					format = V4L2_PIX_FMT_NV21;
+				} else if (strcmp(optarg, "yuyv") != 0) {
+					bench_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'q':
+				quality = atoi(optarg);
+				break;
+			case 's':
+				sscanf(optarg, "%dx%d", &width, &height);
+				break;
+			default:
+				bench_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (width <= 0 || height <= 0 || iterations <= 0) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	length = width * height * 2 + SMDK4210_JPEG_HEADERS_LENGTH;
+
+	data = (unsigned char *) malloc(width * height * 2);
+	buffer = (unsigned char *) malloc(length);
+	if (data == NULL || buffer == NULL)
+		return 1;
+
+	bench_frame(data, width, height, format);
+
+	for (i = 0; i < iterations; i++) {
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		software_size = smdk4210_jpeg_encode(data, width, height, format, quality, buffer, length);
+		software_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		if (software_size < 0) {
+			fprintf(stderr, "Software encode failed\n");
+			return 1;
+		}
+
+		if (!hardware)
+			continue;
+
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		rc = bench_hardware(data, width, height, format, quality, &hardware_size);
+		hardware_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		if (rc < 0) {
+			fprintf(stderr, "Hardware encode failed, only running software\n");
+			hardware = 0;
+		}
+	}
+
+	printf("Frame: %dx%d %s, quality %d\n", width, height,
+		format == V4L2_PIX_FMT_YUYV ? "YUYV" : "NV21", quality);
+	printf("Software: %.3f ms per frame, %d bytes\n",
+		(float) software_duration / iterations / 1000000.0f, software_size);
+
+	if (hardware)
+		printf("Hardware: %.3f ms per frame, %d bytes\n",
+			(float) hardware_duration / iterations / 1000000.0f, hardware_size);
+
+	if (output != NULL) {
+		file = fopen(output, "wb");
+		if (file != NULL) {
+			fwrite(buffer, 1, software_size, file);
+			fclose(file);
+		}
+	}
+
+	free(buffer);
+	free(data);
+
+	return 0;
+}
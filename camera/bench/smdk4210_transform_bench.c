@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Timers.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * Software transform benchmark: rotates, mirrors and zooms a synthetic
+ * frame and reports the time spent per frame. Four quarter turns and two
+ * mirrors are checked to give the original frame back.
+ */
+
+static void bench_frame(unsigned char *data, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		data[i] = (i * 7 + (i >> 9) * 13) & 0xff;
+}
+
+static int bench_check(unsigned char *data, unsigned char *buffer, int width, int height,
+	int format, int rotation, int hflip, int vflip, int count)
+{
+	unsigned char *reference;
+	unsigned char *src, *dst, *p;
+	int size;
+	int w, h;
+	int rc = 0;
+	int i;
+
+	size = smdk4210_transform_frame_size(width, height, format);
+
+	reference = (unsigned char *) malloc(size);
+	if (reference == NULL)
+		return -1;
+
+	memcpy(reference, data, size);
+
+	// Gaps between planes are left alone, they have to match too
+	memcpy(buffer, data, size);
+
+	src = data;
+	dst = buffer;
+	w = width;
+	h = height;
+
+	for (i = 0; i < count; i++) {
+		rc = smdk4210_transform_rotate(src, dst, w, h, format, rotation, hflip, vflip);
+		if (rc < 0)
+			break;
+
+		if (rotation == 90 || rotation == 270) {
+			w = w == width ? height : width;
+			h = h == height ? width : height;
+		}
+
+		p = src;
+		src = dst;
+		dst = p;
+	}
+
+	if (rc >= 0)
+		rc = memcmp(reference, src, size) == 0 ? 0 : -1;
+
+	memcpy(data, reference, size);
+	free(reference);
+
+	return rc;
+}
+
+static void bench_usage(char *name)
+{
+	printf("Usage: %s [-s WxH] [-f nv21|nv12|yuv420|rgb565] [-z zoom] [-n iterations]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct smdk4210_transform transform;
+	unsigned char *data;
+	unsigned char *buffer;
+	nsecs_t durations[5] = { 0 };
+	nsecs_t t;
+	char *format_string = "nv21";
+	int format = V4L2_PIX_FMT_NV21;
+	int width = 640;
+	int height = 480;
+	int zoom = 200;
+	int iterations = 20;
+	int size;
+	int opt;
+	int rc;
+	int i;
+
+	while ((opt = getopt(argc, argv, "f:n:s:z:h")) != -1) {
+		switch (opt) {
+			case 'f':
+				format_string = optarg;
+				if (strcmp(optarg, "nv12") == 0) {
+					format = V4L2_PIX_FMT_NV12;
+				} else if (strcmp(optarg, "yuv420") == 0) {
+					format = V4L2_PIX_FMT_YUV420;
+				} else if (strcmp(optarg, "rgb565") == 0) {
+					format = V4L2_PIX_FMT_RGB565;
+				} else if (strcmp(optarg, "nv21") != 0) {
+					bench_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 's':
+				sscanf(optarg, "%dx%d", &width, &height);
+				break;
+			case 'z':
+				zoom = atoi(optarg);
+				break;
+			default:
+				bench_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	size = smdk4210_transform_frame_size(width, height, format);
+	if (size <= 0 || iterations <= 0 || zoom < 100) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	data = (unsigned char *) malloc(size);
+	buffer = (unsigned char *) malloc(size);
+	if (data == NULL || buffer == NULL)
+		return 1;
+
+	bench_frame(data, size);
+
+	rc = bench_check(data, buffer, width, height, format, 90, 0, 0, 4);
+	printf("Rotation: %s\n", rc < 0 ? "failed" : "ok");
+	rc = bench_check(data, buffer, width, height, format, 0, 1, 1, 2);
+	printf("Mirror: %s\n", rc < 0 ? "failed" : "ok");
+
+	smdk4210_transform_init(&transform);
+
+	for (i = 0; i < iterations; i++) {
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		smdk4210_transform_rotate(data, buffer, width, height, format, 90, 0, 0);
+		durations[0] += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		smdk4210_transform_rotate(data, buffer, width, height, format, 180, 0, 0);
+		durations[1] += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		smdk4210_transform_rotate(data, buffer, width, height, format, 0, 1, 0);
+		durations[2] += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		smdk4210_transform_scale(&transform, data, width, height, buffer, width, height,
+			format, zoom);
+		durations[3] += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		// Rotated in place, as the HAL does
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+		smdk4210_transform_frame(&transform, data, width, height, format, 90, 1, 0, 100);
+		durations[4] += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+	}
+
+	printf("Frame: %dx%d %s\n", width, height, format_string);
+	printf("Rotate 90: %.3f ms per frame\n", (float) durations[0] / iterations / 1000000.0f);
+	printf("Rotate 180: %.3f ms per frame\n", (float) durations[1] / iterations / 1000000.0f);
+	printf("Mirror: %.3f ms per frame\n", (float) durations[2] / iterations / 1000000.0f);
+	printf("Zoom %d%%: %.3f ms per frame\n", zoom, (float) durations[3] / iterations / 1000000.0f);
+	printf("Rotate 90 in place: %.3f ms per frame\n", (float) durations[4] / iterations / 1000000.0f);
+
+	smdk4210_transform_deinit(&transform);
+	free(buffer);
+	free(data);
+
+	return 0;
+}
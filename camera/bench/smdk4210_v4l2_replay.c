@@ -0,0 +1,534 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <utils/Timers.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * V4L2 trace replay: issues the requests of a trace recorded by the HAL
+ * again, on the simulated backend or the kernel driver, and compares the
+ * per-request timings. Requests from different threads are replayed in
+ * the order they completed.
+ */
+
+#define REPLAY_MAX_REQUESTS		32
+#define REPLAY_MAX_EXT_CONTROLS	8
+
+struct smdk4210_v4l2_replay_stats {
+	unsigned int request;
+	int mismatches;
+
+	int a_count;
+	nsecs_t a_sum;
+	nsecs_t a_max;
+	int b_count;
+	nsecs_t b_sum;
+	nsecs_t b_max;
+};
+
+struct smdk4210_v4l2_node smdk4210_v4l2_replay_nodes[] = {
+	{
+		.id = 0,
+		.node = "/dev/video0",
+	},
+	{
+		.id = 1,
+		.node = "/dev/video1",
+	},
+	{
+		.id = 2,
+		.node = "/dev/video2",
+	},
+};
+
+struct exynox_camera_config smdk4210_v4l2_replay_config = {
+	.v4l2_nodes = (struct smdk4210_v4l2_node *) &smdk4210_v4l2_replay_nodes,
+	.v4l2_nodes_count = 3,
+	.v4l2_ops = &smdk4210_v4l2_sim_ops,
+};
+
+static struct smdk4210_v4l2_replay_stats replay_stats[REPLAY_MAX_REQUESTS];
+static int replay_stats_count;
+
+/*
+ * Utils
+ */
+
+static char *replay_request_name(unsigned int request)
+{
+	switch (request) {
+		case SMDK4210_V4L2_TRACE_POLL:
+			return "POLL";
+		case VIDIOC_QUERYCAP:
+			return "VIDIOC_QUERYCAP";
+		case VIDIOC_ENUM_FMT:
+			return "VIDIOC_ENUM_FMT";
+		case VIDIOC_G_FMT:
+			return "VIDIOC_G_FMT";
+		case VIDIOC_S_FMT:
+			return "VIDIOC_S_FMT";
+		case VIDIOC_REQBUFS:
+			return "VIDIOC_REQBUFS";
+		case VIDIOC_QUERYBUF:
+			return "VIDIOC_QUERYBUF";
+		case VIDIOC_G_FBUF:
+			return "VIDIOC_G_FBUF";
+		case VIDIOC_S_FBUF:
+			return "VIDIOC_S_FBUF";
+		case VIDIOC_QBUF:
+			return "VIDIOC_QBUF";
+		case VIDIOC_DQBUF:
+			return "VIDIOC_DQBUF";
+		case VIDIOC_STREAMON:
+			return "VIDIOC_STREAMON";
+		case VIDIOC_STREAMOFF:
+			return "VIDIOC_STREAMOFF";
+		case VIDIOC_S_PARM:
+			return "VIDIOC_S_PARM";
+		case VIDIOC_ENUMINPUT:
+			return "VIDIOC_ENUMINPUT";
+		case VIDIOC_G_CTRL:
+			return "VIDIOC_G_CTRL";
+		case VIDIOC_S_CTRL:
+			return "VIDIOC_S_CTRL";
+		case VIDIOC_S_INPUT:
+			return "VIDIOC_S_INPUT";
+		case VIDIOC_S_CROP:
+			return "VIDIOC_S_CROP";
+		case VIDIOC_G_EXT_CTRLS:
+			return "VIDIOC_G_EXT_CTRLS";
+		default:
+			return "UNKNOWN";
+	}
+}
+
+static struct smdk4210_v4l2_replay_stats *replay_stats_find(unsigned int request)
+{
+	int i;
+
+	for (i = 0; i < replay_stats_count; i++)
+		if (replay_stats[i].request == request)
+			return &replay_stats[i];
+
+	if (replay_stats_count >= REPLAY_MAX_REQUESTS)
+		return NULL;
+
+	i = replay_stats_count++;
+	memset(&replay_stats[i], 0, sizeof(struct smdk4210_v4l2_replay_stats));
+	replay_stats[i].request = request;
+
+	return &replay_stats[i];
+}
+
+static void replay_stats_add(unsigned int request, int b, nsecs_t duration)
+{
+	struct smdk4210_v4l2_replay_stats *stats;
+
+	stats = replay_stats_find(request);
+	if (stats == NULL)
+		return;
+
+	if (!b) {
+		stats->a_count++;
+		stats->a_sum += duration;
+		if (duration > stats->a_max)
+			stats->a_max = duration;
+	} else {
+		stats->b_count++;
+		stats->b_sum += duration;
+		if (duration > stats->b_max)
+			stats->b_max = duration;
+	}
+}
+
+static void replay_stats_print(char *a_name, char *b_name)
+{
+	struct smdk4210_v4l2_replay_stats *stats;
+	nsecs_t a_avg, b_avg;
+	int i;
+
+	printf("%-20s %6s %6s %12s %12s %12s %12s %8s %10s\n", "request", "count", "count",
+		a_name, "max", b_name, "max", "delta", "mismatches");
+
+	for (i = 0; i < replay_stats_count; i++) {
+		stats = &replay_stats[i];
+
+		a_avg = stats->a_count > 0 ? stats->a_sum / stats->a_count : 0;
+		b_avg = stats->b_count > 0 ? stats->b_sum / stats->b_count : 0;
+
+		printf("%-20s %6d %6d %9lld us %9lld us %9lld us %9lld us %7.1f%% %10d\n",
+			replay_request_name(stats->request), stats->a_count, stats->b_count,
+			a_avg / 1000LL, stats->a_max / 1000LL, b_avg / 1000LL, stats->b_max / 1000LL,
+			a_avg > 0 ? (float) (b_avg - a_avg) * 100.0f / a_avg : 0.0f,
+			stats->mismatches);
+	}
+}
+
+/*
+ * Trace
+ */
+
+static int replay_trace_load(char *path, struct smdk4210_v4l2_trace_header *header,
+	struct smdk4210_v4l2_trace_entry **entries_p)
+{
+	struct smdk4210_v4l2_trace_entry *entries = NULL;
+	FILE *file;
+	size_t count;
+
+	if (path == NULL || header == NULL || entries_p == NULL)
+		return -EINVAL;
+
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Unable to open %s\n", path);
+		return -1;
+	}
+
+	count = fread(header, sizeof(struct smdk4210_v4l2_trace_header), 1, file);
+	if (count != 1 || header->magic != SMDK4210_V4L2_TRACE_MAGIC ||
+		header->version != SMDK4210_V4L2_TRACE_VERSION ||
+		header->entry_size != sizeof(struct smdk4210_v4l2_trace_entry)) {
+		fprintf(stderr, "%s is not a V4L2 trace\n", path);
+		goto error;
+	}
+
+	entries = calloc(header->entries_count + 1, sizeof(struct smdk4210_v4l2_trace_entry));
+	if (entries == NULL)
+		goto error;
+
+	count = fread(entries, sizeof(struct smdk4210_v4l2_trace_entry), header->entries_count, file);
+	if (count != header->entries_count) {
+		fprintf(stderr, "%s is truncated\n", path);
+		goto error;
+	}
+
+	fclose(file);
+
+	*entries_p = entries;
+
+	return 0;
+
+error:
+	if (entries != NULL)
+		free(entries);
+
+	fclose(file);
+
+	return -1;
+}
+
+/*
+ * Replay
+ */
+
+static int replay_request(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_v4l2_trace_entry *entry)
+{
+	struct v4l2_ext_control ext_control[REPLAY_MAX_EXT_CONTROLS];
+	char ext_control_string[REPLAY_MAX_EXT_CONTROLS][32];
+	union {
+		struct v4l2_buffer buffer;
+		struct v4l2_requestbuffers requestbuffers;
+		struct v4l2_capability capability;
+		struct v4l2_input input;
+		struct v4l2_fmtdesc fmtdesc;
+		struct v4l2_format format;
+		struct v4l2_control control;
+		struct v4l2_ext_controls ext_controls;
+		struct v4l2_streamparm streamparm;
+		struct v4l2_crop crop;
+		struct v4l2_framebuffer framebuffer;
+		enum v4l2_buf_type type;
+	} data;
+	int32_t *args = entry->args;
+	int i;
+
+	memset(&data, 0, sizeof(data));
+
+	switch (entry->request) {
+		case SMDK4210_V4L2_TRACE_POLL:
+			return smdk4210_v4l2_poll(smdk4210_camera, entry->node);
+		case VIDIOC_QBUF:
+		case VIDIOC_DQBUF:
+		case VIDIOC_QUERYBUF:
+			data.buffer.type = args[0];
+			data.buffer.memory = args[1];
+			data.buffer.index = entry->request == VIDIOC_DQBUF ? 0 : args[2];
+			break;
+		case VIDIOC_REQBUFS:
+			data.requestbuffers.type = args[0];
+			data.requestbuffers.memory = args[1];
+			data.requestbuffers.count = args[2];
+			break;
+		case VIDIOC_QUERYCAP:
+			break;
+		case VIDIOC_ENUMINPUT:
+		case VIDIOC_S_INPUT:
+			data.input.index = args[0];
+			break;
+		case VIDIOC_ENUM_FMT:
+			data.fmtdesc.type = args[0];
+			data.fmtdesc.index = args[1];
+			break;
+		case VIDIOC_S_FMT:
+		case VIDIOC_G_FMT:
+			data.format.type = args[0];
+			if (args[0] == V4L2_BUF_TYPE_VIDEO_OVERLAY) {
+				data.format.fmt.win.w.left = args[1];
+				data.format.fmt.win.w.top = args[2];
+				data.format.fmt.win.w.width = args[3];
+				data.format.fmt.win.w.height = args[4];
+			} else {
+				data.format.fmt.pix.width = args[1];
+				data.format.fmt.pix.height = args[2];
+				data.format.fmt.pix.pixelformat = args[3];
+				data.format.fmt.pix.priv = args[4];
+				data.format.fmt.pix.field = V4L2_FIELD_NONE;
+			}
+			break;
+		case VIDIOC_STREAMON:
+		case VIDIOC_STREAMOFF:
+			data.type = args[0];
+			break;
+		case VIDIOC_S_CTRL:
+		case VIDIOC_G_CTRL:
+			data.control.id = args[0];
+			data.control.value = args[1];
+			break;
+		case VIDIOC_G_EXT_CTRLS:
+			if (args[1] > REPLAY_MAX_EXT_CONTROLS)
+				return -1;
+
+			memset(&ext_control, 0, sizeof(ext_control));
+			for (i = 0; i < args[1]; i++) {
+				// String controls need somewhere to write to
+				ext_control[i].id = args[2];
+				ext_control[i].string = ext_control_string[i];
+			}
+
+			data.ext_controls.ctrl_class = args[0];
+			data.ext_controls.count = args[1];
+			data.ext_controls.controls = ext_control;
+			break;
+		case VIDIOC_S_PARM:
+			data.streamparm.type = args[0];
+			data.streamparm.parm.capture.timeperframe.numerator = args[1];
+			data.streamparm.parm.capture.timeperframe.denominator = args[2];
+			break;
+		case VIDIOC_S_CROP:
+			data.crop.type = args[0];
+			data.crop.c.left = args[1];
+			data.crop.c.top = args[2];
+			data.crop.c.width = args[3];
+			data.crop.c.height = args[4];
+			break;
+		case VIDIOC_G_FBUF:
+		case VIDIOC_S_FBUF:
+			data.framebuffer.fmt.width = args[0];
+			data.framebuffer.fmt.height = args[1];
+			data.framebuffer.fmt.pixelformat = args[2];
+			break;
+		default:
+			return -1;
+	}
+
+	return smdk4210_v4l2_ioctl(smdk4210_camera, entry->node, entry->request, &data);
+}
+
+static int replay(struct smdk4210_v4l2_trace_entry *entries, int count, int paced,
+	char *output)
+{
+	struct smdk4210_camera *smdk4210_camera;
+	struct smdk4210_v4l2_replay_stats *stats;
+	int opened[SMDK4210_CAMERA_MAX_V4L2_NODES_COUNT];
+	nsecs_t start, target, timestamp, duration;
+	int index;
+	int rc;
+	int i;
+
+	smdk4210_camera = calloc(1, sizeof(struct smdk4210_camera));
+	if (smdk4210_camera == NULL)
+		return -1;
+
+	smdk4210_camera->config = &smdk4210_v4l2_replay_config;
+	memset(&opened, 0, sizeof(opened));
+
+	if (output != NULL) {
+		rc = smdk4210_v4l2_trace_init(smdk4210_camera, output);
+		if (rc < 0)
+			fprintf(stderr, "Unable to record the replay to %s\n", output);
+	}
+
+	start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	for (i = 0; i < count; i++) {
+		index = smdk4210_v4l2_find_index(smdk4210_camera, entries[i].node);
+		if (index < 0)
+			continue;
+
+		if (!opened[index]) {
+			rc = smdk4210_v4l2_open(smdk4210_camera, entries[i].node);
+			if (rc < 0) {
+				fprintf(stderr, "Unable to open V4L2 node #%d\n", entries[i].node);
+				goto error;
+			}
+
+			opened[index] = 1;
+		}
+
+		// Keep the recorded spacing, requests are not moved earlier than they were issued
+		if (paced) {
+			target = start + entries[i].timestamp - entries[0].timestamp;
+			timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+			if (target > timestamp)
+				usleep((target - timestamp) / 1000LL);
+		}
+
+		timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+		rc = replay_request(smdk4210_camera, &entries[i]);
+		duration = systemTime(SYSTEM_TIME_MONOTONIC) - timestamp;
+
+		replay_stats_add(entries[i].request, 0, entries[i].duration);
+		replay_stats_add(entries[i].request, 1, duration);
+
+		if ((rc < 0) != (entries[i].rc < 0)) {
+			stats = replay_stats_find(entries[i].request);
+			if (stats != NULL)
+				stats->mismatches++;
+		}
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	for (i = 0; i < SMDK4210_CAMERA_MAX_V4L2_NODES_COUNT; i++)
+		if (opened[i])
+			smdk4210_v4l2_close(smdk4210_camera, smdk4210_camera->config->v4l2_nodes[i].id);
+
+	smdk4210_v4l2_trace_deinit(smdk4210_camera);
+	free(smdk4210_camera);
+
+	return rc;
+}
+
+static void replay_usage(char *name)
+{
+	printf("Usage: %s [-k] [-n] [-o output] [-f fps] [-j jitter_us] trace\n"
+		"       %s -c trace reference\n"
+		"  -k  replay on the kernel driver instead of the simulated backend\n"
+		"  -n  replay as fast as possible instead of with the recorded spacing\n"
+		"  -o  record the replay as a new trace\n"
+		"  -c  compare the recorded timings of two traces\n", name, name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct smdk4210_v4l2_trace_header header;
+	struct smdk4210_v4l2_trace_header reference_header;
+	struct smdk4210_v4l2_trace_entry *entries = NULL;
+	struct smdk4210_v4l2_trace_entry *reference_entries = NULL;
+	char *output = NULL;
+	int compare = 0;
+	int paced = 1;
+	int opt;
+	int rc;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "ckno:f:j:h")) != -1) {
+		switch (opt) {
+			case 'c':
+				compare = 1;
+				break;
+			case 'k':
+				smdk4210_v4l2_replay_config.v4l2_ops = NULL;
+				break;
+			case 'n':
+				paced = 0;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'f':
+				smdk4210_v4l2_sim_config.fps = atoi(optarg);
+				break;
+			case 'j':
+				smdk4210_v4l2_sim_config.jitter = atoi(optarg);
+				break;
+			default:
+				replay_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind + (compare ? 2 : 1) != argc) {
+		replay_usage(argv[0]);
+		return 1;
+	}
+
+	rc = replay_trace_load(argv[optind], &header, &entries);
+	if (rc < 0)
+		return 1;
+
+	printf("%s: %u requests, %u dropped from the ring\n", argv[optind],
+		header.entries_count, header.dropped_count);
+
+	if (compare) {
+		rc = replay_trace_load(argv[optind + 1], &reference_header, &reference_entries);
+		if (rc < 0)
+			goto complete;
+
+		printf("%s: %u requests, %u dropped from the ring\n", argv[optind + 1],
+			reference_header.entries_count, reference_header.dropped_count);
+
+		for (i = 0; i < header.entries_count; i++)
+			replay_stats_add(entries[i].request, 0, entries[i].duration);
+		for (i = 0; i < reference_header.entries_count; i++)
+			replay_stats_add(reference_entries[i].request, 1, reference_entries[i].duration);
+
+		replay_stats_print("trace", "reference");
+		rc = 0;
+	} else {
+		if (header.dropped_count > 0)
+			printf("The trace does not start with the session, some requests may fail\n");
+
+		rc = replay(entries, header.entries_count, paced, output);
+		if (rc < 0)
+			goto complete;
+
+		replay_stats_print("recorded", "replayed");
+	}
+
+complete:
+	if (entries != NULL)
+		free(entries);
+
+	if (reference_entries != NULL)
+		free(reference_entries);
+
+	return rc < 0 ? 1 : 0;
+}
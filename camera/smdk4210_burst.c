@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#define LOG_TAG "smdk4210_burst"
+#include <utils/Log.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * Low-light burst merge, on packed YUV 4:2:2 frames as the sensor gives them: the first frame is the reference
+ * and every following frame is shifted onto it, with the shift found by
+ * block matching on a downscaled luma plane and refined at full resolution.
+ * Shifted frames are accumulated pixel by pixel, except where they differ
+ * too much from the reference (motion), where the reference is used again.
+ */
+
+int smdk4210_burst_format_supported(int format)
+{
+	switch (format) {
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_UYVY:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+int smdk4210_burst_init(struct smdk4210_burst *burst, int width, int height, int format)
+{
+	int size;
+
+	if (burst == NULL || width <= 0 || height <= 0 || !smdk4210_burst_format_supported(format))
+		return -EINVAL;
+
+	memset(burst, 0, sizeof(struct smdk4210_burst));
+
+	burst->width = width;
+	burst->height = height;
+	burst->format = format;
+
+	// Only the luma is needed for alignment, the merge works on bytes
+	burst->luma_offset = format == V4L2_PIX_FMT_UYVY ? 1 : 0;
+	burst->luma_width = width / SMDK4210_BURST_DECIMATION;
+	burst->luma_height = height / SMDK4210_BURST_DECIMATION;
+
+	size = width * height * 2;
+	burst->reference = (unsigned char *) malloc(size);
+	burst->accumulator = (unsigned short *) malloc(size * sizeof(unsigned short));
+
+	size = burst->luma_width * burst->luma_height;
+	burst->reference_luma = (unsigned char *) malloc(size);
+	burst->luma = (unsigned char *) malloc(size);
+
+	if (burst->reference == NULL || burst->accumulator == NULL ||
+		burst->reference_luma == NULL || burst->luma == NULL) {
+		ALOGE("%s: Unable to allocate burst buffers", __func__);
+		smdk4210_burst_deinit(burst);
+		return -1;
+	}
+
+	return 0;
+}
+
+void smdk4210_burst_deinit(struct smdk4210_burst *burst)
+{
+	if (burst == NULL)
+		return;
+
+	if (burst->reference != NULL)
+		free(burst->reference);
+	if (burst->accumulator != NULL)
+		free(burst->accumulator);
+	if (burst->reference_luma != NULL)
+		free(burst->reference_luma);
+	if (burst->luma != NULL)
+		free(burst->luma);
+
+	memset(burst, 0, sizeof(struct smdk4210_burst));
+}
+
+void smdk4210_burst_downscale(struct smdk4210_burst *burst, unsigned char *frame,
+	unsigned char *luma)
+{
+	unsigned char *rows[SMDK4210_BURST_DECIMATION];
+	unsigned int sum;
+	int stride;
+	int x, y, i, j;
+#ifdef __ARM_NEON__
+	uint16x8_t s;
+	uint8x16x2_t v;
+	uint16x4_t n;
+#endif
+
+	if (burst == NULL || frame == NULL || luma == NULL)
+		return;
+
+	stride = burst->width * 2;
+
+	for (y = 0; y < burst->luma_height; y++) {
+		for (j = 0; j < SMDK4210_BURST_DECIMATION; j++)
+			rows[j] = frame + (y * SMDK4210_BURST_DECIMATION + j) * stride + burst->luma_offset;
+
+		x = 0;
+
+#ifdef __ARM_NEON__
+		// 16 luma samples, deinterleaved from 32 bytes, to 4 output pixels
+		for (; x + 4 <= burst->luma_width && (x + 4) * 8 + burst->luma_offset <= stride; x += 4) {
+			v = vld2q_u8(rows[0] + x * 8);
+			s = vpaddlq_u8(v.val[0]);
+			v = vld2q_u8(rows[1] + x * 8);
+			s = vpadalq_u8(s, v.val[0]);
+			v = vld2q_u8(rows[2] + x * 8);
+			s = vpadalq_u8(s, v.val[0]);
+			v = vld2q_u8(rows[3] + x * 8);
+			s = vpadalq_u8(s, v.val[0]);
+
+			n = vshrn_n_u32(vpaddlq_u16(s), 4);
+
+			luma[y * burst->luma_width + x] = vget_lane_u16(n, 0);
+			luma[y * burst->luma_width + x + 1] = vget_lane_u16(n, 1);
+			luma[y * burst->luma_width + x + 2] = vget_lane_u16(n, 2);
+			luma[y * burst->luma_width + x + 3] = vget_lane_u16(n, 3);
+		}
+#endif
+
+		for (; x < burst->luma_width; x++) {
+			sum = 0;
+
+			for (j = 0; j < SMDK4210_BURST_DECIMATION; j++)
+				for (i = 0; i < SMDK4210_BURST_DECIMATION; i++)
+					sum += rows[j][(x * SMDK4210_BURST_DECIMATION + i) * 2];
+
+			luma[y * burst->luma_width + x] = sum / (SMDK4210_BURST_DECIMATION * SMDK4210_BURST_DECIMATION);
+		}
+	}
+}
+
+static unsigned int smdk4210_burst_sad(unsigned char *a, unsigned char *b,
+	int stride, int width, int height)
+{
+	unsigned int sad = 0;
+	int x, y;
+#ifdef __ARM_NEON__
+	uint16x8_t s;
+	uint32x4_t t;
+#endif
+
+	for (y = 0; y < height; y++) {
+		x = 0;
+
+#ifdef __ARM_NEON__
+		s = vdupq_n_u16(0);
+		for (; x + 16 <= width; x += 16) {
+			s = vabal_u8(s, vld1_u8(a + x), vld1_u8(b + x));
+			s = vabal_u8(s, vld1_u8(a + x + 8), vld1_u8(b + x + 8));
+		}
+
+		t = vpaddlq_u16(s);
+		sad += vgetq_lane_u32(t, 0) + vgetq_lane_u32(t, 1) + vgetq_lane_u32(t, 2) + vgetq_lane_u32(t, 3);
+#endif
+
+		for (; x < width; x++)
+			sad += a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+
+		a += stride;
+		b += stride;
+	}
+
+	return sad;
+}
+
+static int smdk4210_burst_median(int *values, int count)
+{
+	int value;
+	int i, j;
+
+	for (i = 1; i < count; i++) {
+		value = values[i];
+		for (j = i; j > 0 && values[j - 1] > value; j--)
+			values[j] = values[j - 1];
+		values[j] = value;
+	}
+
+	return values[count / 2];
+}
+
+int smdk4210_burst_reference(struct smdk4210_burst *burst, unsigned char *frame)
+{
+	int size;
+	int i;
+
+	if (burst == NULL || burst->reference == NULL || frame == NULL)
+		return -EINVAL;
+
+	size = burst->width * burst->height * 2;
+
+	memcpy(burst->reference, frame, size);
+	smdk4210_burst_downscale(burst, burst->reference, burst->reference_luma);
+
+	for (i = 0; i < size; i++)
+		burst->accumulator[i] = burst->reference[i];
+
+	burst->frames_count = 1;
+
+	return 0;
+}
+
+int smdk4210_burst_align(struct smdk4210_burst *burst, unsigned char *frame,
+	int *shift_x, int *shift_y)
+{
+	int blocks_x[SMDK4210_BURST_BLOCKS_COUNT];
+	int blocks_y[SMDK4210_BURST_BLOCKS_COUNT];
+	int blocks_count = 0;
+	unsigned char *reference_block;
+	unsigned char *block;
+	unsigned int sad, best_sad;
+	unsigned int texture;
+	int block_size, radius;
+	int bx, by, best_x, best_y;
+	int dx, dy;
+	int median_x, median_y;
+	int agree;
+	int cx, cy;
+	int stride;
+	int i, j, k;
+
+	if (burst == NULL || frame == NULL || shift_x == NULL || shift_y == NULL)
+		return -EINVAL;
+
+	block_size = SMDK4210_BURST_BLOCK_SIZE;
+	radius = SMDK4210_BURST_SEARCH_RADIUS;
+
+	// Too small to hold the blocks grid: no alignment
+	if (burst->luma_width < 2 * (block_size + 2 * radius) ||
+		burst->luma_height < 2 * (block_size + 2 * radius)) {
+		*shift_x = 0;
+		*shift_y = 0;
+		return 0;
+	}
+
+	smdk4210_burst_downscale(burst, frame, burst->luma);
+
+	// Blocks on a grid, away from the edges by the search radius
+	for (j = 0; j < SMDK4210_BURST_BLOCKS_ROWS; j++) {
+		for (i = 0; i < SMDK4210_BURST_BLOCKS_COLUMNS; i++) {
+			bx = radius + (i * (burst->luma_width - block_size - 2 * radius)) / (SMDK4210_BURST_BLOCKS_COLUMNS - 1);
+			by = radius + (j * (burst->luma_height - block_size - 2 * radius)) / (SMDK4210_BURST_BLOCKS_ROWS - 1);
+			if (bx < radius || by < radius)
+				continue;
+
+			reference_block = burst->reference_luma + by * burst->luma_width + bx;
+
+			// Flat blocks match anywhere
+			texture = 0;
+			for (k = 0; k < block_size - 1; k++)
+				texture += abs(reference_block[k * burst->luma_width + k] - reference_block[k * burst->luma_width + k + 1]) +
+					abs(reference_block[k * burst->luma_width + k] - reference_block[(k + 1) * burst->luma_width + k]);
+			if (texture < (unsigned int) (block_size * SMDK4210_BURST_TEXTURE_MIN))
+				continue;
+
+			best_sad = 0xffffffff;
+			best_x = best_y = 0;
+
+			for (dy = -radius; dy <= radius; dy++) {
+				for (dx = -radius; dx <= radius; dx++) {
+					block = burst->luma + (by + dy) * burst->luma_width + bx + dx;
+
+					sad = smdk4210_burst_sad(reference_block, block, burst->luma_width,
+						block_size, block_size);
+					if (sad < best_sad || (sad == best_sad && abs(dx) + abs(dy) < abs(best_x) + abs(best_y))) {
+						best_sad = sad;
+						best_x = dx;
+						best_y = dy;
+					}
+				}
+			}
+
+			blocks_x[blocks_count] = best_x;
+			blocks_y[blocks_count] = best_y;
+			blocks_count++;
+		}
+	}
+
+	// Nothing to align on: the frame is taken as it is
+	if (blocks_count < 3) {
+		*shift_x = 0;
+		*shift_y = 0;
+		return 0;
+	}
+
+	// Camera shake moves all the blocks the same way, subject motion does not
+	agree = 0;
+	median_x = smdk4210_burst_median(blocks_x, blocks_count);
+	median_y = smdk4210_burst_median(blocks_y, blocks_count);
+	for (i = 0; i < blocks_count; i++) {
+		if (abs(blocks_x[i] - median_x) <= 1 && abs(blocks_y[i] - median_y) <= 1)
+			agree++;
+	}
+
+	if (agree * 2 < blocks_count)
+		return -1;
+
+	// Refine at full resolution, around the center of the frame
+	median_x *= SMDK4210_BURST_DECIMATION;
+	median_y *= SMDK4210_BURST_DECIMATION;
+
+	stride = burst->width * 2;
+	cx = burst->width / 2 - SMDK4210_BURST_REFINE_SIZE / 2;
+	cy = burst->height / 2 - SMDK4210_BURST_REFINE_SIZE / 2;
+
+	best_sad = 0xffffffff;
+	best_x = median_x;
+	best_y = median_y;
+
+	for (dy = median_y - SMDK4210_BURST_DECIMATION; dy <= median_y + SMDK4210_BURST_DECIMATION; dy++) {
+		// Chroma comes in pairs, so horizontal shifts have to be even
+		for (dx = median_x - SMDK4210_BURST_DECIMATION; dx <= median_x + SMDK4210_BURST_DECIMATION; dx += 2) {
+			if (cx + dx < 0 || cy + dy < 0 || cx + dx + SMDK4210_BURST_REFINE_SIZE > burst->width ||
+				cy + dy + SMDK4210_BURST_REFINE_SIZE > burst->height)
+				continue;
+
+			sad = smdk4210_burst_sad(burst->reference + cy * stride + cx * 2,
+				frame + (cy + dy) * stride + (cx + dx) * 2, stride,
+				SMDK4210_BURST_REFINE_SIZE * 2, SMDK4210_BURST_REFINE_SIZE);
+
+			if (sad < best_sad) {
+				best_sad = sad;
+				best_x = dx;
+				best_y = dy;
+			}
+		}
+	}
+
+	*shift_x = best_x & ~1;
+	*shift_y = best_y;
+
+	return 0;
+}
+
+void smdk4210_burst_merge(struct smdk4210_burst *burst, unsigned char *frame,
+	int shift_x, int shift_y, int row_start, int row_end)
+{
+	unsigned char *reference;
+	unsigned char *current;
+	unsigned short *accumulator;
+	unsigned char r, c;
+	int stride;
+	int x0, x1;
+	int x, y;
+#ifdef __ARM_NEON__
+	uint8x16_t vr, vc, vm, vt;
+	uint16x8_t a0, a1;
+#endif
+
+	if (burst == NULL || frame == NULL)
+		return;
+
+	stride = burst->width * 2;
+
+	// Bytes of the reference rows that have a match in the shifted frame
+	x0 = shift_x < 0 ? -shift_x * 2 : 0;
+	x1 = shift_x > 0 ? (burst->width - shift_x) * 2 : stride;
+
+#ifdef __ARM_NEON__
+	vt = vdupq_n_u8(SMDK4210_BURST_THRESHOLD);
+#endif
+
+	for (y = row_start; y < row_end; y++) {
+		reference = burst->reference + y * stride;
+		accumulator = burst->accumulator + y * stride;
+
+		if (y + shift_y < 0 || y + shift_y >= burst->height) {
+			for (x = 0; x < stride; x++)
+				accumulator[x] += reference[x];
+			continue;
+		}
+
+		current = frame + (y + shift_y) * stride + shift_x * 2;
+
+		for (x = 0; x < x0; x++)
+			accumulator[x] += reference[x];
+
+		x = x0;
+
+#ifdef __ARM_NEON__
+		for (; x + 16 <= x1; x += 16) {
+			vr = vld1q_u8(reference + x);
+			vc = vld1q_u8(current + x);
+
+			// Keep the reference where the frame differs too much
+			vm = vcleq_u8(vabdq_u8(vr, vc), vt);
+			vc = vbslq_u8(vm, vc, vr);
+
+			a0 = vld1q_u16(accumulator + x);
+			a1 = vld1q_u16(accumulator + x + 8);
+			a0 = vaddw_u8(a0, vget_low_u8(vc));
+			a1 = vaddw_u8(a1, vget_high_u8(vc));
+			vst1q_u16(accumulator + x, a0);
+			vst1q_u16(accumulator + x + 8, a1);
+		}
+#endif
+
+		for (; x < x1; x++) {
+			r = reference[x];
+			c = current[x];
+
+			// Keep the reference where the frame differs too much
+			if ((r > c ? r - c : c - r) <= SMDK4210_BURST_THRESHOLD)
+				accumulator[x] += c;
+			else
+				accumulator[x] += r;
+		}
+
+		for (; x < stride; x++)
+			accumulator[x] += reference[x];
+	}
+}
+
+void smdk4210_burst_resolve(struct smdk4210_burst *burst, unsigned char *output,
+	int row_start, int row_end)
+{
+	unsigned short *accumulator;
+	unsigned int reciprocal;
+	int stride;
+	int x, y;
+
+	if (burst == NULL || output == NULL || burst->frames_count <= 0)
+		return;
+
+	stride = burst->width * 2;
+
+	// Division by the frames count, as a fixed point multiplication
+	reciprocal = (65536 + burst->frames_count / 2) / burst->frames_count;
+
+	for (y = row_start; y < row_end; y++) {
+		accumulator = burst->accumulator + y * stride;
+
+		for (x = 0; x < stride; x++)
+			output[y * stride + x] = (accumulator[x] * reciprocal + 32768) >> 16;
+	}
+}
@@ -22,6 +22,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <sched.h>
 #include <time.h>
 #include <errno.h>
 #include <malloc.h>
@@ -30,6 +32,7 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 
 #include <asm/types.h>
 #include <jpeg_api.h>
@@ -37,6 +40,7 @@
 #define LOG_TAG "smdk4210_camera"
 #include <utils/Log.h>
 #include <utils/Timers.h>
+#include <cutils/properties.h>
 
 #include "smdk4210_camera.h"
 
@@ -52,11 +56,14 @@ struct smdk4210_camera_preset smdk4210_camera_presets_galaxys2[] = {
 		.rotation = 0,
 		.hflip = 0,
 		.vflip = 0,
+		.software_zoom = 0,
 		.picture_format = V4L2_PIX_FMT_JPEG,
 		.focal_length = 4.03f,
 		.horizontal_view_angle = 60.5f,
 		.vertical_view_angle = 47.1f,
 		.metering = METERING_CENTER,
+		.hfr_width = 640,
+		.hfr_height = 480,
 		.params = {
 			.preview_size_values = "800x480,720x480,640x480,320x240,176x144",
 			.preview_size = "640x480",
@@ -80,6 +87,8 @@ struct smdk4210_camera_preset smdk4210_camera_presets_galaxys2[] = {
 			.recording_size = "720x480",
 			.recording_size_values = "1920x1080,1280x720,720x480,640x480",
 			.recording_format = "yuv420sp",
+			.video_hfr = "off",
+			.video_hfr_values = "off,60",
 
 			.focus_mode = "auto",
 			.focus_mode_values = "auto,infinity,macro,fixed,facedetect,continuous-video",
@@ -121,11 +130,14 @@ struct smdk4210_camera_preset smdk4210_camera_presets_galaxys2[] = {
 		.rotation = 0,
 		.hflip = 0,
 		.vflip = 0,
+		.software_zoom = 1,
 		.picture_format = V4L2_PIX_FMT_YUYV,
 		.focal_length = 2.73f,
 		.horizontal_view_angle = 51.2f,
 		.vertical_view_angle = 39.4f,
 		.metering = METERING_CENTER,
+		.hfr_width = 0,
+		.hfr_height = 0,
 		.params = {
 			.preview_size_values = "640x480,352x288,320x240,176x144",
 			.preview_size = "640x480",
@@ -149,6 +161,8 @@ struct smdk4210_camera_preset smdk4210_camera_presets_galaxys2[] = {
 			.recording_size = "640x480",
 			.recording_size_values = "720x480,640x480",
 			.recording_format = "yuv420sp",
+			.video_hfr = NULL,
+			.video_hfr_values = NULL,
 
 			.focus_mode = "fixed",
 			.focus_mode_values = "fixed",
@@ -156,7 +170,11 @@ struct smdk4210_camera_preset smdk4210_camera_presets_galaxys2[] = {
 			.focus_areas = NULL,
 			.max_num_focus_areas = 0,
 
-			.zoom_supported = 0,
+			.zoom_supported = 1,
+			.smooth_zoom_supported = 0,
+			.zoom_ratios = "100,105,110,115,120,125,130,135,140,145,150,155,160,165,170,175,180,185,190,195,200",
+			.zoom = 0,
+			.max_zoom = 20,
 
 			.flash_mode = NULL,
 			.flash_mode_values = NULL,
@@ -213,12 +231,30 @@ struct exynox_camera_config *smdk4210_camera_config =
 int smdk4210_camera_init(struct smdk4210_camera *smdk4210_camera, int id)
 {
 	char firmware_version[7] = { 0 };
+	char trace_path[PROPERTY_VALUE_MAX];
 	struct smdk4210_v4l2_ext_control control;
 	int rc;
 
 	if (smdk4210_camera == NULL || id >= smdk4210_camera->config->presets_count)
 		return -EINVAL;
 
+	smdk4210_camera_pool_init(smdk4210_camera);
+	smdk4210_transform_init(&smdk4210_camera->transform);
+
+	// V4L2 trace, started first to catch the whole session
+	if (smdk4210_camera->config->v4l2_trace_path != NULL)
+		strncpy(trace_path, smdk4210_camera->config->v4l2_trace_path, sizeof(trace_path) - 1);
+	else
+		property_get("debug.camera.v4l2_trace", trace_path, "");
+
+	trace_path[sizeof(trace_path) - 1] = '\0';
+
+	if (trace_path[0] != '\0') {
+		rc = smdk4210_v4l2_trace_init(smdk4210_camera, trace_path);
+		if (rc < 0)
+			ALOGE("%s: Unable to init V4L2 trace", __func__);
+	}
+
 	// Init FIMC1
 	rc = smdk4210_v4l2_open(smdk4210_camera, 0);
 	if (rc < 0) {
@@ -281,6 +317,18 @@ int smdk4210_camera_init(struct smdk4210_camera *smdk4210_camera, int id)
 		ALOGD("Firmware version: %s", firmware_version);
 	}
 
+	pthread_mutex_init(&smdk4210_camera->request_mutex, NULL);
+	pthread_mutex_init(&smdk4210_camera->preview_config_mutex, NULL);
+
+	// Face detection is started and stopped while the preview thread runs
+	pthread_mutex_init(&smdk4210_camera->face_mutex, NULL);
+	pthread_cond_init(&smdk4210_camera->face_cond, NULL);
+
+	// Sensor controls set from params are applied asynchronously
+	rc = smdk4210_camera_control_start(smdk4210_camera);
+	if (rc < 0)
+		ALOGE("%s: Unable to start control thread", __func__);
+
 	// Params
 	rc = smdk4210_camera_params_init(smdk4210_camera, id);
 	if (rc < 0)
@@ -302,537 +350,1267 @@ void smdk4210_camera_deinit(struct smdk4210_camera *smdk4210_camera)
 	if (smdk4210_camera == NULL || smdk4210_camera->config == NULL)
 		return;
 
+	// Aborted requests restore their controls, before the control lock goes
+	smdk4210_camera_request_abort(smdk4210_camera);
+	pthread_mutex_destroy(&smdk4210_camera->request_mutex);
+	pthread_mutex_destroy(&smdk4210_camera->preview_config_mutex);
+
+	smdk4210_camera_control_stop(smdk4210_camera);
+
+	pthread_cond_destroy(&smdk4210_camera->face_cond);
+	pthread_mutex_destroy(&smdk4210_camera->face_mutex);
+
 	smdk4210_v4l2_close(smdk4210_camera, 0);
 	smdk4210_v4l2_close(smdk4210_camera, 2);
+
+	smdk4210_v4l2_trace_deinit(smdk4210_camera);
+
+	smdk4210_camera_pool_deinit(smdk4210_camera);
+	smdk4210_transform_deinit(&smdk4210_camera->transform);
 }
 
-// Params
+// Control
 
-int smdk4210_camera_params_init(struct smdk4210_camera *smdk4210_camera, int id)
+void *smdk4210_camera_control_thread(void *data)
 {
+	struct smdk4210_camera *smdk4210_camera;
+	struct smdk4210_camera_control control;
+	nsecs_t latency;
 	int rc;
 
-	if (smdk4210_camera == NULL || id >= smdk4210_camera->config->presets_count)
-		return -EINVAL;
+	if (data == NULL)
+		return NULL;
 
-	// Camera params
-	smdk4210_camera->camera_rotation = smdk4210_camera->config->presets[id].rotation;
-	smdk4210_camera->camera_hflip = smdk4210_camera->config->presets[id].hflip;
-	smdk4210_camera->camera_vflip = smdk4210_camera->config->presets[id].vflip;
-	smdk4210_camera->camera_picture_format = smdk4210_camera->config->presets[id].picture_format;
-	smdk4210_camera->camera_focal_length = (int) (smdk4210_camera->config->presets[id].focal_length * 100);
-	smdk4210_camera->camera_metering = smdk4210_camera->config->presets[id].metering;
+	smdk4210_camera = (struct smdk4210_camera *) data;
 
-	// Recording preview
-	smdk4210_param_string_set(smdk4210_camera, "preferred-preview-size-for-video",
-		smdk4210_camera->config->presets[id].params.preview_size);
+	ALOGD("%s: Starting thread", __func__);
+	smdk4210_camera->control_thread_running = 1;
 
-	// Preview
-	smdk4210_param_string_set(smdk4210_camera, "preview-size-values",
-		smdk4210_camera->config->presets[id].params.preview_size_values);
-	smdk4210_param_string_set(smdk4210_camera, "preview-size",
-		smdk4210_camera->config->presets[id].params.preview_size);
-	smdk4210_param_string_set(smdk4210_camera, "preview-format-values",
-		smdk4210_camera->config->presets[id].params.preview_format_values);
-	smdk4210_param_string_set(smdk4210_camera, "preview-format",
-		smdk4210_camera->config->presets[id].params.preview_format);
-	smdk4210_param_string_set(smdk4210_camera, "preview-frame-rate-values",
-		smdk4210_camera->config->presets[id].params.preview_frame_rate_values);
-	smdk4210_param_int_set(smdk4210_camera, "preview-frame-rate",
-		smdk4210_camera->config->presets[id].params.preview_frame_rate);
-	smdk4210_param_string_set(smdk4210_camera, "preview-fps-range-values",
-		smdk4210_camera->config->presets[id].params.preview_fps_range_values);
-	smdk4210_param_string_set(smdk4210_camera, "preview-fps-range",
-		smdk4210_camera->config->presets[id].params.preview_fps_range);
+	pthread_mutex_lock(&smdk4210_camera->control_mutex);
 
-	// Picture
-	smdk4210_param_string_set(smdk4210_camera, "picture-size-values",
-		smdk4210_camera->config->presets[id].params.picture_size_values);
-	smdk4210_param_string_set(smdk4210_camera, "picture-size",
-		smdk4210_camera->config->presets[id].params.picture_size);
-	smdk4210_param_string_set(smdk4210_camera, "picture-format-values",
-		smdk4210_camera->config->presets[id].params.picture_format_values);
-	smdk4210_param_string_set(smdk4210_camera, "picture-format",
-		smdk4210_camera->config->presets[id].params.picture_format);
-	smdk4210_param_string_set(smdk4210_camera, "jpeg-thumbnail-size-values",
-		smdk4210_camera->config->presets[id].params.jpeg_thumbnail_size_values);
-	smdk4210_param_int_set(smdk4210_camera, "jpeg-thumbnail-width",
-		smdk4210_camera->config->presets[id].params.jpeg_thumbnail_width);
-	smdk4210_param_int_set(smdk4210_camera, "jpeg-thumbnail-height",
-		smdk4210_camera->config->presets[id].params.jpeg_thumbnail_height);
-	smdk4210_param_int_set(smdk4210_camera, "jpeg-thumbnail-quality",
-		smdk4210_camera->config->presets[id].params.jpeg_thumbnail_quality);
-	smdk4210_param_int_set(smdk4210_camera, "jpeg-quality",
-		smdk4210_camera->config->presets[id].params.jpeg_quality);
+	while (1) {
+		while (smdk4210_camera->control_enabled && smdk4210_camera->controls_count == 0)
+			pthread_cond_wait(&smdk4210_camera->control_cond, &smdk4210_camera->control_mutex);
 
-	// Recording
-	smdk4210_param_string_set(smdk4210_camera, "video-size",
-		smdk4210_camera->config->presets[id].params.recording_size);
-	smdk4210_param_string_set(smdk4210_camera, "video-size-values",
-		smdk4210_camera->config->presets[id].params.recording_size_values);
-	smdk4210_param_string_set(smdk4210_camera, "video-frame-format",
-		smdk4210_camera->config->presets[id].params.recording_format);
+		if (smdk4210_camera->controls_count == 0)
+			break;
 
-	// Focus
-	smdk4210_param_string_set(smdk4210_camera, "focus-mode",
-		smdk4210_camera->config->presets[id].params.focus_mode);
-	smdk4210_param_string_set(smdk4210_camera, "focus-mode-values",
-		smdk4210_camera->config->presets[id].params.focus_mode_values);
-	smdk4210_param_string_set(smdk4210_camera, "focus-distances",
-		smdk4210_camera->config->presets[id].params.focus_distances);
-	if (smdk4210_camera->config->presets[id].params.max_num_focus_areas > 0) {
-		smdk4210_param_string_set(smdk4210_camera, "focus-areas",
-			smdk4210_camera->config->presets[id].params.focus_areas);
-		smdk4210_param_int_set(smdk4210_camera, "max-num-focus-areas",
-			smdk4210_camera->config->presets[id].params.max_num_focus_areas);
-	}
+		memcpy(&control, &smdk4210_camera->controls[0], sizeof(control));
 
-	// Zoom
-	if (smdk4210_camera->config->presets[id].params.zoom_supported == 1) {
-		smdk4210_param_string_set(smdk4210_camera, "zoom-supported", "true");
+		// Wake up anyone waiting for room in the queue
+		if (smdk4210_camera->controls_count == SMDK4210_CAMERA_CONTROLS_COUNT)
+			pthread_cond_broadcast(&smdk4210_camera->control_cond);
 
-		if (smdk4210_camera->config->presets[id].params.smooth_zoom_supported == 1)
-			smdk4210_param_string_set(smdk4210_camera, "smooth-zoom-supported", "true");
+		smdk4210_camera->controls_count--;
+		memmove(&smdk4210_camera->controls[0], &smdk4210_camera->controls[1],
+			smdk4210_camera->controls_count * sizeof(struct smdk4210_camera_control));
+		smdk4210_camera->control_busy = 1;
 
-		if (smdk4210_camera->config->presets[id].params.zoom_ratios != NULL)
-			smdk4210_param_string_set(smdk4210_camera, "zoom-ratios", smdk4210_camera->config->presets[id].params.zoom_ratios);
+		pthread_mutex_unlock(&smdk4210_camera->control_mutex);
 
-		smdk4210_param_int_set(smdk4210_camera, "zoom", smdk4210_camera->config->presets[id].params.zoom);
-		smdk4210_param_int_set(smdk4210_camera, "max-zoom", smdk4210_camera->config->presets[id].params.max_zoom);
+		rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, control.id, control.value);
+		if (rc < 0)
+			ALOGE("%s: s ctrl failed!", __func__);
 
-	} else {
-		smdk4210_param_string_set(smdk4210_camera, "zoom-supported", "false");
+		latency = systemTime(SYSTEM_TIME_MONOTONIC) - control.timestamp;
+
+		pthread_mutex_lock(&smdk4210_camera->control_mutex);
+
+		smdk4210_camera->control_applied_count++;
+		smdk4210_camera->control_latency_sum += latency;
+		if (latency > smdk4210_camera->control_latency_max)
+			smdk4210_camera->control_latency_max = latency;
+
+		smdk4210_camera->control_busy = 0;
+
+		// Wake up anyone waiting for the controls to be applied
+		if (smdk4210_camera->controls_count == 0)
+			pthread_cond_broadcast(&smdk4210_camera->control_cond);
 	}
 
-	// Flash
-	smdk4210_param_string_set(smdk4210_camera, "flash-mode",
-		smdk4210_camera->config->presets[id].params.flash_mode);
-	smdk4210_param_string_set(smdk4210_camera, "flash-mode-values",
-		smdk4210_camera->config->presets[id].params.flash_mode_values);
+	smdk4210_camera->control_thread_running = 0;
+	pthread_cond_broadcast(&smdk4210_camera->control_cond);
 
-	// Exposure
-	smdk4210_param_int_set(smdk4210_camera, "exposure-compensation",
-		smdk4210_camera->config->presets[id].params.exposure_compensation);
-	smdk4210_param_float_set(smdk4210_camera, "exposure-compensation-step",
-		smdk4210_camera->config->presets[id].params.exposure_compensation_step);
-	smdk4210_param_int_set(smdk4210_camera, "min-exposure-compensation",
-		smdk4210_camera->config->presets[id].params.min_exposure_compensation);
-	smdk4210_param_int_set(smdk4210_camera, "max-exposure-compensation",
-		smdk4210_camera->config->presets[id].params.max_exposure_compensation);
+	pthread_mutex_unlock(&smdk4210_camera->control_mutex);
 
-	// WB
-	smdk4210_param_string_set(smdk4210_camera, "whitebalance",
-		smdk4210_camera->config->presets[id].params.whitebalance);
-	smdk4210_param_string_set(smdk4210_camera, "whitebalance-values",
-		smdk4210_camera->config->presets[id].params.whitebalance_values);
+	ALOGD("%s: Exiting thread", __func__);
 
-	// Scene mode
-	smdk4210_param_string_set(smdk4210_camera, "scene-mode",
-		smdk4210_camera->config->presets[id].params.scene_mode);
-	smdk4210_param_string_set(smdk4210_camera, "scene-mode-values",
-		smdk4210_camera->config->presets[id].params.scene_mode_values);
+	return NULL;
+}
 
-	// Effect
-	smdk4210_param_string_set(smdk4210_camera, "effect",
-		smdk4210_camera->config->presets[id].params.effect);
-	smdk4210_param_string_set(smdk4210_camera, "effect-values",
-		smdk4210_camera->config->presets[id].params.effect_values);
+// Called with the control lock held
+static void smdk4210_camera_control_value_set(struct smdk4210_camera *smdk4210_camera,
+	unsigned int id, int value)
+{
+	int i;
 
-	// ISO
-	smdk4210_param_string_set(smdk4210_camera, "iso",
-		smdk4210_camera->config->presets[id].params.iso);
-	smdk4210_param_string_set(smdk4210_camera, "iso-values",
-		smdk4210_camera->config->presets[id].params.iso_values);
+	for (i = 0; i < smdk4210_camera->control_values_count; i++) {
+		if (smdk4210_camera->control_values[i].id == id) {
+			smdk4210_camera->control_values[i].value = value;
+			return;
+		}
+	}
 
-	// Camera
-	smdk4210_param_float_set(smdk4210_camera, "focal-length",
-		smdk4210_camera->config->presets[id].focal_length);
-	smdk4210_param_float_set(smdk4210_camera, "horizontal-view-angle",
-		smdk4210_camera->config->presets[id].horizontal_view_angle);
-	smdk4210_param_float_set(smdk4210_camera, "vertical-view-angle",
-		smdk4210_camera->config->presets[id].vertical_view_angle);
+	if (i >= SMDK4210_CAMERA_CONTROL_VALUES_COUNT) {
+		ALOGE("%s: No room for control 0x%x", __func__, id);
+		return;
+	}
 
-	rc = smdk4210_camera_params_apply(smdk4210_camera);
-	if (rc < 0) {
-		ALOGE("%s: Unable to apply params", __func__);
-		return -1;
+	smdk4210_camera->control_values[i].id = id;
+	smdk4210_camera->control_values[i].value = value;
+	smdk4210_camera->control_values_count++;
+}
+
+int smdk4210_camera_control_value_get(struct smdk4210_camera *smdk4210_camera,
+	unsigned int id, int *value)
+{
+	int rc = -1;
+	int i;
+
+	if (smdk4210_camera == NULL || value == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&smdk4210_camera->control_mutex);
+
+	for (i = 0; i < smdk4210_camera->control_values_count; i++) {
+		if (smdk4210_camera->control_values[i].id == id) {
+			*value = smdk4210_camera->control_values[i].value;
+			rc = 0;
+			break;
+		}
 	}
 
-	return 0;
+	pthread_mutex_unlock(&smdk4210_camera->control_mutex);
+
+	return rc;
 }
 
-int smdk4210_camera_params_apply(struct smdk4210_camera *smdk4210_camera)
+int smdk4210_camera_control_set(struct smdk4210_camera *smdk4210_camera,
+	unsigned int id, int value)
 {
-	struct preview_stream_ops *preview_window;
-	int gralloc_format;
+	int i;
 
-	char *recording_hint_string;
-	char *recording_preview_size_string;
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
 
-	char *preview_size_string;
-	int preview_width = 0;
-	int preview_height = 0;
-	int preview_changed = 0;
-	char *preview_format_string;
-	int preview_format;
-	int preview_fps;
+	pthread_mutex_lock(&smdk4210_camera->control_mutex);
 
-	char *picture_size_string;
-	int picture_width = 0;
-	int picture_height = 0;
-	char *picture_format_string;
-	int picture_format;
+	smdk4210_camera_control_value_set(smdk4210_camera, id, value);
 
-	int jpeg_thumbnail_width;
-	int jpeg_thumbnail_height;
-	int jpeg_thumbnail_quality;
-	int jpeg_quality;
+	// A control still waiting in the queue is moved to the tail with its new
+	// value: a stale value can't be applied after this one, and controls that
+	// depend on each other keep the order they were last set in
+	for (i = 0; i < smdk4210_camera->controls_count; i++) {
+		if (smdk4210_camera->controls[i].id == id) {
+			smdk4210_camera->controls_count--;
+			memmove(&smdk4210_camera->controls[i], &smdk4210_camera->controls[i + 1],
+				(smdk4210_camera->controls_count - i) * sizeof(struct smdk4210_camera_control));
+			smdk4210_camera->control_coalesced_count++;
+			break;
+		}
+	}
 
-	char *video_size_string;
-	int recording_width = 0;
-	int recording_height = 0;
-	char *video_frame_format_string;
-	int recording_format;
-	int camera_sensor_mode;
-	int camera_sensor_output_size;
+	// Only the control thread issues the ioctls: wait for room in the queue
+	while (smdk4210_camera->control_enabled &&
+		smdk4210_camera->controls_count >= SMDK4210_CAMERA_CONTROLS_COUNT)
+		pthread_cond_wait(&smdk4210_camera->control_cond, &smdk4210_camera->control_mutex);
 
-	char *focus_mode_string;
-	int focus_mode = 0;
-	char *focus_areas_string;
-	int focus_left, focus_top, focus_right, focus_bottom, focus_weigth;
-	int focus_x;
-	int focus_y;
+	if (!smdk4210_camera->control_enabled) {
+		// The thread still applies what is queued before it ends
+		while (smdk4210_camera->control_thread_running)
+			pthread_cond_wait(&smdk4210_camera->control_cond, &smdk4210_camera->control_mutex);
 
-	char *zoom_supported_string;
-	int zoom, max_zoom;
+		pthread_mutex_unlock(&smdk4210_camera->control_mutex);
 
-	char *flash_mode_string;
-	int flash_mode;
+		return smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, id, value);
+	}
 
-	int exposure_compensation;
-	int min_exposure_compensation;
-	int max_exposure_compensation;
+	i = smdk4210_camera->controls_count;
 
-	char *whitebalance_string;
-	int whitebalance;
+	smdk4210_camera->controls[i].id = id;
+	smdk4210_camera->controls[i].value = value;
+	smdk4210_camera->controls[i].timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+	smdk4210_camera->controls_count++;
 
-	char *scene_mode_string;
-	int scene_mode;
+	pthread_cond_broadcast(&smdk4210_camera->control_cond);
 
-	char *effect_string;
-	int effect;
+	pthread_mutex_unlock(&smdk4210_camera->control_mutex);
 
-	char *iso_string;
-	int iso;
+	return 0;
+}
 
-	int force = 0;
+void smdk4210_camera_control_flush(struct smdk4210_camera *smdk4210_camera)
+{
+	if (smdk4210_camera == NULL)
+		return;
 
-	int w, h;
-	char *k;
+	pthread_mutex_lock(&smdk4210_camera->control_mutex);
+
+	while (smdk4210_camera->control_thread_running &&
+		(smdk4210_camera->controls_count > 0 || smdk4210_camera->control_busy))
+		pthread_cond_wait(&smdk4210_camera->control_cond, &smdk4210_camera->control_mutex);
+
+	pthread_mutex_unlock(&smdk4210_camera->control_mutex);
+}
+
+int smdk4210_camera_control_start(struct smdk4210_camera *smdk4210_camera)
+{
+	pthread_attr_t thread_attr;
 	int rc;
 
 	if (smdk4210_camera == NULL)
 		return -EINVAL;
 
-	if (!smdk4210_camera->preview_params_set) {
-		ALOGE("%s: Setting preview params", __func__);
-		smdk4210_camera->preview_params_set = 1;
-		force = 1;
-	}
-	// Preview
-	preview_size_string = smdk4210_param_string_get(smdk4210_camera, "preview-size");
-	if (preview_size_string != NULL) {
-		sscanf(preview_size_string, "%dx%d", &preview_width, &preview_height);
+	pthread_mutex_init(&smdk4210_camera->control_mutex, NULL);
+	pthread_cond_init(&smdk4210_camera->control_cond, NULL);
 
-		if (preview_width != 0 && preview_width != smdk4210_camera->preview_width) {
-			smdk4210_camera->preview_width = preview_width;
-			preview_changed = 1;
-		} if (preview_height != 0 && preview_height != smdk4210_camera->preview_height) {
-			smdk4210_camera->preview_height = preview_height;
-			preview_changed = 1;
-		}
-	}
+	smdk4210_camera->controls_count = 0;
+	smdk4210_camera->control_values_count = 0;
+	smdk4210_camera->control_busy = 0;
 
-	preview_format_string = smdk4210_param_string_get(smdk4210_camera, "preview-format");
-	if (preview_format_string != NULL) {
-		if (strcmp(preview_format_string, "yuv420sp") == 0) {
-			preview_format = V4L2_PIX_FMT_NV21;
-		} else if (strcmp(preview_format_string, "yuv420p") == 0) {
-			preview_format = V4L2_PIX_FMT_YUV420;
-		} else if (strcmp(preview_format_string, "rgb565") == 0) {
-			preview_format = V4L2_PIX_FMT_RGB565;
-		} else if (strcmp(preview_format_string, "rgb8888") == 0) {
-			preview_format = V4L2_PIX_FMT_RGB32;
-		} else {
-			ALOGE("%s: Unsupported preview format: %s", __func__, preview_format_string);
-			preview_format = V4L2_PIX_FMT_NV21;
-		}
+	pthread_attr_init(&thread_attr);
+	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
 
-		if (preview_format != smdk4210_camera->preview_format)
-			smdk4210_camera->preview_format = preview_format;
+	smdk4210_camera->control_enabled = 1;
+	smdk4210_camera->control_thread_running = 1;
+
+	rc = pthread_create(&smdk4210_camera->control_thread, &thread_attr,
+		smdk4210_camera_control_thread, (void *) smdk4210_camera);
+	if (rc != 0) {
+		ALOGE("%s: Unable to create thread", __func__);
+		smdk4210_camera->control_enabled = 0;
+		smdk4210_camera->control_thread_running = 0;
+		return -1;
 	}
 
-	preview_fps = smdk4210_param_int_get(smdk4210_camera, "preview-frame-rate");
-	if (preview_fps > 0)
-		smdk4210_camera->preview_fps = preview_fps;
-	else
-		smdk4210_camera->preview_fps = 0;
+	return 0;
+}
 
-	// Picture
-	picture_size_string = smdk4210_param_string_get(smdk4210_camera, "picture-size");
-	if (picture_size_string != NULL) {
-		sscanf(picture_size_string, "%dx%d", &picture_width, &picture_height);
+void smdk4210_camera_control_stop(struct smdk4210_camera *smdk4210_camera)
+{
+	if (smdk4210_camera == NULL)
+		return;
 
-		if (picture_width != 0 && picture_width != smdk4210_camera->picture_width)
-			smdk4210_camera->picture_width = picture_width;
-		if (picture_height != 0 && picture_height != smdk4210_camera->picture_height)
-			smdk4210_camera->picture_height = picture_height;
-	}
+	pthread_mutex_lock(&smdk4210_camera->control_mutex);
 
-	picture_format_string = smdk4210_param_string_get(smdk4210_camera, "picture-format");
-	if (picture_format_string != NULL) {
-		if (strcmp(picture_format_string, "jpeg") == 0) {
-			picture_format = V4L2_PIX_FMT_JPEG;
-		} else {
-			ALOGE("%s: Unsupported picture format: %s", __func__, picture_format_string);
-			picture_format = V4L2_PIX_FMT_JPEG;
-		}
+	// Disable controls to make the thread end, once the queue is applied
+	smdk4210_camera->control_enabled = 0;
+	pthread_cond_broadcast(&smdk4210_camera->control_cond);
 
-		if (picture_format != smdk4210_camera->picture_format)
-			smdk4210_camera->picture_format = picture_format;
-	}
+	while (smdk4210_camera->control_thread_running)
+		pthread_cond_wait(&smdk4210_camera->control_cond, &smdk4210_camera->control_mutex);
 
-	jpeg_thumbnail_width = smdk4210_param_int_get(smdk4210_camera, "jpeg-thumbnail-width");
-	if (jpeg_thumbnail_width > 0)
-		smdk4210_camera->jpeg_thumbnail_width = jpeg_thumbnail_width;
+	pthread_mutex_unlock(&smdk4210_camera->control_mutex);
 
-	jpeg_thumbnail_height = smdk4210_param_int_get(smdk4210_camera, "jpeg-thumbnail-height");
-	if (jpeg_thumbnail_height > 0)
-		smdk4210_camera->jpeg_thumbnail_height = jpeg_thumbnail_height;
+	pthread_cond_destroy(&smdk4210_camera->control_cond);
+	pthread_mutex_destroy(&smdk4210_camera->control_mutex);
+}
 
-	jpeg_thumbnail_quality = smdk4210_param_int_get(smdk4210_camera, "jpeg-thumbnail-quality");
-	if (jpeg_thumbnail_quality > 0)
-		smdk4210_camera->jpeg_thumbnail_quality = jpeg_thumbnail_quality;
+// Requests
 
-	jpeg_quality = smdk4210_param_int_get(smdk4210_camera, "jpeg-quality");
-	if (jpeg_quality <= 100 && jpeg_quality >= 0 && (jpeg_quality != smdk4210_camera->jpeg_quality || force)) {
-		smdk4210_camera->jpeg_quality = jpeg_quality;
-		rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_QUALITY, jpeg_quality);
-		if (rc < 0)
-			ALOGE("%s: s ctrl failed!", __func__);
-	}
+/*
+ * Requests carry their own controls and are issued from the preview thread,
+ * one per frame, ahead of the sensor latency. Each one completes on the frame
+ * its controls first show on, so results are tagged with the right settings.
+ */
 
-	// Recording
-	video_size_string = smdk4210_param_string_get(smdk4210_camera, "video-size");
-	if (video_size_string == NULL)
-		video_size_string = smdk4210_param_string_get(smdk4210_camera, "preview-size");
+int smdk4210_camera_request_submit(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_request *request)
+{
+	int index;
+	int id;
 
-	if (video_size_string != NULL) {
-		sscanf(video_size_string, "%dx%d", &recording_width, &recording_height);
+	if (smdk4210_camera == NULL || request == NULL ||
+		request->controls_count < 0 || request->controls_count > SMDK4210_CAMERA_REQUEST_CONTROLS_COUNT)
+		return -EINVAL;
+
+	pthread_mutex_lock(&smdk4210_camera->request_mutex);
 
-		if (recording_width != 0 && recording_width != smdk4210_camera->recording_width)
-			smdk4210_camera->recording_width = recording_width;
-		if (recording_height != 0 && recording_height != smdk4210_camera->recording_height)
-			smdk4210_camera->recording_height = recording_height;
+	if (!smdk4210_camera->preview_enabled ||
+		smdk4210_camera->requests_count >= SMDK4210_CAMERA_REQUESTS_COUNT) {
+		pthread_mutex_unlock(&smdk4210_camera->request_mutex);
+		return -1;
 	}
 
-	video_frame_format_string = smdk4210_param_string_get(smdk4210_camera, "video-frame-format");
-	if (video_frame_format_string != NULL) {
-		if (strcmp(video_frame_format_string, "yuv420sp") == 0) {
-			recording_format = V4L2_PIX_FMT_NV12;
-		} else if (strcmp(video_frame_format_string, "yuv420p") == 0) {
-			recording_format = V4L2_PIX_FMT_YUV420;
-		} else if (strcmp(video_frame_format_string, "rgb565") == 0) {
-			recording_format = V4L2_PIX_FMT_RGB565;
-		} else if (strcmp(video_frame_format_string, "rgb8888") == 0) {
-			recording_format = V4L2_PIX_FMT_RGB32;
-		} else {
-			ALOGE("%s: Unsupported recording format: %s", __func__, video_frame_format_string);
-			recording_format = V4L2_PIX_FMT_NV12;
-		}
+	index = (smdk4210_camera->requests_head + smdk4210_camera->requests_count) % SMDK4210_CAMERA_REQUESTS_COUNT;
+
+	memcpy(&smdk4210_camera->requests[index], request, sizeof(struct smdk4210_camera_request));
+
+	id = ++smdk4210_camera->request_id;
+	smdk4210_camera->requests[index].id = id;
+	smdk4210_camera->requests[index].frame = 0;
+	smdk4210_camera->requests[index].status = 0;
+	smdk4210_camera->requests_count++;
+
+	pthread_mutex_unlock(&smdk4210_camera->request_mutex);
+
+	return id;
+}
 
-		if (recording_format != smdk4210_camera->recording_format)
-			smdk4210_camera->recording_format = recording_format;
+static void smdk4210_camera_request_complete(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_request *request, void *data, int size, nsecs_t timestamp)
+{
+	struct smdk4210_camera_request_result result;
+
+	memset(&result, 0, sizeof(result));
+	result.id = request->id;
+	result.status = data != NULL ? request->status : -1;
+	result.frame = request->frame;
+	result.timestamp = timestamp;
+	result.controls = request->controls;
+	result.controls_count = request->controls_count;
+
+	if (data != NULL && request->output != NULL && request->output_size >= size) {
+		memcpy(request->output, data, size);
+		result.output = request->output;
+		result.output_size = size;
 	}
 
-	recording_hint_string = smdk4210_param_string_get(smdk4210_camera, "recording-hint");
-	if (recording_hint_string != NULL && strcmp(recording_hint_string, "true") == 0) {
-		camera_sensor_mode = SENSOR_MOVIE;
+	if (data != NULL)
+		smdk4210_camera->requests_completed_count++;
+	else
+		smdk4210_camera->requests_aborted_count++;
 
-		k = smdk4210_param_string_get(smdk4210_camera, "preview-size-values");
-		while (recording_width != 0 && recording_height != 0) {
-			if (k == NULL)
-				break;
+	if (request->callback != NULL)
+		request->callback(smdk4210_camera, &result, request->data);
+}
 
-			sscanf(k, "%dx%d", &w, &h);
+// The s ctrl helper returns the value, that is negative for some controls
+static int smdk4210_camera_request_control_set(struct smdk4210_camera *smdk4210_camera,
+	unsigned int id, int value)
+{
+	struct v4l2_control control;
 
-			// Look for same aspect ratio
-			if ((recording_width * h) / recording_height == w) {
-				preview_width = w;
-				preview_height = h;
-				break;
-			}
+	control.id = id;
+	control.value = value;
 
-			k = strchr(k, ',');
-			if (k == NULL)
-				break;
+	return smdk4210_v4l2_ioctl(smdk4210_camera, 0, VIDIOC_S_CTRL, &control);
+}
 
-			k++;
-		}
+// Called with the request lock held
+static int smdk4210_camera_request_control_in_flight(struct smdk4210_camera *smdk4210_camera,
+	unsigned int id)
+{
+	int i, j;
 
-		if (preview_width != 0 && preview_width != smdk4210_camera->preview_width)
-			smdk4210_camera->preview_width = preview_width;
-		if (preview_height != 0 && preview_height != smdk4210_camera->preview_height)
-			smdk4210_camera->preview_height = preview_height;
+	for (i = 0; i < smdk4210_camera->requests_in_flight_count; i++)
+		for (j = 0; j < smdk4210_camera->requests_in_flight[i].controls_count; j++)
+			if (smdk4210_camera->requests_in_flight[i].controls[j].id == id)
+				return 1;
 
-		camera_sensor_output_size = ((recording_width & 0xffff) << 16) | (recording_height & 0xffff);
-		rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_SENSOR_OUTPUT_SIZE,
-			camera_sensor_output_size);
+	return 0;
+}
+
+// Controls of retired requests go back to the value the params last asked for
+static void smdk4210_camera_request_restore(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_control *controls, int count)
+{
+	int value;
+	int rc;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		rc = smdk4210_camera_control_value_get(smdk4210_camera, controls[i].id, &value);
 		if (rc < 0)
-			ALOGE("%s: s ctrl failed!", __func__);
-	} else {
-		camera_sensor_mode = SENSOR_CAMERA;
-	}
+			continue;
 
-	// Switching modes
-	if (camera_sensor_mode != smdk4210_camera->camera_sensor_mode) {
-		smdk4210_camera->camera_sensor_mode = camera_sensor_mode;
-		rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_SENSOR_MODE, camera_sensor_mode);
+		rc = smdk4210_camera_request_control_set(smdk4210_camera, controls[i].id, value);
 		if (rc < 0)
 			ALOGE("%s: s ctrl failed!", __func__);
 	}
+}
 
-	// Focus
-	focus_areas_string = smdk4210_param_string_get(smdk4210_camera, "focus-areas");
-	if (focus_areas_string != NULL) {
-		focus_left = focus_top = focus_right = focus_bottom = focus_weigth = 0;
+// Called with the request lock held, adds the controls that aren't listed yet
+static int smdk4210_camera_request_restore_add(struct smdk4210_camera_control *restore,
+	int count, struct smdk4210_camera_request *request)
+{
+	int i, j;
 
-		rc = sscanf(focus_areas_string, "(%d,%d,%d,%d,%d)",
-			&focus_left, &focus_top, &focus_right, &focus_bottom, &focus_weigth);
-		if (rc != 5) {
-			ALOGE("%s: sscanf failed!", __func__);
-		} else if (focus_left != 0 && focus_top != 0 && focus_right != 0 && focus_bottom != 0) {
-			focus_x = (((focus_left + focus_right) / 2) + 1000) * preview_width / 2000;
-			focus_y =  (((focus_top + focus_bottom) / 2) + 1000) * preview_height / 2000;
+	for (i = 0; i < request->controls_count; i++) {
+		for (j = 0; j < count; j++)
+			if (restore[j].id == request->controls[i].id)
+				break;
 
-			if (focus_x != smdk4210_camera->focus_x || force) {
-				smdk4210_camera->focus_x = focus_x;
+		if (j == count)
+			memcpy(&restore[count++], &request->controls[i], sizeof(struct smdk4210_camera_control));
+	}
 
-				rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_OBJECT_POSITION_X, focus_x);
-				if (rc < 0)
-					ALOGE("%s: s ctrl failed!", __func__);
-			}
+	return count;
+}
 
-			if (focus_y != smdk4210_camera->focus_y || force) {
-				smdk4210_camera->focus_y = focus_y;
+void smdk4210_camera_request_frame(struct smdk4210_camera *smdk4210_camera,
+	void *data, int size, nsecs_t timestamp)
+{
+	struct smdk4210_camera_control restore[SMDK4210_CAMERA_REQUEST_LATENCY * SMDK4210_CAMERA_REQUEST_CONTROLS_COUNT];
+	struct smdk4210_camera_request request;
+	unsigned int frame;
+	int restore_count = 0;
+	int issued = 0;
+	int value;
+	int rc;
+	int i;
 
-				rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_OBJECT_POSITION_Y, focus_y);
-				if (rc < 0)
-					ALOGE("%s: s ctrl failed!", __func__);
-			}
+	if (smdk4210_camera == NULL)
+		return;
 
-			focus_mode = FOCUS_MODE_TOUCH;
-		}
+	pthread_mutex_lock(&smdk4210_camera->request_mutex);
+
+	frame = smdk4210_camera->request_frame++;
+
+	// Results, for the requests whose controls show on this frame
+	while (smdk4210_camera->requests_in_flight_count > 0 &&
+		(int) (smdk4210_camera->requests_in_flight[0].frame - frame) <= 0) {
+		memcpy(&request, &smdk4210_camera->requests_in_flight[0], sizeof(request));
+
+		smdk4210_camera->requests_in_flight_count--;
+		memmove(&smdk4210_camera->requests_in_flight[0], &smdk4210_camera->requests_in_flight[1],
+			smdk4210_camera->requests_in_flight_count * sizeof(struct smdk4210_camera_request));
+
+		restore_count = smdk4210_camera_request_restore_add(restore, restore_count, &request);
+
+		pthread_mutex_unlock(&smdk4210_camera->request_mutex);
+		smdk4210_camera_request_complete(smdk4210_camera, &request, data, size, timestamp);
+		pthread_mutex_lock(&smdk4210_camera->request_mutex);
 	}
 
-	focus_mode_string = smdk4210_param_string_get(smdk4210_camera, "focus-mode");
-	if (focus_mode_string != NULL) {
-		if (focus_mode == 0) {
-			if (strcmp(focus_mode_string, "auto") == 0)
-				focus_mode = FOCUS_MODE_AUTO;
-			else if (strcmp(focus_mode_string, "infinity") == 0)
-				focus_mode = FOCUS_MODE_INFINITY;
-			else if (strcmp(focus_mode_string, "macro") == 0)
-				focus_mode = FOCUS_MODE_MACRO;
-			else if (strcmp(focus_mode_string, "fixed") == 0)
-				focus_mode = FOCUS_MODE_FIXED;
-			else if (strcmp(focus_mode_string, "facedetect") == 0)
-				focus_mode = FOCUS_MODE_FACEDETECT;
-			else if (strcmp(focus_mode_string, "continuous-video") == 0)
-				focus_mode = FOCUS_MODE_CONTINOUS;
-			else if (strcmp(focus_mode_string, "continuous-picture") == 0)
-				focus_mode = FOCUS_MODE_CONTINOUS;
-			else
-				focus_mode = FOCUS_MODE_AUTO;
-		}
+	// Next request, its controls are set now to show on a later frame
+	if (smdk4210_camera->requests_count > 0 &&
+		smdk4210_camera->requests_in_flight_count < SMDK4210_CAMERA_REQUEST_LATENCY) {
+		memcpy(&request, &smdk4210_camera->requests[smdk4210_camera->requests_head], sizeof(request));
+		smdk4210_camera->requests_head = (smdk4210_camera->requests_head + 1) % SMDK4210_CAMERA_REQUESTS_COUNT;
+		smdk4210_camera->requests_count--;
 
-		if (focus_mode != smdk4210_camera->focus_mode || force) {
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_FOCUS_MODE, focus_mode);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
-		}
+		request.frame = frame + SMDK4210_CAMERA_REQUEST_LATENCY;
 
-		if (focus_mode == FOCUS_MODE_TOUCH) {
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_TOUCH_AF_START_STOP, 1);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
-		} else if (smdk4210_camera->focus_mode == FOCUS_MODE_TOUCH) {
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_TOUCH_AF_START_STOP, 0);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
-		}
+		memcpy(&smdk4210_camera->requests_in_flight[smdk4210_camera->requests_in_flight_count], &request,
+			sizeof(request));
+		smdk4210_camera->requests_in_flight_count++;
 
-		smdk4210_camera->focus_mode = focus_mode;
+		issued = 1;
 	}
 
-	// Zoom
-	zoom_supported_string = smdk4210_param_string_get(smdk4210_camera, "zoom-supported");
-	if (zoom_supported_string != NULL && strcmp(zoom_supported_string, "true") == 0) {
-		zoom = smdk4210_param_int_get(smdk4210_camera, "zoom");
-		max_zoom = smdk4210_param_int_get(smdk4210_camera, "max-zoom");
-		if (zoom <= max_zoom && zoom >= 0 && (zoom != smdk4210_camera->zoom || force)) {
-			smdk4210_camera->zoom = zoom;
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_ZOOM, zoom);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
+	// Controls that a request still in flight sets are left alone
+	for (i = 0; i < restore_count; i++) {
+		if (smdk4210_camera_request_control_in_flight(smdk4210_camera, restore[i].id)) {
+			memmove(&restore[i], &restore[i + 1], (restore_count - i - 1) * sizeof(struct smdk4210_camera_control));
+			restore_count--;
+			i--;
 		}
-
 	}
 
-	// Flash
-	flash_mode_string = smdk4210_param_string_get(smdk4210_camera, "flash-mode");
-	if (flash_mode_string != NULL) {
-		if (strcmp(flash_mode_string, "off") == 0)
-			flash_mode = FLASH_MODE_OFF;
-		else if (strcmp(flash_mode_string, "auto") == 0)
-			flash_mode = FLASH_MODE_AUTO;
-		else if (strcmp(flash_mode_string, "on") == 0)
-			flash_mode = FLASH_MODE_ON;
-		else if (strcmp(flash_mode_string, "torch") == 0)
-			flash_mode = FLASH_MODE_TORCH;
-		else
-			flash_mode = FLASH_MODE_AUTO;
+	pthread_mutex_unlock(&smdk4210_camera->request_mutex);
 
-		if (flash_mode != smdk4210_camera->flash_mode || force) {
-			smdk4210_camera->flash_mode = flash_mode;
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_FLASH_MODE, flash_mode);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
+	smdk4210_camera_request_restore(smdk4210_camera, restore, restore_count);
+
+	if (!issued)
+		return;
+
+	// Set right away rather than through the control thread, to keep the timing
+	for (i = 0; i < request.controls_count; i++) {
+		rc = smdk4210_camera_request_control_set(smdk4210_camera, request.controls[i].id,
+			request.controls[i].value);
+		if (rc < 0) {
+			ALOGE("%s: s ctrl failed!", __func__);
+			request.status = -1;
+
+			// The driver is left with the session value, when there is one
+			if (smdk4210_camera_control_value_get(smdk4210_camera, request.controls[i].id, &value) == 0) {
+				request.controls[i].value = value;
+			} else {
+				memmove(&request.controls[i], &request.controls[i + 1],
+					(request.controls_count - i - 1) * sizeof(struct smdk4210_camera_control));
+				request.controls_count--;
+				i--;
+			}
 		}
 	}
 
-	// Exposure
-	exposure_compensation = smdk4210_param_int_get(smdk4210_camera, "exposure-compensation");
-	min_exposure_compensation = smdk4210_param_int_get(smdk4210_camera, "min-exposure-compensation");
-	max_exposure_compensation = smdk4210_param_int_get(smdk4210_camera, "max-exposure-compensation");
+	if (request.status == 0)
+		return;
 
-	if (exposure_compensation <= max_exposure_compensation && exposure_compensation >= min_exposure_compensation &&
-		(exposure_compensation != smdk4210_camera->exposure_compensation || force)) {
-		smdk4210_camera->exposure_compensation = exposure_compensation;
-		rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_BRIGHTNESS, exposure_compensation);
-		if (rc < 0)
-			ALOGE("%s: s ctrl failed!", __func__);
+	// Results report the controls as applied
+	pthread_mutex_lock(&smdk4210_camera->request_mutex);
+
+	for (i = 0; i < smdk4210_camera->requests_in_flight_count; i++) {
+		if (smdk4210_camera->requests_in_flight[i].id == request.id) {
+			memcpy(smdk4210_camera->requests_in_flight[i].controls, request.controls,
+				sizeof(request.controls));
+			smdk4210_camera->requests_in_flight[i].controls_count = request.controls_count;
+			smdk4210_camera->requests_in_flight[i].status = request.status;
+			break;
+		}
 	}
 
-	// WB
-	whitebalance_string = smdk4210_param_string_get(smdk4210_camera, "whitebalance");
-	if (whitebalance_string != NULL) {
-		if (strcmp(whitebalance_string, "auto") == 0)
-			whitebalance = WHITE_BALANCE_AUTO;
-		else if (strcmp(whitebalance_string, "incandescent") == 0)
-			whitebalance = WHITE_BALANCE_TUNGSTEN;
-		else if (strcmp(whitebalance_string, "fluorescent") == 0)
-			whitebalance = WHITE_BALANCE_FLUORESCENT;
+	pthread_mutex_unlock(&smdk4210_camera->request_mutex);
+}
+
+void smdk4210_camera_request_abort(struct smdk4210_camera *smdk4210_camera)
+{
+	struct smdk4210_camera_control restore[SMDK4210_CAMERA_REQUEST_LATENCY * SMDK4210_CAMERA_REQUEST_CONTROLS_COUNT];
+	struct smdk4210_camera_request request;
+	int restore_count = 0;
+
+	if (smdk4210_camera == NULL)
+		return;
+
+	pthread_mutex_lock(&smdk4210_camera->request_mutex);
+
+	// In flight first, to keep the completion order
+	while (smdk4210_camera->requests_in_flight_count > 0 || smdk4210_camera->requests_count > 0) {
+		if (smdk4210_camera->requests_in_flight_count > 0) {
+			memcpy(&request, &smdk4210_camera->requests_in_flight[0], sizeof(request));
+
+			smdk4210_camera->requests_in_flight_count--;
+			memmove(&smdk4210_camera->requests_in_flight[0], &smdk4210_camera->requests_in_flight[1],
+				smdk4210_camera->requests_in_flight_count * sizeof(struct smdk4210_camera_request));
+
+			// Its controls were set already
+			restore_count = smdk4210_camera_request_restore_add(restore, restore_count, &request);
+		} else {
+			memcpy(&request, &smdk4210_camera->requests[smdk4210_camera->requests_head], sizeof(request));
+			smdk4210_camera->requests_head = (smdk4210_camera->requests_head + 1) % SMDK4210_CAMERA_REQUESTS_COUNT;
+			smdk4210_camera->requests_count--;
+		}
+
+		pthread_mutex_unlock(&smdk4210_camera->request_mutex);
+		smdk4210_camera_request_complete(smdk4210_camera, &request, NULL, 0, 0);
+		pthread_mutex_lock(&smdk4210_camera->request_mutex);
+	}
+
+	pthread_mutex_unlock(&smdk4210_camera->request_mutex);
+
+	smdk4210_camera_request_restore(smdk4210_camera, restore, restore_count);
+}
+
+// Params
+
+int smdk4210_camera_sensor_frame_rate(struct smdk4210_camera *smdk4210_camera,
+	int fps)
+{
+	int sensor_fps = 0;
+	int value;
+	char *k;
+
+	if (smdk4210_camera == NULL || fps <= 0)
+		return -EINVAL;
+
+	// Pick the lowest advertised rate that is at least the requested one
+	k = smdk4210_param_string_get(smdk4210_camera, "preview-frame-rate-values");
+	while (k != NULL) {
+		if (sscanf(k, "%d", &value) == 1 && value >= fps &&
+			(sensor_fps == 0 || value < sensor_fps))
+			sensor_fps = value;
+
+		k = strchr(k, ',');
+		if (k == NULL)
+			break;
+
+		k++;
+	}
+
+	if (sensor_fps == 0)
+		sensor_fps = fps;
+
+	return sensor_fps;
+}
+
+// Zoom ratio in percents, from the advertised ratios
+int smdk4210_camera_zoom_ratio(struct smdk4210_camera *smdk4210_camera, int zoom)
+{
+	int ratio = 100;
+	int i;
+	char *k;
+
+	if (smdk4210_camera == NULL || zoom < 0)
+		return -EINVAL;
+
+	k = smdk4210_param_string_get(smdk4210_camera, "zoom-ratios");
+	for (i = 0; k != NULL && i < zoom; i++) {
+		k = strchr(k, ',');
+		if (k != NULL)
+			k++;
+	}
+
+	if (k == NULL || sscanf(k, "%d", &ratio) != 1 || ratio < 100)
+		ratio = 100;
+
+	return ratio;
+}
+
+int smdk4210_camera_params_init(struct smdk4210_camera *smdk4210_camera, int id)
+{
+	int rc;
+
+	if (smdk4210_camera == NULL || id >= smdk4210_camera->config->presets_count)
+		return -EINVAL;
+
+	// Camera params
+	smdk4210_camera->camera_rotation = smdk4210_camera->config->presets[id].rotation;
+	smdk4210_camera->camera_hflip = smdk4210_camera->config->presets[id].hflip;
+	smdk4210_camera->camera_vflip = smdk4210_camera->config->presets[id].vflip;
+	smdk4210_camera->camera_software_zoom = smdk4210_camera->config->presets[id].software_zoom;
+	smdk4210_camera->camera_picture_format = smdk4210_camera->config->presets[id].picture_format;
+	smdk4210_camera->camera_focal_length = (int) (smdk4210_camera->config->presets[id].focal_length * 100);
+	smdk4210_camera->camera_metering = smdk4210_camera->config->presets[id].metering;
+	smdk4210_camera->camera_hfr_width = smdk4210_camera->config->presets[id].hfr_width;
+	smdk4210_camera->camera_hfr_height = smdk4210_camera->config->presets[id].hfr_height;
+
+	// Recording preview
+	smdk4210_param_string_set(smdk4210_camera, "preferred-preview-size-for-video",
+		smdk4210_camera->config->presets[id].params.preview_size);
+
+	// Preview
+	smdk4210_param_string_set(smdk4210_camera, "preview-size-values",
+		smdk4210_camera->config->presets[id].params.preview_size_values);
+	smdk4210_param_string_set(smdk4210_camera, "preview-size",
+		smdk4210_camera->config->presets[id].params.preview_size);
+	smdk4210_param_string_set(smdk4210_camera, "preview-format-values",
+		smdk4210_camera->config->presets[id].params.preview_format_values);
+	smdk4210_param_string_set(smdk4210_camera, "preview-format",
+		smdk4210_camera->config->presets[id].params.preview_format);
+	smdk4210_param_string_set(smdk4210_camera, "preview-frame-rate-values",
+		smdk4210_camera->config->presets[id].params.preview_frame_rate_values);
+	smdk4210_param_int_set(smdk4210_camera, "preview-frame-rate",
+		smdk4210_camera->config->presets[id].params.preview_frame_rate);
+	smdk4210_param_string_set(smdk4210_camera, "preview-fps-range-values",
+		smdk4210_camera->config->presets[id].params.preview_fps_range_values);
+	smdk4210_param_string_set(smdk4210_camera, "preview-fps-range",
+		smdk4210_camera->config->presets[id].params.preview_fps_range);
+
+	// Picture
+	smdk4210_param_string_set(smdk4210_camera, "picture-size-values",
+		smdk4210_camera->config->presets[id].params.picture_size_values);
+	smdk4210_param_string_set(smdk4210_camera, "picture-size",
+		smdk4210_camera->config->presets[id].params.picture_size);
+	smdk4210_param_string_set(smdk4210_camera, "picture-format-values",
+		smdk4210_camera->config->presets[id].params.picture_format_values);
+	smdk4210_param_string_set(smdk4210_camera, "picture-format",
+		smdk4210_camera->config->presets[id].params.picture_format);
+	smdk4210_param_string_set(smdk4210_camera, "jpeg-thumbnail-size-values",
+		smdk4210_camera->config->presets[id].params.jpeg_thumbnail_size_values);
+	smdk4210_param_int_set(smdk4210_camera, "jpeg-thumbnail-width",
+		smdk4210_camera->config->presets[id].params.jpeg_thumbnail_width);
+	smdk4210_param_int_set(smdk4210_camera, "jpeg-thumbnail-height",
+		smdk4210_camera->config->presets[id].params.jpeg_thumbnail_height);
+	smdk4210_param_int_set(smdk4210_camera, "jpeg-thumbnail-quality",
+		smdk4210_camera->config->presets[id].params.jpeg_thumbnail_quality);
+	smdk4210_param_int_set(smdk4210_camera, "jpeg-quality",
+		smdk4210_camera->config->presets[id].params.jpeg_quality);
+
+	// Recording
+	smdk4210_param_string_set(smdk4210_camera, "video-size",
+		smdk4210_camera->config->presets[id].params.recording_size);
+	smdk4210_param_string_set(smdk4210_camera, "video-size-values",
+		smdk4210_camera->config->presets[id].params.recording_size_values);
+	smdk4210_param_string_set(smdk4210_camera, "video-frame-format",
+		smdk4210_camera->config->presets[id].params.recording_format);
+	smdk4210_param_string_set(smdk4210_camera, "video-snapshot-supported", "true");
+
+	if (smdk4210_camera->config->presets[id].params.video_hfr_values != NULL) {
+		smdk4210_param_string_set(smdk4210_camera, "video-hfr",
+			smdk4210_camera->config->presets[id].params.video_hfr);
+		smdk4210_param_string_set(smdk4210_camera, "video-hfr-values",
+			smdk4210_camera->config->presets[id].params.video_hfr_values);
+	}
+
+	// Focus
+	smdk4210_param_string_set(smdk4210_camera, "focus-mode",
+		smdk4210_camera->config->presets[id].params.focus_mode);
+	smdk4210_param_string_set(smdk4210_camera, "focus-mode-values",
+		smdk4210_camera->config->presets[id].params.focus_mode_values);
+	smdk4210_param_string_set(smdk4210_camera, "focus-distances",
+		smdk4210_camera->config->presets[id].params.focus_distances);
+	if (smdk4210_camera->config->presets[id].params.max_num_focus_areas > 0) {
+		smdk4210_param_string_set(smdk4210_camera, "focus-areas",
+			smdk4210_camera->config->presets[id].params.focus_areas);
+		smdk4210_param_int_set(smdk4210_camera, "max-num-focus-areas",
+			smdk4210_camera->config->presets[id].params.max_num_focus_areas);
+	}
+
+	// Face detection is done in software, on preview frames
+	smdk4210_param_int_set(smdk4210_camera, "max-num-detected-faces-hw", 0);
+	smdk4210_param_int_set(smdk4210_camera, "max-num-detected-faces-sw", SMDK4210_FACE_MAX_COUNT);
+
+	// Low-light capture merges a burst of frames in software, when they come as YUV
+	smdk4210_param_string_set(smdk4210_camera, "low-light-capture", "off");
+	if (smdk4210_burst_format_supported(smdk4210_camera->camera_picture_format))
+		smdk4210_param_string_set(smdk4210_camera, "low-light-capture-values", "off,on");
+	else
+		smdk4210_param_string_set(smdk4210_camera, "low-light-capture-values", "off");
+
+	// Zoom
+	if (smdk4210_camera->config->presets[id].params.zoom_supported == 1) {
+		smdk4210_param_string_set(smdk4210_camera, "zoom-supported", "true");
+
+		if (smdk4210_camera->config->presets[id].params.smooth_zoom_supported == 1)
+			smdk4210_param_string_set(smdk4210_camera, "smooth-zoom-supported", "true");
+
+		if (smdk4210_camera->config->presets[id].params.zoom_ratios != NULL)
+			smdk4210_param_string_set(smdk4210_camera, "zoom-ratios", smdk4210_camera->config->presets[id].params.zoom_ratios);
+
+		smdk4210_param_int_set(smdk4210_camera, "zoom", smdk4210_camera->config->presets[id].params.zoom);
+		smdk4210_param_int_set(smdk4210_camera, "max-zoom", smdk4210_camera->config->presets[id].params.max_zoom);
+
+	} else {
+		smdk4210_param_string_set(smdk4210_camera, "zoom-supported", "false");
+	}
+
+	// Flash
+	smdk4210_param_string_set(smdk4210_camera, "flash-mode",
+		smdk4210_camera->config->presets[id].params.flash_mode);
+	smdk4210_param_string_set(smdk4210_camera, "flash-mode-values",
+		smdk4210_camera->config->presets[id].params.flash_mode_values);
+
+	// Exposure
+	smdk4210_param_int_set(smdk4210_camera, "exposure-compensation",
+		smdk4210_camera->config->presets[id].params.exposure_compensation);
+	smdk4210_param_float_set(smdk4210_camera, "exposure-compensation-step",
+		smdk4210_camera->config->presets[id].params.exposure_compensation_step);
+	smdk4210_param_int_set(smdk4210_camera, "min-exposure-compensation",
+		smdk4210_camera->config->presets[id].params.min_exposure_compensation);
+	smdk4210_param_int_set(smdk4210_camera, "max-exposure-compensation",
+		smdk4210_camera->config->presets[id].params.max_exposure_compensation);
+
+	// WB
+	smdk4210_param_string_set(smdk4210_camera, "whitebalance",
+		smdk4210_camera->config->presets[id].params.whitebalance);
+	smdk4210_param_string_set(smdk4210_camera, "whitebalance-values",
+		smdk4210_camera->config->presets[id].params.whitebalance_values);
+
+	// Scene mode
+	smdk4210_param_string_set(smdk4210_camera, "scene-mode",
+		smdk4210_camera->config->presets[id].params.scene_mode);
+	smdk4210_param_string_set(smdk4210_camera, "scene-mode-values",
+		smdk4210_camera->config->presets[id].params.scene_mode_values);
+
+	// Effect
+	smdk4210_param_string_set(smdk4210_camera, "effect",
+		smdk4210_camera->config->presets[id].params.effect);
+	smdk4210_param_string_set(smdk4210_camera, "effect-values",
+		smdk4210_camera->config->presets[id].params.effect_values);
+
+	// ISO
+	smdk4210_param_string_set(smdk4210_camera, "iso",
+		smdk4210_camera->config->presets[id].params.iso);
+	smdk4210_param_string_set(smdk4210_camera, "iso-values",
+		smdk4210_camera->config->presets[id].params.iso_values);
+
+	// Camera
+	smdk4210_param_float_set(smdk4210_camera, "focal-length",
+		smdk4210_camera->config->presets[id].focal_length);
+	smdk4210_param_float_set(smdk4210_camera, "horizontal-view-angle",
+		smdk4210_camera->config->presets[id].horizontal_view_angle);
+	smdk4210_param_float_set(smdk4210_camera, "vertical-view-angle",
+		smdk4210_camera->config->presets[id].vertical_view_angle);
+
+	rc = smdk4210_camera_params_apply(smdk4210_camera);
+	if (rc < 0) {
+		ALOGE("%s: Unable to apply params", __func__);
+		return -1;
+	}
+
+	return 0;
+}
+
+int smdk4210_camera_params_apply(struct smdk4210_camera *smdk4210_camera)
+{
+	struct smdk4210_camera_preview_config preview_config;
+
+	char *recording_hint_string;
+	char *recording_preview_size_string;
+
+	char *preview_size_string;
+	int preview_width = 0;
+	int preview_height = 0;
+	char *preview_format_string;
+	int preview_format;
+	int preview_fps;
+	char *preview_fps_range_string;
+	int preview_fps_min = 0;
+	int preview_fps_max = 0;
+	int preview_rotation;
+
+	char *picture_size_string;
+	int picture_width = 0;
+	int picture_height = 0;
+	char *picture_format_string;
+	int picture_format;
+
+	int jpeg_thumbnail_width;
+	int jpeg_thumbnail_height;
+	int jpeg_thumbnail_quality;
+	int jpeg_quality;
+
+	char *low_light_capture_string;
+
+	char *video_size_string;
+	int recording_width = 0;
+	int recording_height = 0;
+	char *video_frame_format_string;
+	int recording_format;
+	int recording_fps;
+	char *video_hfr_string;
+	int hfr = 0;
+	int camera_sensor_mode;
+	int camera_sensor_output_size;
+	int camera_frame_rate;
+
+	char *focus_mode_string;
+	int focus_mode = 0;
+	char *focus_areas_string;
+	int focus_left, focus_top, focus_right, focus_bottom, focus_weigth;
+	int focus_x;
+	int focus_y;
+
+	char *zoom_supported_string;
+	int zoom, max_zoom;
+
+	char *flash_mode_string;
+	int flash_mode;
+
+	int exposure_compensation;
+	int min_exposure_compensation;
+	int max_exposure_compensation;
+
+	char *whitebalance_string;
+	int whitebalance;
+
+	char *scene_mode_string;
+	int scene_mode;
+
+	char *effect_string;
+	int effect;
+
+	char *iso_string;
+	int iso;
+
+	int force = 0;
+
+	int w, h;
+	char *k;
+	int rc;
+
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
+
+	// Settings are read, changed and published by one writer at a time
+	pthread_mutex_lock(&smdk4210_camera->preview_config_mutex);
+
+	if (!smdk4210_camera->preview_params_set) {
+		ALOGE("%s: Setting preview params", __func__);
+		smdk4210_camera->preview_params_set = 1;
+		force = 1;
+	}
+
+	// Preview settings start from the last published ones, not the ones in use
+	rc = smdk4210_camera_preview_config_get(smdk4210_camera, &preview_config);
+	if (rc < 0) {
+		memset(&preview_config, 0, sizeof(preview_config));
+		preview_config.width = smdk4210_camera->preview_width;
+		preview_config.height = smdk4210_camera->preview_height;
+		preview_config.format = smdk4210_camera->preview_format;
+		preview_config.fps = smdk4210_camera->preview_fps;
+		preview_config.hfr = smdk4210_camera->hfr;
+		preview_config.recording_fps = smdk4210_camera->recording_fps;
+		preview_config.rotation = smdk4210_camera->preview_rotation;
+		preview_config.fps_min = smdk4210_camera->preview_fps_min;
+		preview_config.fps_max = smdk4210_camera->preview_fps_max;
+		preview_config.recording_width = smdk4210_camera->recording_width;
+		preview_config.recording_height = smdk4210_camera->recording_height;
+		preview_config.recording_format = smdk4210_camera->recording_format;
+		preview_config.zoom_ratio = smdk4210_camera->zoom_ratio;
+		preview_config.low_light = smdk4210_camera->low_light;
+	}
+
+	// Preview
+	preview_size_string = smdk4210_param_string_get(smdk4210_camera, "preview-size");
+	if (preview_size_string != NULL) {
+		sscanf(preview_size_string, "%dx%d", &preview_width, &preview_height);
+
+		if (preview_width != 0 && preview_width != preview_config.width)
+			preview_config.width = preview_width;
+		if (preview_height != 0 && preview_height != preview_config.height)
+			preview_config.height = preview_height;
+	}
+
+	preview_format_string = smdk4210_param_string_get(smdk4210_camera, "preview-format");
+	if (preview_format_string != NULL) {
+		if (strcmp(preview_format_string, "yuv420sp") == 0) {
+			preview_format = V4L2_PIX_FMT_NV21;
+		} else if (strcmp(preview_format_string, "yuv420p") == 0) {
+			preview_format = V4L2_PIX_FMT_YUV420;
+		} else if (strcmp(preview_format_string, "rgb565") == 0) {
+			preview_format = V4L2_PIX_FMT_RGB565;
+		} else if (strcmp(preview_format_string, "rgb8888") == 0) {
+			preview_format = V4L2_PIX_FMT_RGB32;
+		} else {
+			ALOGE("%s: Unsupported preview format: %s", __func__, preview_format_string);
+			preview_format = V4L2_PIX_FMT_NV21;
+		}
+
+		if (preview_format != preview_config.format)
+			preview_config.format = preview_format;
+	}
+
+	// Preview frames are turned on top of the sensor mounting
+	preview_rotation = smdk4210_param_int_get(smdk4210_camera, "rotation");
+	if (preview_rotation == 90 || preview_rotation == 180 || preview_rotation == 270)
+		preview_config.rotation = preview_rotation;
+	else
+		preview_config.rotation = 0;
+
+	preview_fps = smdk4210_param_int_get(smdk4210_camera, "preview-frame-rate");
+	if (preview_fps > 0)
+		preview_config.fps = preview_fps;
+	else
+		preview_config.fps = 0;
+
+	preview_fps_range_string = smdk4210_param_string_get(smdk4210_camera, "preview-fps-range");
+	if (preview_fps_range_string != NULL) {
+		rc = sscanf(preview_fps_range_string, "%d,%d", &preview_fps_min, &preview_fps_max);
+		if (rc == 2 && preview_fps_min > 0 && preview_fps_min <= preview_fps_max) {
+			preview_config.fps_min = preview_fps_min / 1000;
+			preview_config.fps_max = preview_fps_max / 1000;
+		} else {
+			ALOGE("%s: Invalid preview fps range: %s", __func__, preview_fps_range_string);
+		}
+	}
+
+	// Picture
+	picture_size_string = smdk4210_param_string_get(smdk4210_camera, "picture-size");
+	if (picture_size_string != NULL) {
+		sscanf(picture_size_string, "%dx%d", &picture_width, &picture_height);
+
+		if (picture_width != 0 && picture_width != smdk4210_camera->picture_width)
+			smdk4210_camera->picture_width = picture_width;
+		if (picture_height != 0 && picture_height != smdk4210_camera->picture_height)
+			smdk4210_camera->picture_height = picture_height;
+	}
+
+	picture_format_string = smdk4210_param_string_get(smdk4210_camera, "picture-format");
+	if (picture_format_string != NULL) {
+		if (strcmp(picture_format_string, "jpeg") == 0) {
+			picture_format = V4L2_PIX_FMT_JPEG;
+		} else {
+			ALOGE("%s: Unsupported picture format: %s", __func__, picture_format_string);
+			picture_format = V4L2_PIX_FMT_JPEG;
+		}
+
+		if (picture_format != smdk4210_camera->picture_format)
+			smdk4210_camera->picture_format = picture_format;
+	}
+
+	jpeg_thumbnail_width = smdk4210_param_int_get(smdk4210_camera, "jpeg-thumbnail-width");
+	if (jpeg_thumbnail_width > 0)
+		smdk4210_camera->jpeg_thumbnail_width = jpeg_thumbnail_width;
+
+	jpeg_thumbnail_height = smdk4210_param_int_get(smdk4210_camera, "jpeg-thumbnail-height");
+	if (jpeg_thumbnail_height > 0)
+		smdk4210_camera->jpeg_thumbnail_height = jpeg_thumbnail_height;
+
+	jpeg_thumbnail_quality = smdk4210_param_int_get(smdk4210_camera, "jpeg-thumbnail-quality");
+	if (jpeg_thumbnail_quality > 0)
+		smdk4210_camera->jpeg_thumbnail_quality = jpeg_thumbnail_quality;
+
+	jpeg_quality = smdk4210_param_int_get(smdk4210_camera, "jpeg-quality");
+	if (jpeg_quality <= 100 && jpeg_quality >= 0 && (jpeg_quality != smdk4210_camera->jpeg_quality || force)) {
+		smdk4210_camera->jpeg_quality = jpeg_quality;
+		rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAM_JPEG_QUALITY, jpeg_quality);
+		if (rc < 0)
+			ALOGE("%s: Unable to queue control", __func__);
+	}
+
+	low_light_capture_string = smdk4210_param_string_get(smdk4210_camera, "low-light-capture");
+	if (low_light_capture_string != NULL) {
+		preview_config.low_light = strcmp(low_light_capture_string, "on") == 0;
+
+		// Frames are merged in the sensor's format, which has to be packed YUV
+		if (preview_config.low_light && !smdk4210_burst_format_supported(smdk4210_camera->camera_picture_format)) {
+			ALOGE("%s: Low-light capture is not available", __func__);
+			preview_config.low_light = 0;
+		}
+	}
+
+	// Recording
+	video_size_string = smdk4210_param_string_get(smdk4210_camera, "video-size");
+	if (video_size_string == NULL)
+		video_size_string = smdk4210_param_string_get(smdk4210_camera, "preview-size");
+
+	if (video_size_string != NULL) {
+		sscanf(video_size_string, "%dx%d", &recording_width, &recording_height);
+
+		if (recording_width != 0 && recording_width != preview_config.recording_width)
+			preview_config.recording_width = recording_width;
+		if (recording_height != 0 && recording_height != preview_config.recording_height)
+			preview_config.recording_height = recording_height;
+	}
+
+	video_frame_format_string = smdk4210_param_string_get(smdk4210_camera, "video-frame-format");
+	if (video_frame_format_string != NULL) {
+		if (strcmp(video_frame_format_string, "yuv420sp") == 0) {
+			recording_format = V4L2_PIX_FMT_NV12;
+		} else if (strcmp(video_frame_format_string, "yuv420p") == 0) {
+			recording_format = V4L2_PIX_FMT_YUV420;
+		} else if (strcmp(video_frame_format_string, "rgb565") == 0) {
+			recording_format = V4L2_PIX_FMT_RGB565;
+		} else if (strcmp(video_frame_format_string, "rgb8888") == 0) {
+			recording_format = V4L2_PIX_FMT_RGB32;
+		} else {
+			ALOGE("%s: Unsupported recording format: %s", __func__, video_frame_format_string);
+			recording_format = V4L2_PIX_FMT_NV12;
+		}
+
+		if (recording_format != preview_config.recording_format)
+			preview_config.recording_format = recording_format;
+	}
+
+	// A fixed fps range takes precedence over the legacy preview frame rate
+	if (preview_config.fps_min > 0 && preview_config.fps_min == preview_config.fps_max)
+		recording_fps = preview_config.fps_max;
+	else if (preview_config.fps > 0)
+		recording_fps = preview_config.fps;
+	else
+		recording_fps = preview_config.fps_max;
+
+	if (preview_config.fps_max > 0 && recording_fps > preview_config.fps_max)
+		recording_fps = preview_config.fps_max;
+
+	if (recording_fps > 0)
+		preview_config.recording_fps = recording_fps;
+
+	// High frame rate, only available at low resolutions
+	video_hfr_string = smdk4210_param_string_get(smdk4210_camera, "video-hfr");
+	if (video_hfr_string != NULL && strcmp(video_hfr_string, "off") != 0) {
+		hfr = atoi(video_hfr_string);
+
+		if (hfr != FRAME_RATE_60) {
+			ALOGE("%s: Unsupported HFR mode: %s", __func__, video_hfr_string);
+			hfr = 0;
+		} else if (preview_config.width > smdk4210_camera->camera_hfr_width ||
+			preview_config.height > smdk4210_camera->camera_hfr_height) {
+			ALOGE("%s: HFR is not available at %dx%d", __func__,
+				preview_config.width, preview_config.height);
+			hfr = 0;
+		} else if (preview_config.recording_width > preview_config.width ||
+			preview_config.recording_height > preview_config.height) {
+			// The sensor outputs the preview size in HFR, videos can't exceed it
+			ALOGE("%s: HFR is not available for %dx%d videos at %dx%d", __func__,
+				preview_config.recording_width, preview_config.recording_height,
+				preview_config.width, preview_config.height);
+			hfr = 0;
+		}
+	}
+
+	preview_config.hfr = hfr;
+
+	recording_hint_string = smdk4210_param_string_get(smdk4210_camera, "recording-hint");
+	if (hfr > 0) {
+		camera_sensor_mode = SENSOR_MOVIE;
+
+		preview_config.recording_fps = hfr;
+
+		camera_sensor_output_size = ((preview_config.width & 0xffff) << 16) |
+			(preview_config.height & 0xffff);
+		rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_SENSOR_OUTPUT_SIZE,
+			camera_sensor_output_size);
+		if (rc < 0)
+			ALOGE("%s: Unable to queue control", __func__);
+
+		camera_frame_rate = hfr;
+	} else if (recording_hint_string != NULL && strcmp(recording_hint_string, "true") == 0) {
+		camera_sensor_mode = SENSOR_MOVIE;
+
+		k = smdk4210_param_string_get(smdk4210_camera, "preview-size-values");
+		while (recording_width != 0 && recording_height != 0) {
+			if (k == NULL)
+				break;
+
+			sscanf(k, "%dx%d", &w, &h);
+
+			// Look for same aspect ratio
+			if ((recording_width * h) / recording_height == w) {
+				preview_width = w;
+				preview_height = h;
+				break;
+			}
+
+			k = strchr(k, ',');
+			if (k == NULL)
+				break;
+
+			k++;
+		}
+
+		if (preview_width != 0 && preview_width != preview_config.width)
+			preview_config.width = preview_width;
+		if (preview_height != 0 && preview_height != preview_config.height)
+			preview_config.height = preview_height;
+
+		camera_sensor_output_size = ((recording_width & 0xffff) << 16) | (recording_height & 0xffff);
+		rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_SENSOR_OUTPUT_SIZE,
+			camera_sensor_output_size);
+		if (rc < 0)
+			ALOGE("%s: Unable to queue control", __func__);
+
+		// Frames above the recording rate are decimated in the recording path
+		camera_frame_rate = smdk4210_camera_sensor_frame_rate(smdk4210_camera,
+			preview_config.recording_fps);
+	} else {
+		camera_sensor_mode = SENSOR_CAMERA;
+		camera_frame_rate = FRAME_RATE_AUTO;
+	}
+
+	if (camera_frame_rate >= 0 && (camera_frame_rate != smdk4210_camera->camera_frame_rate || force)) {
+		smdk4210_camera->camera_frame_rate = camera_frame_rate;
+		rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_FRAME_RATE, camera_frame_rate);
+		if (rc < 0)
+			ALOGE("%s: Unable to queue control", __func__);
+	}
+
+	// Switching modes
+	if (camera_sensor_mode != smdk4210_camera->camera_sensor_mode) {
+		smdk4210_camera->camera_sensor_mode = camera_sensor_mode;
+		rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_SENSOR_MODE, camera_sensor_mode);
+		if (rc < 0)
+			ALOGE("%s: Unable to queue control", __func__);
+	}
+
+	// Focus
+	focus_areas_string = smdk4210_param_string_get(smdk4210_camera, "focus-areas");
+	if (focus_areas_string != NULL) {
+		focus_left = focus_top = focus_right = focus_bottom = focus_weigth = 0;
+
+		rc = sscanf(focus_areas_string, "(%d,%d,%d,%d,%d)",
+			&focus_left, &focus_top, &focus_right, &focus_bottom, &focus_weigth);
+		if (rc != 5) {
+			ALOGE("%s: sscanf failed!", __func__);
+		} else if (focus_left != 0 && focus_top != 0 && focus_right != 0 && focus_bottom != 0) {
+			focus_x = (((focus_left + focus_right) / 2) + 1000) * preview_width / 2000;
+			focus_y =  (((focus_top + focus_bottom) / 2) + 1000) * preview_height / 2000;
+
+			if (focus_x != smdk4210_camera->focus_x || force) {
+				smdk4210_camera->focus_x = focus_x;
+
+				rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_OBJECT_POSITION_X, focus_x);
+				if (rc < 0)
+					ALOGE("%s: Unable to queue control", __func__);
+			}
+
+			if (focus_y != smdk4210_camera->focus_y || force) {
+				smdk4210_camera->focus_y = focus_y;
+
+				rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_OBJECT_POSITION_Y, focus_y);
+				if (rc < 0)
+					ALOGE("%s: Unable to queue control", __func__);
+			}
+
+			focus_mode = FOCUS_MODE_TOUCH;
+		}
+	}
+
+	focus_mode_string = smdk4210_param_string_get(smdk4210_camera, "focus-mode");
+	if (focus_mode_string != NULL) {
+		if (focus_mode == 0) {
+			if (strcmp(focus_mode_string, "auto") == 0)
+				focus_mode = FOCUS_MODE_AUTO;
+			else if (strcmp(focus_mode_string, "infinity") == 0)
+				focus_mode = FOCUS_MODE_INFINITY;
+			else if (strcmp(focus_mode_string, "macro") == 0)
+				focus_mode = FOCUS_MODE_MACRO;
+			else if (strcmp(focus_mode_string, "fixed") == 0)
+				focus_mode = FOCUS_MODE_FIXED;
+			else if (strcmp(focus_mode_string, "facedetect") == 0)
+				focus_mode = FOCUS_MODE_FACEDETECT;
+			else if (strcmp(focus_mode_string, "continuous-video") == 0)
+				focus_mode = FOCUS_MODE_CONTINOUS;
+			else if (strcmp(focus_mode_string, "continuous-picture") == 0)
+				focus_mode = FOCUS_MODE_CONTINOUS;
+			else
+				focus_mode = FOCUS_MODE_AUTO;
+		}
+
+		if (focus_mode != smdk4210_camera->focus_mode || force) {
+			rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_FOCUS_MODE, focus_mode);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue control", __func__);
+		}
+
+		if (focus_mode == FOCUS_MODE_TOUCH) {
+			rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_TOUCH_AF_START_STOP, 1);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue control", __func__);
+		} else if (smdk4210_camera->focus_mode == FOCUS_MODE_TOUCH) {
+			rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_TOUCH_AF_START_STOP, 0);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue control", __func__);
+		}
+
+		smdk4210_camera->focus_mode = focus_mode;
+	}
+
+	// Zoom
+	zoom_supported_string = smdk4210_param_string_get(smdk4210_camera, "zoom-supported");
+	if (zoom_supported_string != NULL && strcmp(zoom_supported_string, "true") == 0) {
+		zoom = smdk4210_param_int_get(smdk4210_camera, "zoom");
+		max_zoom = smdk4210_param_int_get(smdk4210_camera, "max-zoom");
+		if (zoom <= max_zoom && zoom >= 0 && (zoom != smdk4210_camera->zoom || force)) {
+			smdk4210_camera->zoom = zoom;
+
+			if (smdk4210_camera->camera_software_zoom) {
+				preview_config.zoom_ratio = smdk4210_camera_zoom_ratio(smdk4210_camera, zoom);
+			} else {
+				rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_ZOOM, zoom);
+				if (rc < 0)
+					ALOGE("%s: Unable to queue control", __func__);
+			}
+		}
+
+	}
+
+	// Flash
+	flash_mode_string = smdk4210_param_string_get(smdk4210_camera, "flash-mode");
+	if (flash_mode_string != NULL) {
+		if (strcmp(flash_mode_string, "off") == 0)
+			flash_mode = FLASH_MODE_OFF;
+		else if (strcmp(flash_mode_string, "auto") == 0)
+			flash_mode = FLASH_MODE_AUTO;
+		else if (strcmp(flash_mode_string, "on") == 0)
+			flash_mode = FLASH_MODE_ON;
+		else if (strcmp(flash_mode_string, "torch") == 0)
+			flash_mode = FLASH_MODE_TORCH;
+		else
+			flash_mode = FLASH_MODE_AUTO;
+
+		if (flash_mode != smdk4210_camera->flash_mode || force) {
+			smdk4210_camera->flash_mode = flash_mode;
+			rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_FLASH_MODE, flash_mode);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue control", __func__);
+		}
+	}
+
+	// Exposure
+	exposure_compensation = smdk4210_param_int_get(smdk4210_camera, "exposure-compensation");
+	min_exposure_compensation = smdk4210_param_int_get(smdk4210_camera, "min-exposure-compensation");
+	max_exposure_compensation = smdk4210_param_int_get(smdk4210_camera, "max-exposure-compensation");
+
+	if (exposure_compensation <= max_exposure_compensation && exposure_compensation >= min_exposure_compensation &&
+		(exposure_compensation != smdk4210_camera->exposure_compensation || force)) {
+		smdk4210_camera->exposure_compensation = exposure_compensation;
+		rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_BRIGHTNESS, exposure_compensation);
+		if (rc < 0)
+			ALOGE("%s: Unable to queue control", __func__);
+	}
+
+	// WB
+	whitebalance_string = smdk4210_param_string_get(smdk4210_camera, "whitebalance");
+	if (whitebalance_string != NULL) {
+		if (strcmp(whitebalance_string, "auto") == 0)
+			whitebalance = WHITE_BALANCE_AUTO;
+		else if (strcmp(whitebalance_string, "incandescent") == 0)
+			whitebalance = WHITE_BALANCE_TUNGSTEN;
+		else if (strcmp(whitebalance_string, "fluorescent") == 0)
+			whitebalance = WHITE_BALANCE_FLUORESCENT;
 		else if (strcmp(whitebalance_string, "daylight") == 0)
 			whitebalance = WHITE_BALANCE_SUNNY;
 		else if (strcmp(whitebalance_string, "cloudy-daylight") == 0)
@@ -840,669 +1618,1833 @@ int smdk4210_camera_params_apply(struct smdk4210_camera *smdk4210_camera)
 		else
 			whitebalance = WHITE_BALANCE_AUTO;
 
-		if (whitebalance != smdk4210_camera->whitebalance || force) {
-			smdk4210_camera->whitebalance = whitebalance;
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_WHITE_BALANCE, whitebalance);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
+		if (whitebalance != smdk4210_camera->whitebalance || force) {
+			smdk4210_camera->whitebalance = whitebalance;
+			rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_WHITE_BALANCE, whitebalance);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue control", __func__);
+		}
+	}
+
+	// Scene mode
+	scene_mode_string = smdk4210_param_string_get(smdk4210_camera, "scene-mode");
+	if (scene_mode_string != NULL) {
+		if (strcmp(scene_mode_string, "auto") == 0)
+			scene_mode = SCENE_MODE_NONE;
+		else if (strcmp(scene_mode_string, "portrait") == 0)
+			scene_mode = SCENE_MODE_PORTRAIT;
+		else if (strcmp(scene_mode_string, "landscape") == 0)
+			scene_mode = SCENE_MODE_LANDSCAPE;
+		else if (strcmp(scene_mode_string, "night") == 0)
+			scene_mode = SCENE_MODE_NIGHTSHOT;
+		else if (strcmp(scene_mode_string, "beach") == 0)
+			scene_mode = SCENE_MODE_BEACH_SNOW;
+		else if (strcmp(scene_mode_string, "snow") == 0)
+			scene_mode = SCENE_MODE_BEACH_SNOW;
+		else if (strcmp(scene_mode_string, "sunset") == 0)
+			scene_mode = SCENE_MODE_SUNSET;
+		else if (strcmp(scene_mode_string, "fireworks") == 0)
+			scene_mode = SCENE_MODE_FIREWORKS;
+		else if (strcmp(scene_mode_string, "sports") == 0)
+			scene_mode = SCENE_MODE_SPORTS;
+		else if (strcmp(scene_mode_string, "party") == 0)
+			scene_mode = SCENE_MODE_PARTY_INDOOR;
+		else if (strcmp(scene_mode_string, "candlelight") == 0)
+			scene_mode = SCENE_MODE_CANDLE_LIGHT;
+		else if (strcmp(scene_mode_string, "dusk-dawn") == 0)
+			scene_mode = SCENE_MODE_DUSK_DAWN;
+		else if (strcmp(scene_mode_string, "fall-color") == 0)
+			scene_mode = SCENE_MODE_FALL_COLOR;
+		else if (strcmp(scene_mode_string, "back-light") == 0)
+			scene_mode = SCENE_MODE_BACK_LIGHT;
+		else if (strcmp(scene_mode_string, "text") == 0)
+			scene_mode = SCENE_MODE_TEXT;
+		else
+			scene_mode = SCENE_MODE_NONE;
+
+		if (scene_mode != smdk4210_camera->scene_mode || force) {
+			smdk4210_camera->scene_mode = scene_mode;
+			rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_SCENE_MODE, scene_mode);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue control", __func__);
+		}
+	}
+
+	// Effect
+	effect_string = smdk4210_param_string_get(smdk4210_camera, "effect");
+	if (effect_string != NULL) {
+		if (strcmp(effect_string, "auto") == 0)
+			effect = IMAGE_EFFECT_NONE;
+		else if (strcmp(effect_string, "mono") == 0)
+			effect = IMAGE_EFFECT_BNW;
+		else if (strcmp(effect_string, "negative") == 0)
+			effect = IMAGE_EFFECT_NEGATIVE;
+		else if (strcmp(effect_string, "sepia") == 0)
+			effect = IMAGE_EFFECT_SEPIA;
+		else if (strcmp(effect_string, "aqua") == 0)
+			effect = IMAGE_EFFECT_AQUA;
+		else
+			effect = IMAGE_EFFECT_NONE;
+
+		if (effect != smdk4210_camera->effect || force) {
+			smdk4210_camera->effect = effect;
+			rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_EFFECT, effect);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue control", __func__);
+		}
+	}
+
+	// ISO
+	iso_string = smdk4210_param_string_get(smdk4210_camera, "iso");
+	if (iso_string != NULL) {
+		if (strcmp(iso_string, "auto") == 0)
+			iso = ISO_AUTO;
+		else if (strcmp(iso_string, "ISO50") == 0)
+			iso = ISO_50;
+		else if (strcmp(iso_string, "ISO100") == 0)
+			iso = ISO_100;
+		else if (strcmp(iso_string, "ISO200") == 0)
+			iso = ISO_200;
+		else if (strcmp(iso_string, "ISO400") == 0)
+			iso = ISO_400;
+		else if (strcmp(iso_string, "ISO800") == 0)
+			iso = ISO_800;
+		else
+			iso = ISO_AUTO;
+
+		if (iso != smdk4210_camera->iso || force) {
+			smdk4210_camera->iso = iso;
+			rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_ISO, iso);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue control", __func__);
+		}
+	}
+
+	ALOGD("%s: Preview size: %dx%d, picture size: %dx%d, recording size: %dx%d",
+		__func__, preview_width, preview_height, picture_width, picture_height,
+		recording_width, recording_height);
+
+	// A running preview thread picks the settings up between frames and restarts by itself
+	smdk4210_camera_preview_config_publish(smdk4210_camera, &preview_config);
+
+	if (!smdk4210_camera->preview_enabled)
+		smdk4210_camera_preview_config_apply(smdk4210_camera, &preview_config);
+
+	pthread_mutex_unlock(&smdk4210_camera->preview_config_mutex);
+
+	return 0;
+}
+
+void smdk4210_camera_preview_config_publish(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_preview_config *config)
+{
+	struct smdk4210_camera_preview_config *published;
+	struct smdk4210_camera_preview_config *slot;
+
+	if (smdk4210_camera == NULL || config == NULL)
+		return;
+
+	// Only one writer at a time, serialized by the preview config lock:
+	// published settings are never written to, fill the other slot and swap
+	published = smdk4210_camera->preview_config;
+	slot = published == &smdk4210_camera->preview_configs[0] ?
+		&smdk4210_camera->preview_configs[1] : &smdk4210_camera->preview_configs[0];
+
+	// The preview thread may still be copying out the previous settings
+	while (smdk4210_camera->preview_config_hazard == slot)
+		sched_yield();
+
+	memcpy(slot, config, sizeof(struct smdk4210_camera_preview_config));
+
+	__sync_synchronize();
+	smdk4210_camera->preview_config = slot;
+	__sync_synchronize();
+}
+
+int smdk4210_camera_preview_config_get(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_preview_config *config)
+{
+	struct smdk4210_camera_preview_config *published;
+
+	if (smdk4210_camera == NULL || config == NULL)
+		return -EINVAL;
+
+	// Mark the slot as in use before copying, so that it isn't refilled meanwhile
+	do {
+		published = smdk4210_camera->preview_config;
+		smdk4210_camera->preview_config_hazard = published;
+		__sync_synchronize();
+	} while (published != smdk4210_camera->preview_config);
+
+	if (published != NULL)
+		memcpy(config, published, sizeof(struct smdk4210_camera_preview_config));
+
+	__sync_synchronize();
+	smdk4210_camera->preview_config_hazard = NULL;
+
+	return published != NULL ? 0 : -1;
+}
+
+void smdk4210_camera_preview_config_apply(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_preview_config *config)
+{
+	if (smdk4210_camera == NULL || config == NULL)
+		return;
+
+	smdk4210_camera->preview_width = config->width;
+	smdk4210_camera->preview_height = config->height;
+	smdk4210_camera->preview_format = config->format;
+	smdk4210_camera->preview_fps = config->fps;
+	smdk4210_camera->hfr = config->hfr;
+	smdk4210_camera->recording_fps = config->recording_fps;
+	smdk4210_camera->preview_rotation = config->rotation;
+	smdk4210_camera->preview_fps_min = config->fps_min;
+	smdk4210_camera->preview_fps_max = config->fps_max;
+	smdk4210_camera->zoom_ratio = config->zoom_ratio;
+	smdk4210_camera->low_light = config->low_light;
+
+	// Recording buffers are sized and mapped for the video size in use
+	if (!smdk4210_camera->recording_enabled) {
+		smdk4210_camera->recording_width = config->recording_width;
+		smdk4210_camera->recording_height = config->recording_height;
+		smdk4210_camera->recording_format = config->recording_format;
+	}
+}
+
+// Picture
+
+int smdk4210_camera_jpeg_encode_hardware(struct smdk4210_camera *smdk4210_camera,
+	void *data, int width, int height, int format, int quality,
+	camera_memory_t **jpeg_memory_p, int *jpeg_size_p)
+{
+	camera_memory_t *jpeg_memory = NULL;
+
+	int jpeg_fd;
+	struct jpeg_enc_param jpeg_enc_params;
+	enum jpeg_frame_format jpeg_in_format;
+	enum jpeg_stream_format jpeg_out_format;
+	enum jpeg_ret_type jpeg_result;
+	void *jpeg_in_buffer;
+	int jpeg_in_size;
+	void *jpeg_out_buffer;
+	int jpeg_out_size;
+
+	if (smdk4210_camera == NULL || data == NULL || jpeg_memory_p == NULL || jpeg_size_p == NULL)
+		return -EINVAL;
+
+	if (smdk4210_camera->callbacks.request_memory == NULL) {
+		ALOGE("%s: No memory request function!", __func__);
+		return -1;
+	}
+
+	jpeg_fd = api_jpeg_encode_init();
+	if (jpeg_fd < 0) {
+		ALOGE("%s: Failed to init JPEG", __func__);
+		smdk4210_camera->jpeg_hardware_failure_timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+		return -1;
+	}
+
+	switch (format) {
+		case V4L2_PIX_FMT_RGB565:
+			jpeg_in_format = RGB_565;
+			jpeg_out_format = JPEG_420;
+			break;
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12T:
+		case V4L2_PIX_FMT_YUV420:
+			jpeg_in_format = YUV_420;
+			jpeg_out_format = JPEG_420;
+			break;
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_UYVY:
+		case V4L2_PIX_FMT_YUV422P:
+		default:
+			jpeg_in_format = YUV_422;
+			jpeg_out_format = JPEG_422;
+			break;
+	}
+
+	jpeg_in_size = smdk4210_camera_buffer_length(width, height, format);
+
+	memset(&jpeg_enc_params, 0, sizeof(jpeg_enc_params));
+
+	jpeg_enc_params.width = width;
+	jpeg_enc_params.height = height;
+	jpeg_enc_params.in_fmt = jpeg_in_format;
+	jpeg_enc_params.out_fmt = jpeg_out_format;
+
+	if (quality >= 90)
+		jpeg_enc_params.quality = QUALITY_LEVEL_1;
+	else if (quality >= 80)
+		jpeg_enc_params.quality = QUALITY_LEVEL_2;
+	else if (quality >= 70)
+		jpeg_enc_params.quality = QUALITY_LEVEL_3;
+	else
+		jpeg_enc_params.quality = QUALITY_LEVEL_4;
+
+	api_jpeg_set_encode_param(&jpeg_enc_params);
+
+	jpeg_in_buffer = api_jpeg_get_encode_in_buf(jpeg_fd, jpeg_in_size);
+	if (jpeg_in_buffer == NULL) {
+		ALOGE("%s: Failed to get JPEG in buffer", __func__);
+		goto error;
+	}
+
+	jpeg_out_buffer = api_jpeg_get_encode_out_buf(jpeg_fd);
+	if (jpeg_out_buffer == NULL) {
+		ALOGE("%s: Failed to get JPEG out buffer", __func__);
+		goto error;
+	}
+
+	memcpy(jpeg_in_buffer, data, jpeg_in_size);
+
+	jpeg_result = api_jpeg_encode_exe(jpeg_fd, &jpeg_enc_params);
+	if (jpeg_result != JPEG_ENCODE_OK) {
+		ALOGE("%s: Failed to encode JPEG", __func__);
+		goto error;
+	}
+
+	jpeg_out_size = jpeg_enc_params.size;
+	if (jpeg_out_size <= 0) {
+		ALOGE("%s: Failed to get JPEG out size", __func__);
+		goto error;
+	}
+
+	jpeg_memory = smdk4210_camera_pool_get(smdk4210_camera, jpeg_out_size);
+	if (jpeg_memory == NULL) {
+		ALOGE("%s: JPEG memory request failed!", __func__);
+		goto error;
+	}
+
+	memcpy(jpeg_memory->data, jpeg_out_buffer, jpeg_out_size);
+
+	api_jpeg_encode_deinit(jpeg_fd);
+
+	*jpeg_memory_p = jpeg_memory;
+	*jpeg_size_p = jpeg_out_size;
+
+	return 0;
+
+error:
+	api_jpeg_encode_deinit(jpeg_fd);
+
+	return -1;
+}
+
+int smdk4210_camera_jpeg_encode_software(struct smdk4210_camera *smdk4210_camera,
+	void *data, int width, int height, int format, int quality,
+	camera_memory_t **jpeg_memory_p, int *jpeg_size_p)
+{
+	camera_memory_t *jpeg_memory = NULL;
+	int jpeg_length;
+	int jpeg_size;
+
+	if (smdk4210_camera == NULL || data == NULL || jpeg_memory_p == NULL || jpeg_size_p == NULL)
+		return -EINVAL;
+
+	// Compressed data stays well below the raw YUV 4:2:2 size
+	jpeg_length = width * height * 2 + SMDK4210_JPEG_HEADERS_LENGTH;
+
+	jpeg_memory = smdk4210_camera_pool_get(smdk4210_camera, jpeg_length);
+	if (jpeg_memory == NULL) {
+		ALOGE("%s: JPEG memory request failed!", __func__);
+		return -1;
+	}
+
+	jpeg_size = smdk4210_jpeg_encode(data, width, height, format, quality,
+		jpeg_memory->data, jpeg_length);
+	if (jpeg_size <= 0) {
+		ALOGE("%s: Failed to encode JPEG", __func__);
+		smdk4210_camera_pool_put(smdk4210_camera, jpeg_memory);
+		return -1;
+	}
+
+	*jpeg_memory_p = jpeg_memory;
+	*jpeg_size_p = jpeg_size;
+
+	return 0;
+}
+
+int smdk4210_camera_jpeg_encode(struct smdk4210_camera *smdk4210_camera,
+	void *data, int width, int height, int format, int quality,
+	camera_memory_t **jpeg_memory_p, int *jpeg_size_p)
+{
+	nsecs_t failure_timestamp;
+	nsecs_t t;
+	int software = 0;
+	int rc;
+
+	if (smdk4210_camera == NULL || data == NULL || jpeg_memory_p == NULL || jpeg_size_p == NULL)
+		return -EINVAL;
+
+	t = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	// Software encoding is picked for jobs it can handle quickly enough
+	if (smdk4210_jpeg_format_supported(format)) {
+		failure_timestamp = smdk4210_camera->jpeg_hardware_failure_timestamp;
+
+		if (width * height <= SMDK4210_JPEG_SOFTWARE_PIXELS_MAX)
+			software = 1;
+		else if (smdk4210_camera->recording_enabled && width * height <= SMDK4210_JPEG_RECORDING_PIXELS_MAX)
+			software = 1;
+		else if (failure_timestamp != 0 && t - failure_timestamp < SMDK4210_JPEG_HARDWARE_RETRY_DELAY)
+			software = 1;
+	}
+
+	if (!software) {
+		rc = smdk4210_camera_jpeg_encode_hardware(smdk4210_camera, data, width, height,
+			format, quality, jpeg_memory_p, jpeg_size_p);
+		if (rc >= 0) {
+			smdk4210_camera->jpeg_hardware_count++;
+			smdk4210_camera->jpeg_hardware_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+			return 0;
+		}
+
+		if (!smdk4210_jpeg_format_supported(format))
+			return -1;
+
+		ALOGD("%s: Falling back to software JPEG encoding", __func__);
+		smdk4210_camera->jpeg_fallback_count++;
+	}
+
+	rc = smdk4210_camera_jpeg_encode_software(smdk4210_camera, data, width, height,
+		format, quality, jpeg_memory_p, jpeg_size_p);
+	if (rc < 0)
+		return -1;
+
+	smdk4210_camera->jpeg_software_count++;
+	smdk4210_camera->jpeg_software_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+	return 0;
+}
+
+int smdk4210_camera_picture_callback(struct smdk4210_camera *smdk4210_camera,
+	void *jpeg_data, int jpeg_size, void *jpeg_thumbnail_data, int jpeg_thumbnail_size)
+{
+	camera_memory_t *data_memory = NULL;
+	camera_memory_t *exif_data_memory = NULL;
+	exif_attribute_t exif_attributes;
+	int exif_size = 0;
+	int data_size;
+	int rc;
+
+	if (smdk4210_camera == NULL || jpeg_data == NULL || jpeg_size <= 2)
+		return -EINVAL;
+
+	// EXIF
+
+	memset(&exif_attributes, 0, sizeof(exif_attributes));
+	smdk4210_exif_attributes_create_static(smdk4210_camera, &exif_attributes);
+	smdk4210_exif_attributes_create_params(smdk4210_camera, &exif_attributes);
+
+	rc = smdk4210_exif_create(smdk4210_camera, &exif_attributes,
+		jpeg_thumbnail_data, jpeg_thumbnail_size,
+		&exif_data_memory, &exif_size);
+	if (rc < 0 || exif_data_memory == NULL || exif_size <= 0) {
+		ALOGE("%s: EXIF create failed!", __func__);
+		goto error;
+	}
+
+	data_size = exif_size + jpeg_size;
+
+	if (smdk4210_camera->callbacks.request_memory != NULL) {
+		data_memory =
+			smdk4210_camera->callbacks.request_memory(-1,
+				data_size, 1, 0);
+		if (data_memory == NULL) {
+			ALOGE("%s: data memory request failed!", __func__);
+			goto error;
+		}
+	} else {
+		ALOGE("%s: No memory request function!", __func__);
+		goto error;
+	}
+
+	// Copy the first two bytes of the JPEG picture
+	memcpy(data_memory->data, jpeg_data, 2);
+
+	// Copy the EXIF data
+	memcpy((void *) ((int) data_memory->data + 2), exif_data_memory->data,
+		exif_size);
+
+	// Copy the JPEG picture
+	memcpy((void *) ((int) data_memory->data + 2 + exif_size),
+		(void *) ((int) jpeg_data + 2), jpeg_size - 2);
+
+	// Callbacks
+
+	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_SHUTTER) && SMDK4210_CAMERA_CALLBACK_DEFINED(notify))
+		smdk4210_camera->callbacks.notify(CAMERA_MSG_SHUTTER, 0, 0,
+			smdk4210_camera->callbacks.user);
+
+	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_COMPRESSED_IMAGE) && SMDK4210_CAMERA_CALLBACK_DEFINED(data) &&
+		data_memory != NULL)
+		smdk4210_camera->callbacks.data(CAMERA_MSG_COMPRESSED_IMAGE,
+			data_memory, 0, NULL, smdk4210_camera->callbacks.user);
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	if (exif_data_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, exif_data_memory);
+
+	if (data_memory != NULL && data_memory->release != NULL)
+		data_memory->release(data_memory);
+
+	return rc;
+}
+
+static void smdk4210_camera_burst_job(struct smdk4210_burst_job *job)
+{
+	struct smdk4210_camera *smdk4210_camera;
+
+	smdk4210_camera = job->camera;
+
+	if (job->frame != NULL)
+		smdk4210_burst_merge(&smdk4210_camera->burst, job->frame,
+			job->shift_x, job->shift_y, job->row_start, job->row_end);
+	else
+		smdk4210_burst_resolve(&smdk4210_camera->burst, smdk4210_camera->burst.reference,
+			job->row_start, job->row_end);
+}
+
+void *smdk4210_camera_burst_thread(void *data)
+{
+	struct smdk4210_camera *smdk4210_camera;
+
+	if (data == NULL)
+		return NULL;
+
+	smdk4210_camera = (struct smdk4210_camera *) data;
+
+	pthread_mutex_lock(&smdk4210_camera->burst_mutex);
+
+	while (1) {
+		while (smdk4210_camera->burst_thread_enabled && !smdk4210_camera->burst_job_pending)
+			pthread_cond_wait(&smdk4210_camera->burst_cond, &smdk4210_camera->burst_mutex);
+
+		if (!smdk4210_camera->burst_job_pending)
+			break;
+
+		pthread_mutex_unlock(&smdk4210_camera->burst_mutex);
+
+		smdk4210_camera_burst_job(&smdk4210_camera->burst_job);
+
+		pthread_mutex_lock(&smdk4210_camera->burst_mutex);
+
+		smdk4210_camera->burst_job_pending = 0;
+		pthread_cond_broadcast(&smdk4210_camera->burst_cond);
+	}
+
+	pthread_mutex_unlock(&smdk4210_camera->burst_mutex);
+
+	return NULL;
+}
+
+static int smdk4210_camera_burst_thread_start(struct smdk4210_camera *smdk4210_camera)
+{
+	int rc;
+
+	pthread_mutex_init(&smdk4210_camera->burst_mutex, NULL);
+	pthread_cond_init(&smdk4210_camera->burst_cond, NULL);
+
+	smdk4210_camera->burst_job_pending = 0;
+	smdk4210_camera->burst_thread_enabled = 1;
+
+	// One worker for the whole burst, rather than one per merged frame
+	rc = pthread_create(&smdk4210_camera->burst_thread, NULL,
+		smdk4210_camera_burst_thread, (void *) smdk4210_camera);
+	if (rc != 0) {
+		ALOGE("%s: Unable to create thread", __func__);
+		smdk4210_camera->burst_thread_enabled = 0;
+		pthread_cond_destroy(&smdk4210_camera->burst_cond);
+		pthread_mutex_destroy(&smdk4210_camera->burst_mutex);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void smdk4210_camera_burst_thread_stop(struct smdk4210_camera *smdk4210_camera)
+{
+	if (!smdk4210_camera->burst_thread_enabled)
+		return;
+
+	pthread_mutex_lock(&smdk4210_camera->burst_mutex);
+	smdk4210_camera->burst_thread_enabled = 0;
+	pthread_cond_broadcast(&smdk4210_camera->burst_cond);
+	pthread_mutex_unlock(&smdk4210_camera->burst_mutex);
+
+	pthread_join(smdk4210_camera->burst_thread, NULL);
+
+	pthread_cond_destroy(&smdk4210_camera->burst_cond);
+	pthread_mutex_destroy(&smdk4210_camera->burst_mutex);
+}
+
+int smdk4210_camera_burst_split(struct smdk4210_camera *smdk4210_camera,
+	unsigned char *frame, int shift_x, int shift_y)
+{
+	struct smdk4210_burst_job jobs[2];
+	int height;
+	int i;
+
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
+
+	height = smdk4210_camera->burst.height;
+
+	// Each core takes one half of the rows
+	for (i = 0; i < 2; i++) {
+		jobs[i].camera = smdk4210_camera;
+		jobs[i].frame = frame;
+		jobs[i].shift_x = shift_x;
+		jobs[i].shift_y = shift_y;
+		jobs[i].row_start = i == 0 ? 0 : height / 2;
+		jobs[i].row_end = i == 0 ? height / 2 : height;
+	}
+
+	if (!smdk4210_camera->burst_thread_enabled) {
+		// Fallback to a single core
+		jobs[0].row_end = height;
+		smdk4210_camera_burst_job(&jobs[0]);
+		return 0;
+	}
+
+	pthread_mutex_lock(&smdk4210_camera->burst_mutex);
+	memcpy(&smdk4210_camera->burst_job, &jobs[1], sizeof(struct smdk4210_burst_job));
+	smdk4210_camera->burst_job_pending = 1;
+	pthread_cond_broadcast(&smdk4210_camera->burst_cond);
+	pthread_mutex_unlock(&smdk4210_camera->burst_mutex);
+
+	smdk4210_camera_burst_job(&jobs[0]);
+
+	pthread_mutex_lock(&smdk4210_camera->burst_mutex);
+	while (smdk4210_camera->burst_job_pending)
+		pthread_cond_wait(&smdk4210_camera->burst_cond, &smdk4210_camera->burst_mutex);
+	pthread_mutex_unlock(&smdk4210_camera->burst_mutex);
+
+	return 0;
+}
+
+int smdk4210_camera_burst(struct smdk4210_camera *smdk4210_camera, int format,
+	void **picture_data)
+{
+	struct smdk4210_burst *burst;
+	unsigned char *frame;
+	nsecs_t timestamp;
+	nsecs_t elapsed;
+	nsecs_t t;
+	int shift_x, shift_y;
+	int index;
+	int rc;
+	int i;
+
+	if (smdk4210_camera == NULL || picture_data == NULL)
+		return -EINVAL;
+
+	burst = &smdk4210_camera->burst;
+
+	smdk4210_camera->burst_frames_merged = 0;
+	smdk4210_camera->burst_frames_rejected = 0;
+	smdk4210_camera->burst_capture_duration = 0;
+	smdk4210_camera->burst_align_duration = 0;
+	smdk4210_camera->burst_merge_duration = 0;
+
+	timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	rc = smdk4210_burst_init(burst, smdk4210_camera->picture_width,
+		smdk4210_camera->picture_height, format);
+	if (rc < 0) {
+		ALOGE("%s: Unable to init burst", __func__);
+		goto error;
+	}
+
+	rc = smdk4210_camera_burst_thread_start(smdk4210_camera);
+	if (rc < 0)
+		ALOGE("%s: Merging on a single core", __func__);
+
+	for (i = 0; i < SMDK4210_BURST_FRAMES_COUNT; i++) {
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
+
+		rc = smdk4210_v4l2_poll(smdk4210_camera, 0);
+		if (rc < 0) {
+			ALOGE("%s: poll failed!", __func__);
+			goto error;
+		} else if (rc == 0) {
+			ALOGE("%s: poll timeout!", __func__);
+
+			// The frames already collected still make a picture
+			if (i > 0) {
+				smdk4210_camera->burst_timeouts++;
+				break;
+			}
+
+			goto error;
+		}
+
+		index = smdk4210_v4l2_dqbuf_cap(smdk4210_camera, 0);
+		if (index < 0 || index >= SMDK4210_BURST_BUFFERS_COUNT) {
+			ALOGE("%s: dqbuf failed!", __func__);
+			goto error;
+		}
+
+		smdk4210_camera->burst_capture_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		frame = (unsigned char *) smdk4210_camera->picture_memory->data +
+			index * smdk4210_camera->picture_buffer_length;
+
+		if (i == 0) {
+			rc = smdk4210_burst_reference(burst, frame);
+			if (rc < 0) {
+				ALOGE("%s: Unable to set burst reference", __func__);
+				goto error;
+			}
+
+			smdk4210_camera->burst_frames_merged++;
+		} else {
+			t = systemTime(SYSTEM_TIME_MONOTONIC);
+			rc = smdk4210_burst_align(burst, frame, &shift_x, &shift_y);
+			smdk4210_camera->burst_align_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+			if (rc < 0) {
+				// Too much motion to be merged safely
+				smdk4210_camera->burst_frames_rejected++;
+			} else {
+				t = systemTime(SYSTEM_TIME_MONOTONIC);
+				smdk4210_camera_burst_split(smdk4210_camera, frame, shift_x, shift_y);
+				burst->frames_count++;
+				smdk4210_camera->burst_merge_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+				smdk4210_camera->burst_frames_merged++;
+			}
+		}
+
+		if (i == SMDK4210_BURST_FRAMES_COUNT - 1)
+			break;
+
+		// Stop early when the next frame would not fit in the budget
+		elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - timestamp;
+		if (elapsed + elapsed / (i + 1) > SMDK4210_BURST_BUDGET) {
+			smdk4210_camera->burst_budget_exceeded++;
+			break;
+		}
+
+		rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 0, index);
+		if (rc < 0) {
+			ALOGE("%s: qbuf failed!", __func__);
+			goto error;
+		}
+	}
+
+	rc = smdk4210_v4l2_streamoff_cap(smdk4210_camera, 0);
+	if (rc < 0) {
+		ALOGE("%s: streamoff failed!", __func__);
+		goto error;
+	}
+
+	// The merged picture replaces the reference
+	t = systemTime(SYSTEM_TIME_MONOTONIC);
+	smdk4210_camera_burst_split(smdk4210_camera, NULL, 0, 0);
+	smdk4210_camera->burst_merge_duration += systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+	*picture_data = (void *) burst->reference;
+
+	rc = 0;
+	goto complete;
+
+error:
+	smdk4210_v4l2_streamoff_cap(smdk4210_camera, 0);
+	smdk4210_burst_deinit(burst);
+
+	rc = -1;
+
+complete:
+	smdk4210_camera_burst_thread_stop(smdk4210_camera);
+
+	smdk4210_camera->burst_duration = systemTime(SYSTEM_TIME_MONOTONIC) - timestamp;
+
+	return rc;
+}
+
+int smdk4210_camera_picture(struct smdk4210_camera *smdk4210_camera)
+{
+	struct smdk4210_transform transform;
+	camera_memory_t *picture_data_memory = NULL;
+	camera_memory_t *raw_thumbnail_data_memory = NULL;
+	camera_memory_t *jpeg_thumbnail_data_memory = NULL;
+
+	void *jpeg_data = NULL;
+	int jpeg_size = 0;
+	void *raw_thumbnail_data = NULL;
+	int raw_thumbnail_size = 0;
+	void *jpeg_thumbnail_data = NULL;
+	int jpeg_thumbnail_size = 0;
+
+	int camera_picture_format;
+	int picture_width;
+	int picture_height;
+	int picture_format;
+
+	int jpeg_thumbnail_width;
+	int jpeg_thumbnail_height;
+	int jpeg_thumbnail_quality;
+	int jpeg_quality;
+
+	void *picture_data = NULL;
+	nsecs_t encode_timestamp;
+
+	int offset = 0;
+	void *jpeg_main_data = NULL;
+	int jpeg_main_size = 0;
+	void *jpeg_thumb_data = NULL;
+	int jpeg_thumb_size = 0;
+
+	int index;
+	int rc;
+
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
+
+	picture_width = smdk4210_camera->picture_width;
+	picture_height = smdk4210_camera->picture_height;
+	picture_format = smdk4210_camera->picture_format;
+	camera_picture_format = smdk4210_camera->camera_picture_format;
+	jpeg_thumbnail_width = smdk4210_camera->jpeg_thumbnail_width;
+	jpeg_thumbnail_height = smdk4210_camera->jpeg_thumbnail_height;
+	jpeg_thumbnail_quality = smdk4210_camera->jpeg_thumbnail_quality;
+	jpeg_quality = smdk4210_camera->jpeg_quality;
+
+	if (camera_picture_format == 0)
+		camera_picture_format = picture_format;
+
+	// Low-light burst
+
+	if (smdk4210_camera->low_light) {
+		rc = smdk4210_camera_burst(smdk4210_camera, camera_picture_format, &picture_data);
+		if (rc < 0) {
+			ALOGE("%s: burst failed!", __func__);
+			return -1;
+		}
+
+		goto encode;
+	}
+
+	// V4L2
+
+	rc = smdk4210_v4l2_poll(smdk4210_camera, 0);
+	if (rc < 0) {
+		ALOGE("%s: poll failed!", __func__);
+		return -1;
+	} else if (rc == 0) {
+		ALOGE("%s: poll timeout!", __func__);
+		return -1;
+	}
+
+	rc = smdk4210_v4l2_streamoff_cap(smdk4210_camera, 0);
+	if (rc < 0) {
+		ALOGE("%s: streamoff failed!", __func__);
+		return -1;
+	}
+
+	index = smdk4210_v4l2_dqbuf_cap(smdk4210_camera, 0);
+	if (index < 0) {
+		ALOGE("%s: dqbuf failed!", __func__);
+		return -1;
+	}
+
+	// This assumes that the output format is JPEG
+
+	if (camera_picture_format == V4L2_PIX_FMT_JPEG) {
+		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_MAIN_SIZE,
+			&jpeg_main_size);
+		if (rc < 0) {
+			ALOGE("%s: g ctrl failed!", __func__);
+			return -1;
+		}
+
+		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_MAIN_OFFSET,
+			&offset);
+		if (rc < 0) {
+			ALOGE("%s: g ctrl failed!", __func__);
+			return -1;
+		}
+
+		jpeg_main_data = (void *) ((int) smdk4210_camera->picture_memory->data + offset);
+
+		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_THUMB_SIZE,
+			&jpeg_thumb_size);
+		if (rc < 0) {
+			ALOGE("%s: g ctrl failed!", __func__);
+			return -1;
+		}
+
+		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_THUMB_OFFSET,
+			&offset);
+		if (rc < 0) {
+			ALOGE("%s: g ctrl failed!", __func__);
+			return -1;
+		}
+
+		jpeg_thumb_data = (void *) ((int) smdk4210_camera->picture_memory->data + offset);
+	}
+
+	picture_data = smdk4210_camera->picture_memory->data;
+
+encode:
+	// Pictures are cropped like the preview was
+	if (smdk4210_camera->camera_software_zoom && smdk4210_camera->zoom_ratio > 100 &&
+		camera_picture_format != V4L2_PIX_FMT_JPEG) {
+		smdk4210_transform_init(&transform);
+
+		rc = smdk4210_transform_frame(&transform, picture_data, picture_width, picture_height,
+			camera_picture_format, 0, 0, 0, smdk4210_camera->zoom_ratio);
+		if (rc < 0)
+			ALOGE("%s: Unable to zoom picture", __func__);
+
+		smdk4210_transform_deinit(&transform);
+	}
+
+	encode_timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	// Thumbnail
+
+	if (camera_picture_format == V4L2_PIX_FMT_JPEG && jpeg_thumb_data != NULL && jpeg_thumb_size >= 0) {
+		jpeg_thumbnail_data = jpeg_thumb_data;
+		jpeg_thumbnail_size = jpeg_thumb_size;
+	} else {
+		raw_thumbnail_size = smdk4210_camera_buffer_length(jpeg_thumbnail_width, jpeg_thumbnail_height, camera_picture_format);
+
+		if (jpeg_thumbnail_width != picture_width || jpeg_thumbnail_height != picture_height) {
+			raw_thumbnail_data_memory = smdk4210_camera_pool_get(smdk4210_camera,
+				raw_thumbnail_size);
+			if (raw_thumbnail_data_memory == NULL) {
+				ALOGE("%s: raw thumbnail memory request failed!", __func__);
+				goto error;
+			}
+
+			switch (camera_picture_format) {
+				case V4L2_PIX_FMT_YUYV:
+				case V4L2_PIX_FMT_UYVY:
+				case V4L2_PIX_FMT_YUV422P:
+				default:
+					rc = smdk4210_scale_yuv422(picture_data, picture_width, picture_height, raw_thumbnail_data_memory->data, jpeg_thumbnail_width, jpeg_thumbnail_height);
+					break;
+			}
+
+			if (rc < 0) {
+				ALOGE("%s: Resizing picture failed!", __func__);
+				goto error;
+			}
+
+			raw_thumbnail_data = raw_thumbnail_data_memory->data;
+		} else {
+			raw_thumbnail_data = picture_data;
+		}
+
+		rc = smdk4210_camera_jpeg_encode(smdk4210_camera, raw_thumbnail_data,
+			jpeg_thumbnail_width, jpeg_thumbnail_height, camera_picture_format,
+			jpeg_thumbnail_quality, &jpeg_thumbnail_data_memory, &jpeg_thumbnail_size);
+		if (rc < 0) {
+			ALOGE("%s: Thumbnail JPEG encode failed!", __func__);
+			goto error;
+		}
+
+		jpeg_thumbnail_data = jpeg_thumbnail_data_memory->data;
+
+		// Give the raw thumbnail back before the picture is encoded
+		if (raw_thumbnail_data_memory != NULL) {
+			smdk4210_camera_pool_put(smdk4210_camera, raw_thumbnail_data_memory);
+			raw_thumbnail_data_memory = NULL;
 		}
 	}
 
-	// Scene mode
-	scene_mode_string = smdk4210_param_string_get(smdk4210_camera, "scene-mode");
-	if (scene_mode_string != NULL) {
-		if (strcmp(scene_mode_string, "auto") == 0)
-			scene_mode = SCENE_MODE_NONE;
-		else if (strcmp(scene_mode_string, "portrait") == 0)
-			scene_mode = SCENE_MODE_PORTRAIT;
-		else if (strcmp(scene_mode_string, "landscape") == 0)
-			scene_mode = SCENE_MODE_LANDSCAPE;
-		else if (strcmp(scene_mode_string, "night") == 0)
-			scene_mode = SCENE_MODE_NIGHTSHOT;
-		else if (strcmp(scene_mode_string, "beach") == 0)
-			scene_mode = SCENE_MODE_BEACH_SNOW;
-		else if (strcmp(scene_mode_string, "snow") == 0)
-			scene_mode = SCENE_MODE_BEACH_SNOW;
-		else if (strcmp(scene_mode_string, "sunset") == 0)
-			scene_mode = SCENE_MODE_SUNSET;
-		else if (strcmp(scene_mode_string, "fireworks") == 0)
-			scene_mode = SCENE_MODE_FIREWORKS;
-		else if (strcmp(scene_mode_string, "sports") == 0)
-			scene_mode = SCENE_MODE_SPORTS;
-		else if (strcmp(scene_mode_string, "party") == 0)
-			scene_mode = SCENE_MODE_PARTY_INDOOR;
-		else if (strcmp(scene_mode_string, "candlelight") == 0)
-			scene_mode = SCENE_MODE_CANDLE_LIGHT;
-		else if (strcmp(scene_mode_string, "dusk-dawn") == 0)
-			scene_mode = SCENE_MODE_DUSK_DAWN;
-		else if (strcmp(scene_mode_string, "fall-color") == 0)
-			scene_mode = SCENE_MODE_FALL_COLOR;
-		else if (strcmp(scene_mode_string, "back-light") == 0)
-			scene_mode = SCENE_MODE_BACK_LIGHT;
-		else if (strcmp(scene_mode_string, "text") == 0)
-			scene_mode = SCENE_MODE_TEXT;
-		else
-			scene_mode = SCENE_MODE_NONE;
+	// Picture
 
-		if (scene_mode != smdk4210_camera->scene_mode || force) {
-			smdk4210_camera->scene_mode = scene_mode;
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_SCENE_MODE, scene_mode);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
+	if (camera_picture_format == V4L2_PIX_FMT_JPEG && jpeg_main_data != NULL && jpeg_main_size >= 0) {
+		jpeg_data = jpeg_main_data;
+		jpeg_size = jpeg_main_size;
+	} else {
+		rc = smdk4210_camera_jpeg_encode(smdk4210_camera, picture_data,
+			picture_width, picture_height, camera_picture_format,
+			jpeg_quality, &picture_data_memory, &jpeg_size);
+		if (rc < 0) {
+			ALOGE("%s: Picture JPEG encode failed!", __func__);
+			goto error;
+		}
+
+		jpeg_data = picture_data_memory->data;
+	}
+
+	if (smdk4210_camera->low_light)
+		smdk4210_camera->burst_encode_duration = systemTime(SYSTEM_TIME_MONOTONIC) - encode_timestamp;
+
+	// EXIF and callbacks
+
+	rc = smdk4210_camera_picture_callback(smdk4210_camera, jpeg_data, jpeg_size,
+		jpeg_thumbnail_data, jpeg_thumbnail_size);
+	if (rc < 0)
+		goto error;
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	if (jpeg_thumbnail_data_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, jpeg_thumbnail_data_memory);
+
+	if (raw_thumbnail_data_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, raw_thumbnail_data_memory);
+
+	if (picture_data_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, picture_data_memory);
+
+	if (smdk4210_camera->low_light)
+		smdk4210_burst_deinit(&smdk4210_camera->burst);
+
+	return rc;
+}
+
+void *smdk4210_camera_picture_thread(void *data)
+{
+	struct smdk4210_camera *smdk4210_camera;
+	int rc;
+	int i;
+
+	if (data == NULL)
+		return NULL;
+
+	smdk4210_camera = (struct smdk4210_camera *) data;
+
+	ALOGE("%s: Starting thread", __func__);
+	smdk4210_camera->picture_thread_running = 1;
+
+	if (smdk4210_camera->picture_enabled == 1) {
+		pthread_mutex_lock(&smdk4210_camera->picture_mutex);
+
+		rc = smdk4210_camera_picture(smdk4210_camera);
+		if (rc < 0) {
+			ALOGE("%s: picture failed!", __func__);
+			smdk4210_camera->picture_enabled = 0;
+		}
+
+		if (smdk4210_camera->picture_memory != NULL && smdk4210_camera->picture_memory->release != NULL) {
+			smdk4210_camera->picture_memory->release(smdk4210_camera->picture_memory);
+			smdk4210_camera->picture_memory = NULL;
+		}
+
+		pthread_mutex_unlock(&smdk4210_camera->picture_mutex);
+	}
+
+	smdk4210_camera->picture_thread_running = 0;
+	smdk4210_camera->picture_enabled = 0;
+
+	ALOGE("%s: Exiting thread", __func__);
+
+	return NULL;
+}
+
+int smdk4210_camera_picture_start(struct smdk4210_camera *smdk4210_camera)
+{
+	pthread_attr_t thread_attr;
+
+	int width, height, format, camera_format;
+	int buffers_count;
+
+	int fd;
+	int rc;
+	int i;
+
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
+
+	// Capture has to happen with the latest settings
+	smdk4210_camera_control_flush(smdk4210_camera);
+
+	// Stop preview thread
+	smdk4210_camera_preview_stop(smdk4210_camera);
+
+	width = smdk4210_camera->picture_width;
+	height = smdk4210_camera->picture_height;
+	format = smdk4210_camera->picture_format;
+	camera_format = smdk4210_camera->camera_picture_format;
+
+	// V4L2
+
+	if (camera_format == 0)
+		camera_format = format;
+
+	// Low-light burst frames are merged in the sensor's own YUV format
+	if (smdk4210_camera->low_light) {
+		buffers_count = SMDK4210_BURST_BUFFERS_COUNT;
+	} else {
+		buffers_count = 1;
+	}
+
+	rc = smdk4210_v4l2_enum_fmt_cap(smdk4210_camera, 0, camera_format);
+	if (rc < 0) {
+		ALOGE("%s: enum fmt failed!", __func__);
+		return -1;
+	}
+
+	rc = smdk4210_v4l2_s_fmt_pix_cap(smdk4210_camera, 0, width, height, camera_format, V4L2_PIX_FMT_MODE_CAPTURE);
+	if (rc < 0) {
+		ALOGE("%s: s fmt failed!", __func__);
+		return -1;
+	}
+
+	// Only use 1 buffer, unless capturing a burst
+	rc = smdk4210_v4l2_reqbufs_cap(smdk4210_camera, 0, buffers_count);
+	if (rc < 0) {
+		ALOGE("%s: reqbufs failed!", __func__);
+		return -1;
+	}
+
+	rc = smdk4210_v4l2_querybuf_cap(smdk4210_camera, 0, 0);
+	if (rc < 0) {
+		ALOGE("%s: querybuf failed!", __func__);
+		return -1;
+	}
+
+	smdk4210_camera->picture_buffer_length = rc;
+
+	if (smdk4210_camera->callbacks.request_memory != NULL) {
+		fd = smdk4210_v4l2_find_fd(smdk4210_camera, 0);
+		if (fd < 0) {
+			ALOGE("%s: Unable to find v4l2 fd", __func__);
+			return -1;
+		}
+
+		if (smdk4210_camera->picture_memory != NULL && smdk4210_camera->picture_memory->release != NULL)
+			smdk4210_camera->picture_memory->release(smdk4210_camera->picture_memory);
+
+		smdk4210_camera->picture_memory =
+			smdk4210_camera->callbacks.request_memory(fd,
+				smdk4210_camera->picture_buffer_length, buffers_count, 0);
+		if (smdk4210_camera->picture_memory == NULL) {
+			ALOGE("%s: memory request failed!", __func__);
+			return -1;
+		}
+	} else {
+		ALOGE("%s: No memory request function!", __func__);
+		return -1;
+	}
+
+	for (i = 0; i < buffers_count; i++) {
+		rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 0, i);
+		if (rc < 0) {
+			ALOGE("%s: qbuf failed!", __func__);
+			return -1;
 		}
 	}
 
-	// Effect
-	effect_string = smdk4210_param_string_get(smdk4210_camera, "effect");
-	if (effect_string != NULL) {
-		if (strcmp(effect_string, "auto") == 0)
-			effect = IMAGE_EFFECT_NONE;
-		else if (strcmp(effect_string, "mono") == 0)
-			effect = IMAGE_EFFECT_BNW;
-		else if (strcmp(effect_string, "negative") == 0)
-			effect = IMAGE_EFFECT_NEGATIVE;
-		else if (strcmp(effect_string, "sepia") == 0)
-			effect = IMAGE_EFFECT_SEPIA;
-		else if (strcmp(effect_string, "aqua") == 0)
-			effect = IMAGE_EFFECT_AQUA;
-		else
-			effect = IMAGE_EFFECT_NONE;
+	rc = smdk4210_v4l2_streamon_cap(smdk4210_camera, 0);
+	if (rc < 0) {
+		ALOGE("%s: streamon failed!", __func__);
+		return -1;
+	}
+
+	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_CAPTURE, 0);
+	if (rc < 0) {
+		ALOGE("%s: s ctrl failed!", __func__);
+		return -1;
+	}
+
+	// Thread
+
+	if (smdk4210_camera->picture_thread_running) {
+		ALOGE("Picture thread is already running!");
+		return -1;
+	}
+
+	pthread_mutex_init(&smdk4210_camera->picture_mutex, NULL);
+
+	pthread_attr_init(&thread_attr);
+	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+
+	smdk4210_camera->picture_enabled = 1;
+
+	rc = pthread_create(&smdk4210_camera->picture_thread, &thread_attr,
+		smdk4210_camera_picture_thread, (void *) smdk4210_camera);
+	if (rc < 0) {
+		ALOGE("%s: Unable to create thread", __func__);
+		return -1;
+	}
+
+	return 0;
+}
+
+void smdk4210_camera_picture_stop(struct smdk4210_camera *smdk4210_camera)
+{
+	int rc;
+	int i;
+
+	if (smdk4210_camera == NULL)
+		return;
+
+	if (!smdk4210_camera->picture_enabled) {
+		ALOGE("Picture was already stopped!");
+		return;
+	}
+
+	pthread_mutex_lock(&smdk4210_camera->picture_mutex);
+
+	// Disable picture to make the thread end
+	smdk4210_camera->picture_enabled = 0;
+
+	pthread_mutex_unlock(&smdk4210_camera->picture_mutex);
+
+	// Wait for the thread to end
+	for (i = 0; i < 10; i++) {
+		if (!smdk4210_camera->picture_thread_running)
+			break;
+
+		usleep(500);
+	}
+
+	pthread_mutex_destroy(&smdk4210_camera->picture_mutex);
+}
 
-		if (effect != smdk4210_camera->effect || force) {
-			smdk4210_camera->effect = effect;
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_EFFECT, effect);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
-		}
+// Auto-focus
+
+void *smdk4210_camera_auto_focus_thread(void *data)
+{
+	struct smdk4210_camera *smdk4210_camera;
+	int auto_focus_status = -1;
+	int auto_focus_result = 0;
+	int rc;
+	int i;
+
+	if (data == NULL)
+		return NULL;
+
+	smdk4210_camera = (struct smdk4210_camera *) data;
+
+	ALOGE("%s: Starting thread", __func__);
+	smdk4210_camera->auto_focus_thread_running = 1;
+
+	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_SET_AUTO_FOCUS, AUTO_FOCUS_ON);
+	if (rc < 0) {
+		ALOGE("%s: s ctrl failed!", __func__);
+		auto_focus_result = 0;
+		goto thread_exit;
 	}
 
-	// ISO
-	iso_string = smdk4210_param_string_get(smdk4210_camera, "iso");
-	if (iso_string != NULL) {
-		if (strcmp(iso_string, "auto") == 0)
-			iso = ISO_AUTO;
-		else if (strcmp(iso_string, "ISO50") == 0)
-			iso = ISO_50;
-		else if (strcmp(iso_string, "ISO100") == 0)
-			iso = ISO_100;
-		else if (strcmp(iso_string, "ISO200") == 0)
-			iso = ISO_200;
-		else if (strcmp(iso_string, "ISO400") == 0)
-			iso = ISO_400;
-		else if (strcmp(iso_string, "ISO800") == 0)
-			iso = ISO_800;
-		else
-			iso = ISO_AUTO;
+	while (smdk4210_camera->auto_focus_enabled == 1) {
+		pthread_mutex_lock(&smdk4210_camera->auto_focus_mutex);
 
-		if (iso != smdk4210_camera->iso || force) {
-			smdk4210_camera->iso = iso;
-			rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_ISO, iso);
-			if (rc < 0)
-				ALOGE("%s: s ctrl failed!", __func__);
+		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_AUTO_FOCUS_RESULT, &auto_focus_status);
+		if (rc < 0) {
+			ALOGE("%s: g ctrl failed!", __func__);
+			auto_focus_result = 0;
+			pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
+			goto thread_exit;
+		}
+
+		if (auto_focus_status & M5MO_AF_STATUS_IN_PROGRESS) {
+			usleep(10000);
+		} else if (auto_focus_status == M5MO_AF_STATUS_SUCCESS || auto_focus_status == M5MO_AF_STATUS_1ST_SUCCESS) {
+			auto_focus_result = 1;
+			pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
+			goto thread_exit;
+		} else {
+			auto_focus_result = 0;
+			pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
+			goto thread_exit;
 		}
+
+		pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
 	}
 
-	ALOGD("%s: Preview size: %dx%d, picture size: %dx%d, recording size: %dx%d",
-		__func__, preview_width, preview_height, picture_width, picture_height,
-		recording_width, recording_height);
+thread_exit:
+	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_SET_AUTO_FOCUS, AUTO_FOCUS_OFF);
+	if (rc < 0)
+		ALOGE("%s: s ctrl failed!", __func__);
+
+	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_FOCUS) && SMDK4210_CAMERA_CALLBACK_DEFINED(notify))
+		smdk4210_camera->callbacks.notify(CAMERA_MSG_FOCUS,
+			(int32_t) auto_focus_result, 0, smdk4210_camera->callbacks.user);
 
-	if (preview_changed && smdk4210_camera->preview_thread_running) {
-		preview_window = smdk4210_camera->preview_window;
+	smdk4210_camera->auto_focus_thread_running = 0;
+	smdk4210_camera->auto_focus_enabled = 0;
 
-		smdk4210_camera_preview_stop(smdk4210_camera);
+	ALOGE("%s: Exiting thread", __func__);
 
-		gralloc_format = smdk4210_gralloc_format(smdk4210_camera->preview_format);
+	return NULL;
+}
 
-		rc = preview_window->set_buffers_geometry(preview_window, smdk4210_camera->preview_width, smdk4210_camera->preview_height, gralloc_format);
-		if (rc)
-			ALOGE("%s: Unable to set buffers geometry", __func__);
+int smdk4210_camera_auto_focus_start(struct smdk4210_camera *smdk4210_camera)
+{
+	pthread_attr_t thread_attr;
+	int rc;
+
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
+
+	// Focus mode and areas have to be set before focusing
+	smdk4210_camera_control_flush(smdk4210_camera);
 
-		smdk4210_camera->preview_window = preview_window;
+	// Thread
+
+	if (smdk4210_camera->auto_focus_thread_running) {
+		ALOGE("Auto-focus thread is already running!");
+		return -1;
+	}
+
+	pthread_mutex_init(&smdk4210_camera->auto_focus_mutex, NULL);
 
-		smdk4210_camera_preview_start(smdk4210_camera);
+	pthread_attr_init(&thread_attr);
+	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+
+	smdk4210_camera->auto_focus_enabled = 1;
+
+	rc = pthread_create(&smdk4210_camera->auto_focus_thread, &thread_attr,
+		smdk4210_camera_auto_focus_thread, (void *) smdk4210_camera);
+	if (rc < 0) {
+		ALOGE("%s: Unable to create thread", __func__);
+		return -1;
 	}
 
 	return 0;
 }
 
-// Picture
-
-int smdk4210_camera_picture(struct smdk4210_camera *smdk4210_camera)
+void smdk4210_camera_auto_focus_stop(struct smdk4210_camera *smdk4210_camera)
 {
-	camera_memory_t *data_memory = NULL;
-	camera_memory_t *exif_data_memory = NULL;
-	camera_memory_t *picture_data_memory = NULL;
-	camera_memory_t *raw_thumbnail_data_memory = NULL;
-	camera_memory_t *jpeg_thumbnail_data_memory = NULL;
+	int rc;
+	int i;
 
-	void *jpeg_data = NULL;
-	int jpeg_size = 0;
-	void *raw_thumbnail_data = NULL;
-	int raw_thumbnail_size = 0;
-	void *jpeg_thumbnail_data = NULL;
-	int jpeg_thumbnail_size = 0;
+	if (smdk4210_camera == NULL)
+		return;
 
-	int camera_picture_format;
-	int picture_width;
-	int picture_height;
-	int picture_format;
+	if (!smdk4210_camera->auto_focus_enabled) {
+		ALOGE("Auto-focus was already stopped!");
+		return;
+	}
 
-	int jpeg_thumbnail_width;
-	int jpeg_thumbnail_height;
-	int jpeg_thumbnail_quality;
-	int jpeg_quality;
+	pthread_mutex_lock(&smdk4210_camera->auto_focus_mutex);
 
-	int data_size;
+	// Disable auto-focus to make the thread end
+	smdk4210_camera->auto_focus_enabled = 0;
 
-	int offset = 0;
-	void *jpeg_main_data = NULL;
-	int jpeg_main_size = 0;
-	void *jpeg_thumb_data = NULL;
-	int jpeg_thumb_size = 0;
+	pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
 
-	int jpeg_fd;
-	struct jpeg_enc_param jpeg_enc_params;
-	enum jpeg_frame_format jpeg_in_format;
-	enum jpeg_stream_format jpeg_out_format;
-	enum jpeg_ret_type jpeg_result;
-	void *jpeg_in_buffer;
-	int jpeg_in_size;
-	void *jpeg_out_buffer;
-	int jpeg_out_size;
+	// Wait for the thread to end
+	for (i = 0; i < 10; i++) {
+		if (!smdk4210_camera->auto_focus_thread_running)
+			break;
 
-	exif_attribute_t exif_attributes;
-	int exif_size = 0;
+		usleep(500);
+	}
 
-	int index;
-	int rc;
+	pthread_mutex_destroy(&smdk4210_camera->auto_focus_mutex);
+}
 
-	if (smdk4210_camera == NULL)
-		return -EINVAL;
+// Transform
 
-	picture_width = smdk4210_camera->picture_width;
-	picture_height = smdk4210_camera->picture_height;
-	picture_format = smdk4210_camera->picture_format;
-	camera_picture_format = smdk4210_camera->camera_picture_format;
-	jpeg_thumbnail_width = smdk4210_camera->jpeg_thumbnail_width;
-	jpeg_thumbnail_height = smdk4210_camera->jpeg_thumbnail_height;
-	jpeg_thumbnail_quality = smdk4210_camera->jpeg_thumbnail_quality;
-	jpeg_quality = smdk4210_camera->jpeg_quality;
+/*
+ * The rotation asked for comes on top of the sensor mounting.
+ * FIMC flips every output format, but its rotator only takes quarter turns
+ * on the two-plane YUV 4:2:0 outputs: the rest is done in software, with
+ * the flips, so that they keep applying before the rotation.
+ */
 
-	if (camera_picture_format == 0)
-		camera_picture_format = picture_format;
+int smdk4210_camera_transform_setup(struct smdk4210_camera *smdk4210_camera, int id,
+	int width, int height, int format, int rotation, struct smdk4210_transform_config *config)
+{
+	int hflip, vflip;
+	int rc;
 
-	// V4L2
+	if (smdk4210_camera == NULL || config == NULL)
+		return -EINVAL;
 
-	rc = smdk4210_v4l2_poll(smdk4210_camera, 0);
+	rotation = (smdk4210_camera->camera_rotation + rotation) % 360;
+	hflip = smdk4210_camera->camera_hflip;
+	vflip = smdk4210_camera->camera_vflip;
+
+	memset(config, 0, sizeof(struct smdk4210_transform_config));
+	config->width = width;
+	config->height = height;
+
+	// Software quarter turns swap the frame size, in the same buffer length
+	if ((rotation == 90 || rotation == 270) && format != V4L2_PIX_FMT_NV12 &&
+		format != V4L2_PIX_FMT_NV21 && smdk4210_transform_format_supported(format)) {
+		config->rotation = rotation;
+		config->hflip = hflip;
+		config->vflip = vflip;
+		config->width = height;
+		config->height = width;
+
+		rotation = 0;
+		hflip = 0;
+		vflip = 0;
+	}
+
+	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, id, V4L2_CID_ROTATION, rotation);
 	if (rc < 0) {
-		ALOGE("%s: poll failed!", __func__);
-		return -1;
-	} else if (rc == 0) {
-		ALOGE("%s: poll timeout!", __func__);
+		ALOGE("%s: s ctrl failed!", __func__);
 		return -1;
 	}
 
-	rc = smdk4210_v4l2_streamoff_cap(smdk4210_camera, 0);
+	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, id, V4L2_CID_HFLIP, hflip);
 	if (rc < 0) {
-		ALOGE("%s: streamoff failed!", __func__);
+		ALOGE("%s: s ctrl failed!", __func__);
 		return -1;
 	}
 
-	index = smdk4210_v4l2_dqbuf_cap(smdk4210_camera, 0);
-	if (index < 0) {
-		ALOGE("%s: dqbuf failed!", __func__);
+	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, id, V4L2_CID_VFLIP, vflip);
+	if (rc < 0) {
+		ALOGE("%s: s ctrl failed!", __func__);
 		return -1;
 	}
 
-	// This assumes that the output format is JPEG
+	return 0;
+}
 
-	if (camera_picture_format == V4L2_PIX_FMT_JPEG) {
-		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_MAIN_SIZE,
-			&jpeg_main_size);
-		if (rc < 0) {
-			ALOGE("%s: g ctrl failed!", __func__);
-			return -1;
-		}
+void smdk4210_camera_transform(struct smdk4210_camera *smdk4210_camera, void *data,
+	int width, int height, int format, struct smdk4210_transform_config *config)
+{
+	nsecs_t timestamp;
+	int zoom_ratio;
+	int rc;
 
-		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_MAIN_OFFSET,
-			&offset);
-		if (rc < 0) {
-			ALOGE("%s: g ctrl failed!", __func__);
-			return -1;
-		}
+	if (smdk4210_camera == NULL || data == NULL || config == NULL)
+		return;
 
-		jpeg_main_data = (void *) ((int) smdk4210_camera->picture_memory->data + offset);
+	zoom_ratio = smdk4210_camera->camera_software_zoom ? smdk4210_camera->zoom_ratio : 100;
 
-		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_THUMB_SIZE,
-			&jpeg_thumb_size);
-		if (rc < 0) {
-			ALOGE("%s: g ctrl failed!", __func__);
-			return -1;
-		}
+	if (config->rotation == 0 && !config->hflip && !config->vflip && zoom_ratio <= 100)
+		return;
+
+	if (!smdk4210_transform_format_supported(format))
+		return;
 
-		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAM_JPEG_THUMB_OFFSET,
-			&offset);
-		if (rc < 0) {
-			ALOGE("%s: g ctrl failed!", __func__);
-			return -1;
-		}
+	timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
 
-		jpeg_thumb_data = (void *) ((int) smdk4210_camera->picture_memory->data + offset);
+	rc = smdk4210_transform_frame(&smdk4210_camera->transform, data, width, height, format,
+		config->rotation, config->hflip, config->vflip, zoom_ratio);
+	if (rc < 0) {
+		// Frames go out untransformed rather than not at all
+		smdk4210_camera->transform_failures_count++;
+		return;
 	}
 
-	// Thumbnail
+	smdk4210_camera->transform_frames_count++;
+	smdk4210_camera->transform_duration += systemTime(SYSTEM_TIME_MONOTONIC) - timestamp;
+}
 
-	if (camera_picture_format == V4L2_PIX_FMT_JPEG && jpeg_thumb_data != NULL && jpeg_thumb_size >= 0) {
-		jpeg_thumbnail_data = jpeg_thumb_data;
-		jpeg_thumbnail_size = jpeg_thumb_size;
-	} else {
-		raw_thumbnail_size = smdk4210_camera_buffer_length(jpeg_thumbnail_width, jpeg_thumbnail_height, camera_picture_format);
+// Preview
 
-		if (jpeg_thumbnail_width != picture_width || jpeg_thumbnail_height != picture_height) {
-			if (smdk4210_camera->callbacks.request_memory != NULL) {
-				raw_thumbnail_data_memory =
-					smdk4210_camera->callbacks.request_memory(-1,
-						raw_thumbnail_size, 1, 0);
-				if (raw_thumbnail_data_memory == NULL) {
-					ALOGE("%s: raw thumbnail memory request failed!", __func__);
-					goto error;
-				}
-			} else {
-				ALOGE("%s: No memory request function!", __func__);
-				goto error;
-			}
+void smdk4210_camera_preview_stats(struct smdk4210_camera *smdk4210_camera,
+	nsecs_t timestamp)
+{
+	nsecs_t interval;
+	nsecs_t delta;
+	int fps;
 
-			switch (camera_picture_format) {
-				case V4L2_PIX_FMT_YUYV:
-				case V4L2_PIX_FMT_UYVY:
-				case V4L2_PIX_FMT_YUV422P:
-				default:
-					rc = smdk4210_scale_yuv422(smdk4210_camera->picture_memory->data, picture_width, picture_height, raw_thumbnail_data_memory->data, jpeg_thumbnail_width, jpeg_thumbnail_height);
-					break;
-			}
+	if (smdk4210_camera == NULL)
+		return;
 
-			if (rc < 0) {
-				ALOGE("%s: Resizing picture failed!", __func__);
-				goto error;
-			}
+	fps = smdk4210_camera->hfr > 0 ? smdk4210_camera->hfr : smdk4210_camera->preview_fps;
 
-			raw_thumbnail_data = raw_thumbnail_data_memory->data;
-		} else {
-			raw_thumbnail_data = smdk4210_camera->picture_memory->data;
-		}
+	smdk4210_camera->preview_frames_count++;
 
-		jpeg_fd = api_jpeg_encode_init();
-		if (jpeg_fd < 0) {
-			ALOGE("%s: Failed to init JPEG", __func__);
-			goto error;
-		}
+	// Frames missing from the expected cadence are counted as dropped
+	if (fps > 0 && smdk4210_camera->preview_last_timestamp != 0) {
+		interval = 1000000000LL / fps;
+		delta = timestamp - smdk4210_camera->preview_last_timestamp;
 
-		switch (camera_picture_format) {
-			case V4L2_PIX_FMT_RGB565:
-				jpeg_in_format = RGB_565;
-				jpeg_out_format = JPEG_420;
-				break;
-			case V4L2_PIX_FMT_NV12:
-			case V4L2_PIX_FMT_NV21:
-			case V4L2_PIX_FMT_NV12T:
-			case V4L2_PIX_FMT_YUV420:
-				jpeg_in_format = YUV_420;
-				jpeg_out_format = JPEG_420;
-				break;
-			case V4L2_PIX_FMT_YUYV:
-			case V4L2_PIX_FMT_UYVY:
-			case V4L2_PIX_FMT_YUV422P:
-			default:
-				jpeg_in_format = YUV_422;
-				jpeg_out_format = JPEG_422;
-				break;
-		}
+		if (delta > interval + interval / 2)
+			smdk4210_camera->preview_frames_dropped += (int) ((delta + interval / 2) / interval) - 1;
+	}
 
-		jpeg_in_size = raw_thumbnail_size;
+	smdk4210_camera->preview_last_timestamp = timestamp;
 
-		memset(&jpeg_enc_params, 0, sizeof(jpeg_enc_params));
+	if (smdk4210_camera->preview_fps_timestamp == 0) {
+		smdk4210_camera->preview_fps_timestamp = timestamp;
+		smdk4210_camera->preview_fps_frames = 0;
+	} else {
+		smdk4210_camera->preview_fps_frames++;
 
-		jpeg_enc_params.width = jpeg_thumbnail_width;
-		jpeg_enc_params.height = jpeg_thumbnail_height;
-		jpeg_enc_params.in_fmt = jpeg_in_format;
-		jpeg_enc_params.out_fmt = jpeg_out_format;
+		if (timestamp - smdk4210_camera->preview_fps_timestamp >= 1000000000LL) {
+			smdk4210_camera->preview_fps_achieved = (float) smdk4210_camera->preview_fps_frames * 1000000000.0f /
+				(float) (timestamp - smdk4210_camera->preview_fps_timestamp);
+			smdk4210_camera->preview_fps_timestamp = timestamp;
+			smdk4210_camera->preview_fps_frames = 0;
 
-		if (jpeg_thumbnail_quality >= 90)
-			jpeg_enc_params.quality = QUALITY_LEVEL_1;
-		else if (jpeg_thumbnail_quality >= 80)
-			jpeg_enc_params.quality = QUALITY_LEVEL_2;
-		else if (jpeg_thumbnail_quality >= 70)
-			jpeg_enc_params.quality = QUALITY_LEVEL_3;
-		else
-			jpeg_enc_params.quality = QUALITY_LEVEL_4;
+			if (smdk4210_camera->hfr > 0)
+				ALOGD("HFR preview at %.2f fps, %d frames dropped", smdk4210_camera->preview_fps_achieved,
+					smdk4210_camera->preview_frames_dropped);
+		}
+	}
+}
 
-		api_jpeg_set_encode_param(&jpeg_enc_params);
+int smdk4210_camera_preview(struct smdk4210_camera *smdk4210_camera)
+{
+	buffer_handle_t *buffer;
+	int stride;
 
-		jpeg_in_buffer = api_jpeg_get_encode_in_buf(jpeg_fd, jpeg_in_size);
-		if (jpeg_in_buffer == NULL) {
-			ALOGE("%s: Failed to get JPEG in buffer", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+	int width, height;
 
-		jpeg_out_buffer = api_jpeg_get_encode_out_buf(jpeg_fd);
-		if (jpeg_out_buffer == NULL) {
-			ALOGE("%s: Failed to get JPEG out buffer", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+	char *preview_format_string;
+	int frame_size, offset;
+	void *preview_data;
+	void *recording_data;
+	void *window_data;
 
-		memcpy(jpeg_in_buffer, raw_thumbnail_data, jpeg_in_size);
+	nsecs_t timestamp;
+	struct timespec ts;
 
-		jpeg_result = api_jpeg_encode_exe(jpeg_fd, &jpeg_enc_params);
-		if (jpeg_result != JPEG_ENCODE_OK) {
-			ALOGE("%s: Failed to encode JPEG", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+	int index;
+	int rc;
+	int i;
 
-		jpeg_out_size = jpeg_enc_params.size;
-		if (jpeg_out_size <= 0) {
-			ALOGE("%s: Failed to get JPEG out size", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+	if (smdk4210_camera == NULL || smdk4210_camera->preview_memory == NULL ||
+		smdk4210_camera->preview_window == NULL)
+		return -EINVAL;
 
-		if (smdk4210_camera->callbacks.request_memory != NULL) {
-			jpeg_thumbnail_data_memory =
-				smdk4210_camera->callbacks.request_memory(-1,
-					jpeg_out_size, 1, 0);
-			if (jpeg_thumbnail_data_memory == NULL) {
-				ALOGE("%s: thumbnail memory request failed!", __func__);
-				api_jpeg_encode_deinit(jpeg_fd);
-				goto error;
-			}
-		} else {
-			ALOGE("%s: No memory request function!", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+	timestamp = systemTime(1);
 
-		memcpy(jpeg_thumbnail_data_memory->data, jpeg_out_buffer, jpeg_out_size);
+	// V4L2
 
-		jpeg_thumbnail_data = jpeg_thumbnail_data_memory->data;
-		jpeg_thumbnail_size = jpeg_out_size;
+	rc = smdk4210_v4l2_poll(smdk4210_camera, 0);
+	if (rc < 0) {
+		ALOGE("%s: poll failed!", __func__);
+		return -1;
+	} else if (rc == 0) {
+		ALOGE("%s: poll timeout!", __func__);
+		return -1;
+	}
 
-		api_jpeg_encode_deinit(jpeg_fd);
+	index = smdk4210_v4l2_dqbuf_cap(smdk4210_camera, 0);
+	if (index < 0 || index >= smdk4210_camera->preview_buffers_count) {
+		ALOGE("%s: dqbuf failed!", __func__);
+		return -1;
 	}
 
-	// Picture
+	smdk4210_camera_queue_dequeued(&smdk4210_camera->preview_queue, index, systemTime(SYSTEM_TIME_MONOTONIC));
 
-	if (camera_picture_format == V4L2_PIX_FMT_JPEG && jpeg_main_data != NULL && jpeg_main_size >= 0) {
-		jpeg_data = jpeg_main_data;
-		jpeg_size = jpeg_main_size;
+	smdk4210_camera_preview_stats(smdk4210_camera, timestamp);
+
+	preview_data = (void *) ((int) smdk4210_camera->preview_memory->data +
+		index * smdk4210_camera->preview_frame_size);
+	smdk4210_camera_transform(smdk4210_camera, preview_data, smdk4210_camera->preview_width,
+		smdk4210_camera->preview_height, smdk4210_camera->preview_format,
+		&smdk4210_camera->preview_transform);
+	smdk4210_camera_request_frame(smdk4210_camera, preview_data,
+		smdk4210_camera->preview_frame_size, timestamp);
+
+	// Preview window
+
+	// In HFR, the display is only fed every other frame, callbacks get them all
+	if (smdk4210_camera->hfr > 0 && (smdk4210_camera->preview_frames_count & 1)) {
+		smdk4210_camera->preview_window_skipped++;
 	} else {
-		jpeg_fd = api_jpeg_encode_init();
-		if (jpeg_fd < 0) {
-			ALOGE("%s: Failed to init JPEG", __func__);
-			goto error;
-		}
+		width = smdk4210_camera->preview_transform.width;
+		height = smdk4210_camera->preview_transform.height;
 
-		switch (camera_picture_format) {
-			case V4L2_PIX_FMT_RGB565:
-				jpeg_in_format = RGB_565;
-				jpeg_out_format = JPEG_420;
-				break;
-			case V4L2_PIX_FMT_NV12:
-			case V4L2_PIX_FMT_NV21:
-			case V4L2_PIX_FMT_NV12T:
-			case V4L2_PIX_FMT_YUV420:
-				jpeg_in_format = YUV_420;
-				jpeg_out_format = JPEG_420;
-				break;
-			case V4L2_PIX_FMT_YUYV:
-			case V4L2_PIX_FMT_UYVY:
-			case V4L2_PIX_FMT_YUV422P:
-			default:
-				jpeg_in_format = YUV_422;
-				jpeg_out_format = JPEG_422;
-				break;
+		smdk4210_camera->preview_window->dequeue_buffer(smdk4210_camera->preview_window,
+			&buffer, &stride);
+		smdk4210_camera->gralloc->lock(smdk4210_camera->gralloc, *buffer, GRALLOC_USAGE_SW_WRITE_OFTEN,
+			0, 0, width, height, &window_data);
+
+		if (window_data == NULL) {
+			ALOGE("%s: gralloc lock failed!", __func__);
+			smdk4210_v4l2_qbuf_cap(smdk4210_camera, 0, index);
+			return -1;
 		}
 
-		jpeg_in_size = smdk4210_camera_buffer_length(picture_width, picture_height, camera_picture_format);
+		frame_size = smdk4210_camera->preview_frame_size;
+		offset = index * frame_size;
 
-		memset(&jpeg_enc_params, 0, sizeof(jpeg_enc_params));
+		preview_data = (void *) ((int) smdk4210_camera->preview_memory->data + offset);
+		memcpy(window_data, preview_data, frame_size);
 
-		jpeg_enc_params.width = picture_width;
-		jpeg_enc_params.height = picture_height;
-		jpeg_enc_params.in_fmt = jpeg_in_format;
-		jpeg_enc_params.out_fmt = jpeg_out_format;
+		smdk4210_camera->gralloc->unlock(smdk4210_camera->gralloc, *buffer);
+		smdk4210_camera->preview_window->enqueue_buffer(smdk4210_camera->preview_window,
+			buffer);
+	}
 
-		if (jpeg_quality >= 90)
-			jpeg_enc_params.quality = QUALITY_LEVEL_1;
-		else if (jpeg_quality >= 80)
-			jpeg_enc_params.quality = QUALITY_LEVEL_2;
-		else if (jpeg_quality >= 70)
-			jpeg_enc_params.quality = QUALITY_LEVEL_3;
-		else
-			jpeg_enc_params.quality = QUALITY_LEVEL_4;
+	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_FRAME) && SMDK4210_CAMERA_CALLBACK_DEFINED(data)) {
+		smdk4210_camera->callbacks.data(CAMERA_MSG_PREVIEW_FRAME,
+			smdk4210_camera->preview_memory, index, NULL, smdk4210_camera->callbacks.user);
+	}
 
-		api_jpeg_set_encode_param(&jpeg_enc_params);
+	if (smdk4210_camera->face_enabled) {
+		preview_data = (void *) ((int) smdk4210_camera->preview_memory->data +
+			index * smdk4210_camera->preview_frame_size);
+		smdk4210_camera_face_frame(smdk4210_camera, preview_data);
+	}
 
-		jpeg_in_buffer = api_jpeg_get_encode_in_buf(jpeg_fd, jpeg_in_size);
-		if (jpeg_in_buffer == NULL) {
-			ALOGE("%s: Failed to get JPEG in buffer", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+	// The frame is done with once the window copy and callbacks returned
+	smdk4210_camera_queue_released(&smdk4210_camera->preview_queue, index, systemTime(SYSTEM_TIME_MONOTONIC));
 
-		jpeg_out_buffer = api_jpeg_get_encode_out_buf(jpeg_fd);
-		if (jpeg_out_buffer == NULL) {
-			ALOGE("%s: Failed to get JPEG out buffer", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+	// Only then can the driver write to it again, the transform works in place
+	rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 0, index);
+	if (rc < 0) {
+		ALOGE("%s: qbuf failed!", __func__);
+		return -1;
+	}
 
-		memcpy(jpeg_in_buffer, smdk4210_camera->picture_memory->data, jpeg_in_size);
+	// Recording
 
-		jpeg_result = api_jpeg_encode_exe(jpeg_fd, &jpeg_enc_params);
-		if (jpeg_result != JPEG_ENCODE_OK) {
-			ALOGE("%s: Failed to encode JPEG", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+	if (smdk4210_camera->recording_enabled && smdk4210_camera->recording_memory != NULL) {
+		pthread_mutex_lock(&smdk4210_camera->recording_mutex);
 
-		jpeg_out_size = jpeg_enc_params.size;
-		if (jpeg_out_size <= 0) {
-			ALOGE("%s: Failed to get JPEG out size", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
-		}
+		// V4L2
 
-		if (smdk4210_camera->callbacks.request_memory != NULL) {
-			picture_data_memory =
-				smdk4210_camera->callbacks.request_memory(-1,
-					jpeg_out_size, 1, 0);
-			if (picture_data_memory == NULL) {
-				ALOGE("%s: picture memory request failed!", __func__);
-				api_jpeg_encode_deinit(jpeg_fd);
-				goto error;
-			}
-		} else {
-			ALOGE("%s: No memory request function!", __func__);
-			api_jpeg_encode_deinit(jpeg_fd);
-			goto error;
+		rc = smdk4210_v4l2_poll(smdk4210_camera, 2);
+		if (rc < 0) {
+			ALOGE("%s: poll failed!", __func__);
+			goto error_recording;
+		} else if (rc == 0) {
+			ALOGE("%s: poll timeout!", __func__);
+			goto error_recording;
 		}
 
-		memcpy(picture_data_memory->data, jpeg_out_buffer, jpeg_out_size);
+		// Physical addresses were resolved in recording start
+		index = smdk4210_v4l2_dqbuf_cap(smdk4210_camera, 2);
+		if (index < 0 || index >= smdk4210_camera->recording_buffers_count) {
+			ALOGE("%s: dqbuf failed!", __func__);
+			goto error_recording;
+		}
 
-		jpeg_data = picture_data_memory->data;
-		jpeg_size = jpeg_out_size;
+		// The encoder reads the buffer back through its physical address
+		if (smdk4210_camera->recording_frames_memory != NULL) {
+			recording_data = (void *) ((int) smdk4210_camera->recording_frames_memory->data +
+				index * smdk4210_camera->recording_frame_size);
+			smdk4210_camera_transform(smdk4210_camera, recording_data,
+				smdk4210_camera->recording_width, smdk4210_camera->recording_height,
+				smdk4210_camera->recording_format, &smdk4210_camera->recording_transform);
+		}
 
-		api_jpeg_encode_deinit(jpeg_fd);
-	}
+		if (smdk4210_camera->snapshot_requested)
+			smdk4210_camera_snapshot_capture(smdk4210_camera, index);
 
-	// EXIF
+		rc = smdk4210_camera_recording_pace(smdk4210_camera, timestamp, &timestamp);
+		if (rc == 0) {
+			// Decimated frame: give it straight back to the driver
+			rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 2, index);
+			if (rc < 0) {
+				ALOGE("%s: qbuf failed!", __func__);
+				goto error_recording;
+			}
 
-	memset(&exif_attributes, 0, sizeof(exif_attributes));
-	smdk4210_exif_attributes_create_static(smdk4210_camera, &exif_attributes);
-	smdk4210_exif_attributes_create_params(smdk4210_camera, &exif_attributes);
+			pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
 
-	rc = smdk4210_exif_create(smdk4210_camera, &exif_attributes,
-		jpeg_thumbnail_data, jpeg_thumbnail_size,
-		&exif_data_memory, &exif_size);
-	if (rc < 0 || exif_data_memory == NULL || exif_size <= 0) {
-		ALOGE("%s: EXIF create failed!", __func__);
-		goto error;
-	}
+			return 0;
+		}
 
-	data_size = exif_size + jpeg_size;
+		pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
 
-	if (smdk4210_camera->callbacks.request_memory != NULL) {
-		data_memory =
-			smdk4210_camera->callbacks.request_memory(-1,
-				data_size, 1, 0);
-		if (data_memory == NULL) {
-			ALOGE("%s: data memory request failed!", __func__);
-			goto error;
+		if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_VIDEO_FRAME) && SMDK4210_CAMERA_CALLBACK_DEFINED(data_timestamp)) {
+			smdk4210_camera_queue_dequeued(&smdk4210_camera->recording_queue, index, systemTime(SYSTEM_TIME_MONOTONIC));
+			smdk4210_camera->callbacks.data_timestamp(timestamp, CAMERA_MSG_VIDEO_FRAME,
+				smdk4210_camera->recording_memory, index, smdk4210_camera->callbacks.user);
+		} else {
+			rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 2, index);
+			if (rc < 0) {
+				ALOGE("%s: qbuf failed!", __func__);
+				return -1;
+			}
 		}
-	} else {
-		ALOGE("%s: No memory request function!", __func__);
-		goto error;
 	}
 
-	// Copy the first two bytes of the JPEG picture
-	memcpy(data_memory->data, jpeg_data, 2);
+	return 0;
 
-	// Copy the EXIF data
-	memcpy((void *) ((int) data_memory->data + 2), exif_data_memory->data,
-		exif_size);
+error_recording:
+	pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
 
-	// Copy the JPEG picture
-	memcpy((void *) ((int) data_memory->data + 2 + exif_size),
-		(void *) ((int) jpeg_data + 2), jpeg_size - 2);
+	return -1;
+}
 
-	// Callbacks
+void *smdk4210_camera_preview_thread(void *data)
+{
+	struct smdk4210_camera *smdk4210_camera;
+	int rc;
 
-	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_SHUTTER) && SMDK4210_CAMERA_CALLBACK_DEFINED(notify))
-		smdk4210_camera->callbacks.notify(CAMERA_MSG_SHUTTER, 0, 0,
-			smdk4210_camera->callbacks.user);
+	if (data == NULL)
+		return NULL;
 
-	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_COMPRESSED_IMAGE) && SMDK4210_CAMERA_CALLBACK_DEFINED(data) &&
-		data_memory != NULL)
-		smdk4210_camera->callbacks.data(CAMERA_MSG_COMPRESSED_IMAGE,
-			data_memory, 0, NULL, smdk4210_camera->callbacks.user);
+	smdk4210_camera = (struct smdk4210_camera *) data;
 
-	rc = 0;
-	goto complete;
+	ALOGE("%s: Starting thread", __func__);
+	smdk4210_camera->preview_thread_running = 1;
 
-error:
-	rc = -1;
+	if (smdk4210_camera->preview_window == NULL) {
+		// Lock preview lock mutex
+		pthread_mutex_lock(&smdk4210_camera->preview_lock_mutex);
+	}
 
-complete:
-	if (jpeg_thumbnail_data_memory != NULL && jpeg_thumbnail_data_memory->release != NULL)
-		jpeg_thumbnail_data_memory->release(jpeg_thumbnail_data_memory);
+	while (smdk4210_camera->preview_enabled == 1) {
+		pthread_mutex_lock(&smdk4210_camera->preview_mutex);
 
-	if (raw_thumbnail_data_memory != NULL && raw_thumbnail_data_memory->release != NULL)
-		raw_thumbnail_data_memory->release(raw_thumbnail_data_memory);
+		rc = smdk4210_camera_preview_config_update(smdk4210_camera);
+		if (rc < 0) {
+			ALOGE("%s: preview config update failed!", __func__);
+			smdk4210_camera->preview_enabled = 0;
+			pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
+			break;
+		}
 
-	if (picture_data_memory != NULL && picture_data_memory->release != NULL)
-		picture_data_memory->release(picture_data_memory);
+		rc = smdk4210_camera_preview(smdk4210_camera);
+		if (rc < 0) {
+			ALOGE("%s: preview failed!", __func__);
+			smdk4210_camera->preview_enabled = 0;
+		}
 
-	if (exif_data_memory != NULL && exif_data_memory->release != NULL)
-		exif_data_memory->release(exif_data_memory);
+		pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
+	}
 
-	if (data_memory != NULL && data_memory->release != NULL)
-		data_memory->release(data_memory);
+	smdk4210_camera->preview_thread_running = 0;
+	ALOGE("%s: Exiting thread", __func__);
 
-	return rc;
+	return NULL;
 }
 
-void *smdk4210_camera_picture_thread(void *data)
+int smdk4210_camera_preview_config_update(struct smdk4210_camera *smdk4210_camera)
 {
-	struct smdk4210_camera *smdk4210_camera;
+	struct smdk4210_camera_preview_config config;
 	int rc;
-	int i;
 
-	if (data == NULL)
-		return NULL;
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
 
-	smdk4210_camera = (struct smdk4210_camera *) data;
+	rc = smdk4210_camera_preview_config_get(smdk4210_camera, &config);
+	if (rc < 0)
+		return 0;
 
-	ALOGE("%s: Starting thread", __func__);
-	smdk4210_camera->picture_thread_running = 1;
+	if (config.width == smdk4210_camera->preview_width && config.height == smdk4210_camera->preview_height &&
+		config.format == smdk4210_camera->preview_format && config.hfr == smdk4210_camera->hfr &&
+		config.rotation == smdk4210_camera->preview_rotation) {
+		smdk4210_camera_preview_config_apply(smdk4210_camera, &config);
+		return 0;
+	}
 
-	if (smdk4210_camera->picture_enabled == 1) {
-		pthread_mutex_lock(&smdk4210_camera->picture_mutex);
+	ALOGD("%s: Restarting preview at %dx%d", __func__, config.width, config.height);
 
-		rc = smdk4210_camera_picture(smdk4210_camera);
-		if (rc < 0) {
-			ALOGE("%s: picture failed!", __func__);
-			smdk4210_camera->picture_enabled = 0;
-		}
+	smdk4210_camera_preview_stream_stop(smdk4210_camera);
 
-		if (smdk4210_camera->picture_memory != NULL && smdk4210_camera->picture_memory->release != NULL) {
-			smdk4210_camera->picture_memory->release(smdk4210_camera->picture_memory);
-			smdk4210_camera->picture_memory = NULL;
-		}
+	smdk4210_camera_preview_config_apply(smdk4210_camera, &config);
 
-		pthread_mutex_unlock(&smdk4210_camera->picture_mutex);
+	// The window geometry follows the transformed frames, set in stream start
+	rc = smdk4210_camera_preview_stream_start(smdk4210_camera);
+	if (rc < 0) {
+		ALOGE("%s: Unable to start preview stream", __func__);
+		return -1;
 	}
 
-	smdk4210_camera->picture_thread_running = 0;
-	smdk4210_camera->picture_enabled = 0;
-
-	ALOGE("%s: Exiting thread", __func__);
+	smdk4210_camera->preview_restarts_count++;
 
-	return NULL;
+	return 0;
 }
 
-int smdk4210_camera_picture_start(struct smdk4210_camera *smdk4210_camera)
+int smdk4210_camera_preview_stream_start(struct smdk4210_camera *smdk4210_camera)
 {
-	pthread_attr_t thread_attr;
-
-	int width, height, format, camera_format;
-
+	struct preview_stream_ops *preview_window;
+	struct v4l2_streamparm streamparm;
+	int width, height, format;
+	int fps, frame_size;
+	int min_buffers_count;
+	int buffers_count;
 	int fd;
+
 	int rc;
+	int i;
 
 	if (smdk4210_camera == NULL)
 		return -EINVAL;
 
-	// Stop preview thread
-	smdk4210_camera_preview_stop(smdk4210_camera);
-
-	width = smdk4210_camera->picture_width;
-	height = smdk4210_camera->picture_height;
-	format = smdk4210_camera->picture_format;
-	camera_format = smdk4210_camera->camera_picture_format;
+	// Sensor mode and output size have to be set before streaming
+	smdk4210_camera_control_flush(smdk4210_camera);
 
 	// V4L2
 
-	if (camera_format == 0)
-		camera_format = format;
+	format = smdk4210_camera->preview_format;
 
-	rc = smdk4210_v4l2_enum_fmt_cap(smdk4210_camera, 0, camera_format);
+	rc = smdk4210_v4l2_enum_fmt_cap(smdk4210_camera, 0, format);
 	if (rc < 0) {
 		ALOGE("%s: enum fmt failed!", __func__);
 		return -1;
 	}
 
-	rc = smdk4210_v4l2_s_fmt_pix_cap(smdk4210_camera, 0, width, height, camera_format, V4L2_PIX_FMT_MODE_CAPTURE);
+	width = smdk4210_camera->preview_width;
+	height = smdk4210_camera->preview_height;
+
+	rc = smdk4210_v4l2_s_fmt_pix_cap(smdk4210_camera, 0, width, height, format, V4L2_PIX_FMT_MODE_PREVIEW);
 	if (rc < 0) {
 		ALOGE("%s: s fmt failed!", __func__);
 		return -1;
 	}
 
-	// Only use 1 buffer
-	rc = smdk4210_v4l2_reqbufs_cap(smdk4210_camera, 0, 1);
+	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CACHEABLE, 1);
+	if (rc < 0) {
+		ALOGE("%s: s ctrl failed!", __func__);
+		return -1;
+	}
+
+	// HFR needs a deeper queue to absorb display and callback jitter
+	min_buffers_count = smdk4210_camera->hfr > 0 ? SMDK4210_CAMERA_HFR_MIN_BUFFERS_COUNT : SMDK4210_CAMERA_MIN_BUFFERS_COUNT;
+
+	fps = smdk4210_camera->hfr > 0 ? smdk4210_camera->hfr : smdk4210_camera->preview_fps;
+
+	buffers_count = smdk4210_camera_queue_count(&smdk4210_camera->preview_queue,
+		smdk4210_camera_buffer_length(width, height, format), fps, min_buffers_count);
+
+	for (i = buffers_count; i >= min_buffers_count; i--) {
+		rc = smdk4210_v4l2_reqbufs_cap(smdk4210_camera, 0, i);
+		if (rc >= 0)
+			break;
+	}
+
 	if (rc < 0) {
 		ALOGE("%s: reqbufs failed!", __func__);
 		return -1;
 	}
 
-	rc = smdk4210_v4l2_querybuf_cap(smdk4210_camera, 0, 0);
+	smdk4210_camera->preview_buffers_count = rc;
+	ALOGD("Found %d preview buffers available (%d requested)!", smdk4210_camera->preview_buffers_count,
+		buffers_count);
+	memset(&streamparm, 0, sizeof(streamparm));
+	streamparm.parm.capture.timeperframe.numerator = 1;
+	streamparm.parm.capture.timeperframe.denominator = fps;
+
+	rc = smdk4210_v4l2_s_parm_cap(smdk4210_camera, 0, &streamparm);
 	if (rc < 0) {
-		ALOGE("%s: querybuf failed!", __func__);
+		ALOGE("%s: s parm failed!", __func__);
 		return -1;
 	}
 
-	smdk4210_camera->picture_buffer_length = rc;
+	frame_size = smdk4210_camera_buffer_length(width, height, format);
+	for (i = 0; i < smdk4210_camera->preview_buffers_count; i++) {
+		rc = smdk4210_v4l2_querybuf_cap(smdk4210_camera, 0, i);
+		if (rc < 0) {
+			ALOGE("%s: querybuf failed!", __func__);
+			return -1;
+		}
+
+		if (rc < frame_size) {
+			ALOGE("%s: problematic frame size: %d/%d", __func__, rc, frame_size);
+			return -1;
+		}
+	}
+
+	frame_size = rc;
+	smdk4210_camera->preview_frame_size = frame_size;
+
+	smdk4210_camera->preview_last_timestamp = 0;
+	smdk4210_camera->preview_fps_timestamp = 0;
+	smdk4210_camera->preview_fps_frames = 0;
+	smdk4210_camera->preview_fps_achieved = 0;
+	smdk4210_camera->preview_frames_count = 0;
+	smdk4210_camera->preview_frames_dropped = 0;
+	smdk4210_camera->preview_window_skipped = 0;
 
 	if (smdk4210_camera->callbacks.request_memory != NULL) {
 		fd = smdk4210_v4l2_find_fd(smdk4210_camera, 0);
@@ -1511,13 +3453,13 @@ int smdk4210_camera_picture_start(struct smdk4210_camera *smdk4210_camera)
 			return -1;
 		}
 
-		if (smdk4210_camera->picture_memory != NULL && smdk4210_camera->picture_memory->release != NULL)
-			smdk4210_camera->picture_memory->release(smdk4210_camera->picture_memory);
+		if (smdk4210_camera->preview_memory != NULL && smdk4210_camera->preview_memory->release != NULL)
+			smdk4210_camera->preview_memory->release(smdk4210_camera->preview_memory);
 
-		smdk4210_camera->picture_memory =
+		smdk4210_camera->preview_memory =
 			smdk4210_camera->callbacks.request_memory(fd,
-				smdk4210_camera->picture_buffer_length, 1, 0);
-		if (smdk4210_camera->picture_memory == NULL) {
+				frame_size, smdk4210_camera->preview_buffers_count, 0);
+		if (smdk4210_camera->preview_memory == NULL) {
 			ALOGE("%s: memory request failed!", __func__);
 			return -1;
 		}
@@ -1526,786 +3468,1029 @@ int smdk4210_camera_picture_start(struct smdk4210_camera *smdk4210_camera)
 		return -1;
 	}
 
-	rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 0, 0);
+	for (i = 0; i < smdk4210_camera->preview_buffers_count; i++) {
+		rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 0, i);
+		if (rc < 0) {
+			ALOGE("%s: qbuf failed!", __func__);
+			return -1;
+		}
+	}
+
+	rc = smdk4210_camera_transform_setup(smdk4210_camera, 0, width, height, format,
+		smdk4210_camera->preview_rotation, &smdk4210_camera->preview_transform);
 	if (rc < 0) {
-		ALOGE("%s: qbuf failed!", __func__);
+		ALOGE("%s: transform setup failed!", __func__);
 		return -1;
 	}
 
+	preview_window = smdk4210_camera->preview_window;
+	if (preview_window != NULL) {
+		rc = preview_window->set_buffers_geometry(preview_window,
+			smdk4210_camera->preview_transform.width, smdk4210_camera->preview_transform.height,
+			smdk4210_gralloc_format(format));
+		if (rc)
+			ALOGE("%s: Unable to set buffers geometry", __func__);
+	}
+
 	rc = smdk4210_v4l2_streamon_cap(smdk4210_camera, 0);
 	if (rc < 0) {
 		ALOGE("%s: streamon failed!", __func__);
 		return -1;
 	}
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_CAPTURE, 0);
+	return 0;
+}
+
+void smdk4210_camera_preview_stream_stop(struct smdk4210_camera *smdk4210_camera)
+{
+	int rc;
+
+	if (smdk4210_camera == NULL)
+		return;
+
+	rc = smdk4210_v4l2_streamoff_cap(smdk4210_camera, 0);
 	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		return -1;
+		ALOGE("%s: streamoff failed!", __func__);
+	}
+
+	smdk4210_camera->preview_params_set = 0;
+
+	if (smdk4210_camera->preview_memory != NULL && smdk4210_camera->preview_memory->release != NULL) {
+		smdk4210_camera->preview_memory->release(smdk4210_camera->preview_memory);
+		smdk4210_camera->preview_memory = NULL;
+	}
+}
+
+int smdk4210_camera_preview_start(struct smdk4210_camera *smdk4210_camera)
+{
+	struct smdk4210_camera_preview_config config;
+	pthread_attr_t thread_attr;
+	int rc;
+
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
+
+	if (smdk4210_camera->preview_enabled) {
+		ALOGE("Preview was already started!");
+		return 0;
 	}
 
+	// Without a preview thread, the latest settings can be taken directly
+	rc = smdk4210_camera_preview_config_get(smdk4210_camera, &config);
+	if (rc >= 0)
+		smdk4210_camera_preview_config_apply(smdk4210_camera, &config);
+
+	rc = smdk4210_camera_preview_stream_start(smdk4210_camera);
+	if (rc < 0)
+		return -1;
+
 	// Thread
 
-	if (smdk4210_camera->picture_thread_running) {
-		ALOGE("Picture thread is already running!");
+	pthread_mutex_init(&smdk4210_camera->preview_mutex, NULL);
+	pthread_mutex_init(&smdk4210_camera->preview_lock_mutex, NULL);
+
+	// Lock preview lock
+	pthread_mutex_lock(&smdk4210_camera->preview_lock_mutex);
+
+	pthread_attr_init(&thread_attr);
+	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+
+	smdk4210_camera->preview_enabled = 1;
+
+	rc = pthread_create(&smdk4210_camera->preview_thread, &thread_attr,
+		smdk4210_camera_preview_thread, (void *) smdk4210_camera);
+	if (rc < 0) {
+		ALOGE("%s: Unable to create thread", __func__);
 		return -1;
 	}
 
-	pthread_mutex_init(&smdk4210_camera->picture_mutex, NULL);
+	return 0;
+}
+
+void smdk4210_camera_preview_stop(struct smdk4210_camera *smdk4210_camera)
+{
+	int i;
+
+	if (smdk4210_camera == NULL)
+		return;
+
+	if (!smdk4210_camera->preview_enabled) {
+		ALOGE("Preview was already stopped!");
+		return;
+	}
+
+	smdk4210_camera->preview_enabled = 0;
+
+	// Unlock preview lock
+	pthread_mutex_unlock(&smdk4210_camera->preview_lock_mutex);
+
+	pthread_mutex_lock(&smdk4210_camera->preview_mutex);
+
+	// Wait for the thread to end
+	for (i = 0; i < 10; i++) {
+		if (!smdk4210_camera->preview_thread_running)
+			break;
+
+		usleep(1000);
+	}
+
+	// Face detection does not outlive the preview
+	if (smdk4210_camera->face_enabled)
+		smdk4210_camera_face_stop(smdk4210_camera);
+
+	// Neither do requests, that need preview frames to complete
+	smdk4210_camera_request_abort(smdk4210_camera);
+
+	smdk4210_camera_preview_stream_stop(smdk4210_camera);
+
+	// The transform buffer is sized for the stream frames
+	smdk4210_transform_deinit(&smdk4210_camera->transform);
+
+	smdk4210_camera->preview_window = NULL;
+
+	pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
+
+	pthread_mutex_destroy(&smdk4210_camera->preview_lock_mutex);
+	pthread_mutex_destroy(&smdk4210_camera->preview_mutex);
+}
+
+// Recording
+
+int smdk4210_camera_recording_pace(struct smdk4210_camera *smdk4210_camera,
+	nsecs_t capture_timestamp, nsecs_t *timestamp)
+{
+	nsecs_t interval;
+	nsecs_t predicted;
+	nsecs_t t;
+
+	if (smdk4210_camera == NULL || timestamp == NULL)
+		return -EINVAL;
+
+	interval = smdk4210_camera->recording_frame_interval;
+	t = capture_timestamp;
+
+	if (interval <= 0) {
+		*timestamp = t;
+		goto complete;
+	}
+
+	// Decimation: only let frames through once they are due
+	if (smdk4210_camera->recording_next_timestamp != 0) {
+		if (t + interval / 2 < smdk4210_camera->recording_next_timestamp) {
+			smdk4210_camera->recording_frames_dropped++;
+			return 0;
+		}
+
+		smdk4210_camera->recording_next_timestamp += interval;
+
+		// Resynchronize after a stall rather than bursting frames
+		if (smdk4210_camera->recording_next_timestamp < t - interval)
+			smdk4210_camera->recording_next_timestamp = t + interval;
+	} else {
+		smdk4210_camera->recording_next_timestamp = t + interval;
+	}
+
+	// Smoothing: follow the nominal interval, slowly correcting drift
+	if (smdk4210_camera->recording_last_timestamp != 0) {
+		predicted = smdk4210_camera->recording_last_timestamp + interval;
+
+		if (t - predicted > interval || predicted - t > interval)
+			*timestamp = t;
+		else
+			*timestamp = predicted + (t - predicted) / 8;
+
+		if (*timestamp <= smdk4210_camera->recording_last_timestamp)
+			*timestamp = smdk4210_camera->recording_last_timestamp + 1;
+	} else {
+		*timestamp = t;
+	}
+
+complete:
+	smdk4210_camera->recording_last_timestamp = *timestamp;
+	smdk4210_camera->recording_frames_count++;
+
+	// Achieved frame rate, over roughly one second
+	if (smdk4210_camera->recording_fps_timestamp == 0) {
+		smdk4210_camera->recording_fps_timestamp = t;
+		smdk4210_camera->recording_fps_frames = 0;
+	} else {
+		smdk4210_camera->recording_fps_frames++;
+
+		if (t - smdk4210_camera->recording_fps_timestamp >= 1000000000LL) {
+			smdk4210_camera->recording_fps_achieved = (float) smdk4210_camera->recording_fps_frames * 1000000000.0f /
+				(float) (t - smdk4210_camera->recording_fps_timestamp);
+			smdk4210_camera->recording_fps_timestamp = t;
+			smdk4210_camera->recording_fps_frames = 0;
+		}
+	}
+
+	return 1;
+}
+
+void smdk4210_camera_recording_frame_release(struct smdk4210_camera *smdk4210_camera, void *data)
+{
+	struct smdk4210_camera_addrs *addrs;
+	int rc;
+
+	if (smdk4210_camera == NULL || data == NULL)
+		return;
+
+	addrs = (struct smdk4210_camera_addrs *) data;
+	if (addrs->index >= (unsigned int) smdk4210_camera->recording_buffers_count)
+		return;
 
-	pthread_attr_init(&thread_attr);
-	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+	pthread_mutex_lock(&smdk4210_camera->recording_mutex);
 
-	smdk4210_camera->picture_enabled = 1;
+	smdk4210_camera_queue_released(&smdk4210_camera->recording_queue, addrs->index, systemTime(SYSTEM_TIME_MONOTONIC));
 
-	rc = pthread_create(&smdk4210_camera->picture_thread, &thread_attr,
-		smdk4210_camera_picture_thread, (void *) smdk4210_camera);
+	rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 2, addrs->index);
 	if (rc < 0) {
-		ALOGE("%s: Unable to create thread", __func__);
-		return -1;
+		ALOGE("%s: qbuf failed!", __func__);
+		goto error;
 	}
 
-	return 0;
+error:
+	pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
 }
 
-void smdk4210_camera_picture_stop(struct smdk4210_camera *smdk4210_camera)
+int smdk4210_camera_recording_start(struct smdk4210_camera *smdk4210_camera)
 {
+	struct smdk4210_camera_addrs *addrs;
+	unsigned int y_addr;
+	unsigned int cbcr_addr;
+	int width, height, format;
+	int min_buffers_count;
+	int buffers_count;
+	int fd;
+
 	int rc;
 	int i;
 
 	if (smdk4210_camera == NULL)
-		return;
+		return -EINVAL;
 
-	if (!smdk4210_camera->picture_enabled) {
-		ALOGE("Picture was already stopped!");
-		return;
+	if (smdk4210_camera->recording_enabled) {
+		ALOGE("Recording was already started!");
+		return 0;
 	}
 
-	pthread_mutex_lock(&smdk4210_camera->picture_mutex);
+	smdk4210_camera_control_flush(smdk4210_camera);
 
-	// Disable picture to make the thread end
-	smdk4210_camera->picture_enabled = 0;
+	pthread_mutex_lock(&smdk4210_camera->preview_mutex);
 
-	pthread_mutex_unlock(&smdk4210_camera->picture_mutex);
+	// V4L2
 
-	// Wait for the thread to end
-	for (i = 0; i < 10; i++) {
-		if (!smdk4210_camera->picture_thread_running)
-			break;
+	format = smdk4210_camera->recording_format;
 
-		usleep(500);
+	rc = smdk4210_v4l2_enum_fmt_cap(smdk4210_camera, 2, format);
+	if (rc < 0) {
+		ALOGE("%s: enum fmt failed!", __func__);
+		goto error;
 	}
 
-	pthread_mutex_destroy(&smdk4210_camera->picture_mutex);
-}
-
-// Auto-focus
+	width = smdk4210_camera->recording_width;
+	height = smdk4210_camera->recording_height;
 
-void *smdk4210_camera_auto_focus_thread(void *data)
-{
-	struct smdk4210_camera *smdk4210_camera;
-	int auto_focus_status = -1;
-	int auto_focus_result = 0;
-	int rc;
-	int i;
+	rc = smdk4210_v4l2_s_fmt_pix_cap(smdk4210_camera, 2, width, height, format, V4L2_PIX_FMT_MODE_CAPTURE);
+	if (rc < 0) {
+		ALOGE("%s: s fmt failed!", __func__);
+		goto error;
+	}
 
-	if (data == NULL)
-		return NULL;
+	min_buffers_count = smdk4210_camera->hfr > 0 ? SMDK4210_CAMERA_HFR_MIN_BUFFERS_COUNT : SMDK4210_CAMERA_MIN_BUFFERS_COUNT;
 
-	smdk4210_camera = (struct smdk4210_camera *) data;
+	buffers_count = smdk4210_camera_queue_count(&smdk4210_camera->recording_queue,
+		smdk4210_camera_buffer_length(width, height, format), smdk4210_camera->recording_fps,
+		min_buffers_count);
 
-	ALOGE("%s: Starting thread", __func__);
-	smdk4210_camera->auto_focus_thread_running = 1;
+	for (i = buffers_count; i >= min_buffers_count; i--) {
+		rc = smdk4210_v4l2_reqbufs_cap(smdk4210_camera, 2, i);
+		if (rc >= 0)
+			break;
+	}
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_SET_AUTO_FOCUS, AUTO_FOCUS_ON);
 	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		auto_focus_result = 0;
-		goto thread_exit;
+		ALOGE("%s: reqbufs failed!", __func__);
+		goto error;
 	}
 
-	while (smdk4210_camera->auto_focus_enabled == 1) {
-		pthread_mutex_lock(&smdk4210_camera->auto_focus_mutex);
+	smdk4210_camera->recording_buffers_count = rc;
+	ALOGD("Found %d recording buffers available (%d requested)!", smdk4210_camera->recording_buffers_count,
+		buffers_count);
 
-		rc = smdk4210_v4l2_g_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_AUTO_FOCUS_RESULT, &auto_focus_status);
+	for (i = 0; i < smdk4210_camera->recording_buffers_count; i++) {
+		rc = smdk4210_v4l2_querybuf_cap(smdk4210_camera, 2, i);
 		if (rc < 0) {
-			ALOGE("%s: g ctrl failed!", __func__);
-			auto_focus_result = 0;
-			pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
-			goto thread_exit;
+			ALOGE("%s: querybuf failed!", __func__);
+			goto error;
 		}
 
-		if (auto_focus_status & M5MO_AF_STATUS_IN_PROGRESS) {
-			usleep(10000);
-		} else if (auto_focus_status == M5MO_AF_STATUS_SUCCESS || auto_focus_status == M5MO_AF_STATUS_1ST_SUCCESS) {
-			auto_focus_result = 1;
-			pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
-			goto thread_exit;
-		} else {
-			auto_focus_result = 0;
-			pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
-			goto thread_exit;
-		}
+		smdk4210_camera->recording_frame_size = rc;
 
-		pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
-	}
+		// Physical addresses are fixed for each buffer after reqbufs
+		y_addr = smdk4210_v4l2_s_ctrl(smdk4210_camera, 2, V4L2_CID_PADDR_Y, i);
+		if (y_addr == 0xffffffff) {
+			ALOGE("%s: s ctrl failed!", __func__);
+			goto error;
+		}
 
-thread_exit:
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CAMERA_SET_AUTO_FOCUS, AUTO_FOCUS_OFF);
-	if (rc < 0)
-		ALOGE("%s: s ctrl failed!", __func__);
+		cbcr_addr = smdk4210_v4l2_s_ctrl(smdk4210_camera, 2, V4L2_CID_PADDR_CBCR, i);
+		if (cbcr_addr == 0xffffffff) {
+			ALOGE("%s: s ctrl failed!", __func__);
+			goto error;
+		}
 
-	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_FOCUS) && SMDK4210_CAMERA_CALLBACK_DEFINED(notify))
-		smdk4210_camera->callbacks.notify(CAMERA_MSG_FOCUS,
-			(int32_t) auto_focus_result, 0, smdk4210_camera->callbacks.user);
+		smdk4210_camera->recording_y_addrs[i] = y_addr;
+		smdk4210_camera->recording_cbcr_addrs[i] = cbcr_addr;
+	}
 
-	smdk4210_camera->auto_focus_thread_running = 0;
-	smdk4210_camera->auto_focus_enabled = 0;
+	if (smdk4210_camera->callbacks.request_memory != NULL) {
+		if (smdk4210_camera->recording_memory != NULL && smdk4210_camera->recording_memory->release != NULL)
+			smdk4210_camera->recording_memory->release(smdk4210_camera->recording_memory);
 
-	ALOGE("%s: Exiting thread", __func__);
+		smdk4210_camera->recording_memory =
+			smdk4210_camera->callbacks.request_memory(-1, sizeof(struct smdk4210_camera_addrs),
+				smdk4210_camera->recording_buffers_count, 0);
+		if (smdk4210_camera->recording_memory == NULL) {
+			ALOGE("%s: memory request failed!", __func__);
+			goto error;
+		}
+	} else {
+		ALOGE("%s: No memory request function!", __func__);
+		goto error;
+	}
 
-	return NULL;
-}
+	// Frames are mapped for snapshots, that read from the recording buffers
+	fd = smdk4210_v4l2_find_fd(smdk4210_camera, 2);
+	if (fd < 0) {
+		ALOGE("%s: Unable to find v4l2 fd", __func__);
+		goto error;
+	}
 
-int smdk4210_camera_auto_focus_start(struct smdk4210_camera *smdk4210_camera)
-{
-	pthread_attr_t thread_attr;
-	int rc;
+	if (smdk4210_camera->recording_frames_memory != NULL && smdk4210_camera->recording_frames_memory->release != NULL)
+		smdk4210_camera->recording_frames_memory->release(smdk4210_camera->recording_frames_memory);
 
-	if (smdk4210_camera == NULL)
-		return -EINVAL;
+	smdk4210_camera->recording_frames_memory =
+		smdk4210_camera->callbacks.request_memory(fd, smdk4210_camera->recording_frame_size,
+			smdk4210_camera->recording_buffers_count, 0);
+	if (smdk4210_camera->recording_frames_memory == NULL)
+		ALOGE("%s: Unable to map recording frames, snapshots are disabled", __func__);
 
-	// Thread
+	addrs = (struct smdk4210_camera_addrs *) smdk4210_camera->recording_memory->data;
 
-	if (smdk4210_camera->auto_focus_thread_running) {
-		ALOGE("Auto-focus thread is already running!");
-		return -1;
+	for (i = 0; i < smdk4210_camera->recording_buffers_count; i++) {
+		addrs[i].type = 0; // kMetadataBufferTypeCameraSource
+		addrs[i].y = smdk4210_camera->recording_y_addrs[i];
+		addrs[i].cbcr = smdk4210_camera->recording_cbcr_addrs[i];
+		addrs[i].index = i;
+		addrs[i].reserved = 0;
 	}
 
-	pthread_mutex_init(&smdk4210_camera->auto_focus_mutex, NULL);
-
-	pthread_attr_init(&thread_attr);
-	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
-
-	smdk4210_camera->auto_focus_enabled = 1;
+	for (i = 0; i < smdk4210_camera->recording_buffers_count; i++) {
+		rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 2, i);
+		if (rc < 0) {
+			ALOGE("%s: qbuf failed!", __func__);
+			goto error;
+		}
+	}
 
-	rc = pthread_create(&smdk4210_camera->auto_focus_thread, &thread_attr,
-		smdk4210_camera_auto_focus_thread, (void *) smdk4210_camera);
+	// Only the sensor mounting applies, the encoder was set up for the video size
+	rc = smdk4210_camera_transform_setup(smdk4210_camera, 2, width, height, format, 0,
+		&smdk4210_camera->recording_transform);
 	if (rc < 0) {
-		ALOGE("%s: Unable to create thread", __func__);
-		return -1;
+		ALOGE("%s: transform setup failed!", __func__);
+		goto error;
 	}
 
-	return 0;
-}
+	rc = smdk4210_v4l2_streamon_cap(smdk4210_camera, 2);
+	if (rc < 0) {
+		ALOGE("%s: streamon failed!", __func__);
+		goto error;
+	}
 
-void smdk4210_camera_auto_focus_stop(struct smdk4210_camera *smdk4210_camera)
-{
-	int rc;
-	int i;
+	pthread_mutex_init(&smdk4210_camera->recording_mutex, NULL);
+	pthread_mutex_init(&smdk4210_camera->snapshot_mutex, NULL);
 
-	if (smdk4210_camera == NULL)
-		return;
+	smdk4210_camera->snapshot_requested = 0;
+	smdk4210_camera->snapshot_thread_running = 0;
+	smdk4210_camera->snapshot_thread_joinable = 0;
 
-	if (!smdk4210_camera->auto_focus_enabled) {
-		ALOGE("Auto-focus was already stopped!");
-		return;
-	}
+	if (smdk4210_camera->recording_fps > 0)
+		smdk4210_camera->recording_frame_interval = 1000000000LL / smdk4210_camera->recording_fps;
+	else
+		smdk4210_camera->recording_frame_interval = 0;
 
-	pthread_mutex_lock(&smdk4210_camera->auto_focus_mutex);
+	smdk4210_camera->recording_next_timestamp = 0;
+	smdk4210_camera->recording_last_timestamp = 0;
+	smdk4210_camera->recording_fps_timestamp = 0;
+	smdk4210_camera->recording_fps_frames = 0;
+	smdk4210_camera->recording_fps_achieved = 0;
+	smdk4210_camera->recording_frames_count = 0;
+	smdk4210_camera->recording_frames_dropped = 0;
 
-	// Disable auto-focus to make the thread end
-	smdk4210_camera->auto_focus_enabled = 0;
+	ALOGD("Recording at %d fps (sensor at %d fps)", smdk4210_camera->recording_fps,
+		smdk4210_camera->camera_frame_rate);
 
-	pthread_mutex_unlock(&smdk4210_camera->auto_focus_mutex);
+	smdk4210_camera->recording_enabled = 1;
 
-	// Wait for the thread to end
-	for (i = 0; i < 10; i++) {
-		if (!smdk4210_camera->auto_focus_thread_running)
-			break;
+	pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
 
-		usleep(500);
-	}
+	return 0;
+error:
+	pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
 
-	pthread_mutex_destroy(&smdk4210_camera->auto_focus_mutex);
+	return -1;
 }
 
-// Preview
-
-int smdk4210_camera_preview(struct smdk4210_camera *smdk4210_camera)
+void smdk4210_camera_recording_stop(struct smdk4210_camera *smdk4210_camera)
 {
-	buffer_handle_t *buffer;
-	int stride;
-
-	int width, height;
-
-	char *preview_format_string;
-	int frame_size, offset;
-	void *preview_data;
-	void *window_data;
+	int rc;
 
-	unsigned int recording_y_addr;
-	unsigned int recording_cbcr_addr;
-	nsecs_t timestamp;
-	struct smdk4210_camera_addrs *addrs;
-	struct timespec ts;
+	if (smdk4210_camera == NULL)
+		return;
 
-	int index;
-	int rc;
-	int i;
+	if (!smdk4210_camera->recording_enabled) {
+		ALOGE("Recording was already stopped!");
+		return;
+	}
 
-	if (smdk4210_camera == NULL || smdk4210_camera->preview_memory == NULL ||
-		smdk4210_camera->preview_window == NULL)
-		return -EINVAL;
+	smdk4210_camera->recording_enabled = 0;
 
-	timestamp = systemTime(1);
+	smdk4210_camera_snapshot_stop(smdk4210_camera);
 
-	// V4L2
+	pthread_mutex_lock(&smdk4210_camera->preview_mutex);
 
-	rc = smdk4210_v4l2_poll(smdk4210_camera, 0);
+	rc = smdk4210_v4l2_streamoff_cap(smdk4210_camera, 2);
 	if (rc < 0) {
-		ALOGE("%s: poll failed!", __func__);
-		return -1;
-	} else if (rc == 0) {
-		ALOGE("%s: poll timeout!", __func__);
-		return -1;
+		ALOGE("%s: streamoff failed!", __func__);
 	}
 
-	index = smdk4210_v4l2_dqbuf_cap(smdk4210_camera, 0);
-	if (index < 0 || index >= smdk4210_camera->preview_buffers_count) {
-		ALOGE("%s: dqbuf failed!", __func__);
-		return -1;
+	if (smdk4210_camera->recording_memory != NULL && smdk4210_camera->recording_memory->release != NULL) {
+		smdk4210_camera->recording_memory->release(smdk4210_camera->recording_memory);
+		smdk4210_camera->recording_memory = NULL;
 	}
 
-	rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 0, index);
-	if (rc < 0) {
-		ALOGE("%s: qbuf failed!", __func__);
-		return -1;
+	if (smdk4210_camera->recording_frames_memory != NULL && smdk4210_camera->recording_frames_memory->release != NULL) {
+		smdk4210_camera->recording_frames_memory->release(smdk4210_camera->recording_frames_memory);
+		smdk4210_camera->recording_frames_memory = NULL;
 	}
 
-	// Preview window
+	pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
 
-	width = smdk4210_camera->preview_width;
-	height = smdk4210_camera->preview_height;
+	pthread_mutex_destroy(&smdk4210_camera->snapshot_mutex);
+	pthread_mutex_destroy(&smdk4210_camera->recording_mutex);
+}
 
-	smdk4210_camera->preview_window->dequeue_buffer(smdk4210_camera->preview_window,
-		&buffer, &stride);
-	smdk4210_camera->gralloc->lock(smdk4210_camera->gralloc, *buffer, GRALLOC_USAGE_SW_WRITE_OFTEN,
-		0, 0, width, height, &window_data);
+// Snapshot
 
-	if (window_data == NULL) {
-		ALOGE("%s: gralloc lock failed!", __func__);
-		return -1;
-	}
+void *smdk4210_camera_snapshot_thread(void *data)
+{
+	struct smdk4210_camera *smdk4210_camera;
+	camera_memory_t *linear_memory = NULL;
+	camera_memory_t *raw_thumbnail_memory = NULL;
+	camera_memory_t *jpeg_thumbnail_memory = NULL;
+	camera_memory_t *jpeg_memory = NULL;
+	void *frame_data;
+	int jpeg_thumbnail_size = 0;
+	int jpeg_size = 0;
+	int width, height, format;
+	int thumbnail_width, thumbnail_height;
+	int frames_count, frames_dropped;
+	nsecs_t t;
+	int rc;
 
-	frame_size = smdk4210_camera->preview_frame_size;
-	offset = index * frame_size;
+	if (data == NULL)
+		return NULL;
 
-	preview_data = (void *) ((int) smdk4210_camera->preview_memory->data + offset);
-	memcpy(window_data, preview_data, frame_size);
+	smdk4210_camera = (struct smdk4210_camera *) data;
 
-	smdk4210_camera->gralloc->unlock(smdk4210_camera->gralloc, *buffer);
-	smdk4210_camera->preview_window->enqueue_buffer(smdk4210_camera->preview_window,
-		buffer);
+	ALOGD("%s: Starting thread", __func__);
 
-	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_FRAME) && SMDK4210_CAMERA_CALLBACK_DEFINED(data)) {
-		smdk4210_camera->callbacks.data(CAMERA_MSG_PREVIEW_FRAME,
-			smdk4210_camera->preview_memory, index, NULL, smdk4210_camera->callbacks.user);
-	}
+	pthread_mutex_lock(&smdk4210_camera->snapshot_mutex);
 
-	// Recording
+	width = smdk4210_camera->snapshot_width;
+	height = smdk4210_camera->snapshot_height;
+	format = smdk4210_camera->snapshot_format;
+	thumbnail_width = smdk4210_camera->jpeg_thumbnail_width;
+	thumbnail_height = smdk4210_camera->jpeg_thumbnail_height;
 
-	if (smdk4210_camera->recording_enabled && smdk4210_camera->recording_memory != NULL) {
-		pthread_mutex_lock(&smdk4210_camera->recording_mutex);
+	if (smdk4210_camera->callbacks.request_memory == NULL) {
+		ALOGE("%s: No memory request function!", __func__);
+		goto error;
+	}
 
-		// V4L2
+	frame_data = smdk4210_camera->snapshot_memory->data;
 
-		rc = smdk4210_v4l2_poll(smdk4210_camera, 2);
+	if (format == V4L2_PIX_FMT_NV12T) {
+		linear_memory = smdk4210_camera_pool_get(smdk4210_camera,
+			smdk4210_camera_buffer_length(width, height, V4L2_PIX_FMT_NV12));
+		if (linear_memory == NULL) {
+			ALOGE("%s: linear memory request failed!", __func__);
+			goto error;
+		}
+
+		rc = smdk4210_detile_nv12t(frame_data, width, height, linear_memory->data);
 		if (rc < 0) {
-			ALOGE("%s: poll failed!", __func__);
-			goto error_recording;
-		} else if (rc == 0) {
-			ALOGE("%s: poll timeout!", __func__);
-			goto error_recording;
+			ALOGE("%s: Detiling frame failed!", __func__);
+			goto error;
 		}
 
-		index = smdk4210_v4l2_dqbuf_cap(smdk4210_camera, 2);
-		if (index < 0) {
-			ALOGE("%s: dqbuf failed!", __func__);
-			goto error_recording;
+		frame_data = linear_memory->data;
+		format = V4L2_PIX_FMT_NV12;
+	}
+
+	// Thumbnail, disabled with a 0x0 size
+
+	if (thumbnail_width > 0 && thumbnail_height > 0) {
+		raw_thumbnail_memory = smdk4210_camera_pool_get(smdk4210_camera,
+			smdk4210_camera_buffer_length(thumbnail_width, thumbnail_height, format));
+		if (raw_thumbnail_memory == NULL) {
+			ALOGE("%s: raw thumbnail memory request failed!", __func__);
+			goto error;
 		}
 
-		recording_y_addr = smdk4210_v4l2_s_ctrl(smdk4210_camera, 2, V4L2_CID_PADDR_Y, index);
-		if (recording_y_addr == 0xffffffff) {
-			ALOGE("%s: s ctrl failed!", __func__);
-			goto error_recording;
+		rc = smdk4210_scale_nv12(frame_data, width, height, raw_thumbnail_memory->data,
+			thumbnail_width, thumbnail_height);
+		if (rc < 0) {
+			ALOGE("%s: Resizing frame failed!", __func__);
+			goto error;
 		}
 
-		recording_cbcr_addr = smdk4210_v4l2_s_ctrl(smdk4210_camera, 2, V4L2_CID_PADDR_CBCR, index);
-		if (recording_cbcr_addr == 0xffffffff) {
-			ALOGE("%s: s ctrl failed!", __func__);
-			goto error_recording;
+		rc = smdk4210_camera_jpeg_encode(smdk4210_camera, raw_thumbnail_memory->data,
+			thumbnail_width, thumbnail_height, format, smdk4210_camera->jpeg_thumbnail_quality,
+			&jpeg_thumbnail_memory, &jpeg_thumbnail_size);
+		if (rc < 0) {
+			ALOGE("%s: Thumbnail JPEG encode failed!", __func__);
+			goto error;
 		}
 
-		addrs = (struct smdk4210_camera_addrs *) smdk4210_camera->recording_memory->data;
+		smdk4210_camera_pool_put(smdk4210_camera, raw_thumbnail_memory);
+		raw_thumbnail_memory = NULL;
+	}
 
-		addrs[index].type = 0; // kMetadataBufferTypeCameraSource
-		addrs[index].y = recording_y_addr;
-		addrs[index].cbcr = recording_cbcr_addr;
-		addrs[index].index = index;
-		addrs[index].reserved = 0;
+	// Picture
 
-		pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
+	rc = smdk4210_camera_jpeg_encode(smdk4210_camera, frame_data, width, height, format,
+		smdk4210_camera->jpeg_quality, &jpeg_memory, &jpeg_size);
+	if (rc < 0) {
+		ALOGE("%s: Picture JPEG encode failed!", __func__);
+		goto error;
+	}
 
-		if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_VIDEO_FRAME) && SMDK4210_CAMERA_CALLBACK_DEFINED(data_timestamp)) {
-			smdk4210_camera->callbacks.data_timestamp(timestamp, CAMERA_MSG_VIDEO_FRAME,
-				smdk4210_camera->recording_memory, index, smdk4210_camera->callbacks.user);
-		} else {
-			rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 2, index);
-			if (rc < 0) {
-				ALOGE("%s: qbuf failed!", __func__);
-				return -1;
-			}
-		}
+	if (linear_memory != NULL) {
+		smdk4210_camera_pool_put(smdk4210_camera, linear_memory);
+		linear_memory = NULL;
 	}
 
-	return 0;
+	rc = smdk4210_camera_picture_callback(smdk4210_camera, jpeg_memory->data, jpeg_size,
+		jpeg_thumbnail_memory != NULL ? jpeg_thumbnail_memory->data : NULL, jpeg_thumbnail_size);
+	if (rc < 0)
+		goto error;
 
-error_recording:
-	pthread_mutex_lock(&smdk4210_camera->recording_mutex);
+	smdk4210_camera->snapshot_count++;
 
-	return -1;
-}
+	goto complete;
 
-void *smdk4210_camera_preview_thread(void *data)
-{
-	struct smdk4210_camera *smdk4210_camera;
-	int rc;
+error:
+	if (SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_ERROR) && SMDK4210_CAMERA_CALLBACK_DEFINED(notify))
+		smdk4210_camera->callbacks.notify(CAMERA_MSG_ERROR, CAMERA_ERROR_UNKNOWN, 0,
+			smdk4210_camera->callbacks.user);
 
-	if (data == NULL)
-		return NULL;
+complete:
+	if (jpeg_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, jpeg_memory);
 
-	smdk4210_camera = (struct smdk4210_camera *) data;
+	if (jpeg_thumbnail_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, jpeg_thumbnail_memory);
 
-	ALOGE("%s: Starting thread", __func__);
-	smdk4210_camera->preview_thread_running = 1;
+	if (raw_thumbnail_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, raw_thumbnail_memory);
 
-	if (smdk4210_camera->preview_window == NULL) {
-		// Lock preview lock mutex
-		pthread_mutex_lock(&smdk4210_camera->preview_lock_mutex);
-	}
+	if (linear_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, linear_memory);
 
-	while (smdk4210_camera->preview_enabled == 1) {
-		pthread_mutex_lock(&smdk4210_camera->preview_mutex);
+	// Recording must have kept its pace while the snapshot was encoded
+	t = systemTime(SYSTEM_TIME_MONOTONIC);
+	frames_count = smdk4210_camera->recording_frames_count - smdk4210_camera->snapshot_frames_base;
+	frames_dropped = smdk4210_camera->recording_frames_dropped - smdk4210_camera->snapshot_dropped_base;
 
-		rc = smdk4210_camera_preview(smdk4210_camera);
-		if (rc < 0) {
-			ALOGE("%s: preview failed!", __func__);
-			smdk4210_camera->preview_enabled = 0;
-		}
+	smdk4210_camera->snapshot_duration = t - smdk4210_camera->snapshot_timestamp;
+	smdk4210_camera->snapshot_frames_count = frames_count;
+	smdk4210_camera->snapshot_frames_dropped = frames_dropped;
 
-		pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
-	}
+	if (smdk4210_camera->snapshot_duration > 0)
+		smdk4210_camera->snapshot_fps = (float) frames_count * 1000000000.0f /
+			(float) smdk4210_camera->snapshot_duration;
 
-	smdk4210_camera->preview_thread_running = 0;
-	ALOGE("%s: Exiting thread", __func__);
+	ALOGD("Snapshot took %lld ms, %d recording frames delivered (%.2f fps), %d decimated",
+		smdk4210_camera->snapshot_duration / 1000000LL, frames_count,
+		smdk4210_camera->snapshot_fps, frames_dropped);
+
+	pthread_mutex_unlock(&smdk4210_camera->snapshot_mutex);
+
+	// The snapshot flags are all guarded by the recording lock
+	pthread_mutex_lock(&smdk4210_camera->recording_mutex);
+	smdk4210_camera->snapshot_thread_running = 0;
+	pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
+
+	ALOGD("%s: Exiting thread", __func__);
 
 	return NULL;
 }
 
-int smdk4210_camera_preview_start(struct smdk4210_camera *smdk4210_camera)
+void smdk4210_camera_snapshot_capture(struct smdk4210_camera *smdk4210_camera, int index)
 {
-	struct v4l2_streamparm streamparm;
-	int width, height, format;
-	int fps, frame_size;
-	int fd;
-
-	pthread_attr_t thread_attr;
-
+	void *frame_data;
 	int rc;
-	int i;
 
-	if (smdk4210_camera == NULL)
-		return -EINVAL;
+	if (smdk4210_camera == NULL || !smdk4210_camera->snapshot_requested)
+		return;
 
-	if (smdk4210_camera->preview_enabled) {
-		ALOGE("Preview was already started!");
-		return 0;
-	}
+	// This runs on the preview thread with the recording lock held:
+	// only copy the frame, encoding is deferred
+	smdk4210_camera->snapshot_requested = 0;
 
-	// V4L2
+	if (smdk4210_camera->recording_frames_memory == NULL || smdk4210_camera->snapshot_memory == NULL ||
+		index < 0 || index >= smdk4210_camera->recording_buffers_count)
+		return;
 
-	format = smdk4210_camera->preview_format;
+	frame_data = (void *) ((int) smdk4210_camera->recording_frames_memory->data +
+		index * smdk4210_camera->recording_frame_size);
+	memcpy(smdk4210_camera->snapshot_memory->data, frame_data,
+		smdk4210_camera->recording_frame_size);
 
-	rc = smdk4210_v4l2_enum_fmt_cap(smdk4210_camera, 0, format);
-	if (rc < 0) {
-		ALOGE("%s: enum fmt failed!", __func__);
-		return -1;
-	}
+	smdk4210_camera->snapshot_width = smdk4210_camera->recording_width;
+	smdk4210_camera->snapshot_height = smdk4210_camera->recording_height;
+	smdk4210_camera->snapshot_format = smdk4210_camera->recording_format;
+	smdk4210_camera->snapshot_timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+	smdk4210_camera->snapshot_frames_base = smdk4210_camera->recording_frames_count;
+	smdk4210_camera->snapshot_dropped_base = smdk4210_camera->recording_frames_dropped;
 
-	width = smdk4210_camera->preview_width;
-	height = smdk4210_camera->preview_height;
+	smdk4210_camera->snapshot_thread_running = 1;
 
-	rc = smdk4210_v4l2_s_fmt_pix_cap(smdk4210_camera, 0, width, height, format, V4L2_PIX_FMT_MODE_PREVIEW);
-	if (rc < 0) {
-		ALOGE("%s: s fmt failed!", __func__);
-		return -1;
+	// Joined in snapshot start or stop, that release the frame copy
+	rc = pthread_create(&smdk4210_camera->snapshot_thread, NULL,
+		smdk4210_camera_snapshot_thread, (void *) smdk4210_camera);
+	if (rc != 0) {
+		ALOGE("%s: Unable to create thread", __func__);
+		smdk4210_camera->snapshot_thread_running = 0;
+		return;
 	}
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_CACHEABLE, 1);
-	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		return -1;
-	}
+	smdk4210_camera->snapshot_thread_joinable = 1;
+}
 
-	for (i = SMDK4210_CAMERA_MAX_BUFFERS_COUNT; i >= SMDK4210_CAMERA_MIN_BUFFERS_COUNT; i--) {
-		rc = smdk4210_v4l2_reqbufs_cap(smdk4210_camera, 0, i);
-		if (rc >= 0)
-			break;
-	}
+int smdk4210_camera_snapshot_start(struct smdk4210_camera *smdk4210_camera)
+{
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
 
-	if (rc < 0) {
-		ALOGE("%s: reqbufs failed!", __func__);
+	if (!smdk4210_camera->recording_enabled || smdk4210_camera->recording_frames_memory == NULL) {
+		ALOGE("%s: Recording frames are not available!", __func__);
 		return -1;
 	}
 
-	smdk4210_camera->preview_buffers_count = rc;
-	ALOGD("Found %d preview buffers available!", smdk4210_camera->preview_buffers_count);
-
-	fps = smdk4210_camera->preview_fps;
-	memset(&streamparm, 0, sizeof(streamparm));
-	streamparm.parm.capture.timeperframe.numerator = 1;
-	streamparm.parm.capture.timeperframe.denominator = fps;
+	pthread_mutex_lock(&smdk4210_camera->recording_mutex);
 
-	rc = smdk4210_v4l2_s_parm_cap(smdk4210_camera, 0, &streamparm);
-	if (rc < 0) {
-		ALOGE("%s: s parm failed!", __func__);
-		return -1;
+	if (smdk4210_camera->snapshot_requested || smdk4210_camera->snapshot_thread_running) {
+		ALOGE("Snapshot is already in progress!");
+		goto error;
 	}
 
-	frame_size = smdk4210_camera_buffer_length(width, height, format);
-	for (i = 0; i < smdk4210_camera->preview_buffers_count; i++) {
-		rc = smdk4210_v4l2_querybuf_cap(smdk4210_camera, 0, i);
-		if (rc < 0) {
-			ALOGE("%s: querybuf failed!", __func__);
-			return -1;
-		}
-
-		if (rc < frame_size) {
-			ALOGE("%s: problematic frame size: %d/%d", __func__, rc, frame_size);
-			return -1;
-		}
+	// The previous snapshot thread has exited already
+	if (smdk4210_camera->snapshot_thread_joinable) {
+		pthread_join(smdk4210_camera->snapshot_thread, NULL);
+		smdk4210_camera->snapshot_thread_joinable = 0;
 	}
 
-	frame_size = rc;
-	smdk4210_camera->preview_frame_size = frame_size;
-
-	if (smdk4210_camera->callbacks.request_memory != NULL) {
-		fd = smdk4210_v4l2_find_fd(smdk4210_camera, 0);
-		if (fd < 0) {
-			ALOGE("%s: Unable to find v4l2 fd", __func__);
-			return -1;
-		}
-
-		if (smdk4210_camera->preview_memory != NULL && smdk4210_camera->preview_memory->release != NULL)
-			smdk4210_camera->preview_memory->release(smdk4210_camera->preview_memory);
-
-		smdk4210_camera->preview_memory =
-			smdk4210_camera->callbacks.request_memory(fd,
-				frame_size, smdk4210_camera->preview_buffers_count, 0);
-		if (smdk4210_camera->preview_memory == NULL) {
-			ALOGE("%s: memory request failed!", __func__);
-			return -1;
+	if (smdk4210_camera->snapshot_memory == NULL) {
+		if (smdk4210_camera->callbacks.request_memory != NULL) {
+			smdk4210_camera->snapshot_memory =
+				smdk4210_camera->callbacks.request_memory(-1,
+					smdk4210_camera->recording_frame_size, 1, 0);
+			if (smdk4210_camera->snapshot_memory == NULL) {
+				ALOGE("%s: memory request failed!", __func__);
+				goto error;
+			}
+		} else {
+			ALOGE("%s: No memory request function!", __func__);
+			goto error;
 		}
-	} else {
-		ALOGE("%s: No memory request function!", __func__);
-		return -1;
 	}
 
-	for (i = 0; i < smdk4210_camera->preview_buffers_count; i++) {
-		rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 0, i);
-		if (rc < 0) {
-			ALOGE("%s: qbuf failed!", __func__);
-			return -1;
-		}
-	}
+	smdk4210_camera->snapshot_requested = 1;
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_ROTATION,
-		smdk4210_camera->camera_rotation);
-	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		return -1;
-	}
+	pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_HFLIP,
-		smdk4210_camera->camera_hflip);
-	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		return -1;
-	}
+	return 0;
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 0, V4L2_CID_VFLIP,
-		smdk4210_camera->camera_vflip);
-	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		return -1;
-	}
+error:
+	pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
 
-	rc = smdk4210_v4l2_streamon_cap(smdk4210_camera, 0);
-	if (rc < 0) {
-		ALOGE("%s: streamon failed!", __func__);
-		return -1;
-	}
+	return -1;
+}
 
-	// Thread
+void smdk4210_camera_snapshot_stop(struct smdk4210_camera *smdk4210_camera)
+{
+	int joinable;
 
-	pthread_mutex_init(&smdk4210_camera->preview_mutex, NULL);
-	pthread_mutex_init(&smdk4210_camera->preview_lock_mutex, NULL);
+	if (smdk4210_camera == NULL)
+		return;
 
-	// Lock preview lock
-	pthread_mutex_lock(&smdk4210_camera->preview_lock_mutex);
+	// Capture holds the recording lock while it copies the frame
+	pthread_mutex_lock(&smdk4210_camera->recording_mutex);
+	smdk4210_camera->snapshot_requested = 0;
+	joinable = smdk4210_camera->snapshot_thread_joinable;
+	smdk4210_camera->snapshot_thread_joinable = 0;
+	pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
 
-	pthread_attr_init(&thread_attr);
-	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+	// Wait for the encoding to complete
+	if (joinable)
+		pthread_join(smdk4210_camera->snapshot_thread, NULL);
 
-	smdk4210_camera->preview_enabled = 1;
+	pthread_mutex_lock(&smdk4210_camera->recording_mutex);
 
-	rc = pthread_create(&smdk4210_camera->preview_thread, &thread_attr,
-		smdk4210_camera_preview_thread, (void *) smdk4210_camera);
-	if (rc < 0) {
-		ALOGE("%s: Unable to create thread", __func__);
-		return -1;
+	if (smdk4210_camera->snapshot_memory != NULL && smdk4210_camera->snapshot_memory->release != NULL) {
+		smdk4210_camera->snapshot_memory->release(smdk4210_camera->snapshot_memory);
+		smdk4210_camera->snapshot_memory = NULL;
 	}
 
-	return 0;
+	pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
 }
 
-void smdk4210_camera_preview_stop(struct smdk4210_camera *smdk4210_camera)
+// Face detection
+
+void *smdk4210_camera_face_thread(void *data)
 {
+	struct smdk4210_camera *smdk4210_camera;
+	struct smdk4210_face faces[SMDK4210_FACE_MAX_COUNT];
+	camera_frame_metadata_t metadata;
+	camera_face_t *face;
+	unsigned long cpu_mask;
+	int width, height;
+	int focus_x, focus_y;
+	int largest;
+	int count;
+	nsecs_t t;
 	int rc;
 	int i;
 
-	if (smdk4210_camera == NULL)
-		return;
+	if (data == NULL)
+		return NULL;
 
-	if (!smdk4210_camera->preview_enabled) {
-		ALOGE("Preview was already stopped!");
-		return;
-	}
+	smdk4210_camera = (struct smdk4210_camera *) data;
 
-	smdk4210_camera->preview_enabled = 0;
+	ALOGD("%s: Starting thread", __func__);
+	smdk4210_camera->face_thread_running = 1;
 
-	// Unlock preview lock
-	pthread_mutex_unlock(&smdk4210_camera->preview_lock_mutex);
+	// Keep off the core running the preview thread when possible
+	cpu_mask = 1 << 1;
+	syscall(__NR_sched_setaffinity, 0, sizeof(cpu_mask), &cpu_mask);
 
-	pthread_mutex_lock(&smdk4210_camera->preview_mutex);
+	pthread_mutex_lock(&smdk4210_camera->face_mutex);
 
-	// Wait for the thread to end
-	for (i = 0; i < 10; i++) {
-		if (!smdk4210_camera->preview_thread_running)
+	while (1) {
+		while (smdk4210_camera->face_enabled && !smdk4210_camera->face_pending)
+			pthread_cond_wait(&smdk4210_camera->face_cond, &smdk4210_camera->face_mutex);
+
+		if (!smdk4210_camera->face_enabled)
 			break;
 
-		usleep(1000);
-	}
+		smdk4210_camera->face_pending = 0;
+		smdk4210_camera->face_busy = 1;
 
-	rc = smdk4210_v4l2_streamoff_cap(smdk4210_camera, 0);
-	if (rc < 0) {
-		ALOGE("%s: streamoff failed!", __func__);
-	}
+		pthread_mutex_unlock(&smdk4210_camera->face_mutex);
 
-	smdk4210_camera->preview_params_set = 0;
+		t = systemTime(SYSTEM_TIME_MONOTONIC);
 
-	if (smdk4210_camera->preview_memory != NULL && smdk4210_camera->preview_memory->release != NULL) {
-		smdk4210_camera->preview_memory->release(smdk4210_camera->preview_memory);
-		smdk4210_camera->preview_memory = NULL;
-	}
+		count = smdk4210_face_detect(&smdk4210_camera->face_detector, (struct smdk4210_face *) &faces,
+			SMDK4210_FACE_MAX_COUNT, SMDK4210_FACE_BUDGET);
+		if (count < 0) {
+			ALOGE("%s: Face detection failed!", __func__);
+			count = 0;
+		}
 
-	smdk4210_camera->preview_window = NULL;
+		t = systemTime(SYSTEM_TIME_MONOTONIC) - t;
+
+		width = smdk4210_camera->face_detector.frame_width;
+		height = smdk4210_camera->face_detector.frame_height;
+		largest = 0;
+
+		// Android wants faces in the [-1000, 1000] range
+		for (i = 0; i < count; i++) {
+			face = &smdk4210_camera->faces[i];
+			memset(face, 0, sizeof(camera_face_t));
+
+			face->rect[0] = faces[i].x * 2000 / width - 1000;
+			face->rect[1] = faces[i].y * 2000 / height - 1000;
+			face->rect[2] = (faces[i].x + faces[i].size) * 2000 / width - 1000;
+			face->rect[3] = (faces[i].y + faces[i].size) * 2000 / height - 1000;
+			face->score = faces[i].score;
+			face->id = i + 1;
+			face->left_eye[0] = (faces[i].x + (faces[i].size * 27) / 100) * 2000 / width - 1000;
+			face->left_eye[1] = (faces[i].y + (faces[i].size * 33) / 100) * 2000 / height - 1000;
+			face->right_eye[0] = (faces[i].x + (faces[i].size * 72) / 100) * 2000 / width - 1000;
+			face->right_eye[1] = face->left_eye[1];
+			face->mouth[0] = (faces[i].x + faces[i].size / 2) * 2000 / width - 1000;
+			face->mouth[1] = (faces[i].y + (faces[i].size * 80) / 100) * 2000 / height - 1000;
+
+			if (faces[i].size > faces[largest].size)
+				largest = i;
+		}
 
-	pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
+		// Empty results are only sent once, to clear the faces
+		if ((count > 0 || smdk4210_camera->faces_count > 0) && smdk4210_camera->face_memory != NULL &&
+			SMDK4210_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_METADATA) && SMDK4210_CAMERA_CALLBACK_DEFINED(data)) {
+			metadata.number_of_faces = count;
+			metadata.faces = smdk4210_camera->faces;
 
-	pthread_mutex_destroy(&smdk4210_camera->preview_lock_mutex);
-	pthread_mutex_destroy(&smdk4210_camera->preview_mutex);
-}
+			smdk4210_camera->callbacks.data(CAMERA_MSG_PREVIEW_METADATA,
+				smdk4210_camera->face_memory, 0, &metadata, smdk4210_camera->callbacks.user);
+		}
 
-// Recording
+		smdk4210_camera->faces_count = count;
 
-void smdk4210_camera_recording_frame_release(struct smdk4210_camera *smdk4210_camera, void *data)
-{
-	struct smdk4210_camera_addrs *addrs;
-	int rc;
+		// Focus on the largest face, only when it moved noticeably
+		if (count > 0 && smdk4210_camera->focus_mode == FOCUS_MODE_FACEDETECT) {
+			focus_x = faces[largest].x + faces[largest].size / 2;
+			focus_y = faces[largest].y + faces[largest].size / 2;
 
-	if (smdk4210_camera == NULL || data == NULL)
-		return;
+			if (abs(focus_x - smdk4210_camera->face_focus_x) > width / 16 ||
+				abs(focus_y - smdk4210_camera->face_focus_y) > height / 16) {
+				smdk4210_camera->face_focus_x = focus_x;
+				smdk4210_camera->face_focus_y = focus_y;
 
-	addrs = (struct smdk4210_camera_addrs *) data;
-	if (addrs->index >= (unsigned int) smdk4210_camera->recording_buffers_count)
-		return;
+				rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_OBJECT_POSITION_X, focus_x);
+				if (rc < 0)
+					ALOGE("%s: Unable to queue control", __func__);
 
-	pthread_mutex_lock(&smdk4210_camera->recording_mutex);
+				rc = smdk4210_camera_control_set(smdk4210_camera, V4L2_CID_CAMERA_OBJECT_POSITION_Y, focus_y);
+				if (rc < 0)
+					ALOGE("%s: Unable to queue control", __func__);
+			}
+		}
 
-	rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 2, addrs->index);
-	if (rc < 0) {
-		ALOGE("%s: qbuf failed!", __func__);
-		goto error;
-	}
+		pthread_mutex_lock(&smdk4210_camera->face_mutex);
 
-error:
-	pthread_mutex_unlock(&smdk4210_camera->recording_mutex);
-}
+		smdk4210_camera->face_frames_count++;
+		smdk4210_camera->face_duration_sum += t;
+		if (t > smdk4210_camera->face_duration_max)
+			smdk4210_camera->face_duration_max = t;
+		if (smdk4210_camera->face_detector.budget_exceeded)
+			smdk4210_camera->face_budget_exceeded++;
 
-int smdk4210_camera_recording_start(struct smdk4210_camera *smdk4210_camera)
-{
-	int width, height, format;
-	int fd;
+		smdk4210_camera->face_busy = 0;
+	}
 
-	int rc;
-	int i;
+	smdk4210_camera->face_thread_running = 0;
+	pthread_cond_broadcast(&smdk4210_camera->face_cond);
 
-	if (smdk4210_camera == NULL)
-		return -EINVAL;
+	pthread_mutex_unlock(&smdk4210_camera->face_mutex);
 
-	if (smdk4210_camera->recording_enabled) {
-		ALOGE("Recording was already started!");
-		return 0;
-	}
+	ALOGD("%s: Exiting thread", __func__);
 
-	pthread_mutex_lock(&smdk4210_camera->preview_mutex);
+	return NULL;
+}
 
-	// V4L2
+void smdk4210_camera_face_frame(struct smdk4210_camera *smdk4210_camera, void *data)
+{
+	int width, height;
+	int rc;
 
-	format = smdk4210_camera->recording_format;
+	if (smdk4210_camera == NULL || data == NULL || !smdk4210_camera->face_enabled)
+		return;
 
-	rc = smdk4210_v4l2_enum_fmt_cap(smdk4210_camera, 2, format);
-	if (rc < 0) {
-		ALOGE("%s: enum fmt failed!", __func__);
-		goto error;
+	// Frames coming while the detector is busy are skipped
+	if (pthread_mutex_trylock(&smdk4210_camera->face_mutex) != 0) {
+		smdk4210_camera->face_frames_skipped++;
+		return;
 	}
 
-	width = smdk4210_camera->recording_width;
-	height = smdk4210_camera->recording_height;
-
-	rc = smdk4210_v4l2_s_fmt_pix_cap(smdk4210_camera, 2, width, height, format, V4L2_PIX_FMT_MODE_CAPTURE);
-	if (rc < 0) {
-		ALOGE("%s: s fmt failed!", __func__);
-		goto error;
-	}
+	// Face detection may have been stopped since the unlocked check
+	if (!smdk4210_camera->face_enabled)
+		goto complete;
 
-	for (i = SMDK4210_CAMERA_MAX_BUFFERS_COUNT; i >= SMDK4210_CAMERA_MIN_BUFFERS_COUNT; i--) {
-		rc = smdk4210_v4l2_reqbufs_cap(smdk4210_camera, 2, i);
-		if (rc >= 0)
-			break;
+	if (smdk4210_camera->face_busy || smdk4210_camera->face_pending) {
+		smdk4210_camera->face_frames_skipped++;
+		goto complete;
 	}
 
-	if (rc < 0) {
-		ALOGE("%s: reqbufs failed!", __func__);
-		goto error;
-	}
+	width = smdk4210_camera->preview_transform.width;
+	height = smdk4210_camera->preview_transform.height;
 
-	smdk4210_camera->recording_buffers_count = rc;
-	ALOGD("Found %d recording buffers available!", smdk4210_camera->recording_buffers_count);
+	if (width != smdk4210_camera->face_detector.frame_width ||
+		height != smdk4210_camera->face_detector.frame_height) {
+		smdk4210_face_detector_deinit(&smdk4210_camera->face_detector);
 
-	for (i = 0; i < smdk4210_camera->recording_buffers_count; i++) {
-		rc = smdk4210_v4l2_querybuf_cap(smdk4210_camera, 2, i);
+		rc = smdk4210_face_detector_init(&smdk4210_camera->face_detector, width, height);
 		if (rc < 0) {
-			ALOGE("%s: querybuf failed!", __func__);
-			goto error;
+			ALOGE("%s: Unable to init face detector", __func__);
+			goto complete;
 		}
 	}
 
-	if (smdk4210_camera->callbacks.request_memory != NULL) {
-		if (smdk4210_camera->recording_memory != NULL && smdk4210_camera->recording_memory->release != NULL)
-			smdk4210_camera->recording_memory->release(smdk4210_camera->recording_memory);
+	rc = smdk4210_face_decimate(&smdk4210_camera->face_detector, data, smdk4210_camera->preview_format);
+	if (rc < 0)
+		goto complete;
 
-		smdk4210_camera->recording_memory =
-			smdk4210_camera->callbacks.request_memory(-1, sizeof(struct smdk4210_camera_addrs),
-				smdk4210_camera->recording_buffers_count, 0);
-		if (smdk4210_camera->recording_memory == NULL) {
-			ALOGE("%s: memory request failed!", __func__);
-			goto error;
-		}
-	} else {
-		ALOGE("%s: No memory request function!", __func__);
-		goto error;
+	smdk4210_camera->face_pending = 1;
+	pthread_cond_signal(&smdk4210_camera->face_cond);
+
+complete:
+	pthread_mutex_unlock(&smdk4210_camera->face_mutex);
+}
+
+int smdk4210_camera_face_start(struct smdk4210_camera *smdk4210_camera)
+{
+	pthread_attr_t thread_attr;
+	int rc;
+
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&smdk4210_camera->face_mutex);
+
+	if (smdk4210_camera->face_enabled || smdk4210_camera->face_thread_running) {
+		pthread_mutex_unlock(&smdk4210_camera->face_mutex);
+		ALOGE("Face detection was already started!");
+		return 0;
 	}
 
-	for (i = 0; i < smdk4210_camera->recording_buffers_count; i++) {
-		rc = smdk4210_v4l2_qbuf_cap(smdk4210_camera, 2, i);
-		if (rc < 0) {
-			ALOGE("%s: qbuf failed!", __func__);
+	// Metadata callbacks still need a buffer to come with
+	if (smdk4210_camera->face_memory == NULL) {
+		if (smdk4210_camera->callbacks.request_memory != NULL) {
+			smdk4210_camera->face_memory =
+				smdk4210_camera->callbacks.request_memory(-1, 1, 1, 0);
+			if (smdk4210_camera->face_memory == NULL) {
+				ALOGE("%s: memory request failed!", __func__);
+				goto error;
+			}
+		} else {
+			ALOGE("%s: No memory request function!", __func__);
 			goto error;
 		}
 	}
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 2, V4L2_CID_ROTATION,
-		smdk4210_camera->camera_rotation);
-	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		goto error;
-	}
+	smdk4210_camera->face_pending = 0;
+	smdk4210_camera->face_busy = 0;
+	smdk4210_camera->faces_count = 0;
+	smdk4210_camera->face_focus_x = 0;
+	smdk4210_camera->face_focus_y = 0;
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 2, V4L2_CID_HFLIP,
-		smdk4210_camera->camera_hflip);
-	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		goto error;
-	}
+	pthread_attr_init(&thread_attr);
+	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
 
-	rc = smdk4210_v4l2_s_ctrl(smdk4210_camera, 2, V4L2_CID_VFLIP,
-		smdk4210_camera->camera_vflip);
-	if (rc < 0) {
-		ALOGE("%s: s ctrl failed!", __func__);
-		goto error;
-	}
+	smdk4210_camera->face_thread_running = 1;
+	smdk4210_camera->face_enabled = 1;
 
-	rc = smdk4210_v4l2_streamon_cap(smdk4210_camera, 2);
-	if (rc < 0) {
-		ALOGE("%s: streamon failed!", __func__);
+	rc = pthread_create(&smdk4210_camera->face_thread, &thread_attr,
+		smdk4210_camera_face_thread, (void *) smdk4210_camera);
+	if (rc != 0) {
+		ALOGE("%s: Unable to create thread", __func__);
+		smdk4210_camera->face_enabled = 0;
+		smdk4210_camera->face_thread_running = 0;
 		goto error;
 	}
 
-	pthread_mutex_init(&smdk4210_camera->recording_mutex, NULL);
-
-	smdk4210_camera->recording_enabled = 1;
-
-	pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
+	pthread_mutex_unlock(&smdk4210_camera->face_mutex);
 
 	return 0;
+
 error:
-	pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
+	pthread_mutex_unlock(&smdk4210_camera->face_mutex);
 
 	return -1;
 }
 
-void smdk4210_camera_recording_stop(struct smdk4210_camera *smdk4210_camera)
+void smdk4210_camera_face_stop(struct smdk4210_camera *smdk4210_camera)
 {
-	int rc;
-
 	if (smdk4210_camera == NULL)
 		return;
 
-	if (!smdk4210_camera->recording_enabled) {
-		ALOGE("Recording was already stopped!");
+	pthread_mutex_lock(&smdk4210_camera->face_mutex);
+
+	if (!smdk4210_camera->face_enabled) {
+		pthread_mutex_unlock(&smdk4210_camera->face_mutex);
+		ALOGE("Face detection was already stopped!");
 		return;
 	}
 
-	smdk4210_camera->recording_enabled = 0;
-
-	pthread_mutex_lock(&smdk4210_camera->preview_mutex);
+	// Disable face detection to make the thread end
+	smdk4210_camera->face_enabled = 0;
+	pthread_cond_broadcast(&smdk4210_camera->face_cond);
 
-	rc = smdk4210_v4l2_streamoff_cap(smdk4210_camera, 2);
-	if (rc < 0) {
-		ALOGE("%s: streamoff failed!", __func__);
-	}
+	while (smdk4210_camera->face_thread_running)
+		pthread_cond_wait(&smdk4210_camera->face_cond, &smdk4210_camera->face_mutex);
 
-	if (smdk4210_camera->recording_memory != NULL && smdk4210_camera->recording_memory->release != NULL) {
-		smdk4210_camera->recording_memory->release(smdk4210_camera->recording_memory);
-		smdk4210_camera->recording_memory = NULL;
-	}
+	// Under the lock, so that the preview thread can't init it again meanwhile
+	smdk4210_face_detector_deinit(&smdk4210_camera->face_detector);
 
-	pthread_mutex_unlock(&smdk4210_camera->preview_mutex);
+	pthread_mutex_unlock(&smdk4210_camera->face_mutex);
 
-	pthread_mutex_destroy(&smdk4210_camera->recording_mutex);
+	if (smdk4210_camera->face_memory != NULL && smdk4210_camera->face_memory->release != NULL) {
+		smdk4210_camera->face_memory->release(smdk4210_camera->face_memory);
+		smdk4210_camera->face_memory = NULL;
+	}
 }
 
 /*
@@ -2358,8 +4543,15 @@ int smdk4210_camera_set_preview_window(struct camera_device *device,
 		return -1;
 	}
 
-	width = smdk4210_camera->preview_width;
-	height = smdk4210_camera->preview_height;
+	// Once streaming, frames may have been turned in software
+	if (smdk4210_camera->preview_transform.width > 0 && smdk4210_camera->preview_transform.height > 0) {
+		width = smdk4210_camera->preview_transform.width;
+		height = smdk4210_camera->preview_transform.height;
+	} else {
+		width = smdk4210_camera->preview_width;
+		height = smdk4210_camera->preview_height;
+	}
+
 	format = smdk4210_camera->preview_format;
 
 	gralloc_format = smdk4210_gralloc_format(format);
@@ -2591,6 +4783,10 @@ int smdk4210_camera_take_picture(struct camera_device *device)
 
 	smdk4210_camera = (struct smdk4210_camera *) device->priv;
 
+	// Taking a picture would stop the preview and break the recording
+	if (smdk4210_camera->recording_enabled)
+		return smdk4210_camera_snapshot_start(smdk4210_camera);
+
 	return smdk4210_camera_picture_start(smdk4210_camera);
 }
 
@@ -2670,8 +4866,23 @@ void smdk4210_camera_put_parameters(struct camera_device *device, char *params)
 int smdk4210_camera_send_command(struct camera_device *device,
 	int32_t cmd, int32_t arg1, int32_t arg2)
 {
+	struct smdk4210_camera *smdk4210_camera;
+
 	ALOGD("%s(%p, %d, %d, %d)", __func__, device, cmd, arg1, arg2);
 
+	if (device == NULL || device->priv == NULL)
+		return -EINVAL;
+
+	smdk4210_camera = (struct smdk4210_camera *) device->priv;
+
+	switch (cmd) {
+		case CAMERA_CMD_START_FACE_DETECTION:
+			return smdk4210_camera_face_start(smdk4210_camera);
+		case CAMERA_CMD_STOP_FACE_DETECTION:
+			smdk4210_camera_face_stop(smdk4210_camera);
+			return 0;
+	}
+
 	return 0;
 }
 
@@ -2686,6 +4897,9 @@ void smdk4210_camera_release(struct camera_device *device)
 
 	smdk4210_camera = (struct smdk4210_camera *) device->priv;
 
+	if (smdk4210_camera->face_enabled)
+		smdk4210_camera_face_stop(smdk4210_camera);
+
 	if (smdk4210_camera->preview_memory != NULL && smdk4210_camera->preview_memory->release != NULL) {
 		smdk4210_camera->preview_memory->release(smdk4210_camera->preview_memory);
 		smdk4210_camera->preview_memory = NULL;
@@ -2699,10 +4913,211 @@ void smdk4210_camera_release(struct camera_device *device)
 	smdk4210_camera_deinit(smdk4210_camera);
 }
 
+static void smdk4210_camera_dump_flush(struct smdk4210_camera_dump *dump)
+{
+	int offset = 0;
+	int rc;
+
+	while (!dump->error && offset < dump->length) {
+		rc = write(dump->fd, dump->buffer + offset, dump->length - offset);
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc <= 0) {
+			ALOGE("%s: write failed!", __func__);
+			dump->error = 1;
+			break;
+		}
+
+		offset += rc;
+	}
+
+	dump->length = 0;
+}
+
+static void smdk4210_camera_dump_append(struct smdk4210_camera_dump *dump,
+	const char *format, ...)
+{
+	va_list ap;
+	int remaining;
+	int length;
+
+	if (dump->error)
+		return;
+
+	remaining = sizeof(dump->buffer) - dump->length;
+
+	va_start(ap, format);
+	length = vsnprintf(dump->buffer + dump->length, remaining, format, ap);
+	va_end(ap);
+
+	if (length < 0)
+		return;
+
+	// Write out what is already there when the line doesn't fit, then retry
+	if (length >= remaining && dump->length > 0) {
+		smdk4210_camera_dump_flush(dump);
+		if (dump->error)
+			return;
+
+		remaining = sizeof(dump->buffer);
+
+		va_start(ap, format);
+		length = vsnprintf(dump->buffer, remaining, format, ap);
+		va_end(ap);
+
+		if (length < 0)
+			return;
+	}
+
+	// Longer than the whole buffer: truncated
+	if (length >= remaining)
+		length = remaining - 1;
+
+	dump->length += length;
+}
+
 int smdk4210_camera_dump(struct camera_device *device, int fd)
 {
+	struct smdk4210_camera *smdk4210_camera;
+	struct smdk4210_camera_queue *queue;
+	struct smdk4210_camera_dump dump;
+	int rc;
+	int i;
+
 	ALOGD("%s(%p, %d)", __func__, device, fd);
 
+	if (device == NULL || device->priv == NULL || fd < 0)
+		return -EINVAL;
+
+	smdk4210_camera = (struct smdk4210_camera *) device->priv;
+
+	memset(&dump, 0, sizeof(dump));
+	dump.fd = fd;
+
+	smdk4210_camera_dump_append(&dump, "SMDK4210 Camera:\n");
+
+	smdk4210_camera_dump_append(&dump,
+		"  Preview: %dx%d, %d fps (range %d-%d), %d buffers, %d restarts\n",
+		smdk4210_camera->preview_width, smdk4210_camera->preview_height,
+		smdk4210_camera->preview_fps, smdk4210_camera->preview_fps_min,
+		smdk4210_camera->preview_fps_max, smdk4210_camera->preview_buffers_count,
+		smdk4210_camera->preview_restarts_count);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Preview frames: %d delivered, %d dropped, %d not displayed, achieved %.2f fps, HFR %d\n",
+		smdk4210_camera->preview_frames_count, smdk4210_camera->preview_frames_dropped,
+		smdk4210_camera->preview_window_skipped, smdk4210_camera->preview_fps_achieved,
+		smdk4210_camera->hfr);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Recording: %dx%d, target %d fps, sensor %d fps, achieved %.2f fps\n",
+		smdk4210_camera->recording_width, smdk4210_camera->recording_height,
+		smdk4210_camera->recording_fps, smdk4210_camera->camera_frame_rate,
+		smdk4210_camera->recording_fps_achieved);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Recording frames: %d delivered, %d decimated\n",
+		smdk4210_camera->recording_frames_count,
+		smdk4210_camera->recording_frames_dropped);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Snapshots: %d taken, last took %lld ms with %d frames delivered (%.2f fps), %d decimated\n",
+		smdk4210_camera->snapshot_count, smdk4210_camera->snapshot_duration / 1000000LL,
+		smdk4210_camera->snapshot_frames_count, smdk4210_camera->snapshot_fps,
+		smdk4210_camera->snapshot_frames_dropped);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Controls: %d applied, %d coalesced, queue latency average %lld us, max %lld us\n",
+		smdk4210_camera->control_applied_count, smdk4210_camera->control_coalesced_count,
+		smdk4210_camera->control_applied_count > 0 ? smdk4210_camera->control_latency_sum /
+		smdk4210_camera->control_applied_count / 1000LL : 0LL,
+		smdk4210_camera->control_latency_max / 1000LL);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Requests: %d completed, %d aborted, %d pending, %d in flight, frame %u\n",
+		smdk4210_camera->requests_completed_count, smdk4210_camera->requests_aborted_count,
+		smdk4210_camera->requests_count, smdk4210_camera->requests_in_flight_count,
+		smdk4210_camera->request_frame);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Face detection: %d frames, %d skipped, %d over budget, average %lld us, max %lld us, %d faces\n",
+		smdk4210_camera->face_frames_count, smdk4210_camera->face_frames_skipped,
+		smdk4210_camera->face_budget_exceeded,
+		smdk4210_camera->face_frames_count > 0 ? smdk4210_camera->face_duration_sum /
+		smdk4210_camera->face_frames_count / 1000LL : 0LL,
+		smdk4210_camera->face_duration_max / 1000LL, smdk4210_camera->faces_count);
+
+	for (i = 0; i < 2; i++) {
+		queue = i == 0 ? &smdk4210_camera->preview_queue : &smdk4210_camera->recording_queue;
+
+		smdk4210_camera_dump_append(&dump,
+			"  %s queue: %d buffers (budget %d, latency %d), latency estimate %lld us, "
+			"current max %lld us, average %lld us over %d frames\n",
+			i == 0 ? "Preview" : "Recording", queue->buffers_count, queue->budget_count,
+			queue->latency_count, queue->latency_estimate / 1000LL, queue->latency_max / 1000LL,
+			queue->latency_samples > 0 ? queue->latency_sum / queue->latency_samples / 1000LL : 0LL,
+			queue->latency_samples);
+	}
+
+	smdk4210_camera_dump_append(&dump,
+		"  Memory pool: %d kB in use, %d kB cached, peak %d kB, %d reused, %d allocated\n",
+		smdk4210_camera->memory_pool.used_size / 1024,
+		smdk4210_camera->memory_pool.cached_size / 1024,
+		smdk4210_camera->memory_pool.peak_size / 1024,
+		smdk4210_camera->memory_pool.hits, smdk4210_camera->memory_pool.misses);
+
+	smdk4210_camera_dump_append(&dump,
+		"  JPEG: %d hardware (average %lld ms), %d software (average %lld ms), %d fallbacks\n",
+		smdk4210_camera->jpeg_hardware_count,
+		smdk4210_camera->jpeg_hardware_count > 0 ? smdk4210_camera->jpeg_hardware_duration /
+		smdk4210_camera->jpeg_hardware_count / 1000000LL : 0LL,
+		smdk4210_camera->jpeg_software_count,
+		smdk4210_camera->jpeg_software_count > 0 ? smdk4210_camera->jpeg_software_duration /
+		smdk4210_camera->jpeg_software_count / 1000000LL : 0LL,
+		smdk4210_camera->jpeg_fallback_count);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Low-light: %s, last burst %d frames merged, %d rejected, %d over budget, %d timeouts, capture %lld ms, "
+		"align %lld ms, merge %lld ms, encode %lld ms, total %lld ms\n",
+		smdk4210_camera->low_light ? "on" : "off",
+		smdk4210_camera->burst_frames_merged, smdk4210_camera->burst_frames_rejected,
+		smdk4210_camera->burst_budget_exceeded, smdk4210_camera->burst_timeouts,
+		smdk4210_camera->burst_capture_duration / 1000000LL,
+		smdk4210_camera->burst_align_duration / 1000000LL,
+		smdk4210_camera->burst_merge_duration / 1000000LL,
+		smdk4210_camera->burst_encode_duration / 1000000LL,
+		smdk4210_camera->burst_duration / 1000000LL);
+
+	smdk4210_camera_dump_append(&dump,
+		"  Transform: preview rotation %d%s%s, recording rotation %d%s%s, zoom %d%%, "
+		"%d frames (average %lld us), %d failed\n",
+		smdk4210_camera->preview_transform.rotation,
+		smdk4210_camera->preview_transform.hflip ? " hflip" : "",
+		smdk4210_camera->preview_transform.vflip ? " vflip" : "",
+		smdk4210_camera->recording_transform.rotation,
+		smdk4210_camera->recording_transform.hflip ? " hflip" : "",
+		smdk4210_camera->recording_transform.vflip ? " vflip" : "",
+		smdk4210_camera->camera_software_zoom && smdk4210_camera->zoom_ratio > 100 ?
+		smdk4210_camera->zoom_ratio : 100,
+		smdk4210_camera->transform_frames_count,
+		smdk4210_camera->transform_frames_count > 0 ? smdk4210_camera->transform_duration /
+		smdk4210_camera->transform_frames_count / 1000LL : 0LL,
+		smdk4210_camera->transform_failures_count);
+
+	if (smdk4210_camera->v4l2_trace != NULL) {
+		rc = smdk4210_v4l2_trace_write(smdk4210_camera);
+
+		smdk4210_camera_dump_append(&dump,
+			"  V4L2 trace: %u requests recorded, %s %s\n",
+			smdk4210_camera->v4l2_trace->head, rc < 0 ? "unable to write" : "written to",
+			smdk4210_camera->v4l2_trace->path);
+	}
+
+	smdk4210_camera_dump_flush(&dump);
+	if (dump.error)
+		return -1;
+
 	return 0;
 }
 
@@ -26,6 +26,8 @@
 
 #include <Exif.h>
 
+#include <utils/Timers.h>
+
 #include <hardware/hardware.h>
 #include <hardware/camera.h>
 
@@ -34,8 +36,62 @@
 
 #define SMDK4210_CAMERA_MAX_PRESETS_COUNT		2
 #define SMDK4210_CAMERA_MAX_V4L2_NODES_COUNT	4
+#define SMDK4210_CAMERA_HFR_MIN_BUFFERS_COUNT	6
 #define SMDK4210_CAMERA_MIN_BUFFERS_COUNT		3
 #define SMDK4210_CAMERA_MAX_BUFFERS_COUNT		8
+#define SMDK4210_CAMERA_BUFFERS_MEMORY_BUDGET	(12 * 1024 * 1024)
+#define SMDK4210_CAMERA_POOL_BUFFERS_COUNT		8
+#define SMDK4210_CAMERA_POOL_MEMORY_BUDGET		(8 * 1024 * 1024)
+
+#define SMDK4210_CAMERA_CONTROLS_COUNT			32
+#define SMDK4210_CAMERA_CONTROL_VALUES_COUNT	64
+
+#define SMDK4210_CAMERA_REQUESTS_COUNT			16
+#define SMDK4210_CAMERA_REQUEST_CONTROLS_COUNT	8
+// Frames between setting controls and the first frame exposed with them
+#define SMDK4210_CAMERA_REQUEST_LATENCY			2
+
+#define SMDK4210_CAMERA_DUMP_BUFFER_SIZE		1024
+
+#define SMDK4210_FACE_MAX_COUNT				5
+#define SMDK4210_FACE_WIDTH_MAX				160
+#define SMDK4210_FACE_WINDOW_MIN			16
+#define SMDK4210_FACE_CANDIDATES_COUNT		128
+#define SMDK4210_FACE_NEIGHBOURS_MIN		2
+#define SMDK4210_FACE_SKIN_RATIO			60
+#define SMDK4210_FACE_DEVIATION_MIN			8
+#define SMDK4210_FACE_BUDGET				(8 * 1000000LL)
+
+#define SMDK4210_JPEG_HEADERS_LENGTH		1024
+// Small pictures are not worth the hardware encoder setup
+#define SMDK4210_JPEG_SOFTWARE_PIXELS_MAX	(320 * 240)
+// While recording, the hardware encoder competes with the MFC
+#define SMDK4210_JPEG_RECORDING_PIXELS_MAX	(1280 * 720)
+#define SMDK4210_JPEG_HARDWARE_RETRY_DELAY	(1000 * 1000000LL)
+
+#define SMDK4210_BURST_FRAMES_COUNT			4
+#define SMDK4210_BURST_BUFFERS_COUNT		2
+#define SMDK4210_BURST_BUDGET				(1500 * 1000000LL)
+// NEON paths assume a decimation of 4
+#define SMDK4210_BURST_DECIMATION			4
+#define SMDK4210_BURST_BLOCK_SIZE			32
+#define SMDK4210_BURST_SEARCH_RADIUS		6
+#define SMDK4210_BURST_BLOCKS_COLUMNS		4
+#define SMDK4210_BURST_BLOCKS_ROWS			3
+#define SMDK4210_BURST_BLOCKS_COUNT			(SMDK4210_BURST_BLOCKS_COLUMNS * SMDK4210_BURST_BLOCKS_ROWS)
+#define SMDK4210_BURST_REFINE_SIZE			256
+#define SMDK4210_BURST_TEXTURE_MIN			4
+#define SMDK4210_BURST_THRESHOLD			24
+
+#define SMDK4210_TRANSFORM_PLANES_COUNT		3
+// Transposed in blocks of 32x32 pixels, well within the L1 cache
+#define SMDK4210_TRANSFORM_BLOCK_SIZE		32
+
+#define SMDK4210_V4L2_TRACE_MAGIC			0x54344c56
+#define SMDK4210_V4L2_TRACE_VERSION			1
+#define SMDK4210_V4L2_TRACE_ENTRIES_COUNT	4096
+#define SMDK4210_V4L2_TRACE_ARGS_COUNT		6
+#define SMDK4210_V4L2_TRACE_POLL			0
 
 #define SMDK4210_CAMERA_MSG_ENABLED(msg) \
 	(smdk4210_camera->messages_enabled & msg)
@@ -43,6 +99,7 @@
 	(smdk4210_camera->callbacks.cb != NULL)
 
 #define SMDK4210_CAMERA_ALIGN(value) ((value + (0x10000 - 1)) & ~(0x10000 - 1))
+#define SMDK4210_CAMERA_TILE_ALIGN(value, align) (((value) + ((align) - 1)) & ~((align) - 1))
 
 /*
  * Structures
@@ -96,6 +153,8 @@ struct smdk4210_camera_params {
 	char *recording_size;
 	char *recording_size_values;
 	char *recording_format;
+	char *video_hfr;
+	char *video_hfr_values;
 
 	char *focus_mode;
 	char *focus_mode_values;
@@ -139,6 +198,9 @@ struct smdk4210_camera_preset {
 	int hflip;
 	int vflip;
 
+	// The sensor has no zoom, it is done on the frames
+	int software_zoom;
+
 	int picture_format;
 
 	float focal_length;
@@ -147,6 +209,9 @@ struct smdk4210_camera_preset {
 
 	int metering;
 
+	int hfr_width;
+	int hfr_height;
+
 	struct smdk4210_camera_params params;
 };
 
@@ -155,12 +220,251 @@ struct smdk4210_v4l2_node {
 	char *node;
 };
 
+struct smdk4210_v4l2_ops {
+	int (*open)(int id, char *node);
+	int (*close)(int fd);
+	int (*ioctl)(int fd, int request, void *data);
+	int (*poll)(int fd, int timeout);
+};
+
+struct smdk4210_v4l2_sim_config {
+	int fps;
+	int jitter;
+	int auto_focus_frames;
+	int controls_latency;
+};
+
+/*
+ * The trace file is a header followed by the entries, oldest first.
+ * Timestamps are relative to the start of the trace.
+ */
+
+struct smdk4210_v4l2_trace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_size;
+	uint32_t entries_count;
+	uint32_t dropped_count;
+};
+
+struct smdk4210_v4l2_trace_entry {
+	int64_t timestamp;
+	int32_t duration;
+	uint32_t request;
+	int32_t node;
+	int32_t rc;
+	int32_t args[SMDK4210_V4L2_TRACE_ARGS_COUNT];
+};
+
+struct smdk4210_v4l2_trace {
+	struct smdk4210_v4l2_trace_entry *entries;
+	unsigned int head;
+	nsecs_t base_timestamp;
+	char *path;
+
+	pthread_mutex_t mutex;
+};
+
 struct exynox_camera_config {
 	struct smdk4210_camera_preset *presets;
 	int presets_count;
 
 	struct smdk4210_v4l2_node *v4l2_nodes;
 	int v4l2_nodes_count;
+
+	// Kernel backend when NULL
+	struct smdk4210_v4l2_ops *v4l2_ops;
+	// Taken from the debug.camera.v4l2_trace property when NULL
+	char *v4l2_trace_path;
+};
+
+struct smdk4210_camera_queue {
+	int buffers_count;
+	int budget_count;
+	int latency_count;
+
+	nsecs_t dequeue_timestamps[SMDK4210_CAMERA_MAX_BUFFERS_COUNT];
+	nsecs_t latency_estimate;
+	nsecs_t latency_max;
+	nsecs_t latency_sum;
+	int latency_samples;
+};
+
+struct smdk4210_camera_control {
+	unsigned int id;
+	int value;
+	nsecs_t timestamp;
+};
+
+struct smdk4210_camera;
+
+struct smdk4210_camera_request_result {
+	unsigned int id;
+	int status;
+	unsigned int frame;
+	nsecs_t timestamp;
+
+	struct smdk4210_camera_control *controls;
+	int controls_count;
+
+	void *output;
+	int output_size;
+};
+
+struct smdk4210_camera_request {
+	unsigned int id;
+	struct smdk4210_camera_control controls[SMDK4210_CAMERA_REQUEST_CONTROLS_COUNT];
+	int controls_count;
+
+	// Optional, the preview frame is copied there
+	void *output;
+	int output_size;
+
+	void (*callback)(struct smdk4210_camera *smdk4210_camera,
+		struct smdk4210_camera_request_result *result, void *data);
+	void *data;
+
+	// Frame the controls are expected to show on
+	unsigned int frame;
+	// Negative when a control could not be set, its value is then the session one
+	int status;
+};
+
+struct smdk4210_face {
+	int x;
+	int y;
+	int size;
+	int score;
+};
+
+struct smdk4210_face_detector {
+	int frame_width;
+	int frame_height;
+	int decimation;
+
+	// Decimated planes
+	int width;
+	int height;
+	unsigned char *luma;
+	unsigned char *skin;
+	unsigned int *luma_integral;
+	unsigned int *luma_squared_integral;
+	unsigned int *skin_integral;
+
+	int windows_count;
+	int budget_exceeded;
+};
+
+struct smdk4210_jpeg {
+	unsigned char *buffer;
+	int size;
+	int offset;
+	int overflow;
+
+	unsigned int bits;
+	int bits_count;
+	int dc[3];
+
+	unsigned char quantization[2][64];
+	unsigned short reciprocals[2][64];
+	unsigned short codes[4][256];
+	unsigned char sizes[4][256];
+};
+
+struct smdk4210_burst {
+	int width;
+	int height;
+	int format;
+	int luma_offset;
+	unsigned char *reference;
+	unsigned short *accumulator;
+	int frames_count;
+
+	// Downscaled luma, for alignment
+	int luma_width;
+	int luma_height;
+	unsigned char *reference_luma;
+	unsigned char *luma;
+};
+
+struct smdk4210_transform_plane {
+	int offset;
+	int width;
+	int height;
+	// Bytes per element: interleaved chroma pairs and RGB565 are 2
+	int size;
+};
+
+struct smdk4210_transform {
+	unsigned char *buffer;
+	int buffer_size;
+
+	// Bilinear scaling: vertically interpolated row, horizontal taps
+	unsigned char *row;
+	int row_size;
+	int *taps;
+	int taps_size;
+	int *chroma_taps;
+	int chroma_taps_size;
+};
+
+// Part of the rotation and flips left to software, and the frame size it gives
+struct smdk4210_transform_config {
+	int rotation;
+	int hflip;
+	int vflip;
+	int width;
+	int height;
+};
+
+struct smdk4210_burst_job {
+	struct smdk4210_camera *camera;
+	unsigned char *frame;
+	int shift_x;
+	int shift_y;
+	int row_start;
+	int row_end;
+};
+
+struct smdk4210_camera_dump {
+	int fd;
+	char buffer[SMDK4210_CAMERA_DUMP_BUFFER_SIZE];
+	int length;
+	int error;
+};
+
+struct smdk4210_camera_preview_config {
+	int width;
+	int height;
+	int format;
+	int fps;
+	int hfr;
+	int recording_fps;
+	int rotation;
+	int fps_min;
+	int fps_max;
+	int recording_width;
+	int recording_height;
+	int recording_format;
+	int zoom_ratio;
+	int low_light;
+};
+
+struct smdk4210_camera_pool_buffer {
+	camera_memory_t *memory;
+	int size;
+	int used;
+};
+
+struct smdk4210_camera_pool {
+	struct smdk4210_camera_pool_buffer buffers[SMDK4210_CAMERA_POOL_BUFFERS_COUNT];
+	pthread_mutex_t mutex;
+
+	int used_size;
+	int cached_size;
+	int peak_size;
+	int hits;
+	int misses;
 };
 
 struct smdk4210_camera_callbacks {
@@ -173,6 +477,7 @@ struct smdk4210_camera_callbacks {
 
 struct smdk4210_camera {
 	int v4l2_fds[SMDK4210_CAMERA_MAX_V4L2_NODES_COUNT];
+	struct smdk4210_v4l2_trace *v4l2_trace;
 
 	struct exynox_camera_config *config;
 	struct smdk4210_param *params;
@@ -182,6 +487,68 @@ struct smdk4210_camera {
 
 	gralloc_module_t *gralloc;
 
+	// Intermediate buffers for pictures and snapshots
+	struct smdk4210_camera_pool memory_pool;
+
+	// JPEG
+	nsecs_t jpeg_hardware_failure_timestamp;
+	int jpeg_hardware_count;
+	int jpeg_software_count;
+	int jpeg_fallback_count;
+	nsecs_t jpeg_hardware_duration;
+	nsecs_t jpeg_software_duration;
+
+	// Control
+	pthread_t control_thread;
+	pthread_mutex_t control_mutex;
+	pthread_cond_t control_cond;
+	int control_thread_running;
+
+	int control_enabled;
+	int control_busy;
+	struct smdk4210_camera_control controls[SMDK4210_CAMERA_CONTROLS_COUNT];
+	int controls_count;
+	// Session values, that requests go back to once retired
+	struct smdk4210_camera_control control_values[SMDK4210_CAMERA_CONTROL_VALUES_COUNT];
+	int control_values_count;
+	int control_applied_count;
+	int control_coalesced_count;
+	nsecs_t control_latency_max;
+	nsecs_t control_latency_sum;
+
+	// Requests
+	pthread_mutex_t request_mutex;
+	struct smdk4210_camera_request requests[SMDK4210_CAMERA_REQUESTS_COUNT];
+	int requests_head;
+	int requests_count;
+	struct smdk4210_camera_request requests_in_flight[SMDK4210_CAMERA_REQUEST_LATENCY];
+	int requests_in_flight_count;
+	unsigned int request_id;
+	unsigned int request_frame;
+	int requests_completed_count;
+	int requests_aborted_count;
+
+	// Face detection
+	pthread_t face_thread;
+	pthread_mutex_t face_mutex;
+	pthread_cond_t face_cond;
+	int face_thread_running;
+
+	int face_enabled;
+	int face_pending;
+	int face_busy;
+	struct smdk4210_face_detector face_detector;
+	camera_memory_t *face_memory;
+	camera_face_t faces[SMDK4210_FACE_MAX_COUNT];
+	int faces_count;
+	int face_focus_x;
+	int face_focus_y;
+	int face_frames_count;
+	int face_frames_skipped;
+	int face_budget_exceeded;
+	nsecs_t face_duration_max;
+	nsecs_t face_duration_sum;
+
 	// Picture
 	pthread_t picture_thread;
 	pthread_mutex_t picture_mutex;
@@ -191,6 +558,34 @@ struct smdk4210_camera {
 	camera_memory_t *picture_memory;
 	int picture_buffer_length;
 
+	// Low-light burst
+	int low_light;
+	struct smdk4210_burst burst;
+	pthread_t burst_thread;
+	pthread_mutex_t burst_mutex;
+	pthread_cond_t burst_cond;
+	int burst_thread_enabled;
+	struct smdk4210_burst_job burst_job;
+	int burst_job_pending;
+	int burst_frames_merged;
+	int burst_frames_rejected;
+	int burst_budget_exceeded;
+	int burst_timeouts;
+	nsecs_t burst_capture_duration;
+	nsecs_t burst_align_duration;
+	nsecs_t burst_merge_duration;
+	nsecs_t burst_encode_duration;
+	nsecs_t burst_duration;
+
+	// Software transform
+	struct smdk4210_transform transform;
+	struct smdk4210_transform_config preview_transform;
+	struct smdk4210_transform_config recording_transform;
+	int zoom_ratio;
+	int transform_frames_count;
+	int transform_failures_count;
+	nsecs_t transform_duration;
+
 	// Auto-focus
 	pthread_t auto_focus_thread;
 	pthread_mutex_t auto_focus_mutex;
@@ -210,6 +605,23 @@ struct smdk4210_camera {
 	int preview_buffers_count;
 	int preview_frame_size;
 	int preview_params_set;
+	struct smdk4210_camera_queue preview_queue;
+
+	// Settings snapshots, swapped in by params apply. The preview thread reads
+	// them without locking, which only holds with a single writer at a time
+	pthread_mutex_t preview_config_mutex;
+	struct smdk4210_camera_preview_config preview_configs[2];
+	struct smdk4210_camera_preview_config *volatile preview_config;
+	struct smdk4210_camera_preview_config *volatile preview_config_hazard;
+	int preview_restarts_count;
+
+	nsecs_t preview_last_timestamp;
+	nsecs_t preview_fps_timestamp;
+	int preview_fps_frames;
+	float preview_fps_achieved;
+	int preview_frames_count;
+	int preview_frames_dropped;
+	int preview_window_skipped;
 
 	// Recording
 	pthread_mutex_t recording_mutex;
@@ -217,22 +629,63 @@ struct smdk4210_camera {
 	int recording_enabled;
 	camera_memory_t *recording_memory;
 	int recording_buffers_count;
+	struct smdk4210_camera_queue recording_queue;
+	unsigned int recording_y_addrs[SMDK4210_CAMERA_MAX_BUFFERS_COUNT];
+	unsigned int recording_cbcr_addrs[SMDK4210_CAMERA_MAX_BUFFERS_COUNT];
+
+	nsecs_t recording_frame_interval;
+	nsecs_t recording_next_timestamp;
+	nsecs_t recording_last_timestamp;
+	nsecs_t recording_fps_timestamp;
+	int recording_fps_frames;
+	float recording_fps_achieved;
+	int recording_frames_count;
+	int recording_frames_dropped;
+	camera_memory_t *recording_frames_memory;
+	int recording_frame_size;
+
+	// Snapshot
+	pthread_t snapshot_thread;
+	pthread_mutex_t snapshot_mutex;
+	int snapshot_thread_running;
+	int snapshot_thread_joinable;
+
+	int snapshot_requested;
+	camera_memory_t *snapshot_memory;
+	int snapshot_width;
+	int snapshot_height;
+	int snapshot_format;
+	nsecs_t snapshot_timestamp;
+	nsecs_t snapshot_duration;
+	int snapshot_frames_base;
+	int snapshot_dropped_base;
+	int snapshot_frames_count;
+	int snapshot_frames_dropped;
+	float snapshot_fps;
+	int snapshot_count;
 
 	// Camera params
 	int camera_rotation;
 	int camera_hflip;
 	int camera_vflip;
+	int camera_software_zoom;
 	int camera_picture_format;
 	int camera_focal_length;
 	int camera_metering;
 
 	int camera_sensor_mode;
+	int camera_frame_rate;
+	int camera_hfr_width;
+	int camera_hfr_height;
 
 	// Params
 	int preview_width;
 	int preview_height;
 	int preview_format;
 	int preview_fps;
+	int preview_fps_min;
+	int preview_fps_max;
+	int preview_rotation;
 	int picture_width;
 	int picture_height;
 	int picture_format;
@@ -243,6 +696,8 @@ struct smdk4210_camera {
 	int recording_width;
 	int recording_height;
 	int recording_format;
+	int recording_fps;
+	int hfr;
 	int focus_mode;
 	int focus_x;
 	int focus_y;
@@ -287,19 +742,124 @@ enum m5mo_af_status {
  * Camera
  */
 
+int smdk4210_camera_control_value_get(struct smdk4210_camera *smdk4210_camera,
+	unsigned int id, int *value);
+int smdk4210_camera_control_set(struct smdk4210_camera *smdk4210_camera,
+	unsigned int id, int value);
+void smdk4210_camera_control_flush(struct smdk4210_camera *smdk4210_camera);
+int smdk4210_camera_control_start(struct smdk4210_camera *smdk4210_camera);
+void smdk4210_camera_control_stop(struct smdk4210_camera *smdk4210_camera);
+
+int smdk4210_camera_request_submit(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_request *request);
+void smdk4210_camera_request_frame(struct smdk4210_camera *smdk4210_camera,
+	void *data, int size, nsecs_t timestamp);
+void smdk4210_camera_request_abort(struct smdk4210_camera *smdk4210_camera);
+
+int smdk4210_camera_sensor_frame_rate(struct smdk4210_camera *smdk4210_camera,
+	int fps);
+int smdk4210_camera_zoom_ratio(struct smdk4210_camera *smdk4210_camera, int zoom);
 int smdk4210_camera_params_init(struct smdk4210_camera *smdk4210_camera, int id);
 int smdk4210_camera_params_apply(struct smdk4210_camera *smdk4210_camera);
+void smdk4210_camera_preview_config_publish(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_preview_config *config);
+int smdk4210_camera_preview_config_get(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_preview_config *config);
+void smdk4210_camera_preview_config_apply(struct smdk4210_camera *smdk4210_camera,
+	struct smdk4210_camera_preview_config *config);
 
 int smdk4210_camera_auto_focus_start(struct smdk4210_camera *smdk4210_camera);
 void smdk4210_camera_auto_focus_stop(struct smdk4210_camera *smdk4210_camera);
 
+int smdk4210_camera_jpeg_encode_hardware(struct smdk4210_camera *smdk4210_camera,
+	void *data, int width, int height, int format, int quality,
+	camera_memory_t **jpeg_memory_p, int *jpeg_size_p);
+int smdk4210_camera_jpeg_encode_software(struct smdk4210_camera *smdk4210_camera,
+	void *data, int width, int height, int format, int quality,
+	camera_memory_t **jpeg_memory_p, int *jpeg_size_p);
+int smdk4210_camera_jpeg_encode(struct smdk4210_camera *smdk4210_camera,
+	void *data, int width, int height, int format, int quality,
+	camera_memory_t **jpeg_memory_p, int *jpeg_size_p);
+int smdk4210_camera_picture_callback(struct smdk4210_camera *smdk4210_camera,
+	void *jpeg_data, int jpeg_size, void *jpeg_thumbnail_data, int jpeg_thumbnail_size);
+int smdk4210_camera_burst(struct smdk4210_camera *smdk4210_camera, int format,
+	void **picture_data);
 int smdk4210_camera_picture(struct smdk4210_camera *smdk4210_camera);
 int smdk4210_camera_picture_start(struct smdk4210_camera *smdk4210_camera);
 
+int smdk4210_camera_transform_setup(struct smdk4210_camera *smdk4210_camera, int id,
+	int width, int height, int format, int rotation, struct smdk4210_transform_config *config);
+void smdk4210_camera_transform(struct smdk4210_camera *smdk4210_camera, void *data,
+	int width, int height, int format, struct smdk4210_transform_config *config);
+
+void smdk4210_camera_preview_stats(struct smdk4210_camera *smdk4210_camera,
+	nsecs_t timestamp);
 int smdk4210_camera_preview(struct smdk4210_camera *smdk4210_camera);
+int smdk4210_camera_preview_config_update(struct smdk4210_camera *smdk4210_camera);
+int smdk4210_camera_preview_stream_start(struct smdk4210_camera *smdk4210_camera);
+void smdk4210_camera_preview_stream_stop(struct smdk4210_camera *smdk4210_camera);
 int smdk4210_camera_preview_start(struct smdk4210_camera *smdk4210_camera);
 void smdk4210_camera_preview_stop(struct smdk4210_camera *smdk4210_camera);
 
+int smdk4210_camera_recording_pace(struct smdk4210_camera *smdk4210_camera,
+	nsecs_t capture_timestamp, nsecs_t *timestamp);
+int smdk4210_camera_recording_start(struct smdk4210_camera *smdk4210_camera);
+void smdk4210_camera_recording_stop(struct smdk4210_camera *smdk4210_camera);
+
+void smdk4210_camera_snapshot_capture(struct smdk4210_camera *smdk4210_camera, int index);
+int smdk4210_camera_snapshot_start(struct smdk4210_camera *smdk4210_camera);
+void smdk4210_camera_snapshot_stop(struct smdk4210_camera *smdk4210_camera);
+
+void smdk4210_camera_face_frame(struct smdk4210_camera *smdk4210_camera, void *data);
+int smdk4210_camera_face_start(struct smdk4210_camera *smdk4210_camera);
+void smdk4210_camera_face_stop(struct smdk4210_camera *smdk4210_camera);
+
+/*
+ * Face
+ */
+
+int smdk4210_face_detector_init(struct smdk4210_face_detector *detector,
+	int width, int height);
+void smdk4210_face_detector_deinit(struct smdk4210_face_detector *detector);
+int smdk4210_face_decimate(struct smdk4210_face_detector *detector,
+	void *data, int format);
+int smdk4210_face_detect(struct smdk4210_face_detector *detector,
+	struct smdk4210_face *faces, int faces_count, nsecs_t budget);
+
+/*
+ * Burst
+ */
+
+int smdk4210_burst_format_supported(int format);
+int smdk4210_burst_init(struct smdk4210_burst *burst, int width, int height, int format);
+void smdk4210_burst_deinit(struct smdk4210_burst *burst);
+void smdk4210_burst_downscale(struct smdk4210_burst *burst, unsigned char *frame,
+	unsigned char *luma);
+int smdk4210_burst_reference(struct smdk4210_burst *burst, unsigned char *frame);
+int smdk4210_burst_align(struct smdk4210_burst *burst, unsigned char *frame,
+	int *shift_x, int *shift_y);
+void smdk4210_burst_merge(struct smdk4210_burst *burst, unsigned char *frame,
+	int shift_x, int shift_y, int row_start, int row_end);
+void smdk4210_burst_resolve(struct smdk4210_burst *burst, unsigned char *output,
+	int row_start, int row_end);
+
+/*
+ * Transform
+ */
+
+int smdk4210_transform_format_supported(int format);
+int smdk4210_transform_frame_size(int width, int height, int format);
+int smdk4210_transform_rotate(void *src, void *dst, int width, int height, int format,
+	int rotation, int hflip, int vflip);
+int smdk4210_transform_scale(struct smdk4210_transform *transform, void *src,
+	int src_width, int src_height, void *dst, int width, int height, int format,
+	int zoom_ratio);
+void smdk4210_transform_init(struct smdk4210_transform *transform);
+void smdk4210_transform_deinit(struct smdk4210_transform *transform);
+int smdk4210_transform_frame(struct smdk4210_transform *transform, void *data,
+	int width, int height, int format, int rotation, int hflip, int vflip,
+	int zoom_ratio);
+
 /*
  * EXIF
  */
@@ -314,6 +874,14 @@ int smdk4210_exif_create(struct smdk4210_camera *smdk4210_camera,
 	void *jpeg_thumbnail_data, int jpeg_thumbnail_size,
 	camera_memory_t **exif_data_memory_p, int *exif_size_p);
 
+/*
+ * JPEG
+ */
+
+int smdk4210_jpeg_format_supported(int format);
+int smdk4210_jpeg_encode(void *data, int width, int height, int format, int quality,
+	void *buffer, int size);
+
 /*
  * Param
  */
@@ -343,15 +911,42 @@ int smdk4210_camera_buffer_length(int width, int height, int format);
 int smdk4210_gralloc_format(int format);
 int smdk4210_scale_yuv422(void *src, int src_width, int src_height, void *dst,
 	int dst_width, int dst_height);
+int smdk4210_scale_nv12(void *src, int src_width, int src_height, void *dst,
+	int dst_width, int dst_height);
+int smdk4210_detile_nv12t(void *src, int width, int height, void *dst);
+
+int smdk4210_camera_queue_count(struct smdk4210_camera_queue *queue,
+	int frame_size, int fps, int min_count);
+void smdk4210_camera_queue_dequeued(struct smdk4210_camera_queue *queue,
+	int index, nsecs_t timestamp);
+void smdk4210_camera_queue_released(struct smdk4210_camera_queue *queue,
+	int index, nsecs_t timestamp);
+
+int smdk4210_camera_pool_init(struct smdk4210_camera *smdk4210_camera);
+void smdk4210_camera_pool_deinit(struct smdk4210_camera *smdk4210_camera);
+camera_memory_t *smdk4210_camera_pool_get(struct smdk4210_camera *smdk4210_camera, int size);
+void smdk4210_camera_pool_put(struct smdk4210_camera *smdk4210_camera, camera_memory_t *memory);
 
 /*
  * V4L2
  */
 
+extern struct smdk4210_v4l2_ops smdk4210_v4l2_kernel_ops;
+extern struct smdk4210_v4l2_ops smdk4210_v4l2_sim_ops;
+extern struct smdk4210_v4l2_sim_config smdk4210_v4l2_sim_config;
+
 // Utils
+struct smdk4210_v4l2_ops *smdk4210_v4l2_ops(struct smdk4210_camera *smdk4210_camera);
 int smdk4210_v4l2_find_index(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l2_id);
 int smdk4210_v4l2_find_fd(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l2_id);
 
+// Trace
+int smdk4210_v4l2_trace_init(struct smdk4210_camera *smdk4210_camera, char *path);
+void smdk4210_v4l2_trace_deinit(struct smdk4210_camera *smdk4210_camera);
+void smdk4210_v4l2_trace_record(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l2_id,
+	unsigned int request, void *data, int rc, nsecs_t timestamp, nsecs_t duration);
+int smdk4210_v4l2_trace_write(struct smdk4210_camera *smdk4210_camera);
+
 // File ops
 int smdk4210_v4l2_open(struct smdk4210_camera *smdk4210_camera, int id);
 void smdk4210_v4l2_close(struct smdk4210_camera *smdk4210_camera, int id);
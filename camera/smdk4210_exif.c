@@ -217,7 +217,8 @@ int smdk4210_exif_attributes_create_params(struct smdk4210_camera *smdk4210_came
 	// Thumbnail
 	exif_attributes->widthThumb = smdk4210_camera->jpeg_thumbnail_width;
 	exif_attributes->heightThumb = smdk4210_camera->jpeg_thumbnail_height;
-	exif_attributes->enableThumb = true;
+	exif_attributes->enableThumb = exif_attributes->widthThumb > 0 &&
+		exif_attributes->heightThumb > 0;
 
 	// Orientation
 	rotation = smdk4210_param_int_get(smdk4210_camera, "rotation");
@@ -426,21 +427,18 @@ int smdk4210_exif_create(struct smdk4210_camera *smdk4210_camera,
 	unsigned int value;
 
 	if (smdk4210_camera == NULL || exif_attributes == NULL ||
-		jpeg_thumbnail_data == NULL || jpeg_thumbnail_size <= 0 ||
 		exif_data_memory_p == NULL || exif_size_p == NULL)
 		return -EINVAL;
 
+	// The thumbnail is optional
+	if (jpeg_thumbnail_data == NULL || jpeg_thumbnail_size < 0)
+		jpeg_thumbnail_size = 0;
+
 	exif_data_size = EXIF_FILE_SIZE + jpeg_thumbnail_size;
 
-	if (smdk4210_camera->callbacks.request_memory != NULL) {
-		exif_data_memory = smdk4210_camera->callbacks.request_memory(-1,
-			exif_data_size, 1, 0);
-		if (exif_data_memory == NULL) {
-			ALOGE("%s: exif memory request failed!", __func__);
-			goto error;
-		}
-	} else {
-		ALOGE("%s: No memory request function!", __func__);
+	exif_data_memory = smdk4210_camera_pool_get(smdk4210_camera, exif_data_size);
+	if (exif_data_memory == NULL) {
+		ALOGE("%s: exif memory request failed!", __func__);
 		goto error;
 	}
 
@@ -781,8 +779,8 @@ int smdk4210_exif_create(struct smdk4210_camera *smdk4210_camera,
 	return 0;
 
 error:
-	if (exif_data_memory != NULL && exif_data_memory->release != NULL)
-		exif_data_memory->release(exif_data_memory);
+	if (exif_data_memory != NULL)
+		smdk4210_camera_pool_put(smdk4210_camera, exif_data_memory);
 
 	*exif_data_memory_p = NULL;
 	*exif_size_p = 0;
@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#define LOG_TAG "smdk4210_face"
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * Lightweight face detection: preview frames are decimated to a small luma
+ * plane along with a skin tone mask taken from the chroma. Square windows
+ * are then scanned over integral images, keeping the ones that are mostly
+ * skin and show a darker eyes band between the forehead and the cheeks,
+ * split by a brighter nose bridge. Overlapping matches are merged and only
+ * kept when enough of them agree.
+ */
+
+int smdk4210_face_detector_init(struct smdk4210_face_detector *detector,
+	int width, int height)
+{
+	int decimation;
+	int size;
+
+	if (detector == NULL || width <= 0 || height <= 0)
+		return -EINVAL;
+
+	decimation = 1;
+	while (width / decimation > SMDK4210_FACE_WIDTH_MAX)
+		decimation *= 2;
+
+	memset(detector, 0, sizeof(struct smdk4210_face_detector));
+
+	detector->frame_width = width;
+	detector->frame_height = height;
+	detector->decimation = decimation;
+	detector->width = width / decimation;
+	detector->height = height / decimation;
+
+	size = detector->width * detector->height;
+	detector->luma = (unsigned char *) calloc(1, size);
+	detector->skin = (unsigned char *) calloc(1, size);
+
+	size = (detector->width + 1) * (detector->height + 1) * sizeof(unsigned int);
+	detector->luma_integral = (unsigned int *) calloc(1, size);
+	detector->luma_squared_integral = (unsigned int *) calloc(1, size);
+	detector->skin_integral = (unsigned int *) calloc(1, size);
+
+	if (detector->luma == NULL || detector->skin == NULL || detector->luma_integral == NULL ||
+		detector->luma_squared_integral == NULL || detector->skin_integral == NULL) {
+		ALOGE("%s: Unable to allocate detector buffers", __func__);
+		smdk4210_face_detector_deinit(detector);
+		return -1;
+	}
+
+	return 0;
+}
+
+void smdk4210_face_detector_deinit(struct smdk4210_face_detector *detector)
+{
+	if (detector == NULL)
+		return;
+
+	if (detector->luma != NULL)
+		free(detector->luma);
+	if (detector->skin != NULL)
+		free(detector->skin);
+	if (detector->luma_integral != NULL)
+		free(detector->luma_integral);
+	if (detector->luma_squared_integral != NULL)
+		free(detector->luma_squared_integral);
+	if (detector->skin_integral != NULL)
+		free(detector->skin_integral);
+
+	memset(detector, 0, sizeof(struct smdk4210_face_detector));
+}
+
+#ifdef __ARM_NEON__
+static void smdk4210_face_decimate_luma_neon(struct smdk4210_face_detector *detector,
+	unsigned char *data)
+{
+	unsigned char *r0, *r1, *r2, *r3;
+	unsigned char *out;
+	uint16x8_t s0, s1;
+	uint16x4_t n0, n1;
+	int x, y;
+
+	// 4x4 box average, 32 input columns to 8 output pixels at a time
+	for (y = 0; y < detector->height; y++) {
+		r0 = data + (y * 4) * detector->frame_width;
+		r1 = r0 + detector->frame_width;
+		r2 = r1 + detector->frame_width;
+		r3 = r2 + detector->frame_width;
+		out = detector->luma + y * detector->width;
+
+		for (x = 0; x < detector->frame_width; x += 32) {
+			s0 = vpaddlq_u8(vld1q_u8(r0 + x));
+			s0 = vpadalq_u8(s0, vld1q_u8(r1 + x));
+			s0 = vpadalq_u8(s0, vld1q_u8(r2 + x));
+			s0 = vpadalq_u8(s0, vld1q_u8(r3 + x));
+
+			s1 = vpaddlq_u8(vld1q_u8(r0 + x + 16));
+			s1 = vpadalq_u8(s1, vld1q_u8(r1 + x + 16));
+			s1 = vpadalq_u8(s1, vld1q_u8(r2 + x + 16));
+			s1 = vpadalq_u8(s1, vld1q_u8(r3 + x + 16));
+
+			n0 = vshrn_n_u32(vpaddlq_u16(s0), 4);
+			n1 = vshrn_n_u32(vpaddlq_u16(s1), 4);
+
+			vst1_u8(out + x / 4, vmovn_u16(vcombine_u16(n0, n1)));
+		}
+	}
+}
+#endif
+
+static void smdk4210_face_decimate_luma(struct smdk4210_face_detector *detector,
+	unsigned char *data)
+{
+	unsigned char *p;
+	unsigned int sum;
+	int d, shift;
+	int x, y, i, j;
+
+	d = detector->decimation;
+	for (shift = 0; (1 << shift) < d; shift++);
+
+	for (y = 0; y < detector->height; y++) {
+		for (x = 0; x < detector->width; x++) {
+			sum = 0;
+
+			for (j = 0; j < d; j++) {
+				p = data + (y * d + j) * detector->frame_width + x * d;
+				for (i = 0; i < d; i++)
+					sum += p[i];
+			}
+
+			detector->luma[y * detector->width + x] = (unsigned char) (sum >> (shift * 2));
+		}
+	}
+}
+
+int smdk4210_face_decimate(struct smdk4210_face_detector *detector,
+	void *data, int format)
+{
+	unsigned char *chroma;
+	unsigned char *u_plane, *v_plane;
+	int cb, cr;
+	int cx, cy;
+	int x, y;
+
+	if (detector == NULL || detector->luma == NULL || data == NULL)
+		return -EINVAL;
+
+	if (format != V4L2_PIX_FMT_NV21 && format != V4L2_PIX_FMT_NV12 && format != V4L2_PIX_FMT_YUV420)
+		return -1;
+
+#ifdef __ARM_NEON__
+	if (detector->decimation == 4 && (detector->frame_width % 32) == 0)
+		smdk4210_face_decimate_luma_neon(detector, (unsigned char *) data);
+	else
+#endif
+		smdk4210_face_decimate_luma(detector, (unsigned char *) data);
+
+	// Skin tone is told from the chroma only, sampled once per output pixel
+	chroma = (unsigned char *) data + detector->frame_width * detector->frame_height;
+	u_plane = chroma;
+	v_plane = chroma + (detector->frame_width / 2) * (detector->frame_height / 2);
+
+	for (y = 0; y < detector->height; y++) {
+		cy = (y * detector->decimation) / 2;
+
+		for (x = 0; x < detector->width; x++) {
+			cx = (x * detector->decimation) / 2;
+
+			switch (format) {
+				case V4L2_PIX_FMT_NV21:
+					cr = chroma[cy * detector->frame_width + cx * 2];
+					cb = chroma[cy * detector->frame_width + cx * 2 + 1];
+					break;
+				case V4L2_PIX_FMT_NV12:
+					cb = chroma[cy * detector->frame_width + cx * 2];
+					cr = chroma[cy * detector->frame_width + cx * 2 + 1];
+					break;
+				default:
+					cb = u_plane[cy * (detector->frame_width / 2) + cx];
+					cr = v_plane[cy * (detector->frame_width / 2) + cx];
+					break;
+			}
+
+			detector->skin[y * detector->width + x] = cr >= 133 && cr <= 173 && cb >= 77 && cb <= 127;
+		}
+	}
+
+	return 0;
+}
+
+static void smdk4210_face_integrate(struct smdk4210_face_detector *detector)
+{
+	unsigned int luma_row, luma_squared_row, skin_row;
+	unsigned int *li, *lsi, *si;
+	unsigned char *luma, *skin;
+	int stride;
+	int x, y;
+
+	stride = detector->width + 1;
+
+	li = detector->luma_integral;
+	lsi = detector->luma_squared_integral;
+	si = detector->skin_integral;
+
+	memset(li, 0, stride * sizeof(unsigned int));
+	memset(lsi, 0, stride * sizeof(unsigned int));
+	memset(si, 0, stride * sizeof(unsigned int));
+
+	for (y = 0; y < detector->height; y++) {
+		luma = detector->luma + y * detector->width;
+		skin = detector->skin + y * detector->width;
+
+		luma_row = luma_squared_row = skin_row = 0;
+
+		li[(y + 1) * stride] = 0;
+		lsi[(y + 1) * stride] = 0;
+		si[(y + 1) * stride] = 0;
+
+		for (x = 0; x < detector->width; x++) {
+			luma_row += luma[x];
+			luma_squared_row += luma[x] * luma[x];
+			skin_row += skin[x];
+
+			li[(y + 1) * stride + x + 1] = li[y * stride + x + 1] + luma_row;
+			lsi[(y + 1) * stride + x + 1] = lsi[y * stride + x + 1] + luma_squared_row;
+			si[(y + 1) * stride + x + 1] = si[y * stride + x + 1] + skin_row;
+		}
+	}
+}
+
+static unsigned int smdk4210_face_sum(unsigned int *integral, int stride,
+	int x, int y, int w, int h)
+{
+	return integral[(y + h) * stride + x + w] - integral[y * stride + x + w] -
+		integral[(y + h) * stride + x] + integral[y * stride + x];
+}
+
+static int smdk4210_face_mean(struct smdk4210_face_detector *detector,
+	int x, int y, int w, int h)
+{
+	if (w <= 0 || h <= 0)
+		return 0;
+
+	return smdk4210_face_sum(detector->luma_integral, detector->width + 1, x, y, w, h) / (w * h);
+}
+
+static int smdk4210_face_window(struct smdk4210_face_detector *detector,
+	int x, int y, int s)
+{
+	unsigned int area;
+	unsigned int skin;
+	int mean, variance, deviation;
+	int forehead, eyes, cheeks;
+	int left_eye, right_eye, bridge;
+	int band_y, band_h;
+	int score;
+
+	area = s * s;
+
+	skin = smdk4210_face_sum(detector->skin_integral, detector->width + 1, x, y, s, s);
+	if (skin * 100 < area * SMDK4210_FACE_SKIN_RATIO)
+		return 0;
+
+	mean = smdk4210_face_sum(detector->luma_integral, detector->width + 1, x, y, s, s) / area;
+	variance = smdk4210_face_sum(detector->luma_squared_integral, detector->width + 1, x, y, s, s) / area -
+		mean * mean;
+	if (variance < SMDK4210_FACE_DEVIATION_MIN * SMDK4210_FACE_DEVIATION_MIN)
+		return 0;
+
+	for (deviation = 1; deviation * deviation < variance; deviation++);
+
+	// Eyes band is darker than the cheeks
+	band_y = y + (s * 20) / 100;
+	band_h = (s * 25) / 100;
+
+	eyes = smdk4210_face_mean(detector, x + s / 10, band_y, (s * 8) / 10, band_h);
+	cheeks = smdk4210_face_mean(detector, x + s / 10, band_y + band_h + s / 20, (s * 8) / 10, band_h);
+	if ((cheeks - eyes) * 10 < deviation * 3)
+		return 0;
+
+	// And darker than the forehead
+	forehead = smdk4210_face_mean(detector, x + s / 5, y, (s * 6) / 10, band_y - y);
+	if ((forehead - eyes) * 10 < deviation * 3)
+		return 0;
+
+	// Nose bridge is brighter than both eyes
+	left_eye = smdk4210_face_mean(detector, x + (s * 15) / 100, band_y, s / 4, band_h);
+	bridge = smdk4210_face_mean(detector, x + (s * 40) / 100, band_y, s / 5, band_h);
+	right_eye = smdk4210_face_mean(detector, x + (s * 60) / 100, band_y, s / 4, band_h);
+	if ((bridge - left_eye) * 10 < deviation * 2 || (bridge - right_eye) * 10 < deviation * 2)
+		return 0;
+
+	score = ((cheeks - eyes) + (forehead - eyes) + (bridge - left_eye) + (bridge - right_eye)) * 15 / deviation;
+	if (score < 1)
+		score = 1;
+	else if (score > 100)
+		score = 100;
+
+	return score;
+}
+
+static int smdk4210_face_overlap(struct smdk4210_face *a, struct smdk4210_face *b)
+{
+	int left, top, right, bottom;
+	int smallest;
+
+	left = a->x > b->x ? a->x : b->x;
+	top = a->y > b->y ? a->y : b->y;
+	right = (a->x + a->size) < (b->x + b->size) ? (a->x + a->size) : (b->x + b->size);
+	bottom = (a->y + a->size) < (b->y + b->size) ? (a->y + a->size) : (b->y + b->size);
+
+	if (right <= left || bottom <= top)
+		return 0;
+
+	smallest = a->size < b->size ? a->size : b->size;
+
+	// Percentage of the smallest window covered by the intersection
+	return ((right - left) * (bottom - top) * 100) / (smallest * smallest);
+}
+
+int smdk4210_face_detect(struct smdk4210_face_detector *detector,
+	struct smdk4210_face *faces, int faces_count, nsecs_t budget)
+{
+	struct smdk4210_face candidates[SMDK4210_FACE_CANDIDATES_COUNT];
+	struct smdk4210_face groups[SMDK4210_FACE_CANDIDATES_COUNT];
+	int groups_neighbours[SMDK4210_FACE_CANDIDATES_COUNT];
+	struct smdk4210_face face;
+	int candidates_count = 0;
+	int neighbours;
+	int best;
+	int count = 0;
+	nsecs_t t;
+	int s, step;
+	int score;
+	int x, y;
+	int i, j;
+
+	if (detector == NULL || detector->luma == NULL || faces == NULL || faces_count <= 0)
+		return -EINVAL;
+
+	t = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	smdk4210_face_integrate(detector);
+
+	detector->windows_count = 0;
+	detector->budget_exceeded = 0;
+
+	// Largest windows first, so running out of budget only loses small faces
+	s = detector->width < detector->height ? detector->width : detector->height;
+	for (; s >= SMDK4210_FACE_WINDOW_MIN && !detector->budget_exceeded; s = (s * 5) / 6) {
+		step = s / 8 > 1 ? s / 8 : 1;
+
+		for (y = 0; y + s <= detector->height; y += step) {
+			// A single scale can take longer than the budget, check every row
+			if (budget > 0 && systemTime(SYSTEM_TIME_MONOTONIC) - t > budget) {
+				detector->budget_exceeded = 1;
+				break;
+			}
+
+			for (x = 0; x + s <= detector->width; x += step) {
+				detector->windows_count++;
+
+				score = smdk4210_face_window(detector, x, y, s);
+				if (score == 0 || candidates_count >= SMDK4210_FACE_CANDIDATES_COUNT)
+					continue;
+
+				candidates[candidates_count].x = x;
+				candidates[candidates_count].y = y;
+				candidates[candidates_count].size = s;
+				candidates[candidates_count].score = score;
+				candidates_count++;
+			}
+		}
+	}
+
+	// Faces trigger several overlapping windows, stray matches don't
+	for (i = 0; i < candidates_count; i++) {
+		memset(&face, 0, sizeof(face));
+		neighbours = 0;
+
+		for (j = 0; j < candidates_count; j++) {
+			if (j != i && smdk4210_face_overlap(&candidates[i], &candidates[j]) <= 50)
+				continue;
+
+			face.x += candidates[j].x;
+			face.y += candidates[j].y;
+			face.size += candidates[j].size;
+			face.score += candidates[j].score;
+			neighbours++;
+		}
+
+		// Windows are replaced with the average of their group
+		groups[i].x = face.x / neighbours;
+		groups[i].y = face.y / neighbours;
+		groups[i].size = face.size / neighbours;
+		groups[i].score = face.score / neighbours;
+		groups_neighbours[i] = neighbours - 1;
+	}
+
+	// Largest groups first
+	while (count < faces_count) {
+		best = -1;
+		for (j = 0; j < candidates_count; j++) {
+			if (groups_neighbours[j] < SMDK4210_FACE_NEIGHBOURS_MIN)
+				continue;
+
+			if (best < 0 || groups_neighbours[j] > groups_neighbours[best] ||
+				(groups_neighbours[j] == groups_neighbours[best] && groups[j].score > groups[best].score))
+				best = j;
+		}
+
+		if (best < 0)
+			break;
+
+		groups_neighbours[best] = -1;
+
+		for (j = 0; j < count; j++) {
+			if (smdk4210_face_overlap(&groups[best], &faces[j]) > 30)
+				break;
+		}
+
+		if (j < count)
+			continue;
+
+		memcpy(&faces[count], &groups[best], sizeof(struct smdk4210_face));
+		count++;
+	}
+
+	// Back to frame coordinates
+	for (i = 0; i < count; i++) {
+		faces[i].x *= detector->decimation;
+		faces[i].y *= detector->decimation;
+		faces[i].size *= detector->decimation;
+	}
+
+	return count;
+}
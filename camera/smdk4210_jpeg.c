@@ -0,0 +1,791 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#define LOG_TAG "smdk4210_jpeg"
+#include <utils/Log.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * Baseline JPEG encoder, used when the hardware encoder is busy or missing.
+ * Blocks go through the AAN fast integer DCT, with the AAN scale factors
+ * folded into the quantization reciprocals, and are Huffman coded with the
+ * standard tables, skipping runs of zero coefficients with a bitmap.
+ */
+
+static const unsigned char smdk4210_jpeg_natural_order[64] = {
+	0, 1, 8, 16, 9, 2, 3, 10,
+	17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+static const unsigned char smdk4210_jpeg_luma_quantization[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61,
+	12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56,
+	14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77,
+	24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103, 99,
+};
+
+static const unsigned char smdk4210_jpeg_chroma_quantization[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+// AAN scale factors, in Q14
+static const unsigned short smdk4210_jpeg_aan_scales[64] = {
+	16384, 22725, 21407, 19266, 16384, 12873, 8867, 4520,
+	22725, 31521, 29692, 26722, 22725, 17855, 12299, 6270,
+	21407, 29692, 27969, 25172, 21407, 16819, 11585, 5906,
+	19266, 26722, 25172, 22654, 19266, 15137, 10426, 5315,
+	16384, 22725, 21407, 19266, 16384, 12873, 8867, 4520,
+	12873, 17855, 16819, 15137, 12873, 10114, 6967, 3552,
+	8867, 12299, 11585, 10426, 8867, 6967, 4799, 2446,
+	4520, 6270, 5906, 5315, 4520, 3552, 2446, 1247,
+};
+
+// Standard Huffman tables: code counts per length, then symbols
+
+static const unsigned char smdk4210_jpeg_dc_luma_bits[16] = {
+	0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const unsigned char smdk4210_jpeg_dc_chroma_bits[16] = {
+	0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+};
+
+static const unsigned char smdk4210_jpeg_dc_values[12] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+};
+
+static const unsigned char smdk4210_jpeg_ac_luma_bits[16] = {
+	0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d,
+};
+
+static const unsigned char smdk4210_jpeg_ac_luma_values[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+	0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+	0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+	0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+	0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+	0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+	0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+	0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+	0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+	0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+	0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa,
+};
+
+static const unsigned char smdk4210_jpeg_ac_chroma_bits[16] = {
+	0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77,
+};
+
+static const unsigned char smdk4210_jpeg_ac_chroma_values[162] = {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+	0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+	0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+	0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+	0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+	0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+	0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+	0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+	0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+	0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+	0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+	0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+	0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa,
+};
+
+int smdk4210_jpeg_format_supported(int format)
+{
+	switch (format) {
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_UYVY:
+		case V4L2_PIX_FMT_YUV422P:
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_YUV420:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+// Tables
+
+static void smdk4210_jpeg_quantization_init(struct smdk4210_jpeg *jpeg, int quality)
+{
+	const unsigned char *base;
+	unsigned int divisor;
+	int scale;
+	int value;
+	int i, j;
+
+	if (quality <= 0)
+		quality = 1;
+	else if (quality > 100)
+		quality = 100;
+
+	// Same scaling as the IJG library
+	scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+	for (i = 0; i < 2; i++) {
+		base = i == 0 ? smdk4210_jpeg_luma_quantization : smdk4210_jpeg_chroma_quantization;
+
+		for (j = 0; j < 64; j++) {
+			value = (base[j] * scale + 50) / 100;
+			if (value < 1)
+				value = 1;
+			else if (value > 255)
+				value = 255;
+
+			jpeg->quantization[i][j] = value;
+
+			// The DCT output is scaled by 8 and the AAN factors
+			divisor = (value * smdk4210_jpeg_aan_scales[j] + (1 << 10)) >> 11;
+			if (divisor < 1)
+				divisor = 1;
+
+			// Reciprocals have to fit in 16 bits
+			if (divisor < 2)
+				jpeg->reciprocals[i][j] = 0xffff;
+			else
+				jpeg->reciprocals[i][j] = ((1 << 16) + divisor / 2) / divisor;
+		}
+	}
+}
+
+static void smdk4210_jpeg_huffman_init(struct smdk4210_jpeg *jpeg, int table,
+	const unsigned char *bits, const unsigned char *values)
+{
+	unsigned int code = 0;
+	int length;
+	int i, k = 0;
+
+	for (length = 1; length <= 16; length++) {
+		for (i = 0; i < bits[length - 1]; i++) {
+			jpeg->codes[table][values[k]] = code;
+			jpeg->sizes[table][values[k]] = length;
+			code++;
+			k++;
+		}
+
+		code <<= 1;
+	}
+}
+
+// Bit writer
+
+static inline void smdk4210_jpeg_byte(struct smdk4210_jpeg *jpeg, unsigned char value)
+{
+	if (jpeg->offset + 2 > jpeg->size) {
+		jpeg->overflow = 1;
+		return;
+	}
+
+	jpeg->buffer[jpeg->offset++] = value;
+
+	// Stuffing, so that data never looks like a marker
+	if (value == 0xff)
+		jpeg->buffer[jpeg->offset++] = 0;
+}
+
+static inline void smdk4210_jpeg_bits(struct smdk4210_jpeg *jpeg, unsigned int value, int count)
+{
+	jpeg->bits = (jpeg->bits << count) | (value & ((1 << count) - 1));
+	jpeg->bits_count += count;
+
+	while (jpeg->bits_count >= 8) {
+		jpeg->bits_count -= 8;
+		smdk4210_jpeg_byte(jpeg, (jpeg->bits >> jpeg->bits_count) & 0xff);
+	}
+}
+
+static void smdk4210_jpeg_bits_flush(struct smdk4210_jpeg *jpeg)
+{
+	// Pad with ones
+	if (jpeg->bits_count > 0)
+		smdk4210_jpeg_bits(jpeg, 0x7f, 8 - jpeg->bits_count);
+
+	jpeg->bits = 0;
+	jpeg->bits_count = 0;
+}
+
+static void smdk4210_jpeg_raw(struct smdk4210_jpeg *jpeg, const unsigned char *data, int length)
+{
+	if (jpeg->offset + length > jpeg->size) {
+		jpeg->overflow = 1;
+		return;
+	}
+
+	memcpy(jpeg->buffer + jpeg->offset, data, length);
+	jpeg->offset += length;
+}
+
+static void smdk4210_jpeg_marker(struct smdk4210_jpeg *jpeg, int marker, int length)
+{
+	unsigned char header[4];
+
+	header[0] = 0xff;
+	header[1] = marker;
+	header[2] = (length + 2) >> 8;
+	header[3] = (length + 2) & 0xff;
+
+	smdk4210_jpeg_raw(jpeg, header, length >= 0 ? 4 : 2);
+}
+
+// Headers
+
+static void smdk4210_jpeg_headers(struct smdk4210_jpeg *jpeg, int width, int height, int subsampling)
+{
+	unsigned char data[20];
+	const unsigned char *bits;
+	const unsigned char *values;
+	int count;
+	int i, j;
+
+	// SOI
+	smdk4210_jpeg_marker(jpeg, 0xd8, -1);
+
+	// DQT
+	for (i = 0; i < 2; i++) {
+		smdk4210_jpeg_marker(jpeg, 0xdb, 65);
+
+		data[0] = i;
+		smdk4210_jpeg_raw(jpeg, data, 1);
+
+		for (j = 0; j < 64; j++)
+			smdk4210_jpeg_raw(jpeg, &jpeg->quantization[i][smdk4210_jpeg_natural_order[j]], 1);
+	}
+
+	// SOF0
+	smdk4210_jpeg_marker(jpeg, 0xc0, 15);
+
+	data[0] = 8;
+	data[1] = height >> 8;
+	data[2] = height & 0xff;
+	data[3] = width >> 8;
+	data[4] = width & 0xff;
+	data[5] = 3;
+
+	for (i = 0; i < 3; i++) {
+		data[6 + i * 3] = i + 1;
+		data[7 + i * 3] = i == 0 ? subsampling : 0x11;
+		data[8 + i * 3] = i == 0 ? 0 : 1;
+	}
+
+	smdk4210_jpeg_raw(jpeg, data, 15);
+
+	// DHT
+	for (i = 0; i < 4; i++) {
+		switch (i) {
+			case 0:
+				bits = smdk4210_jpeg_dc_luma_bits;
+				values = smdk4210_jpeg_dc_values;
+				break;
+			case 1:
+				bits = smdk4210_jpeg_ac_luma_bits;
+				values = smdk4210_jpeg_ac_luma_values;
+				break;
+			case 2:
+				bits = smdk4210_jpeg_dc_chroma_bits;
+				values = smdk4210_jpeg_dc_values;
+				break;
+			case 3:
+			default:
+				bits = smdk4210_jpeg_ac_chroma_bits;
+				values = smdk4210_jpeg_ac_chroma_values;
+				break;
+		}
+
+		count = 0;
+		for (j = 0; j < 16; j++)
+			count += bits[j];
+
+		smdk4210_jpeg_marker(jpeg, 0xc4, 1 + 16 + count);
+
+		// Class in the high nibble, identifier in the low one
+		data[0] = ((i & 1) << 4) | (i >> 1);
+		smdk4210_jpeg_raw(jpeg, data, 1);
+		smdk4210_jpeg_raw(jpeg, bits, 16);
+		smdk4210_jpeg_raw(jpeg, values, count);
+	}
+
+	// SOS
+	smdk4210_jpeg_marker(jpeg, 0xda, 10);
+
+	data[0] = 3;
+	for (i = 0; i < 3; i++) {
+		data[1 + i * 2] = i + 1;
+		data[2 + i * 2] = i == 0 ? 0x00 : 0x11;
+	}
+
+	data[7] = 0;
+	data[8] = 63;
+	data[9] = 0;
+
+	smdk4210_jpeg_raw(jpeg, data, 10);
+}
+
+// Blocks
+
+static void smdk4210_jpeg_block_load(short *block, unsigned char *base, int step, int stride,
+	int x, int y, int width, int height)
+{
+	unsigned char *row;
+	int xx, yy;
+	int i, j;
+
+	// Fast path, inside the picture
+	if (x + 8 <= width && y + 8 <= height) {
+		for (i = 0; i < 8; i++) {
+			row = base + (y + i) * stride + x * step;
+			for (j = 0; j < 8; j++)
+				block[i * 8 + j] = row[j * step] - 128;
+		}
+
+		return;
+	}
+
+	// Edges are padded with the last pixel
+	for (i = 0; i < 8; i++) {
+		yy = y + i < height ? y + i : height - 1;
+		row = base + yy * stride;
+
+		for (j = 0; j < 8; j++) {
+			xx = x + j < width ? x + j : width - 1;
+			block[i * 8 + j] = row[xx * step] - 128;
+		}
+	}
+}
+
+#ifdef __ARM_NEON__
+static inline void smdk4210_jpeg_transpose(int16x8_t *rows)
+{
+	int16x8x2_t t0, t1, t2, t3;
+	int32x4x2_t u0, u1, u2, u3;
+
+	t0 = vtrnq_s16(rows[0], rows[1]);
+	t1 = vtrnq_s16(rows[2], rows[3]);
+	t2 = vtrnq_s16(rows[4], rows[5]);
+	t3 = vtrnq_s16(rows[6], rows[7]);
+
+	u0 = vtrnq_s32(vreinterpretq_s32_s16(t0.val[0]), vreinterpretq_s32_s16(t1.val[0]));
+	u1 = vtrnq_s32(vreinterpretq_s32_s16(t0.val[1]), vreinterpretq_s32_s16(t1.val[1]));
+	u2 = vtrnq_s32(vreinterpretq_s32_s16(t2.val[0]), vreinterpretq_s32_s16(t3.val[0]));
+	u3 = vtrnq_s32(vreinterpretq_s32_s16(t2.val[1]), vreinterpretq_s32_s16(t3.val[1]));
+
+	rows[0] = vcombine_s16(vreinterpret_s16_s32(vget_low_s32(u0.val[0])), vreinterpret_s16_s32(vget_low_s32(u2.val[0])));
+	rows[1] = vcombine_s16(vreinterpret_s16_s32(vget_low_s32(u1.val[0])), vreinterpret_s16_s32(vget_low_s32(u3.val[0])));
+	rows[2] = vcombine_s16(vreinterpret_s16_s32(vget_low_s32(u0.val[1])), vreinterpret_s16_s32(vget_low_s32(u2.val[1])));
+	rows[3] = vcombine_s16(vreinterpret_s16_s32(vget_low_s32(u1.val[1])), vreinterpret_s16_s32(vget_low_s32(u3.val[1])));
+	rows[4] = vcombine_s16(vreinterpret_s16_s32(vget_high_s32(u0.val[0])), vreinterpret_s16_s32(vget_high_s32(u2.val[0])));
+	rows[5] = vcombine_s16(vreinterpret_s16_s32(vget_high_s32(u1.val[0])), vreinterpret_s16_s32(vget_high_s32(u3.val[0])));
+	rows[6] = vcombine_s16(vreinterpret_s16_s32(vget_high_s32(u0.val[1])), vreinterpret_s16_s32(vget_high_s32(u2.val[1])));
+	rows[7] = vcombine_s16(vreinterpret_s16_s32(vget_high_s32(u1.val[1])), vreinterpret_s16_s32(vget_high_s32(u3.val[1])));
+}
+
+// One AAN pass, on all the columns at once
+static inline void smdk4210_jpeg_dct_pass(int16x8_t *d)
+{
+	int16x8_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+	int16x8_t tmp10, tmp11, tmp12, tmp13;
+	int16x8_t z1, z2, z3, z4, z5, z11, z13;
+
+	tmp0 = vaddq_s16(d[0], d[7]);
+	tmp7 = vsubq_s16(d[0], d[7]);
+	tmp1 = vaddq_s16(d[1], d[6]);
+	tmp6 = vsubq_s16(d[1], d[6]);
+	tmp2 = vaddq_s16(d[2], d[5]);
+	tmp5 = vsubq_s16(d[2], d[5]);
+	tmp3 = vaddq_s16(d[3], d[4]);
+	tmp4 = vsubq_s16(d[3], d[4]);
+
+	// Even part
+	tmp10 = vaddq_s16(tmp0, tmp3);
+	tmp13 = vsubq_s16(tmp0, tmp3);
+	tmp11 = vaddq_s16(tmp1, tmp2);
+	tmp12 = vsubq_s16(tmp1, tmp2);
+
+	d[0] = vaddq_s16(tmp10, tmp11);
+	d[4] = vsubq_s16(tmp10, tmp11);
+
+	// Constants are the 8 bits fixed-point ones, in Q15
+	z1 = vqdmulhq_n_s16(vaddq_s16(tmp12, tmp13), 181 * 128);
+	d[2] = vaddq_s16(tmp13, z1);
+	d[6] = vsubq_s16(tmp13, z1);
+
+	// Odd part
+	tmp10 = vaddq_s16(tmp4, tmp5);
+	tmp11 = vaddq_s16(tmp5, tmp6);
+	tmp12 = vaddq_s16(tmp6, tmp7);
+
+	z5 = vqdmulhq_n_s16(vsubq_s16(tmp10, tmp12), 98 * 128);
+	z2 = vaddq_s16(vqdmulhq_n_s16(tmp10, 139 * 128), z5);
+	z4 = vaddq_s16(vaddq_s16(vqdmulhq_n_s16(tmp12, 78 * 128), tmp12), z5);
+	z3 = vqdmulhq_n_s16(tmp11, 181 * 128);
+
+	z11 = vaddq_s16(tmp7, z3);
+	z13 = vsubq_s16(tmp7, z3);
+
+	d[5] = vaddq_s16(z13, z2);
+	d[3] = vsubq_s16(z13, z2);
+	d[1] = vaddq_s16(z11, z4);
+	d[7] = vsubq_s16(z11, z4);
+}
+#else
+#define SMDK4210_JPEG_MULTIPLY(v, c)	(((v) * (c)) >> 8)
+
+static inline void smdk4210_jpeg_dct_pass(short *d, int step)
+{
+	int tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+	int tmp10, tmp11, tmp12, tmp13;
+	int z1, z2, z3, z4, z5, z11, z13;
+
+	tmp0 = d[0] + d[7 * step];
+	tmp7 = d[0] - d[7 * step];
+	tmp1 = d[step] + d[6 * step];
+	tmp6 = d[step] - d[6 * step];
+	tmp2 = d[2 * step] + d[5 * step];
+	tmp5 = d[2 * step] - d[5 * step];
+	tmp3 = d[3 * step] + d[4 * step];
+	tmp4 = d[3 * step] - d[4 * step];
+
+	// Even part
+	tmp10 = tmp0 + tmp3;
+	tmp13 = tmp0 - tmp3;
+	tmp11 = tmp1 + tmp2;
+	tmp12 = tmp1 - tmp2;
+
+	d[0] = tmp10 + tmp11;
+	d[4 * step] = tmp10 - tmp11;
+
+	z1 = SMDK4210_JPEG_MULTIPLY(tmp12 + tmp13, 181);
+	d[2 * step] = tmp13 + z1;
+	d[6 * step] = tmp13 - z1;
+
+	// Odd part
+	tmp10 = tmp4 + tmp5;
+	tmp11 = tmp5 + tmp6;
+	tmp12 = tmp6 + tmp7;
+
+	z5 = SMDK4210_JPEG_MULTIPLY(tmp10 - tmp12, 98);
+	z2 = SMDK4210_JPEG_MULTIPLY(tmp10, 139) + z5;
+	z4 = SMDK4210_JPEG_MULTIPLY(tmp12, 334) + z5;
+	z3 = SMDK4210_JPEG_MULTIPLY(tmp11, 181);
+
+	z11 = tmp7 + z3;
+	z13 = tmp7 - z3;
+
+	d[5 * step] = z13 + z2;
+	d[3 * step] = z13 - z2;
+	d[step] = z11 + z4;
+	d[7 * step] = z11 - z4;
+}
+#endif
+
+// Forward DCT and quantization, the output is in zigzag order
+static void smdk4210_jpeg_block_quantize(short *block, unsigned short *reciprocals, short *output)
+{
+	short quantized[64];
+	int i;
+#ifdef __ARM_NEON__
+	int16x8_t rows[8];
+	int16x8_t sign;
+	uint16x8_t magnitude;
+	uint16x8_t reciprocal;
+	uint32x4_t low, high;
+
+	for (i = 0; i < 8; i++)
+		rows[i] = vld1q_s16(block + i * 8);
+
+	// Columns, then rows
+	smdk4210_jpeg_dct_pass(rows);
+	smdk4210_jpeg_transpose(rows);
+	smdk4210_jpeg_dct_pass(rows);
+	smdk4210_jpeg_transpose(rows);
+
+	for (i = 0; i < 8; i++) {
+		sign = vshrq_n_s16(rows[i], 15);
+		magnitude = vreinterpretq_u16_s16(vabsq_s16(rows[i]));
+		reciprocal = vld1q_u16(reciprocals + i * 8);
+
+		low = vmull_u16(vget_low_u16(magnitude), vget_low_u16(reciprocal));
+		high = vmull_u16(vget_high_u16(magnitude), vget_high_u16(reciprocal));
+
+		magnitude = vcombine_u16(vrshrn_n_u32(low, 16), vrshrn_n_u32(high, 16));
+
+		// Restore the sign
+		rows[i] = vsubq_s16(veorq_s16(vreinterpretq_s16_u16(magnitude), sign), sign);
+		vst1q_s16(quantized + i * 8, rows[i]);
+	}
+#else
+	int value;
+
+	for (i = 0; i < 8; i++)
+		smdk4210_jpeg_dct_pass(block + i * 8, 1);
+
+	for (i = 0; i < 8; i++)
+		smdk4210_jpeg_dct_pass(block + i, 8);
+
+	for (i = 0; i < 64; i++) {
+		value = block[i];
+
+		if (value < 0)
+			quantized[i] = -(short) (((unsigned int) -value * reciprocals[i] + (1 << 15)) >> 16);
+		else
+			quantized[i] = (short) (((unsigned int) value * reciprocals[i] + (1 << 15)) >> 16);
+	}
+#endif
+
+	for (i = 0; i < 64; i++)
+		output[i] = quantized[smdk4210_jpeg_natural_order[i]];
+}
+
+static inline int smdk4210_jpeg_magnitude(int value)
+{
+	if (value < 0)
+		value = -value;
+
+	return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+static void smdk4210_jpeg_block_encode(struct smdk4210_jpeg *jpeg, short *block,
+	int component)
+{
+	unsigned long long nonzero = 0;
+	int dc_table, ac_table;
+	int value, size;
+	int run;
+	int diff;
+	int i, k;
+
+	dc_table = component == 0 ? 0 : 2;
+	ac_table = dc_table + 1;
+
+	// DC, coded as the difference with the previous block
+	diff = block[0] - jpeg->dc[component];
+	jpeg->dc[component] = block[0];
+
+	size = smdk4210_jpeg_magnitude(diff);
+	smdk4210_jpeg_bits(jpeg, jpeg->codes[dc_table][size], jpeg->sizes[dc_table][size]);
+	if (size > 0)
+		smdk4210_jpeg_bits(jpeg, diff < 0 ? diff - 1 : diff, size);
+
+	// AC, jumping from one non-zero coefficient to the next
+	for (i = 1; i < 64; i++)
+		if (block[i] != 0)
+			nonzero |= 1ULL << i;
+
+	k = 1;
+	while (nonzero != 0) {
+		i = __builtin_ctzll(nonzero);
+		nonzero &= nonzero - 1;
+
+		run = i - k;
+		while (run >= 16) {
+			// ZRL
+			smdk4210_jpeg_bits(jpeg, jpeg->codes[ac_table][0xf0], jpeg->sizes[ac_table][0xf0]);
+			run -= 16;
+		}
+
+		value = block[i];
+		size = smdk4210_jpeg_magnitude(value);
+
+		smdk4210_jpeg_bits(jpeg, jpeg->codes[ac_table][(run << 4) | size],
+			jpeg->sizes[ac_table][(run << 4) | size]);
+		smdk4210_jpeg_bits(jpeg, value < 0 ? value - 1 : value, size);
+
+		k = i + 1;
+	}
+
+	// EOB
+	if (k < 64)
+		smdk4210_jpeg_bits(jpeg, jpeg->codes[ac_table][0x00], jpeg->sizes[ac_table][0x00]);
+}
+
+// Encode
+
+int smdk4210_jpeg_encode(void *data, int width, int height, int format, int quality,
+	void *buffer, int size)
+{
+	struct smdk4210_jpeg *jpeg = NULL;
+	unsigned char *planes[3];
+	int steps[3];
+	int strides[3];
+	int chroma_width, chroma_height;
+	int mcu_width, mcu_height;
+	short block[64];
+	short coefficients[64];
+	int subsampling;
+	int x, y;
+	int i, j;
+	int rc;
+
+	if (data == NULL || buffer == NULL || width <= 0 || height <= 0 || width > 0xffff || height > 0xffff)
+		return -EINVAL;
+
+	chroma_width = (width + 1) / 2;
+
+	switch (format) {
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_UYVY:
+			planes[0] = (unsigned char *) data + (format == V4L2_PIX_FMT_UYVY ? 1 : 0);
+			planes[1] = (unsigned char *) data + (format == V4L2_PIX_FMT_UYVY ? 0 : 1);
+			planes[2] = planes[1] + 2;
+			steps[0] = 2;
+			steps[1] = steps[2] = 4;
+			strides[0] = strides[1] = strides[2] = width * 2;
+			chroma_height = height;
+			break;
+		case V4L2_PIX_FMT_YUV422P:
+			planes[0] = (unsigned char *) data;
+			planes[1] = planes[0] + width * height;
+			planes[2] = planes[1] + (width / 2) * height;
+			steps[0] = steps[1] = steps[2] = 1;
+			strides[0] = width;
+			strides[1] = strides[2] = width / 2;
+			chroma_height = height;
+			break;
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+			planes[0] = (unsigned char *) data;
+			planes[1] = planes[0] + width * height + (format == V4L2_PIX_FMT_NV21 ? 1 : 0);
+			planes[2] = planes[0] + width * height + (format == V4L2_PIX_FMT_NV21 ? 0 : 1);
+			steps[0] = 1;
+			steps[1] = steps[2] = 2;
+			strides[0] = strides[1] = strides[2] = width;
+			chroma_height = (height + 1) / 2;
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			planes[0] = (unsigned char *) data;
+			planes[1] = planes[0] + width * height;
+			planes[2] = planes[1] + (width / 2) * (height / 2);
+			steps[0] = steps[1] = steps[2] = 1;
+			strides[0] = width;
+			strides[1] = strides[2] = width / 2;
+			chroma_height = (height + 1) / 2;
+			break;
+		default:
+			ALOGE("%s: Unsupported format: 0x%x", __func__, format);
+			return -EINVAL;
+	}
+
+	// 4:2:2 is coded as 16x8 MCUs, 4:2:0 as 16x16
+	if (chroma_height == height) {
+		subsampling = 0x21;
+		mcu_height = 8;
+	} else {
+		subsampling = 0x22;
+		mcu_height = 16;
+	}
+
+	mcu_width = 16;
+
+	jpeg = (struct smdk4210_jpeg *) calloc(1, sizeof(struct smdk4210_jpeg));
+	if (jpeg == NULL)
+		return -ENOMEM;
+
+	jpeg->buffer = (unsigned char *) buffer;
+	jpeg->size = size;
+
+	smdk4210_jpeg_quantization_init(jpeg, quality);
+	smdk4210_jpeg_huffman_init(jpeg, 0, smdk4210_jpeg_dc_luma_bits, smdk4210_jpeg_dc_values);
+	smdk4210_jpeg_huffman_init(jpeg, 1, smdk4210_jpeg_ac_luma_bits, smdk4210_jpeg_ac_luma_values);
+	smdk4210_jpeg_huffman_init(jpeg, 2, smdk4210_jpeg_dc_chroma_bits, smdk4210_jpeg_dc_values);
+	smdk4210_jpeg_huffman_init(jpeg, 3, smdk4210_jpeg_ac_chroma_bits, smdk4210_jpeg_ac_chroma_values);
+
+	smdk4210_jpeg_headers(jpeg, width, height, subsampling);
+
+	for (y = 0; y < height && !jpeg->overflow; y += mcu_height) {
+		for (x = 0; x < width; x += mcu_width) {
+			// Luma
+			for (i = 0; i < mcu_height; i += 8) {
+				for (j = 0; j < mcu_width; j += 8) {
+					smdk4210_jpeg_block_load(block, planes[0], steps[0], strides[0],
+						x + j, y + i, width, height);
+					smdk4210_jpeg_block_quantize(block, jpeg->reciprocals[0], coefficients);
+					smdk4210_jpeg_block_encode(jpeg, coefficients, 0);
+				}
+			}
+
+			// Chroma
+			for (i = 1; i < 3; i++) {
+				smdk4210_jpeg_block_load(block, planes[i], steps[i], strides[i],
+					x / 2, mcu_height == 16 ? y / 2 : y, chroma_width, chroma_height);
+				smdk4210_jpeg_block_quantize(block, jpeg->reciprocals[1], coefficients);
+				smdk4210_jpeg_block_encode(jpeg, coefficients, i);
+			}
+		}
+	}
+
+	smdk4210_jpeg_bits_flush(jpeg);
+
+	// EOI
+	smdk4210_jpeg_marker(jpeg, 0xd9, -1);
+
+	if (jpeg->overflow) {
+		ALOGE("%s: Output buffer is too small", __func__);
+		rc = -1;
+	} else {
+		rc = jpeg->offset;
+	}
+
+	free(jpeg);
+
+	return rc;
+}
@@ -0,0 +1,822 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#define LOG_TAG "smdk4210_transform"
+#include <utils/Log.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * Software transform, for what FIMC can not do on its own: rotation by
+ * quarter turns with mirroring, then center-crop digital zoom with bilinear
+ * scaling back to the frame size. Rotation works plane by plane, with
+ * interleaved chroma pairs and RGB565 pixels moved as 16-bit elements.
+ * Quarter turns are transposes, done in blocks that fit the L1 cache.
+ */
+
+int smdk4210_transform_format_supported(int format)
+{
+	switch (format) {
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_YUV420:
+		case V4L2_PIX_FMT_RGB565:
+		case V4L2_PIX_FMT_YUYV:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+// Same layout as the FIMC buffers, see smdk4210_camera_buffer_length
+static int smdk4210_transform_planes(int width, int height, int format,
+	struct smdk4210_transform_plane *planes)
+{
+	int offset;
+
+	if (format != V4L2_PIX_FMT_RGB565 && ((width & 1) || (height & 1)))
+		return -1;
+
+	planes[0].offset = 0;
+	planes[0].width = width;
+	planes[0].height = height;
+	planes[0].size = format == V4L2_PIX_FMT_RGB565 || format == V4L2_PIX_FMT_YUYV ? 2 : 1;
+
+	switch (format) {
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+			offset = format == V4L2_PIX_FMT_NV12 ? SMDK4210_CAMERA_ALIGN(width * height) : width * height;
+
+			planes[1].offset = offset;
+			planes[1].width = width / 2;
+			planes[1].height = height / 2;
+			planes[1].size = 2;
+			return 2;
+		case V4L2_PIX_FMT_YUV420:
+			offset = SMDK4210_CAMERA_ALIGN(width * height);
+
+			planes[1].offset = offset;
+			planes[1].width = width / 2;
+			planes[1].height = height / 2;
+			planes[1].size = 1;
+
+			planes[2].offset = offset + (width / 2) * (height / 2);
+			planes[2].width = width / 2;
+			planes[2].height = height / 2;
+			planes[2].size = 1;
+			return 3;
+		case V4L2_PIX_FMT_RGB565:
+		case V4L2_PIX_FMT_YUYV:
+			return 1;
+		default:
+			return -1;
+	}
+}
+
+int smdk4210_transform_frame_size(int width, int height, int format)
+{
+	struct smdk4210_transform_plane planes[SMDK4210_TRANSFORM_PLANES_COUNT];
+	int count;
+
+	count = smdk4210_transform_planes(width, height, format, planes);
+	if (count <= 0)
+		return -1;
+
+	return planes[count - 1].offset + planes[count - 1].width * planes[count - 1].height *
+		planes[count - 1].size;
+}
+
+// Rotation
+
+static void smdk4210_transform_reverse8(unsigned char *src, unsigned char *dst, int count)
+{
+	int i = 0;
+
+#ifdef __ARM_NEON__
+	uint8x16_t v;
+
+	for (; i + 16 <= count; i += 16) {
+		v = vld1q_u8(src + count - 16 - i);
+		v = vrev64q_u8(v);
+		vst1q_u8(dst + i, vcombine_u8(vget_high_u8(v), vget_low_u8(v)));
+	}
+#endif
+
+	for (; i < count; i++)
+		dst[i] = src[count - 1 - i];
+}
+
+static void smdk4210_transform_reverse16(unsigned short *src, unsigned short *dst, int count)
+{
+	int i = 0;
+
+#ifdef __ARM_NEON__
+	uint16x8_t v;
+
+	for (; i + 8 <= count; i += 8) {
+		v = vld1q_u16(src + count - 8 - i);
+		v = vrev64q_u16(v);
+		vst1q_u16(dst + i, vcombine_u16(vget_high_u16(v), vget_low_u16(v)));
+	}
+#endif
+
+	for (; i < count; i++)
+		dst[i] = src[count - 1 - i];
+}
+
+static void smdk4210_transform_copy_plane(unsigned char *src, unsigned char *dst,
+	int width, int height, int size, int mirror_x, int mirror_y)
+{
+	unsigned char *s;
+	unsigned char *d;
+	int stride;
+	int y;
+
+	stride = width * size;
+
+	for (y = 0; y < height; y++) {
+		s = src + (mirror_y ? height - 1 - y : y) * stride;
+		d = dst + y * stride;
+
+		if (!mirror_x)
+			memcpy(d, s, stride);
+		else if (size == 1)
+			smdk4210_transform_reverse8(s, d, width);
+		else
+			smdk4210_transform_reverse16((unsigned short *) s, (unsigned short *) d, width);
+	}
+}
+
+/*
+ * The source is width x height, the destination height x width: source
+ * pixel (x, y) goes to column y and row x, each mirrored when asked for.
+ */
+
+static void smdk4210_transform_transpose8(unsigned char *src, unsigned char *dst,
+	int width, int height, int mirror_x, int mirror_y, int bx, int by, int bw, int bh)
+{
+	int dx, dy;
+	int x, y;
+
+#ifdef __ARM_NEON__
+	uint8x8_t r0, r1, r2, r3, r4, r5, r6, r7;
+	uint8x8x2_t t0, t1, t2, t3;
+	uint16x4x2_t u0, u1, u2, u3;
+	uint32x2x2_t v0, v1, v2, v3;
+	uint8x8_t columns[8];
+	unsigned char *s;
+	int i;
+
+	if ((bw & 7) == 0 && (bh & 7) == 0) {
+		for (y = by; y < by + bh; y += 8) {
+			for (x = bx; x < bx + bw; x += 8) {
+				s = src + y * width + x;
+
+				r0 = vld1_u8(s);
+				r1 = vld1_u8(s + width);
+				r2 = vld1_u8(s + width * 2);
+				r3 = vld1_u8(s + width * 3);
+				r4 = vld1_u8(s + width * 4);
+				r5 = vld1_u8(s + width * 5);
+				r6 = vld1_u8(s + width * 6);
+				r7 = vld1_u8(s + width * 7);
+
+				t0 = vtrn_u8(r0, r1);
+				t1 = vtrn_u8(r2, r3);
+				t2 = vtrn_u8(r4, r5);
+				t3 = vtrn_u8(r6, r7);
+
+				u0 = vtrn_u16(vreinterpret_u16_u8(t0.val[0]), vreinterpret_u16_u8(t1.val[0]));
+				u1 = vtrn_u16(vreinterpret_u16_u8(t0.val[1]), vreinterpret_u16_u8(t1.val[1]));
+				u2 = vtrn_u16(vreinterpret_u16_u8(t2.val[0]), vreinterpret_u16_u8(t3.val[0]));
+				u3 = vtrn_u16(vreinterpret_u16_u8(t2.val[1]), vreinterpret_u16_u8(t3.val[1]));
+
+				v0 = vtrn_u32(vreinterpret_u32_u16(u0.val[0]), vreinterpret_u32_u16(u2.val[0]));
+				v1 = vtrn_u32(vreinterpret_u32_u16(u1.val[0]), vreinterpret_u32_u16(u3.val[0]));
+				v2 = vtrn_u32(vreinterpret_u32_u16(u0.val[1]), vreinterpret_u32_u16(u2.val[1]));
+				v3 = vtrn_u32(vreinterpret_u32_u16(u1.val[1]), vreinterpret_u32_u16(u3.val[1]));
+
+				columns[0] = vreinterpret_u8_u32(v0.val[0]);
+				columns[1] = vreinterpret_u8_u32(v1.val[0]);
+				columns[2] = vreinterpret_u8_u32(v2.val[0]);
+				columns[3] = vreinterpret_u8_u32(v3.val[0]);
+				columns[4] = vreinterpret_u8_u32(v0.val[1]);
+				columns[5] = vreinterpret_u8_u32(v1.val[1]);
+				columns[6] = vreinterpret_u8_u32(v2.val[1]);
+				columns[7] = vreinterpret_u8_u32(v3.val[1]);
+
+				dx = mirror_y ? height - 8 - y : y;
+
+				for (i = 0; i < 8; i++) {
+					dy = mirror_x ? width - 1 - (x + i) : x + i;
+
+					if (mirror_y)
+						vst1_u8(dst + dy * height + dx, vrev64_u8(columns[i]));
+					else
+						vst1_u8(dst + dy * height + dx, columns[i]);
+				}
+			}
+		}
+
+		return;
+	}
+#endif
+
+	for (y = by; y < by + bh; y++) {
+		dx = mirror_y ? height - 1 - y : y;
+
+		for (x = bx; x < bx + bw; x++) {
+			dy = mirror_x ? width - 1 - x : x;
+			dst[dy * height + dx] = src[y * width + x];
+		}
+	}
+}
+
+static void smdk4210_transform_transpose16(unsigned short *src, unsigned short *dst,
+	int width, int height, int mirror_x, int mirror_y, int bx, int by, int bw, int bh)
+{
+	int dx, dy;
+	int x, y;
+
+#ifdef __ARM_NEON__
+	uint16x4_t r0, r1, r2, r3;
+	uint16x4x2_t t0, t1;
+	uint32x2x2_t v0, v1;
+	uint16x4_t columns[4];
+	unsigned short *s;
+	int i;
+
+	if ((bw & 3) == 0 && (bh & 3) == 0) {
+		for (y = by; y < by + bh; y += 4) {
+			for (x = bx; x < bx + bw; x += 4) {
+				s = src + y * width + x;
+
+				r0 = vld1_u16(s);
+				r1 = vld1_u16(s + width);
+				r2 = vld1_u16(s + width * 2);
+				r3 = vld1_u16(s + width * 3);
+
+				t0 = vtrn_u16(r0, r1);
+				t1 = vtrn_u16(r2, r3);
+
+				v0 = vtrn_u32(vreinterpret_u32_u16(t0.val[0]), vreinterpret_u32_u16(t1.val[0]));
+				v1 = vtrn_u32(vreinterpret_u32_u16(t0.val[1]), vreinterpret_u32_u16(t1.val[1]));
+
+				columns[0] = vreinterpret_u16_u32(v0.val[0]);
+				columns[1] = vreinterpret_u16_u32(v1.val[0]);
+				columns[2] = vreinterpret_u16_u32(v0.val[1]);
+				columns[3] = vreinterpret_u16_u32(v1.val[1]);
+
+				dx = mirror_y ? height - 4 - y : y;
+
+				for (i = 0; i < 4; i++) {
+					dy = mirror_x ? width - 1 - (x + i) : x + i;
+
+					if (mirror_y)
+						vst1_u16(dst + dy * height + dx, vrev64_u16(columns[i]));
+					else
+						vst1_u16(dst + dy * height + dx, columns[i]);
+				}
+			}
+		}
+
+		return;
+	}
+#endif
+
+	for (y = by; y < by + bh; y++) {
+		dx = mirror_y ? height - 1 - y : y;
+
+		for (x = bx; x < bx + bw; x++) {
+			dy = mirror_x ? width - 1 - x : x;
+			dst[dy * height + dx] = src[y * width + x];
+		}
+	}
+}
+
+static void smdk4210_transform_transpose_plane(unsigned char *src, unsigned char *dst,
+	int width, int height, int size, int mirror_x, int mirror_y)
+{
+	int bw, bh;
+	int x, y;
+
+	for (y = 0; y < height; y += SMDK4210_TRANSFORM_BLOCK_SIZE) {
+		bh = height - y < SMDK4210_TRANSFORM_BLOCK_SIZE ? height - y : SMDK4210_TRANSFORM_BLOCK_SIZE;
+
+		for (x = 0; x < width; x += SMDK4210_TRANSFORM_BLOCK_SIZE) {
+			bw = width - x < SMDK4210_TRANSFORM_BLOCK_SIZE ? width - x : SMDK4210_TRANSFORM_BLOCK_SIZE;
+
+			if (size == 1)
+				smdk4210_transform_transpose8(src, dst, width, height,
+					mirror_x, mirror_y, x, y, bw, bh);
+			else
+				smdk4210_transform_transpose16((unsigned short *) src, (unsigned short *) dst,
+					width, height, mirror_x, mirror_y, x, y, bw, bh);
+		}
+	}
+}
+
+/*
+ * Flips apply to the source, before the clockwise rotation, which comes
+ * down to an optional transpose and a mirror on each source axis.
+ */
+
+int smdk4210_transform_rotate(void *src, void *dst, int width, int height, int format,
+	int rotation, int hflip, int vflip)
+{
+	struct smdk4210_transform_plane src_planes[SMDK4210_TRANSFORM_PLANES_COUNT];
+	struct smdk4210_transform_plane dst_planes[SMDK4210_TRANSFORM_PLANES_COUNT];
+	int mirror_x, mirror_y;
+	int transpose;
+	int count;
+	int i;
+
+	if (src == NULL || dst == NULL || src == dst || width <= 0 || height <= 0)
+		return -EINVAL;
+
+	// Packed 4:2:2 pictures are only ever scaled
+	if (format == V4L2_PIX_FMT_YUYV)
+		return -EINVAL;
+
+	switch (rotation) {
+		case 0:
+			transpose = 0;
+			mirror_x = hflip;
+			mirror_y = vflip;
+			break;
+		case 90:
+			transpose = 1;
+			mirror_x = hflip;
+			mirror_y = !vflip;
+			break;
+		case 180:
+			transpose = 0;
+			mirror_x = !hflip;
+			mirror_y = !vflip;
+			break;
+		case 270:
+			transpose = 1;
+			mirror_x = !hflip;
+			mirror_y = vflip;
+			break;
+		default:
+			return -EINVAL;
+	}
+
+	count = smdk4210_transform_planes(width, height, format, src_planes);
+	if (count <= 0)
+		return -EINVAL;
+
+	if (transpose)
+		smdk4210_transform_planes(height, width, format, dst_planes);
+	else
+		memcpy(dst_planes, src_planes, sizeof(src_planes));
+
+	for (i = 0; i < count; i++) {
+		if (transpose)
+			smdk4210_transform_transpose_plane((unsigned char *) src + src_planes[i].offset,
+				(unsigned char *) dst + dst_planes[i].offset, src_planes[i].width,
+				src_planes[i].height, src_planes[i].size, mirror_x, mirror_y);
+		else
+			smdk4210_transform_copy_plane((unsigned char *) src + src_planes[i].offset,
+				(unsigned char *) dst + dst_planes[i].offset, src_planes[i].width,
+				src_planes[i].height, src_planes[i].size, mirror_x, mirror_y);
+	}
+
+	return 0;
+}
+
+// Scaling
+
+static void *smdk4210_transform_alloc(void *buffer, int *size, int required)
+{
+	if (buffer != NULL && *size >= required)
+		return buffer;
+
+	if (buffer != NULL)
+		free(buffer);
+
+	buffer = malloc(required);
+	*size = buffer != NULL ? required : 0;
+
+	return buffer;
+}
+
+/*
+ * A tap is the two samples to interpolate between and the weight of the
+ * second one, out of 256. Positions are pixel centers, in 16.16 fixed point.
+ */
+
+static void smdk4210_transform_tap(int index, int count, int crop_start, int crop_length,
+	int limit, int *p0, int *p1, int *frac)
+{
+	long long position;
+
+	position = (((long long) (2 * index + 1) * crop_length) << 16) / (2 * count) - 32768 +
+		((long long) crop_start << 16);
+	if (position < 0)
+		position = 0;
+
+	*p0 = (int) (position >> 16);
+	*frac = (int) (position >> 8) & 0xff;
+
+	if (*p0 >= limit - 1) {
+		*p0 = limit - 1;
+		*frac = 0;
+	}
+
+	*p1 = *frac > 0 ? *p0 + 1 : *p0;
+}
+
+// Horizontal taps are stored as byte offsets in the row
+static void smdk4210_transform_taps(int *taps, int count, int crop_start, int crop_length,
+	int limit, int stride, int base)
+{
+	int p0, p1, frac;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		smdk4210_transform_tap(i, count, crop_start, crop_length, limit, &p0, &p1, &frac);
+
+		taps[i * 3] = p0 * stride + base;
+		taps[i * 3 + 1] = p1 * stride + base;
+		taps[i * 3 + 2] = frac;
+	}
+}
+
+static void smdk4210_transform_blend(unsigned char *a, unsigned char *b, unsigned char *row,
+	int count, int weight)
+{
+	int i = 0;
+
+#ifdef __ARM_NEON__
+	uint8x8_t weight_a, weight_b;
+	uint8x16_t va, vb;
+	uint16x8_t low, high;
+
+	weight_a = vdup_n_u8(256 - weight);
+	weight_b = vdup_n_u8(weight);
+
+	for (; i + 16 <= count; i += 16) {
+		va = vld1q_u8(a + i);
+		vb = vld1q_u8(b + i);
+
+		low = vmull_u8(vget_low_u8(va), weight_a);
+		low = vmlal_u8(low, vget_low_u8(vb), weight_b);
+		high = vmull_u8(vget_high_u8(va), weight_a);
+		high = vmlal_u8(high, vget_high_u8(vb), weight_b);
+
+		vst1q_u8(row + i, vcombine_u8(vrshrn_n_u16(low, 8), vrshrn_n_u16(high, 8)));
+	}
+#endif
+
+	for (; i < count; i++)
+		row[i] = (a[i] * (256 - weight) + b[i] * weight + 128) >> 8;
+}
+
+/*
+ * Rows are first interpolated vertically, with NEON, over the bytes the
+ * horizontal taps cover. The horizontal pass is a gather and stays scalar.
+ * The returned row starts at byte start of the source lines.
+ */
+
+static unsigned char *smdk4210_transform_row(struct smdk4210_transform *transform,
+	unsigned char *src, int stride, int src_height, int crop_y, int crop_height,
+	int y, int height, int start, int end)
+{
+	int p0, p1, frac;
+
+	smdk4210_transform_tap(y, height, crop_y, crop_height, src_height, &p0, &p1, &frac);
+
+	if (frac == 0)
+		return src + p0 * stride + start;
+
+	smdk4210_transform_blend(src + p0 * stride + start, src + p1 * stride + start,
+		transform->row, end - start, frac);
+
+	return transform->row;
+}
+
+static int smdk4210_transform_scale_plane(struct smdk4210_transform *transform,
+	unsigned char *src, int src_width, int src_height, int crop_x, int crop_y,
+	int crop_width, int crop_height, unsigned char *dst, int width, int height,
+	int channels)
+{
+	unsigned char *row;
+	int *taps;
+	int start, end;
+	int a, b, frac;
+	int x, y, c;
+
+	transform->taps = (int *) smdk4210_transform_alloc(transform->taps, &transform->taps_size,
+		width * 3 * sizeof(int));
+	transform->row = (unsigned char *) smdk4210_transform_alloc(transform->row, &transform->row_size,
+		src_width * channels);
+	if (transform->taps == NULL || transform->row == NULL)
+		return -1;
+
+	taps = transform->taps;
+	smdk4210_transform_taps(taps, width, crop_x, crop_width, src_width, channels, 0);
+
+	start = taps[0];
+	end = taps[(width - 1) * 3 + 1] + channels;
+
+	for (y = 0; y < height; y++) {
+		row = smdk4210_transform_row(transform, src, src_width * channels, src_height,
+			crop_y, crop_height, y, height, start, end);
+
+		for (x = 0; x < width; x++) {
+			frac = taps[x * 3 + 2];
+
+			for (c = 0; c < channels; c++) {
+				a = row[taps[x * 3] - start + c];
+				b = row[taps[x * 3 + 1] - start + c];
+				*dst++ = (a * (256 - frac) + b * frac + 128) >> 8;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int smdk4210_transform_scale_rgb565(struct smdk4210_transform *transform,
+	unsigned short *src, int src_width, int src_height, int crop_x, int crop_y,
+	int crop_width, int crop_height, unsigned short *dst, int width, int height)
+{
+	unsigned short *line0, *line1;
+	unsigned short p00, p01, p10, p11;
+	int w00, w01, w10, w11;
+	int r, g, b;
+	int p0, p1, fx, fy;
+	int *taps;
+	int x, y;
+
+	transform->taps = (int *) smdk4210_transform_alloc(transform->taps, &transform->taps_size,
+		width * 3 * sizeof(int));
+	if (transform->taps == NULL)
+		return -1;
+
+	taps = transform->taps;
+	smdk4210_transform_taps(taps, width, crop_x, crop_width, src_width, 1, 0);
+
+	for (y = 0; y < height; y++) {
+		smdk4210_transform_tap(y, height, crop_y, crop_height, src_height, &p0, &p1, &fy);
+		line0 = src + p0 * src_width;
+		line1 = src + p1 * src_width;
+
+		for (x = 0; x < width; x++) {
+			fx = taps[x * 3 + 2];
+
+			p00 = line0[taps[x * 3]];
+			p01 = line0[taps[x * 3 + 1]];
+			p10 = line1[taps[x * 3]];
+			p11 = line1[taps[x * 3 + 1]];
+
+			w00 = (256 - fx) * (256 - fy);
+			w01 = fx * (256 - fy);
+			w10 = (256 - fx) * fy;
+			w11 = fx * fy;
+
+			r = ((p00 >> 11) * w00 + (p01 >> 11) * w01 + (p10 >> 11) * w10 +
+				(p11 >> 11) * w11 + 32768) >> 16;
+			g = (((p00 >> 5) & 0x3f) * w00 + ((p01 >> 5) & 0x3f) * w01 +
+				((p10 >> 5) & 0x3f) * w10 + ((p11 >> 5) & 0x3f) * w11 + 32768) >> 16;
+			b = ((p00 & 0x1f) * w00 + (p01 & 0x1f) * w01 + (p10 & 0x1f) * w10 +
+				(p11 & 0x1f) * w11 + 32768) >> 16;
+
+			*dst++ = (r << 11) | (g << 5) | b;
+		}
+	}
+
+	return 0;
+}
+
+// Luma is sampled per pixel, chroma per pair of pixels
+static int smdk4210_transform_scale_yuyv(struct smdk4210_transform *transform,
+	unsigned char *src, int src_width, int src_height, int crop_x, int crop_y,
+	int crop_width, int crop_height, unsigned char *dst, int width, int height)
+{
+	unsigned char *row;
+	int *taps, *chroma_taps;
+	int start, end;
+	int a, b, frac;
+	int x, y, i;
+
+	transform->taps = (int *) smdk4210_transform_alloc(transform->taps, &transform->taps_size,
+		width * 3 * sizeof(int));
+	transform->chroma_taps = (int *) smdk4210_transform_alloc(transform->chroma_taps,
+		&transform->chroma_taps_size, (width / 2) * 3 * sizeof(int));
+	transform->row = (unsigned char *) smdk4210_transform_alloc(transform->row, &transform->row_size,
+		src_width * 2);
+	if (transform->taps == NULL || transform->chroma_taps == NULL || transform->row == NULL)
+		return -1;
+
+	taps = transform->taps;
+	chroma_taps = transform->chroma_taps;
+
+	smdk4210_transform_taps(taps, width, crop_x, crop_width, src_width, 2, 0);
+	smdk4210_transform_taps(chroma_taps, width / 2, crop_x / 2, crop_width / 2, src_width / 2, 4, 1);
+
+	start = taps[0] < chroma_taps[0] - 1 ? taps[0] : chroma_taps[0] - 1;
+	end = taps[(width - 1) * 3 + 1] + 1 > chroma_taps[(width / 2 - 1) * 3 + 1] + 3 ?
+		taps[(width - 1) * 3 + 1] + 1 : chroma_taps[(width / 2 - 1) * 3 + 1] + 3;
+
+	for (y = 0; y < height; y++) {
+		row = smdk4210_transform_row(transform, src, src_width * 2, src_height,
+			crop_y, crop_height, y, height, start, end);
+
+		for (x = 0; x < width; x++) {
+			frac = taps[x * 3 + 2];
+			a = row[taps[x * 3] - start];
+			b = row[taps[x * 3 + 1] - start];
+			dst[x * 2] = (a * (256 - frac) + b * frac + 128) >> 8;
+
+			// U on even pixels, V on odd ones
+			i = (x / 2) * 3;
+			frac = chroma_taps[i + 2];
+			a = row[chroma_taps[i] - start + (x & 1) * 2];
+			b = row[chroma_taps[i + 1] - start + (x & 1) * 2];
+			dst[x * 2 + 1] = (a * (256 - frac) + b * frac + 128) >> 8;
+		}
+
+		dst += width * 2;
+	}
+
+	return 0;
+}
+
+/*
+ * The crop is the largest centered one with the destination aspect ratio,
+ * narrowed down by the zoom ratio, in percents.
+ */
+
+int smdk4210_transform_scale(struct smdk4210_transform *transform, void *src,
+	int src_width, int src_height, void *dst, int width, int height, int format,
+	int zoom_ratio)
+{
+	struct smdk4210_transform_plane src_planes[SMDK4210_TRANSFORM_PLANES_COUNT];
+	struct smdk4210_transform_plane dst_planes[SMDK4210_TRANSFORM_PLANES_COUNT];
+	int crop_x, crop_y, crop_width, crop_height;
+	int divisor, channels;
+	int count;
+	int rc;
+	int i;
+
+	if (transform == NULL || src == NULL || dst == NULL || src == dst || zoom_ratio < 100)
+		return -EINVAL;
+
+	count = smdk4210_transform_planes(src_width, src_height, format, src_planes);
+	if (count <= 0 || smdk4210_transform_planes(width, height, format, dst_planes) != count)
+		return -EINVAL;
+
+	if (src_width * height > src_height * width) {
+		crop_height = src_height;
+		crop_width = src_height * width / height;
+	} else {
+		crop_width = src_width;
+		crop_height = src_width * height / width;
+	}
+
+	crop_width = (crop_width * 100 / zoom_ratio) & ~1;
+	crop_height = (crop_height * 100 / zoom_ratio) & ~1;
+	if (crop_width < 2 || crop_height < 2)
+		return -EINVAL;
+
+	crop_x = ((src_width - crop_width) / 2) & ~1;
+	crop_y = ((src_height - crop_height) / 2) & ~1;
+
+	if (format == V4L2_PIX_FMT_RGB565)
+		return smdk4210_transform_scale_rgb565(transform, (unsigned short *) src,
+			src_width, src_height, crop_x, crop_y, crop_width, crop_height,
+			(unsigned short *) dst, width, height);
+
+	if (format == V4L2_PIX_FMT_YUYV)
+		return smdk4210_transform_scale_yuyv(transform, (unsigned char *) src,
+			src_width, src_height, crop_x, crop_y, crop_width, crop_height,
+			(unsigned char *) dst, width, height);
+
+	for (i = 0; i < count; i++) {
+		divisor = i > 0 ? 2 : 1;
+		channels = src_planes[i].size;
+
+		rc = smdk4210_transform_scale_plane(transform, (unsigned char *) src + src_planes[i].offset,
+			src_planes[i].width, src_planes[i].height, crop_x / divisor, crop_y / divisor,
+			crop_width / divisor, crop_height / divisor, (unsigned char *) dst + dst_planes[i].offset,
+			dst_planes[i].width, dst_planes[i].height, channels);
+		if (rc < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+// Frame
+
+void smdk4210_transform_init(struct smdk4210_transform *transform)
+{
+	if (transform == NULL)
+		return;
+
+	memset(transform, 0, sizeof(struct smdk4210_transform));
+}
+
+void smdk4210_transform_deinit(struct smdk4210_transform *transform)
+{
+	if (transform == NULL)
+		return;
+
+	if (transform->buffer != NULL)
+		free(transform->buffer);
+	if (transform->row != NULL)
+		free(transform->row);
+	if (transform->taps != NULL)
+		free(transform->taps);
+	if (transform->chroma_taps != NULL)
+		free(transform->chroma_taps);
+
+	memset(transform, 0, sizeof(struct smdk4210_transform));
+}
+
+/*
+ * The frame is transformed in place, through the transform buffer.
+ * Quarter turns leave a height x width frame, of the same length.
+ */
+
+int smdk4210_transform_frame(struct smdk4210_transform *transform, void *data,
+	int width, int height, int format, int rotation, int hflip, int vflip,
+	int zoom_ratio)
+{
+	int rotated_width, rotated_height;
+	int size;
+	int rc;
+
+	if (transform == NULL || data == NULL)
+		return -EINVAL;
+
+	size = smdk4210_transform_frame_size(width, height, format);
+	if (size <= 0)
+		return -EINVAL;
+
+	transform->buffer = (unsigned char *) smdk4210_transform_alloc(transform->buffer,
+		&transform->buffer_size, size);
+	if (transform->buffer == NULL) {
+		ALOGE("%s: Unable to allocate transform buffer", __func__);
+		return -1;
+	}
+
+	if (zoom_ratio < 100)
+		zoom_ratio = 100;
+
+	if (rotation == 0 && !hflip && !vflip) {
+		if (zoom_ratio == 100)
+			return 0;
+
+		rc = smdk4210_transform_scale(transform, data, width, height, transform->buffer,
+			width, height, format, zoom_ratio);
+		if (rc < 0)
+			return rc;
+
+		memcpy(data, transform->buffer, size);
+
+		return 0;
+	}
+
+	rc = smdk4210_transform_rotate(data, transform->buffer, width, height, format,
+		rotation, hflip, vflip);
+	if (rc < 0)
+		return rc;
+
+	rotated_width = rotation == 90 || rotation == 270 ? height : width;
+	rotated_height = rotation == 90 || rotation == 270 ? width : height;
+
+	if (zoom_ratio > 100)
+		return smdk4210_transform_scale(transform, transform->buffer, rotated_width,
+			rotated_height, data, rotated_width, rotated_height, format, zoom_ratio);
+
+	memcpy(data, transform->buffer, smdk4210_transform_frame_size(rotated_width,
+		rotated_height, format));
+
+	return 0;
+}
@@ -16,9 +16,12 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 #define LOG_TAG "smdk4210_camera"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 
 #include "smdk4210_camera.h"
 
@@ -114,3 +117,387 @@ int smdk4210_scale_yuv422(void *src, int src_width, int src_height, void *dst,
 
 	return 0;
 }
+
+int smdk4210_scale_nv12(void *src, int src_width, int src_height, void *dst,
+	int dst_width, int dst_height)
+{
+	unsigned char *src_y, *src_cbcr;
+	unsigned char *dst_y, *dst_cbcr;
+	int src_x, src_y_index;
+	int x, y;
+
+	if (src == NULL || dst == NULL || dst_width <= 0 || dst_height <= 0)
+		return -1;
+
+	src_cbcr = (unsigned char *) src + src_width * src_height;
+	dst_y = (unsigned char *) dst;
+	dst_cbcr = (unsigned char *) dst + dst_width * dst_height;
+
+	for (y = 0; y < dst_height; y++) {
+		src_y_index = y * src_height / dst_height;
+		src_y = (unsigned char *) src + src_y_index * src_width;
+
+		for (x = 0; x < dst_width; x++) {
+			src_x = x * src_width / dst_width;
+			*dst_y++ = src_y[src_x];
+		}
+	}
+
+	for (y = 0; y < dst_height / 2; y++) {
+		src_y_index = y * src_height / dst_height;
+		src_y = src_cbcr + src_y_index * src_width;
+
+		for (x = 0; x < dst_width; x += 2) {
+			src_x = (x * src_width / dst_width) & ~1;
+			*dst_cbcr++ = src_y[src_x];
+			*dst_cbcr++ = src_y[src_x + 1];
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * NV12T is made of 64x32 tiles, grouped by 4 in 8K units. Pairs of tile rows
+ * are laid out in a Z pattern that is mirrored every other unit, except for
+ * a trailing odd tile row, which is linear.
+ */
+
+static int smdk4210_nv12t_tile_offset(int width, int height, int tile_x, int tile_y)
+{
+	int units_x;
+	int unit;
+	int bank;
+
+	units_x = ((width - 1) >> 7) + 1;
+
+	if ((tile_y & 1) == 0 && height <= (tile_y + 1) * 32 && (((height - 1) >> 5) & 1) == 0)
+		unit = (tile_y >> 1) * units_x + (tile_x >> 2);
+	else
+		unit = (tile_y >> 1) * units_x + (tile_x >> 1);
+
+	if (((tile_x >> 1) & 1) == (tile_y & 1))
+		bank = tile_x & 1;
+	else
+		bank = 2 | (tile_x & 1);
+
+	return unit * 8192 + bank * 2048;
+}
+
+static void smdk4210_nv12t_detile_plane(unsigned char *src, unsigned char *dst,
+	int width, int height)
+{
+	unsigned char *tile;
+	int tile_x, tile_y;
+	int tile_width, tile_height;
+	int y;
+
+	for (tile_y = 0; tile_y * 32 < height; tile_y++) {
+		tile_height = height - tile_y * 32;
+		if (tile_height > 32)
+			tile_height = 32;
+
+		for (tile_x = 0; tile_x * 64 < width; tile_x++) {
+			tile_width = width - tile_x * 64;
+			if (tile_width > 64)
+				tile_width = 64;
+
+			tile = src + smdk4210_nv12t_tile_offset(width, height, tile_x, tile_y);
+
+			for (y = 0; y < tile_height; y++)
+				memcpy(dst + (tile_y * 32 + y) * width + tile_x * 64,
+					tile + y * 64, tile_width);
+		}
+	}
+}
+
+int smdk4210_detile_nv12t(void *src, int width, int height, void *dst)
+{
+	int cbcr_offset;
+
+	if (src == NULL || dst == NULL || width <= 0 || height <= 0)
+		return -1;
+
+	// The CbCr plane starts after the 8K-aligned, tile-padded Y plane
+	cbcr_offset = SMDK4210_CAMERA_TILE_ALIGN(width, 128) * SMDK4210_CAMERA_TILE_ALIGN(height, 32);
+	cbcr_offset = SMDK4210_CAMERA_TILE_ALIGN(cbcr_offset, 8192);
+
+	smdk4210_nv12t_detile_plane((unsigned char *) src, (unsigned char *) dst,
+		width, height);
+	smdk4210_nv12t_detile_plane((unsigned char *) src + cbcr_offset,
+		(unsigned char *) dst + width * height, width, height / 2);
+
+	return 0;
+}
+
+/*
+ * Queue depth policy: the memory budget bounds the number of buffers for a
+ * given frame size, then the dequeue-to-release latency measured during the
+ * previous session gives how many buffers the consumer actually holds.
+ */
+
+int smdk4210_camera_queue_count(struct smdk4210_camera_queue *queue,
+	int frame_size, int fps, int min_count)
+{
+	nsecs_t interval;
+	int budget_count;
+	int latency_count = 0;
+	int count;
+
+	if (queue == NULL || frame_size <= 0)
+		return SMDK4210_CAMERA_MAX_BUFFERS_COUNT;
+
+	budget_count = SMDK4210_CAMERA_BUFFERS_MEMORY_BUDGET / frame_size;
+	if (budget_count > SMDK4210_CAMERA_MAX_BUFFERS_COUNT)
+		budget_count = SMDK4210_CAMERA_MAX_BUFFERS_COUNT;
+	if (budget_count < min_count)
+		budget_count = min_count;
+
+	if (queue->latency_samples > 0)
+		queue->latency_estimate = queue->latency_max;
+
+	count = budget_count;
+
+	if (queue->latency_estimate > 0 && fps > 0) {
+		interval = 1000000000LL / fps;
+
+		// Buffers held by the consumer, plus one being filled and one ahead
+		latency_count = (int) ((queue->latency_estimate + interval - 1) / interval) + 2;
+		if (latency_count < min_count)
+			latency_count = min_count;
+
+		if (latency_count < count)
+			count = latency_count;
+	}
+
+	queue->buffers_count = count;
+	queue->budget_count = budget_count;
+	queue->latency_count = latency_count;
+
+	queue->latency_max = 0;
+	queue->latency_sum = 0;
+	queue->latency_samples = 0;
+	memset(queue->dequeue_timestamps, 0, sizeof(queue->dequeue_timestamps));
+
+	return count;
+}
+
+void smdk4210_camera_queue_dequeued(struct smdk4210_camera_queue *queue,
+	int index, nsecs_t timestamp)
+{
+	if (queue == NULL || index < 0 || index >= SMDK4210_CAMERA_MAX_BUFFERS_COUNT)
+		return;
+
+	queue->dequeue_timestamps[index] = timestamp;
+}
+
+void smdk4210_camera_queue_released(struct smdk4210_camera_queue *queue,
+	int index, nsecs_t timestamp)
+{
+	nsecs_t latency;
+
+	if (queue == NULL || index < 0 || index >= SMDK4210_CAMERA_MAX_BUFFERS_COUNT ||
+		queue->dequeue_timestamps[index] == 0)
+		return;
+
+	latency = timestamp - queue->dequeue_timestamps[index];
+	queue->dequeue_timestamps[index] = 0;
+
+	if (latency > queue->latency_max)
+		queue->latency_max = latency;
+
+	queue->latency_sum += latency;
+	queue->latency_samples++;
+}
+
+/*
+ * Memory pool
+ */
+
+static int smdk4210_camera_pool_class_size(int size)
+{
+	int step = 0x10000;
+
+	// Quarter power of two steps: at most a fourth of a buffer goes unused
+	while (step * 8 < size)
+		step <<= 1;
+
+	return (size + step - 1) & ~(step - 1);
+}
+
+int smdk4210_camera_pool_init(struct smdk4210_camera *smdk4210_camera)
+{
+	if (smdk4210_camera == NULL)
+		return -EINVAL;
+
+	memset(&smdk4210_camera->memory_pool, 0, sizeof(struct smdk4210_camera_pool));
+	pthread_mutex_init(&smdk4210_camera->memory_pool.mutex, NULL);
+
+	return 0;
+}
+
+void smdk4210_camera_pool_deinit(struct smdk4210_camera *smdk4210_camera)
+{
+	struct smdk4210_camera_pool *pool;
+	camera_memory_t *memory;
+	int i;
+
+	if (smdk4210_camera == NULL)
+		return;
+
+	pool = &smdk4210_camera->memory_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	for (i = 0; i < SMDK4210_CAMERA_POOL_BUFFERS_COUNT; i++) {
+		memory = pool->buffers[i].memory;
+		if (memory == NULL)
+			continue;
+
+		if (pool->buffers[i].used)
+			ALOGE("%s: Buffer %d is still in use", __func__, i);
+
+		if (memory->release != NULL)
+			memory->release(memory);
+
+		pool->buffers[i].memory = NULL;
+	}
+
+	pool->used_size = 0;
+	pool->cached_size = 0;
+
+	pthread_mutex_unlock(&pool->mutex);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+camera_memory_t *smdk4210_camera_pool_get(struct smdk4210_camera *smdk4210_camera, int size)
+{
+	struct smdk4210_camera_pool *pool;
+	struct smdk4210_camera_pool_buffer *buffer;
+	camera_memory_t *memory = NULL;
+	int class_size;
+	int index = -1;
+	int i;
+
+	if (smdk4210_camera == NULL || size <= 0)
+		return NULL;
+
+	if (smdk4210_camera->callbacks.request_memory == NULL) {
+		ALOGE("%s: No memory request function!", __func__);
+		return NULL;
+	}
+
+	pool = &smdk4210_camera->memory_pool;
+	class_size = smdk4210_camera_pool_class_size(size);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	for (i = 0; i < SMDK4210_CAMERA_POOL_BUFFERS_COUNT; i++) {
+		buffer = &pool->buffers[i];
+
+		if (buffer->memory != NULL && !buffer->used && buffer->size == class_size) {
+			buffer->used = 1;
+			pool->cached_size -= class_size;
+			pool->used_size += class_size;
+			pool->hits++;
+
+			memory = buffer->memory;
+			goto complete;
+		}
+	}
+
+	for (i = 0; i < SMDK4210_CAMERA_POOL_BUFFERS_COUNT; i++) {
+		if (pool->buffers[i].memory == NULL) {
+			index = i;
+			break;
+		}
+	}
+
+	// Drop cached buffers of other sizes rather than growing past the budget
+	for (i = 0; i < SMDK4210_CAMERA_POOL_BUFFERS_COUNT; i++) {
+		buffer = &pool->buffers[i];
+
+		if (index >= 0 && pool->used_size + pool->cached_size + class_size <= SMDK4210_CAMERA_POOL_MEMORY_BUDGET)
+			break;
+
+		if (buffer->memory == NULL || buffer->used)
+			continue;
+
+		if (buffer->memory->release != NULL)
+			buffer->memory->release(buffer->memory);
+
+		buffer->memory = NULL;
+		pool->cached_size -= buffer->size;
+
+		if (index < 0)
+			index = i;
+	}
+
+	memory = smdk4210_camera->callbacks.request_memory(-1, class_size, 1, 0);
+	if (memory == NULL) {
+		ALOGE("%s: memory request failed!", __func__);
+		goto complete;
+	}
+
+	// Without a free slot, the buffer is released when put back
+	if (index >= 0) {
+		buffer = &pool->buffers[index];
+		buffer->memory = memory;
+		buffer->size = class_size;
+		buffer->used = 1;
+	}
+
+	pool->used_size += class_size;
+	pool->misses++;
+
+complete:
+	if (pool->used_size + pool->cached_size > pool->peak_size)
+		pool->peak_size = pool->used_size + pool->cached_size;
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return memory;
+}
+
+void smdk4210_camera_pool_put(struct smdk4210_camera *smdk4210_camera, camera_memory_t *memory)
+{
+	struct smdk4210_camera_pool *pool;
+	struct smdk4210_camera_pool_buffer *buffer;
+	int i;
+
+	if (smdk4210_camera == NULL || memory == NULL)
+		return;
+
+	pool = &smdk4210_camera->memory_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	for (i = 0; i < SMDK4210_CAMERA_POOL_BUFFERS_COUNT; i++) {
+		buffer = &pool->buffers[i];
+
+		if (buffer->memory != memory)
+			continue;
+
+		buffer->used = 0;
+		pool->used_size -= buffer->size;
+		pool->cached_size += buffer->size;
+
+		if (pool->cached_size > SMDK4210_CAMERA_POOL_MEMORY_BUDGET) {
+			if (memory->release != NULL)
+				memory->release(memory);
+
+			buffer->memory = NULL;
+			pool->cached_size -= buffer->size;
+		}
+
+		pthread_mutex_unlock(&pool->mutex);
+		return;
+	}
+
+	pool->used_size -= memory->size;
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (memory->release != NULL)
+		memory->release(memory);
+}
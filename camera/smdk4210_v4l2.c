@@ -19,6 +19,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -37,10 +39,61 @@
 
 #include "smdk4210_camera.h"
 
+/*
+ * Kernel backend
+ */
+
+static int smdk4210_v4l2_kernel_open(int id, char *node)
+{
+	return open(node, O_RDWR);
+}
+
+static int smdk4210_v4l2_kernel_close(int fd)
+{
+	return close(fd);
+}
+
+static int smdk4210_v4l2_kernel_ioctl(int fd, int request, void *data)
+{
+	return ioctl(fd, request, data);
+}
+
+static int smdk4210_v4l2_kernel_poll(int fd, int timeout)
+{
+	struct pollfd events;
+	int rc;
+
+	memset(&events, 0, sizeof(events));
+	events.fd = fd;
+	events.events = POLLIN | POLLERR;
+
+	rc = poll(&events, 1, timeout);
+	if (rc < 0 || events.revents & POLLERR)
+		return -1;
+
+	return rc;
+}
+
+struct smdk4210_v4l2_ops smdk4210_v4l2_kernel_ops = {
+	.open = smdk4210_v4l2_kernel_open,
+	.close = smdk4210_v4l2_kernel_close,
+	.ioctl = smdk4210_v4l2_kernel_ioctl,
+	.poll = smdk4210_v4l2_kernel_poll,
+};
+
 /*
  * Utils
  */
 
+struct smdk4210_v4l2_ops *smdk4210_v4l2_ops(struct smdk4210_camera *smdk4210_camera)
+{
+	if (smdk4210_camera == NULL || smdk4210_camera->config == NULL ||
+		smdk4210_camera->config->v4l2_ops == NULL)
+		return &smdk4210_v4l2_kernel_ops;
+
+	return smdk4210_camera->config->v4l2_ops;
+}
+
 int smdk4210_v4l2_find_index(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l2_id)
 {
 	int index;
@@ -78,6 +131,252 @@ int smdk4210_v4l2_find_fd(struct smdk4210_camera *smdk4210_camera, int smdk4210_
 	return smdk4210_camera->v4l2_fds[index];
 }
 
+/*
+ * Trace
+ */
+
+int smdk4210_v4l2_trace_init(struct smdk4210_camera *smdk4210_camera, char *path)
+{
+	struct smdk4210_v4l2_trace *trace;
+
+	if (smdk4210_camera == NULL || path == NULL)
+		return -EINVAL;
+
+	trace = calloc(1, sizeof(struct smdk4210_v4l2_trace));
+	if (trace == NULL)
+		return -1;
+
+	// The ring is allocated once, recording never allocates
+	trace->entries = calloc(SMDK4210_V4L2_TRACE_ENTRIES_COUNT, sizeof(struct smdk4210_v4l2_trace_entry));
+	trace->path = strdup(path);
+	if (trace->entries == NULL || trace->path == NULL) {
+		ALOGE("%s: Unable to allocate trace", __func__);
+		goto error;
+	}
+
+	trace->base_timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+	pthread_mutex_init(&trace->mutex, NULL);
+
+	smdk4210_camera->v4l2_trace = trace;
+
+	ALOGD("Recording V4L2 trace to %s", path);
+
+	return 0;
+
+error:
+	if (trace->entries != NULL)
+		free(trace->entries);
+
+	if (trace->path != NULL)
+		free(trace->path);
+
+	free(trace);
+
+	return -1;
+}
+
+void smdk4210_v4l2_trace_deinit(struct smdk4210_camera *smdk4210_camera)
+{
+	struct smdk4210_v4l2_trace *trace;
+
+	if (smdk4210_camera == NULL || smdk4210_camera->v4l2_trace == NULL)
+		return;
+
+	smdk4210_v4l2_trace_write(smdk4210_camera);
+
+	trace = smdk4210_camera->v4l2_trace;
+	smdk4210_camera->v4l2_trace = NULL;
+
+	pthread_mutex_destroy(&trace->mutex);
+	free(trace->entries);
+	free(trace->path);
+	free(trace);
+}
+
+void smdk4210_v4l2_trace_record(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l2_id,
+	unsigned int request, void *data, int rc, nsecs_t timestamp, nsecs_t duration)
+{
+	struct smdk4210_v4l2_trace *trace;
+	struct smdk4210_v4l2_trace_entry *entry;
+	int32_t *args;
+
+	if (smdk4210_camera == NULL || smdk4210_camera->v4l2_trace == NULL)
+		return;
+
+	trace = smdk4210_camera->v4l2_trace;
+
+	pthread_mutex_lock(&trace->mutex);
+
+	entry = &trace->entries[trace->head % SMDK4210_V4L2_TRACE_ENTRIES_COUNT];
+	trace->head++;
+
+	memset(entry, 0, sizeof(struct smdk4210_v4l2_trace_entry));
+	entry->timestamp = timestamp - trace->base_timestamp;
+	entry->duration = (int32_t) duration;
+	entry->request = request;
+	entry->node = smdk4210_v4l2_id;
+	entry->rc = rc < 0 ? -errno : rc;
+
+	args = entry->args;
+
+	// Keep what is needed to issue the request again
+	switch (request) {
+		case SMDK4210_V4L2_TRACE_POLL:
+			args[0] = *((int *) data);
+			break;
+		case VIDIOC_QBUF:
+		case VIDIOC_DQBUF:
+		case VIDIOC_QUERYBUF:
+			args[0] = ((struct v4l2_buffer *) data)->type;
+			args[1] = ((struct v4l2_buffer *) data)->memory;
+			args[2] = ((struct v4l2_buffer *) data)->index;
+			args[3] = ((struct v4l2_buffer *) data)->length;
+			break;
+		case VIDIOC_REQBUFS:
+			args[0] = ((struct v4l2_requestbuffers *) data)->type;
+			args[1] = ((struct v4l2_requestbuffers *) data)->memory;
+			args[2] = ((struct v4l2_requestbuffers *) data)->count;
+			break;
+		case VIDIOC_QUERYCAP:
+			args[0] = ((struct v4l2_capability *) data)->capabilities;
+			break;
+		case VIDIOC_ENUMINPUT:
+		case VIDIOC_S_INPUT:
+			args[0] = ((struct v4l2_input *) data)->index;
+			break;
+		case VIDIOC_ENUM_FMT:
+			args[0] = ((struct v4l2_fmtdesc *) data)->type;
+			args[1] = ((struct v4l2_fmtdesc *) data)->index;
+			args[2] = ((struct v4l2_fmtdesc *) data)->pixelformat;
+			break;
+		case VIDIOC_S_FMT:
+		case VIDIOC_G_FMT:
+			args[0] = ((struct v4l2_format *) data)->type;
+			if (args[0] == V4L2_BUF_TYPE_VIDEO_OVERLAY) {
+				args[1] = ((struct v4l2_format *) data)->fmt.win.w.left;
+				args[2] = ((struct v4l2_format *) data)->fmt.win.w.top;
+				args[3] = ((struct v4l2_format *) data)->fmt.win.w.width;
+				args[4] = ((struct v4l2_format *) data)->fmt.win.w.height;
+			} else {
+				args[1] = ((struct v4l2_format *) data)->fmt.pix.width;
+				args[2] = ((struct v4l2_format *) data)->fmt.pix.height;
+				args[3] = ((struct v4l2_format *) data)->fmt.pix.pixelformat;
+				args[4] = ((struct v4l2_format *) data)->fmt.pix.priv;
+			}
+			break;
+		case VIDIOC_STREAMON:
+		case VIDIOC_STREAMOFF:
+			args[0] = *((enum v4l2_buf_type *) data);
+			break;
+		case VIDIOC_S_CTRL:
+		case VIDIOC_G_CTRL:
+			args[0] = ((struct v4l2_control *) data)->id;
+			args[1] = ((struct v4l2_control *) data)->value;
+			break;
+		case VIDIOC_G_EXT_CTRLS:
+			args[0] = ((struct v4l2_ext_controls *) data)->ctrl_class;
+			args[1] = ((struct v4l2_ext_controls *) data)->count;
+			if (((struct v4l2_ext_controls *) data)->count > 0 &&
+				((struct v4l2_ext_controls *) data)->controls != NULL)
+				args[2] = ((struct v4l2_ext_controls *) data)->controls[0].id;
+			break;
+		case VIDIOC_S_PARM:
+			args[0] = ((struct v4l2_streamparm *) data)->type;
+			args[1] = ((struct v4l2_streamparm *) data)->parm.capture.timeperframe.numerator;
+			args[2] = ((struct v4l2_streamparm *) data)->parm.capture.timeperframe.denominator;
+			break;
+		case VIDIOC_S_CROP:
+			args[0] = ((struct v4l2_crop *) data)->type;
+			args[1] = ((struct v4l2_crop *) data)->c.left;
+			args[2] = ((struct v4l2_crop *) data)->c.top;
+			args[3] = ((struct v4l2_crop *) data)->c.width;
+			args[4] = ((struct v4l2_crop *) data)->c.height;
+			break;
+		case VIDIOC_G_FBUF:
+		case VIDIOC_S_FBUF:
+			args[0] = ((struct v4l2_framebuffer *) data)->fmt.width;
+			args[1] = ((struct v4l2_framebuffer *) data)->fmt.height;
+			args[2] = ((struct v4l2_framebuffer *) data)->fmt.pixelformat;
+			break;
+	}
+
+	pthread_mutex_unlock(&trace->mutex);
+}
+
+int smdk4210_v4l2_trace_write(struct smdk4210_camera *smdk4210_camera)
+{
+	struct smdk4210_v4l2_trace *trace;
+	struct smdk4210_v4l2_trace_header header;
+	struct smdk4210_v4l2_trace_entry *entries = NULL;
+	unsigned int first;
+	unsigned int count;
+	unsigned int i;
+	int length;
+	int fd = -1;
+	int rc;
+
+	if (smdk4210_camera == NULL || smdk4210_camera->v4l2_trace == NULL)
+		return -EINVAL;
+
+	trace = smdk4210_camera->v4l2_trace;
+
+	entries = calloc(SMDK4210_V4L2_TRACE_ENTRIES_COUNT, sizeof(struct smdk4210_v4l2_trace_entry));
+	if (entries == NULL)
+		return -1;
+
+	// Copy out the ring so that the file is written without holding the lock
+	pthread_mutex_lock(&trace->mutex);
+
+	count = trace->head < SMDK4210_V4L2_TRACE_ENTRIES_COUNT ? trace->head : SMDK4210_V4L2_TRACE_ENTRIES_COUNT;
+	first = trace->head - count;
+
+	for (i = 0; i < count; i++)
+		memcpy(&entries[i], &trace->entries[(first + i) % SMDK4210_V4L2_TRACE_ENTRIES_COUNT],
+			sizeof(struct smdk4210_v4l2_trace_entry));
+
+	pthread_mutex_unlock(&trace->mutex);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SMDK4210_V4L2_TRACE_MAGIC;
+	header.version = SMDK4210_V4L2_TRACE_VERSION;
+	header.entry_size = sizeof(struct smdk4210_v4l2_trace_entry);
+	header.entries_count = count;
+	header.dropped_count = first;
+
+	fd = open(trace->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		ALOGE("%s: Unable to open %s", __func__, trace->path);
+		goto error;
+	}
+
+	rc = write(fd, &header, sizeof(header));
+	if (rc != sizeof(header)) {
+		ALOGE("%s: Unable to write trace header", __func__);
+		goto error;
+	}
+
+	length = count * sizeof(struct smdk4210_v4l2_trace_entry);
+	rc = write(fd, entries, length);
+	if (rc != length) {
+		ALOGE("%s: Unable to write trace entries", __func__);
+		goto error;
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	if (fd >= 0)
+		close(fd);
+
+	free(entries);
+
+	return rc;
+}
+
 /*
  * File ops
  */
@@ -99,7 +398,7 @@ int smdk4210_v4l2_open(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l
 	}
 
 	node = smdk4210_camera->config->v4l2_nodes[index].node;
-	fd = open(node, O_RDWR);
+	fd = smdk4210_v4l2_ops(smdk4210_camera)->open(smdk4210_v4l2_id, node);
 	if (fd < 0) {
 		ALOGE("%s: Unable to open v4l2 node #%d", __func__, smdk4210_v4l2_id);
 		return -1;
@@ -125,7 +424,7 @@ void smdk4210_v4l2_close(struct smdk4210_camera *smdk4210_camera, int smdk4210_v
 	}
 
 	if (smdk4210_camera->v4l2_fds[index] > 0)
-		close(smdk4210_camera->v4l2_fds[index]);
+		smdk4210_v4l2_ops(smdk4210_camera)->close(smdk4210_camera->v4l2_fds[index]);
 
 	smdk4210_camera->v4l2_fds[index] = -1;
 }
@@ -133,7 +432,9 @@ void smdk4210_v4l2_close(struct smdk4210_camera *smdk4210_camera, int smdk4210_v
 int smdk4210_v4l2_ioctl(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l2_id,
 	int request, void *data)
 {
+	nsecs_t timestamp;
 	int fd;
+	int rc;
 
 	if (smdk4210_camera == NULL)
 		return -EINVAL;
@@ -144,12 +445,21 @@ int smdk4210_v4l2_ioctl(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4
 		return -1;
 	}
 
-	return ioctl(fd, request, data);
+	if (smdk4210_camera->v4l2_trace == NULL)
+		return smdk4210_v4l2_ops(smdk4210_camera)->ioctl(fd, request, data);
+
+	timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+	rc = smdk4210_v4l2_ops(smdk4210_camera)->ioctl(fd, request, data);
+	smdk4210_v4l2_trace_record(smdk4210_camera, smdk4210_v4l2_id, request, data, rc,
+		timestamp, systemTime(SYSTEM_TIME_MONOTONIC) - timestamp);
+
+	return rc;
 }
 
 int smdk4210_v4l2_poll(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l2_id)
 {
-	struct pollfd events;
+	nsecs_t timestamp = 0;
+	int timeout = 1000;
 	int fd;
 	int rc;
 
@@ -162,12 +472,16 @@ int smdk4210_v4l2_poll(struct smdk4210_camera *smdk4210_camera, int smdk4210_v4l
 		return -1;
 	}
 
-	memset(&events, 0, sizeof(events));
-	events.fd = fd;
-	events.events = POLLIN | POLLERR;
+	if (smdk4210_camera->v4l2_trace != NULL)
+		timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
 
-	rc = poll(&events, 1, 1000);
-	if (rc < 0 || events.revents & POLLERR) {
+	rc = smdk4210_v4l2_ops(smdk4210_camera)->poll(fd, timeout);
+
+	if (smdk4210_camera->v4l2_trace != NULL)
+		smdk4210_v4l2_trace_record(smdk4210_camera, smdk4210_v4l2_id, SMDK4210_V4L2_TRACE_POLL,
+			&timeout, rc, timestamp, systemTime(SYSTEM_TIME_MONOTONIC) - timestamp);
+
+	if (rc < 0) {
 		ALOGE("%s: poll failed", __func__);
 		return -1;
 	}
@@ -0,0 +1,662 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+#include <asm/types.h>
+
+#define LOG_TAG "smdk4210_v4l2_sim"
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include "smdk4210_camera.h"
+
+/*
+ * Simulated FIMC nodes, backed by unlinked temporary files so that buffers
+ * can be mapped with the fd, just like the kernel driver's MMAP buffers.
+ */
+
+#define SMDK4210_V4L2_SIM_NODES_COUNT		SMDK4210_CAMERA_MAX_V4L2_NODES_COUNT
+#define SMDK4210_V4L2_SIM_CONTROLS_COUNT	64
+#define SMDK4210_V4L2_SIM_PADDR_BASE		0x40000000
+#define SMDK4210_V4L2_SIM_EXPOSURES_COUNT	8
+
+struct smdk4210_v4l2_sim_control {
+	int id;
+	int value;
+};
+
+struct smdk4210_v4l2_sim_exposure {
+	int frame;
+	int value;
+};
+
+struct smdk4210_v4l2_sim_node {
+	int fd;
+	int id;
+	int input;
+
+	int width;
+	int height;
+	int format;
+	int mode;
+
+	void *buffers_data;
+	int buffers_count;
+	int buffer_length;
+	int queued[SMDK4210_CAMERA_MAX_BUFFERS_COUNT];
+	int queued_count;
+	int streaming;
+
+	int fps;
+	nsecs_t frame_timestamp;
+	int frames_count;
+
+	int jpeg_main_size;
+	int jpeg_thumb_size;
+	int jpeg_thumb_offset;
+	int auto_focus_frames;
+
+	// Exposure changes only show after the sensor latency
+	struct smdk4210_v4l2_sim_exposure exposures[SMDK4210_V4L2_SIM_EXPOSURES_COUNT];
+	int exposures_count;
+	int exposure;
+
+	struct smdk4210_v4l2_sim_control controls[SMDK4210_V4L2_SIM_CONTROLS_COUNT];
+	int controls_count;
+};
+
+struct smdk4210_v4l2_sim_config smdk4210_v4l2_sim_config = {
+	.fps = 30,
+	.jitter = 2000,
+	.auto_focus_frames = 5,
+	.controls_latency = 2,
+};
+
+static struct smdk4210_v4l2_sim_node smdk4210_v4l2_sim_nodes[SMDK4210_V4L2_SIM_NODES_COUNT];
+static pthread_mutex_t smdk4210_v4l2_sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char *smdk4210_v4l2_sim_inputs[] = {
+	"M5MO",
+	"S5K5BAFX",
+};
+
+static int smdk4210_v4l2_sim_formats[] = {
+	V4L2_PIX_FMT_NV21,
+	V4L2_PIX_FMT_NV12,
+	V4L2_PIX_FMT_NV12T,
+	V4L2_PIX_FMT_YUV420,
+	V4L2_PIX_FMT_RGB565,
+	V4L2_PIX_FMT_RGB32,
+	V4L2_PIX_FMT_YUYV,
+	V4L2_PIX_FMT_JPEG,
+};
+
+/*
+ * Utils
+ */
+
+static struct smdk4210_v4l2_sim_node *smdk4210_v4l2_sim_node_find(int fd)
+{
+	int i;
+
+	for (i = 0; i < SMDK4210_V4L2_SIM_NODES_COUNT; i++)
+		if (smdk4210_v4l2_sim_nodes[i].fd == fd && fd > 0)
+			return &smdk4210_v4l2_sim_nodes[i];
+
+	return NULL;
+}
+
+static int smdk4210_v4l2_sim_control_get(struct smdk4210_v4l2_sim_node *node, int id)
+{
+	int i;
+
+	for (i = 0; i < node->controls_count; i++)
+		if (node->controls[i].id == id)
+			return node->controls[i].value;
+
+	return 0;
+}
+
+static void smdk4210_v4l2_sim_control_set(struct smdk4210_v4l2_sim_node *node, int id, int value)
+{
+	int i;
+
+	for (i = 0; i < node->controls_count; i++) {
+		if (node->controls[i].id == id) {
+			node->controls[i].value = value;
+			return;
+		}
+	}
+
+	if (node->controls_count >= SMDK4210_V4L2_SIM_CONTROLS_COUNT)
+		return;
+
+	node->controls[node->controls_count].id = id;
+	node->controls[node->controls_count].value = value;
+	node->controls_count++;
+}
+
+static int smdk4210_v4l2_sim_buffer_length(struct smdk4210_v4l2_sim_node *node)
+{
+	int length;
+
+	// The M5MO writes main JPEG and thumbnail in the same buffer
+	if (node->format == V4L2_PIX_FMT_JPEG)
+		return SMDK4210_CAMERA_ALIGN(node->width * node->height);
+
+	if (node->format == V4L2_PIX_FMT_NV12T) {
+		length = SMDK4210_CAMERA_TILE_ALIGN(SMDK4210_CAMERA_TILE_ALIGN(node->width, 128) *
+			SMDK4210_CAMERA_TILE_ALIGN(node->height, 32), 8192);
+		length += SMDK4210_CAMERA_TILE_ALIGN(SMDK4210_CAMERA_TILE_ALIGN(node->width, 128) *
+			SMDK4210_CAMERA_TILE_ALIGN(node->height / 2, 32), 8192);
+		return length;
+	}
+
+	return smdk4210_camera_buffer_length(node->width, node->height, node->format);
+}
+
+static void smdk4210_v4l2_sim_buffers_release(struct smdk4210_v4l2_sim_node *node)
+{
+	if (node->buffers_data != NULL && node->buffers_count > 0)
+		munmap(node->buffers_data, node->buffers_count * node->buffer_length);
+
+	node->buffers_data = NULL;
+	node->buffers_count = 0;
+	node->queued_count = 0;
+}
+
+/*
+ * Frames
+ */
+
+static void smdk4210_v4l2_sim_frame_jpeg(struct smdk4210_v4l2_sim_node *node, unsigned char *data)
+{
+	unsigned char *p;
+	int size;
+
+	// Only the JPEG framing matters to the HAL: SOI, a comment segment, EOI
+	size = node->width * node->height / 8;
+	if (size > node->buffer_length / 2)
+		size = node->buffer_length / 2;
+
+	node->jpeg_main_size = size;
+	node->jpeg_thumb_offset = size;
+	node->jpeg_thumb_size = size / 32 > 64 ? size / 32 : 64;
+
+	p = data;
+	*p++ = 0xff;
+	*p++ = 0xd8;
+	*p++ = 0xff;
+	*p++ = 0xfe;
+	*p++ = 0x00;
+	*p++ = 0x02;
+	memset(p, node->frames_count & 0xff, size - 8);
+	p += size - 8;
+	*p++ = 0xff;
+	*p++ = 0xd9;
+
+	p = data + node->jpeg_thumb_offset;
+	p[0] = 0xff;
+	p[1] = 0xd8;
+	memset(p + 2, 0x80, node->jpeg_thumb_size - 4);
+	p[node->jpeg_thumb_size - 2] = 0xff;
+	p[node->jpeg_thumb_size - 1] = 0xd9;
+}
+
+static void smdk4210_v4l2_sim_frame(struct smdk4210_v4l2_sim_node *node, int index)
+{
+	unsigned char *data;
+	unsigned char *p;
+	int luma_size;
+	int x, y;
+
+	if (node->buffers_data == NULL)
+		return;
+
+	data = (unsigned char *) node->buffers_data + index * node->buffer_length;
+
+	while (node->exposures_count > 0 && node->exposures[0].frame <= node->frames_count) {
+		node->exposure = node->exposures[0].value;
+		node->exposures_count--;
+		memmove(&node->exposures[0], &node->exposures[1],
+			node->exposures_count * sizeof(struct smdk4210_v4l2_sim_exposure));
+	}
+
+	switch (node->format) {
+		case V4L2_PIX_FMT_JPEG:
+			smdk4210_v4l2_sim_frame_jpeg(node, data);
+			break;
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV12T:
+		case V4L2_PIX_FMT_YUV420:
+			// Moving diagonal gradient, so that consecutive frames differ
+			luma_size = node->width * node->height;
+			p = data;
+			for (y = 0; y < node->height; y++)
+				for (x = 0; x < node->width; x++)
+					*p++ = (unsigned char) (x + y + node->frames_count * 4);
+
+			memset(data + luma_size, 0x80, node->buffer_length - luma_size);
+
+			// The first pixel tells the exposure the frame was taken with
+			data[0] = node->exposure;
+			break;
+		default:
+			memset(data, node->frames_count & 0xff, node->buffer_length);
+			break;
+	}
+}
+
+static nsecs_t smdk4210_v4l2_sim_frame_due(struct smdk4210_v4l2_sim_node *node)
+{
+	nsecs_t interval;
+	nsecs_t jitter = 0;
+	int fps;
+
+	fps = node->fps > 0 ? node->fps : smdk4210_v4l2_sim_config.fps;
+	if (fps <= 0)
+		fps = 30;
+
+	interval = 1000000000LL / fps;
+
+	if (smdk4210_v4l2_sim_config.jitter > 0)
+		jitter = (nsecs_t) (rand() % (2 * smdk4210_v4l2_sim_config.jitter + 1) - smdk4210_v4l2_sim_config.jitter) * 1000LL;
+
+	return node->frame_timestamp + interval + jitter;
+}
+
+static void smdk4210_v4l2_sim_frame_wait(struct smdk4210_v4l2_sim_node *node)
+{
+	nsecs_t due;
+	nsecs_t t;
+
+	t = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	if (node->frame_timestamp == 0) {
+		node->frame_timestamp = t;
+		return;
+	}
+
+	due = smdk4210_v4l2_sim_frame_due(node);
+	if (due > t)
+		usleep((useconds_t) ((due - t) / 1000LL));
+
+	node->frame_timestamp = due > t ? due : t;
+}
+
+/*
+ * Ops
+ */
+
+static int smdk4210_v4l2_sim_open(int id, char *node)
+{
+	char path[] = "/tmp/smdk4210_v4l2_sim_XXXXXX";
+	struct smdk4210_v4l2_sim_node *sim_node = NULL;
+	int fd;
+	int i;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		ALOGE("%s: Unable to create backing file for %s", __func__, node);
+		return -1;
+	}
+
+	unlink(path);
+
+	pthread_mutex_lock(&smdk4210_v4l2_sim_mutex);
+
+	for (i = 0; i < SMDK4210_V4L2_SIM_NODES_COUNT; i++) {
+		if (smdk4210_v4l2_sim_nodes[i].fd <= 0) {
+			sim_node = &smdk4210_v4l2_sim_nodes[i];
+			break;
+		}
+	}
+
+	if (sim_node == NULL) {
+		pthread_mutex_unlock(&smdk4210_v4l2_sim_mutex);
+		close(fd);
+		errno = EBUSY;
+		return -1;
+	}
+
+	memset(sim_node, 0, sizeof(struct smdk4210_v4l2_sim_node));
+	sim_node->fd = fd;
+	sim_node->id = id;
+
+	pthread_mutex_unlock(&smdk4210_v4l2_sim_mutex);
+
+	ALOGD("%s: Simulating %s as node #%d", __func__, node, id);
+
+	return fd;
+}
+
+static int smdk4210_v4l2_sim_close(int fd)
+{
+	struct smdk4210_v4l2_sim_node *node;
+
+	pthread_mutex_lock(&smdk4210_v4l2_sim_mutex);
+
+	node = smdk4210_v4l2_sim_node_find(fd);
+	if (node != NULL) {
+		smdk4210_v4l2_sim_buffers_release(node);
+		node->fd = -1;
+	}
+
+	pthread_mutex_unlock(&smdk4210_v4l2_sim_mutex);
+
+	return close(fd);
+}
+
+static int smdk4210_v4l2_sim_ctrl(struct smdk4210_v4l2_sim_node *node, int request,
+	struct v4l2_control *control)
+{
+	// Requests are ints, while ioctl numbers can be wider
+	if (request == (int) VIDIOC_S_CTRL) {
+		switch (control->id) {
+			case V4L2_CID_PADDR_Y:
+				control->value = SMDK4210_V4L2_SIM_PADDR_BASE + node->id * 0x1000000 +
+					control->value * node->buffer_length;
+				return 0;
+			case V4L2_CID_PADDR_CBCR:
+				control->value = SMDK4210_V4L2_SIM_PADDR_BASE + node->id * 0x1000000 +
+					control->value * node->buffer_length + node->width * node->height;
+				return 0;
+			case V4L2_CID_CAMERA_FRAME_RATE:
+				if (control->value > 0)
+					node->fps = control->value;
+				break;
+			case V4L2_CID_CAMERA_SET_AUTO_FOCUS:
+				node->auto_focus_frames = smdk4210_v4l2_sim_config.auto_focus_frames;
+				break;
+			case V4L2_CID_CAMERA_BRIGHTNESS:
+				// Set after a frame was dequeued, shown on the latency-th next one
+				if (node->exposures_count < SMDK4210_V4L2_SIM_EXPOSURES_COUNT) {
+					node->exposures[node->exposures_count].frame = node->frames_count +
+						smdk4210_v4l2_sim_config.controls_latency - 1;
+					node->exposures[node->exposures_count].value = control->value;
+					node->exposures_count++;
+				}
+				break;
+		}
+
+		smdk4210_v4l2_sim_control_set(node, control->id, control->value);
+		return 0;
+	}
+
+	switch (control->id) {
+		case V4L2_CID_CAM_JPEG_MAIN_SIZE:
+			control->value = node->jpeg_main_size;
+			break;
+		case V4L2_CID_CAM_JPEG_MAIN_OFFSET:
+			control->value = 0;
+			break;
+		case V4L2_CID_CAM_JPEG_THUMB_SIZE:
+			control->value = node->jpeg_thumb_size;
+			break;
+		case V4L2_CID_CAM_JPEG_THUMB_OFFSET:
+			control->value = node->jpeg_thumb_offset;
+			break;
+		case V4L2_CID_CAMERA_AUTO_FOCUS_RESULT:
+			// Report progress for a few polls, then success
+			if (node->auto_focus_frames > 0) {
+				node->auto_focus_frames--;
+				control->value = M5MO_AF_STATUS_IN_PROGRESS;
+			} else {
+				control->value = M5MO_AF_STATUS_SUCCESS;
+			}
+			break;
+		default:
+			control->value = smdk4210_v4l2_sim_control_get(node, control->id);
+			break;
+	}
+
+	return 0;
+}
+
+static int smdk4210_v4l2_sim_ioctl(int fd, int request, void *data)
+{
+	struct smdk4210_v4l2_sim_node *node;
+	struct v4l2_capability *capability;
+	struct v4l2_input *input;
+	struct v4l2_fmtdesc *fmtdesc;
+	struct v4l2_format *format;
+	struct v4l2_requestbuffers *requestbuffers;
+	struct v4l2_buffer *buffer;
+	struct v4l2_streamparm *streamparm;
+	struct v4l2_ext_controls *ext_controls;
+	void *buffers_data;
+	int rc = 0;
+	int i;
+
+	pthread_mutex_lock(&smdk4210_v4l2_sim_mutex);
+
+	node = smdk4210_v4l2_sim_node_find(fd);
+	if (node == NULL || data == NULL) {
+		errno = EBADF;
+		rc = -1;
+		goto complete;
+	}
+
+	switch (request) {
+		case VIDIOC_QUERYCAP:
+			capability = (struct v4l2_capability *) data;
+			memset(capability, 0, sizeof(struct v4l2_capability));
+			strncpy((char *) capability->driver, "smdk4210-sim", sizeof(capability->driver) - 1);
+			capability->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+			break;
+		case VIDIOC_ENUMINPUT:
+			input = (struct v4l2_input *) data;
+			if (input->index >= sizeof(smdk4210_v4l2_sim_inputs) / sizeof(char *)) {
+				errno = EINVAL;
+				rc = -1;
+				break;
+			}
+
+			memset(input->name, 0, sizeof(input->name));
+			strncpy((char *) input->name, smdk4210_v4l2_sim_inputs[input->index], sizeof(input->name) - 1);
+			break;
+		case VIDIOC_S_INPUT:
+			input = (struct v4l2_input *) data;
+			node->input = input->index;
+			break;
+		case VIDIOC_ENUM_FMT:
+			fmtdesc = (struct v4l2_fmtdesc *) data;
+			if (fmtdesc->index >= sizeof(smdk4210_v4l2_sim_formats) / sizeof(int)) {
+				errno = EINVAL;
+				rc = -1;
+				break;
+			}
+
+			fmtdesc->pixelformat = smdk4210_v4l2_sim_formats[fmtdesc->index];
+			break;
+		case VIDIOC_S_FMT:
+			format = (struct v4l2_format *) data;
+			if (format->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+				break;
+
+			node->width = format->fmt.pix.width;
+			node->height = format->fmt.pix.height;
+			node->format = format->fmt.pix.pixelformat;
+			node->mode = format->fmt.pix.priv;
+			break;
+		case VIDIOC_G_FMT:
+			format = (struct v4l2_format *) data;
+			format->fmt.pix.width = node->width;
+			format->fmt.pix.height = node->height;
+			format->fmt.pix.pixelformat = node->format;
+			format->fmt.pix.priv = node->mode;
+			break;
+		case VIDIOC_REQBUFS:
+			requestbuffers = (struct v4l2_requestbuffers *) data;
+			if (requestbuffers->count > SMDK4210_CAMERA_MAX_BUFFERS_COUNT) {
+				errno = ENOMEM;
+				rc = -1;
+				break;
+			}
+
+			smdk4210_v4l2_sim_buffers_release(node);
+
+			if (requestbuffers->count == 0)
+				break;
+
+			node->buffer_length = smdk4210_v4l2_sim_buffer_length(node);
+			if (node->buffer_length <= 0) {
+				errno = EINVAL;
+				rc = -1;
+				break;
+			}
+
+			rc = ftruncate(fd, (off_t) requestbuffers->count * node->buffer_length);
+			if (rc < 0)
+				break;
+
+			buffers_data = mmap(NULL, requestbuffers->count * node->buffer_length,
+				PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (buffers_data == MAP_FAILED) {
+				rc = -1;
+				break;
+			}
+
+			node->buffers_data = buffers_data;
+			node->buffers_count = requestbuffers->count;
+			break;
+		case VIDIOC_QUERYBUF:
+			buffer = (struct v4l2_buffer *) data;
+			if ((int) buffer->index >= node->buffers_count) {
+				errno = EINVAL;
+				rc = -1;
+				break;
+			}
+
+			buffer->length = node->buffer_length;
+			buffer->m.offset = buffer->index * node->buffer_length;
+			break;
+		case VIDIOC_QBUF:
+			buffer = (struct v4l2_buffer *) data;
+			if ((int) buffer->index >= node->buffers_count ||
+				node->queued_count >= SMDK4210_CAMERA_MAX_BUFFERS_COUNT) {
+				errno = EINVAL;
+				rc = -1;
+				break;
+			}
+
+			for (i = 0; i < node->queued_count; i++) {
+				if (node->queued[i] == (int) buffer->index) {
+					errno = EINVAL;
+					rc = -1;
+					goto complete;
+				}
+			}
+
+			node->queued[node->queued_count++] = buffer->index;
+			break;
+		case VIDIOC_DQBUF:
+			buffer = (struct v4l2_buffer *) data;
+			if (node->queued_count == 0) {
+				errno = EAGAIN;
+				rc = -1;
+				break;
+			}
+
+			// The frame was waited for in poll, a capture can still be dequeued after streamoff
+			buffer->index = node->queued[0];
+			node->queued_count--;
+			memmove(&node->queued[0], &node->queued[1], node->queued_count * sizeof(int));
+
+			smdk4210_v4l2_sim_frame(node, buffer->index);
+			node->frames_count++;
+			break;
+		case VIDIOC_STREAMON:
+			node->streaming = 1;
+			node->frame_timestamp = 0;
+			break;
+		case VIDIOC_STREAMOFF:
+			node->streaming = 0;
+			break;
+		case VIDIOC_S_PARM:
+			streamparm = (struct v4l2_streamparm *) data;
+			if (streamparm->parm.capture.timeperframe.numerator > 0 &&
+				streamparm->parm.capture.timeperframe.denominator > 0)
+				node->fps = streamparm->parm.capture.timeperframe.denominator /
+					streamparm->parm.capture.timeperframe.numerator;
+			break;
+		case VIDIOC_S_CTRL:
+		case VIDIOC_G_CTRL:
+			rc = smdk4210_v4l2_sim_ctrl(node, request, (struct v4l2_control *) data);
+			break;
+		case VIDIOC_G_EXT_CTRLS:
+			ext_controls = (struct v4l2_ext_controls *) data;
+			for (i = 0; i < (int) ext_controls->count; i++)
+				ext_controls->controls[i].value = 0;
+			break;
+		default:
+			// Cropping and framebuffer requests have no effect here
+			break;
+	}
+
+complete:
+	pthread_mutex_unlock(&smdk4210_v4l2_sim_mutex);
+
+	return rc;
+}
+
+static int smdk4210_v4l2_sim_poll(int fd, int timeout)
+{
+	struct smdk4210_v4l2_sim_node *node;
+	int ready;
+
+	pthread_mutex_lock(&smdk4210_v4l2_sim_mutex);
+
+	node = smdk4210_v4l2_sim_node_find(fd);
+	if (node == NULL) {
+		pthread_mutex_unlock(&smdk4210_v4l2_sim_mutex);
+		return -1;
+	}
+
+	ready = node->streaming && node->queued_count > 0;
+
+	pthread_mutex_unlock(&smdk4210_v4l2_sim_mutex);
+
+	if (!ready) {
+		usleep(timeout * 1000);
+		return 0;
+	}
+
+	// Sensor cadence: sleep until the next frame is due
+	smdk4210_v4l2_sim_frame_wait(node);
+
+	return 1;
+}
+
+struct smdk4210_v4l2_ops smdk4210_v4l2_sim_ops = {
+	.open = smdk4210_v4l2_sim_open,
+	.close = smdk4210_v4l2_sim_close,
+	.ioctl = smdk4210_v4l2_sim_ioctl,
+	.poll = smdk4210_v4l2_sim_poll,
+};
@@ -38,4 +38,72 @@ LOCAL_MODULE := libyamaha-mc1n2-audio
 
 include $(BUILD_SHARED_LIBRARY)
 
+# Round-trip and output start latency tool, to run with the audio HAL stopped
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	tools/yamaha-mc1n2-audio-latency.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/include \
+	external/tinyalsa/include
+
+LOCAL_SHARED_LIBRARIES := \
+	libc \
+	libcutils \
+	libtinyalsa \
+	libyamaha-mc1n2-audio
+
+ifneq ($(strip $(TARGET_YAMAHA_MC1N2_AUDIO_DEVICE)),)
+LOCAL_CFLAGS := -DYAMAHA_MC1N2_AUDIO_DEVICE=\"$(TARGET_YAMAHA_MC1N2_AUDIO_DEVICE)\"
+endif
+
+LOCAL_MODULE := yamaha-mc1n2-audio-latency
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# Host benchmark, switching routes on the simulated codec driver
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	device/galaxys2.c \
+	yamaha-mc1n2-audio.c \
+	yamaha-mc1n2-audio-sim.c \
+	bench/yamaha-mc1n2-audio-bench.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/include
+
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MODULE := yamaha-mc1n2-audio-bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host params image generator, the image layout has to match the 32-bit target
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	device/galaxys2.c \
+	yamaha-mc1n2-audio.c \
+	tools/yamaha-mc1n2-audio-image.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/include
+
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MULTILIB := 32
+LOCAL_MODULE := yamaha-mc1n2-audio-image
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
 endif
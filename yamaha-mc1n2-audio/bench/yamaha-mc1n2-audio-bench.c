@@ -0,0 +1,493 @@
+/*
+ * Copyright (C) 2012 Paul Kocialkowski <contact@paulk.fr>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <linux/ioctl.h>
+
+#include <yamaha-mc1n2-audio.h>
+
+/*
+ * Route switching benchmark: runs every output, input and modem route of the
+ * platform through start, stop and set_route on the simulated codec driver
+ * and reports the latency and ioctls count of each transition.
+ */
+
+#define BENCH_TRANSITIONS_COUNT		512
+
+struct bench_transition {
+	char name[80];
+	int64_t duration;
+	int ioctls_count;
+	int count;
+};
+
+struct bench_transition bench_transitions[BENCH_TRANSITIONS_COUNT];
+int bench_transitions_count = 0;
+int bench_transition_index = 0;
+int bench_verbose = 0;
+
+int64_t bench_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+char *bench_device_name(audio_devices_t device)
+{
+	switch(device) {
+		case AUDIO_DEVICE_OUT_EARPIECE:
+			return "earpiece";
+		case AUDIO_DEVICE_OUT_SPEAKER:
+			return "speaker";
+		case AUDIO_DEVICE_OUT_WIRED_HEADSET:
+			return "headset";
+		case AUDIO_DEVICE_OUT_WIRED_HEADPHONE:
+			return "headphone";
+		case AUDIO_DEVICE_OUT_BLUETOOTH_SCO:
+		case AUDIO_DEVICE_OUT_BLUETOOTH_SCO_HEADSET:
+		case AUDIO_DEVICE_OUT_BLUETOOTH_SCO_CARKIT:
+			return "bt-sco";
+		case AUDIO_DEVICE_IN_BUILTIN_MIC:
+			return "mic";
+		case AUDIO_DEVICE_IN_WIRED_HEADSET:
+			return "headset-mic";
+		default:
+			return "unknown";
+	}
+}
+
+void bench_records_dump(int start, int end)
+{
+	struct yamaha_mc1n2_audio_hw_sim_record *record = NULL;
+	int i;
+
+	if(end - start > YAMAHA_MC1N2_AUDIO_HW_SIM_RECORDS_COUNT)
+		start = end - YAMAHA_MC1N2_AUDIO_HW_SIM_RECORDS_COUNT;
+
+	for(i=start ; i < end ; i++) {
+		record = &yamaha_mc1n2_audio_hw_sim.records[i % YAMAHA_MC1N2_AUDIO_HW_SIM_RECORDS_COUNT];
+
+		if(record->request == (int) MC1N2_IOCTL_NOTIFY)
+			printf("    NOTIFY %ld\n", record->command);
+		else
+			printf("    SET_CTRL %ld, update 0x%lx, %d bytes\n", record->command,
+				record->update_info, record->length);
+	}
+}
+
+int bench_transition(char *name, int (*transition)(struct yamaha_mc1n2_audio_pdata *pdata,
+	audio_devices_t device), struct yamaha_mc1n2_audio_pdata *pdata, audio_devices_t device)
+{
+	struct bench_transition *entry = NULL;
+	int64_t time;
+	int records_count;
+	int rc;
+
+	if(bench_transition_index >= BENCH_TRANSITIONS_COUNT)
+		return -1;
+
+	entry = &bench_transitions[bench_transition_index++];
+	if(bench_transition_index > bench_transitions_count) {
+		strncpy(entry->name, name, sizeof(entry->name) - 1);
+		bench_transitions_count = bench_transition_index;
+	}
+
+	records_count = yamaha_mc1n2_audio_hw_sim.records_count;
+
+	time = bench_time();
+	rc = transition(pdata, device);
+	time = bench_time() - time;
+
+	if(rc < 0) {
+		printf("%s failed!\n", name);
+		return -1;
+	}
+
+	entry->duration += time;
+	entry->ioctls_count += yamaha_mc1n2_audio_hw_sim.records_count - records_count;
+	entry->count++;
+
+	if(bench_verbose) {
+		printf("%s:\n", name);
+		bench_records_dump(records_count, yamaha_mc1n2_audio_hw_sim.records_count);
+	}
+
+	return 0;
+}
+
+int bench_set_route(struct yamaha_mc1n2_audio_pdata *pdata, audio_devices_t device)
+{
+	return yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_set_route(pdata, device));
+}
+
+int bench_output_start(struct yamaha_mc1n2_audio_pdata *pdata, audio_devices_t device)
+{
+	return yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_output_start(pdata));
+}
+
+int bench_output_stop(struct yamaha_mc1n2_audio_pdata *pdata, audio_devices_t device)
+{
+	return yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_output_stop(pdata));
+}
+
+int bench_input_start(struct yamaha_mc1n2_audio_pdata *pdata, audio_devices_t device)
+{
+	return yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_input_start(pdata));
+}
+
+int bench_input_stop(struct yamaha_mc1n2_audio_pdata *pdata, audio_devices_t device)
+{
+	return yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_input_stop(pdata));
+}
+
+int bench_modem_start(struct yamaha_mc1n2_audio_pdata *pdata, audio_devices_t device)
+{
+	return yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_modem_start(pdata));
+}
+
+int bench_modem_stop(struct yamaha_mc1n2_audio_pdata *pdata, audio_devices_t device)
+{
+	return yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_modem_stop(pdata));
+}
+
+int bench_matrix(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	struct yamaha_mc1n2_audio_params_route *routes = NULL;
+	int routes_count;
+	char name[80];
+	char *o, *d;
+	int i, j;
+	int rc;
+
+	routes = pdata->ops->params.routes;
+	routes_count = pdata->ops->params.routes_count;
+
+	bench_transition_index = 0;
+
+	for(i=0 ; i < routes_count ; i++) {
+		if(routes[i].direction != YAMAHA_MC1N2_AUDIO_DIRECTION_OUTPUT)
+			continue;
+
+		o = bench_device_name(routes[i].device);
+
+		snprintf(name, sizeof(name), "set_route %s", o);
+		rc = bench_transition(name, bench_set_route, pdata, routes[i].device);
+		snprintf(name, sizeof(name), "output_start %s", o);
+		rc |= bench_transition(name, bench_output_start, pdata, 0);
+		if(rc < 0)
+			return -1;
+
+		// Switching while playing
+		for(j=0 ; j < routes_count ; j++) {
+			if(j == i || routes[j].direction != YAMAHA_MC1N2_AUDIO_DIRECTION_OUTPUT)
+				continue;
+
+			d = bench_device_name(routes[j].device);
+
+			snprintf(name, sizeof(name), "output %s -> %s", o, d);
+			rc = bench_transition(name, bench_set_route, pdata, routes[j].device);
+			rc |= bench_set_route(pdata, routes[i].device);
+			if(rc < 0)
+				return -1;
+		}
+
+		// Recording while playing
+		for(j=0 ; j < routes_count ; j++) {
+			if(routes[j].direction != YAMAHA_MC1N2_AUDIO_DIRECTION_INPUT)
+				continue;
+
+			d = bench_device_name(routes[j].device);
+
+			rc = bench_set_route(pdata, routes[j].device);
+			snprintf(name, sizeof(name), "input_start %s, output %s", d, o);
+			rc |= bench_transition(name, bench_input_start, pdata, 0);
+			snprintf(name, sizeof(name), "input_stop %s, output %s", d, o);
+			rc |= bench_transition(name, bench_input_stop, pdata, 0);
+			if(rc < 0)
+				return -1;
+		}
+
+		snprintf(name, sizeof(name), "output_stop %s", o);
+		rc = bench_transition(name, bench_output_stop, pdata, 0);
+		if(rc < 0)
+			return -1;
+	}
+
+	for(i=0 ; i < routes_count ; i++) {
+		if(routes[i].direction != YAMAHA_MC1N2_AUDIO_DIRECTION_INPUT)
+			continue;
+
+		d = bench_device_name(routes[i].device);
+
+		rc = bench_set_route(pdata, routes[i].device);
+		snprintf(name, sizeof(name), "input_start %s", d);
+		rc |= bench_transition(name, bench_input_start, pdata, 0);
+		snprintf(name, sizeof(name), "input_stop %s", d);
+		rc |= bench_transition(name, bench_input_stop, pdata, 0);
+		if(rc < 0)
+			return -1;
+	}
+
+	for(i=0 ; i < routes_count ; i++) {
+		if(routes[i].direction != YAMAHA_MC1N2_AUDIO_DIRECTION_MODEM)
+			continue;
+
+		d = bench_device_name(routes[i].device);
+
+		rc = bench_set_route(pdata, routes[i].device);
+		snprintf(name, sizeof(name), "modem_start %s", d);
+		rc |= bench_transition(name, bench_modem_start, pdata, 0);
+
+		// Switching during a call
+		for(j=0 ; j < routes_count ; j++) {
+			if(j == i || routes[j].direction != YAMAHA_MC1N2_AUDIO_DIRECTION_MODEM)
+				continue;
+
+			snprintf(name, sizeof(name), "modem %s -> %s", d, bench_device_name(routes[j].device));
+			rc |= bench_transition(name, bench_set_route, pdata, routes[j].device);
+			rc |= bench_set_route(pdata, routes[i].device);
+		}
+
+		snprintf(name, sizeof(name), "modem_stop %s", d);
+		rc |= bench_transition(name, bench_modem_stop, pdata, 0);
+		if(rc < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+// Mic mute during a call, against the period of the fast output profile
+int bench_mic_mute(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	struct yamaha_mc1n2_audio_pcm_config *config = NULL;
+	struct yamaha_mc1n2_audio_hw_sim_record *record = NULL;
+	int64_t period;
+	int64_t post_time;
+	int64_t time;
+	int records_count;
+	int paths_count;
+	int mute;
+	int rc;
+	int i;
+
+	config = yamaha_mc1n2_audio_get_output_config(pdata, YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_FAST);
+	if(config == NULL || config->rate <= 0)
+		return -1;
+
+	period = (int64_t) config->period_size * 1000000LL / config->rate;
+
+	rc = bench_set_route(pdata, AUDIO_DEVICE_OUT_EARPIECE);
+	rc |= bench_modem_start(pdata, 0);
+	if(rc < 0) {
+		printf("Unable to start modem\n");
+		return -1;
+	}
+
+	for(mute=1 ; mute >= 0 ; mute--) {
+		records_count = yamaha_mc1n2_audio_hw_sim.records_count;
+
+		// The caller only pays for the post, the worker configures the codec
+		time = bench_time();
+		rc = yamaha_mc1n2_audio_set_mic_mute(pdata, mute);
+		post_time = bench_time() - time;
+		rc = yamaha_mc1n2_audio_request_wait(pdata, rc);
+		time = bench_time() - time;
+
+		if(rc < 0) {
+			printf("Mic %s failed!\n", mute ? "mute" : "unmute");
+			break;
+		}
+
+		paths_count = 0;
+		for(i=records_count ; i < yamaha_mc1n2_audio_hw_sim.records_count ; i++) {
+			record = &yamaha_mc1n2_audio_hw_sim.records[i % YAMAHA_MC1N2_AUDIO_HW_SIM_RECORDS_COUNT];
+			if(record->request != (int) MC1N2_IOCTL_NOTIFY && record->command == MCDRV_SET_PATH)
+				paths_count++;
+		}
+
+		printf("Mic %s during a call: posted in %lld us, applied in %lld us, %d ioctls, %d SET_PATH, "
+			"%s a fast output period (%lld us)\n", mute ? "mute" : "unmute",
+			(long long) post_time, (long long) time,
+			yamaha_mc1n2_audio_hw_sim.records_count - records_count, paths_count,
+			time <= period ? "within" : "over", (long long) period);
+
+		if(bench_verbose)
+			bench_records_dump(records_count, yamaha_mc1n2_audio_hw_sim.records_count);
+	}
+
+	bench_modem_stop(pdata, 0);
+
+	return rc;
+}
+
+// Route changes posted back to back, only waiting for the last one
+int bench_coalesce(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	audio_devices_t devices[] = {
+		AUDIO_DEVICE_OUT_SPEAKER,
+		AUDIO_DEVICE_OUT_EARPIECE,
+		AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+		AUDIO_DEVICE_OUT_SPEAKER,
+	};
+	int devices_count = sizeof(devices) / sizeof(audio_devices_t);
+	int64_t post_time;
+	int64_t time;
+	int records_count;
+	int passes;
+	int rc = 0;
+	int i;
+
+	rc = bench_set_route(pdata, AUDIO_DEVICE_OUT_SPEAKER);
+	rc |= bench_output_start(pdata, 0);
+	if(rc < 0) {
+		printf("Unable to start output\n");
+		return -1;
+	}
+
+	records_count = yamaha_mc1n2_audio_hw_sim.records_count;
+	passes = pdata->worker.passes;
+
+	time = bench_time();
+	for(i=0 ; i < devices_count ; i++) {
+		rc = yamaha_mc1n2_audio_set_route(pdata, devices[i]);
+		if(rc < 0)
+			break;
+	}
+	post_time = bench_time() - time;
+	rc = yamaha_mc1n2_audio_request_wait(pdata, rc);
+	time = bench_time() - time;
+
+	if(rc < 0) {
+		printf("Route changes failed!\n");
+		return -1;
+	}
+
+	printf("Route changes during playback: %d posted in %lld us, applied in %lld us, %d passes, %d ioctls\n",
+		devices_count, (long long) post_time, (long long) time, pdata->worker.passes - passes,
+		yamaha_mc1n2_audio_hw_sim.records_count - records_count);
+
+	return bench_output_stop(pdata, 0);
+}
+
+void bench_usage(char *name)
+{
+	printf("Usage: %s [-n iterations] [-s standby delay] [-z] [-v]\n", name);
+	printf("  -z: no simulated ioctl delays\n");
+	printf("  -v: dump the submitted controls of each transition\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct yamaha_mc1n2_audio_pdata *pdata = NULL;
+	struct bench_transition *entry = NULL;
+	int64_t duration = 0;
+	int ioctls_count = 0;
+	int iterations = 1;
+	int standby_delay = 0;
+	int opt;
+	int rc;
+	int i;
+
+	while((opt = getopt(argc, argv, "n:s:zvh")) != -1) {
+		switch(opt) {
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 's':
+				standby_delay = atoi(optarg);
+				break;
+			case 'z':
+				memset(&yamaha_mc1n2_audio_hw_sim_config, 0,
+					sizeof(yamaha_mc1n2_audio_hw_sim_config));
+				break;
+			case 'v':
+				bench_verbose = 1;
+				break;
+			default:
+				bench_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if(iterations <= 0 || standby_delay < 0) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	rc = yamaha_mc1n2_audio_start(&pdata, "galaxys2");
+	if(rc < 0 || pdata == NULL) {
+		printf("Unable to start audio\n");
+		return 1;
+	}
+
+	pdata->hw_ops = &yamaha_mc1n2_audio_hw_sim_ops;
+	yamaha_mc1n2_audio_hw_sim_reset();
+
+	yamaha_mc1n2_audio_set_standby_delay(pdata, standby_delay);
+
+	rc = yamaha_mc1n2_audio_init(pdata);
+	if(rc < 0) {
+		printf("Unable to init audio\n");
+		return 1;
+	}
+
+	for(i=0 ; i < iterations ; i++) {
+		rc = bench_matrix(pdata);
+		if(rc < 0)
+			break;
+	}
+
+	printf("%-44s %12s %8s\n", "Transition", "Latency (us)", "IOCTLs");
+
+	for(i=0 ; i < bench_transitions_count ; i++) {
+		entry = &bench_transitions[i];
+		if(entry->count == 0)
+			continue;
+
+		printf("%-44s %12lld %8.1f\n", entry->name, (long long) (entry->duration / entry->count),
+			(float) entry->ioctls_count / entry->count);
+
+		duration += entry->duration;
+		ioctls_count += entry->ioctls_count;
+	}
+
+	printf("Total: %d transitions, %lld us, %d ioctls\n", bench_transitions_count * iterations,
+		(long long) duration, ioctls_count);
+
+	if(rc >= 0)
+		rc = bench_mic_mute(pdata);
+	if(rc >= 0)
+		rc = bench_coalesce(pdata);
+
+	if(bench_verbose) {
+		fflush(stdout);
+		yamaha_mc1n2_audio_dump(pdata, STDOUT_FILENO);
+	}
+
+	yamaha_mc1n2_audio_stop(pdata);
+
+	return rc < 0 ? 1 : 0;
+}
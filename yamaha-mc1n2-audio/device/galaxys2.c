@@ -846,6 +846,12 @@ struct yamaha_mc1n2_audio_params_route galaxys2_params_routes[] = {
 struct yamaha_mc1n2_audio_device_ops galaxys2_ops = {
 	.hw_node = "/dev/snd/hwC0D0",
 	.hw_fd = -1,
+	.standby_delay = 1000,
+	.output_configs = {
+		[YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_DEEP_BUFFER] = { 44100, 1024, 4 },
+		// About 12 ms of buffering, the output path is kept warm for it
+		[YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_FAST] = { 44100, 256, 2 },
+	},
 	.params = {
 		.init = &galaxys2_params_init,
 		.routes = &galaxys2_params_routes,
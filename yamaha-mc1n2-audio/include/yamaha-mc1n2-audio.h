@@ -18,10 +18,36 @@
 #ifndef YAMAHA_MC1N2_AUDIO_H
 #define YAMAHA_MC1N2_AUDIO_H
 
+#include <stdint.h>
+#include <pthread.h>
+
 #include <system/audio.h>
 
 #include "mc1n2.h"
 
+#define YAMAHA_MC1N2_AUDIO_COMMANDS_COUNT		36
+#define YAMAHA_MC1N2_AUDIO_NOTIFY_COUNT			16
+#define YAMAHA_MC1N2_AUDIO_STATS_BUCKETS_COUNT		8
+#define YAMAHA_MC1N2_AUDIO_HW_SIM_RECORDS_COUNT		64
+
+/*
+ * Wanted state word: started paths in the low bits, generation above
+ */
+#define YAMAHA_MC1N2_AUDIO_STATE_OUTPUT			(1 << 0)
+#define YAMAHA_MC1N2_AUDIO_STATE_INPUT			(1 << 1)
+#define YAMAHA_MC1N2_AUDIO_STATE_MODEM			(1 << 2)
+#define YAMAHA_MC1N2_AUDIO_STATE_OUTPUT_WARM		(1 << 3)
+#define YAMAHA_MC1N2_AUDIO_STATE_MIC_MUTE		(1 << 4)
+#define YAMAHA_MC1N2_AUDIO_STATE_FLAGS			0x1f
+#define YAMAHA_MC1N2_AUDIO_STATE_GENERATION_SHIFT	5
+#define YAMAHA_MC1N2_AUDIO_STATE_GENERATION_MASK	(0xffffffff >> YAMAHA_MC1N2_AUDIO_STATE_GENERATION_SHIFT)
+
+#define YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_MAGIC		0x4e31434d
+#define YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_VERSION		2
+#ifndef YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_PATH
+#define YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_PATH		"/system/etc/yamaha-mc1n2-audio-%s.bin"
+#endif
+
 enum yamaha_mc1n2_audio_direction {
 	YAMAHA_MC1N2_AUDIO_DIRECTION_OUTPUT,
 	YAMAHA_MC1N2_AUDIO_DIRECTION_INPUT,
@@ -29,6 +55,35 @@ enum yamaha_mc1n2_audio_direction {
 	YAMAHA_MC1N2_AUDIO_DIRECTION_MAX
 };
 
+enum yamaha_mc1n2_audio_request {
+	YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_START,
+	YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_STOP,
+	YAMAHA_MC1N2_AUDIO_REQUEST_INPUT_START,
+	YAMAHA_MC1N2_AUDIO_REQUEST_INPUT_STOP,
+	YAMAHA_MC1N2_AUDIO_REQUEST_MODEM_START,
+	YAMAHA_MC1N2_AUDIO_REQUEST_MODEM_STOP,
+	YAMAHA_MC1N2_AUDIO_REQUEST_SET_ROUTE,
+	YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_WARM_START,
+	YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_WARM_STOP,
+	YAMAHA_MC1N2_AUDIO_REQUEST_MIC_MUTE,
+	YAMAHA_MC1N2_AUDIO_REQUEST_MIC_UNMUTE
+};
+
+/*
+ * Deep buffer output for music, fast output for latency-sensitive streams
+ */
+enum yamaha_mc1n2_audio_output_profile {
+	YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_DEEP_BUFFER,
+	YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_FAST,
+	YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_MAX
+};
+
+struct yamaha_mc1n2_audio_pcm_config {
+	int32_t rate;
+	int32_t period_size;
+	int32_t period_count;
+};
+
 struct yamaha_mc1n2_audio_params_init {
 	MCDRV_AE_INFO ae_info;
 	MCDRV_PATH_INFO path_info;
@@ -55,22 +110,223 @@ struct yamaha_mc1n2_audio_params {
 	int routes_count;
 };
 
+/*
+ * Params image: this header, followed by the init params and the routes, as
+ * laid out in memory. The structures hold no pointers, so the image is used
+ * in place once mapped. The structure sizes are kept to detect an image made
+ * for another layout.
+ */
+struct yamaha_mc1n2_audio_params_image {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+
+	uint32_t params_init_size;
+	uint32_t params_route_size;
+
+	char name[32];
+	char hw_node[64];
+	int32_t standby_delay;
+	struct yamaha_mc1n2_audio_pcm_config output_configs[YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_MAX];
+
+	uint32_t init_offset;
+	uint32_t routes_offset;
+	uint32_t routes_count;
+};
+
+/*
+ * Merged routes are memoized by the routes of the running directions: each
+ * route gets a slot in its direction, slot 0 being no route.
+ */
+struct yamaha_mc1n2_audio_route_table {
+	struct yamaha_mc1n2_audio_params_route **entries;
+	int entries_count;
+
+	int *routes_slots;
+	int slots_count[YAMAHA_MC1N2_AUDIO_DIRECTION_MAX];
+
+	int hits;
+	int misses;
+};
+
+/*
+ * Last control blocks applied to the codec, invalid until first sent
+ */
+struct yamaha_mc1n2_audio_shadow {
+	MCDRV_AE_INFO ae_info;
+	MCDRV_PATH_INFO path_info;
+	MCDRV_DAC_INFO dac_info;
+
+	int ae_valid;
+	int path_valid;
+	int dac_valid;
+
+	int sent;
+	int avoided;
+};
+
+struct yamaha_mc1n2_audio_state {
+	audio_devices_t output_device;
+	audio_devices_t input_device;
+
+	int output_state;
+	int input_state;
+	int modem_state;
+	// Output path kept powered while stopped, for the fast output
+	int output_warm;
+	int mic_mute;
+
+	unsigned int generation;
+};
+
+/*
+ * Output and input paths are kept powered for the standby delay after they
+ * are stopped, so that a start in the meantime finds them ready.
+ */
+struct yamaha_mc1n2_audio_standby {
+	// In ms, 0 to stop right away
+	int delay;
+
+	int64_t output_stop_time;
+	int64_t input_stop_time;
+	int64_t deadline;
+	int output_held;
+	int input_held;
+
+	int warm_starts;
+	int cold_starts;
+	// In us
+	int64_t cold_starts_duration;
+};
+
+/*
+ * Requests only update the wanted state: the worker applies the latest one
+ * as a whole, so a burst of requests ends up in a single codec configuration.
+ * Each request gets the generation of the state it produced, that is the
+ * handle to wait for.
+ */
+struct yamaha_mc1n2_audio_worker {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t request_cond;
+	pthread_cond_t complete_cond;
+	// Held while the codec is configured
+	pthread_mutex_t codec_mutex;
+
+	int running;
+
+	struct yamaha_mc1n2_audio_standby standby;
+
+	unsigned int complete_generation;
+	unsigned int failed_generation_start;
+	unsigned int failed_generation_end;
+
+	int requests;
+	int passes;
+	// Snapshots superseded before they could be applied
+	int dropped;
+};
+
+struct yamaha_mc1n2_audio_hw_ops {
+	int (*open)(char *node);
+	int (*close)(int fd);
+	int (*ioctl)(int fd, int request, void *data);
+};
+
+struct yamaha_mc1n2_audio_hw_sim_config {
+	// In us, indexed by the MCDRV_SET_* commands
+	int set_ctrl_delays[YAMAHA_MC1N2_AUDIO_COMMANDS_COUNT];
+	int notify_delay;
+};
+
+struct yamaha_mc1n2_audio_hw_sim_record {
+	int request;
+	unsigned long command;
+	unsigned long update_info;
+
+	union {
+		MCDRV_AE_INFO ae_info;
+		MCDRV_PATH_INFO path_info;
+		MCDRV_DAC_INFO dac_info;
+		MCDRV_ADC_INFO adc_info;
+		MCDRV_SP_INFO sp_info;
+		MCDRV_PDM_INFO pdm_info;
+		MCDRV_DNG_INFO dng_info;
+		MCDRV_SYSEQ_INFO syseq_info;
+	} data;
+	int length;
+};
+
+/*
+ * The last records are kept in a ring, records_count is the total
+ */
+struct yamaha_mc1n2_audio_hw_sim {
+	struct yamaha_mc1n2_audio_hw_sim_record records[YAMAHA_MC1N2_AUDIO_HW_SIM_RECORDS_COUNT];
+	int records_count;
+
+	int set_ctrl_count;
+	int notify_count;
+};
+
+/*
+ * Buckets go from under 100 us to 10 ms and more
+ */
+struct yamaha_mc1n2_audio_stats_command {
+	int count;
+	int failures;
+	// In us
+	int64_t duration;
+	int64_t duration_max;
+	int buckets[YAMAHA_MC1N2_AUDIO_STATS_BUCKETS_COUNT];
+};
+
+struct yamaha_mc1n2_audio_stats {
+	struct yamaha_mc1n2_audio_stats_command set_ctrl[YAMAHA_MC1N2_AUDIO_COMMANDS_COUNT];
+	struct yamaha_mc1n2_audio_stats_command notify[YAMAHA_MC1N2_AUDIO_NOTIFY_COUNT];
+};
+
 struct yamaha_mc1n2_audio_device_ops {
 	char *hw_node;
 	int hw_fd;
+	int standby_delay;
+	struct yamaha_mc1n2_audio_pcm_config output_configs[YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_MAX];
 	struct yamaha_mc1n2_audio_params params;
 };
 
 struct yamaha_mc1n2_audio_pdata {
 	char *name;
 	struct yamaha_mc1n2_audio_device_ops *ops;
+	// The kernel driver is used when NULL
+	struct yamaha_mc1n2_audio_hw_ops *hw_ops;
+
+	// Mapped params image, the params point in it when set
+	void *params_image;
+	size_t params_image_size;
 
 	audio_devices_t output_device;
 	audio_devices_t input_device;
 
+	// Applied state, only changed with the codec mutex held
 	int output_state;
 	int input_state;
 	int modem_state;
+	int mic_mute;
+	unsigned int generation;
+
+	// Wanted state, changed with compare-and-swap and read as a snapshot
+	volatile uint32_t state_word;
+	volatile audio_devices_t state_output_device;
+	volatile audio_devices_t state_input_device;
+
+	// Updated along with the devices, in yamaha_mc1n2_audio_set_route
+	struct yamaha_mc1n2_audio_params_route *output_route;
+	struct yamaha_mc1n2_audio_params_route *input_route;
+	struct yamaha_mc1n2_audio_params_route *modem_route;
+
+	struct yamaha_mc1n2_audio_route_table route_table;
+	struct yamaha_mc1n2_audio_shadow shadow;
+	struct yamaha_mc1n2_audio_worker worker;
+	struct yamaha_mc1n2_audio_stats stats;
 };
 
 /*
@@ -79,10 +335,23 @@ struct yamaha_mc1n2_audio_pdata {
 
 extern struct yamaha_mc1n2_audio_pdata galaxys2_pdata;
 
+/*
+ * Hardware
+ */
+
+extern struct yamaha_mc1n2_audio_hw_ops yamaha_mc1n2_audio_hw_kernel_ops;
+extern struct yamaha_mc1n2_audio_hw_ops yamaha_mc1n2_audio_hw_sim_ops;
+extern struct yamaha_mc1n2_audio_hw_sim_config yamaha_mc1n2_audio_hw_sim_config;
+extern struct yamaha_mc1n2_audio_hw_sim yamaha_mc1n2_audio_hw_sim;
+
 /*
  * Functions
  */
 
+// Hardware
+struct yamaha_mc1n2_audio_hw_ops *yamaha_mc1n2_audio_hw_ops(struct yamaha_mc1n2_audio_pdata *pdata);
+void yamaha_mc1n2_audio_hw_sim_reset(void);
+
 // IOCTL
 int yamaha_mc1n2_audio_ioctl(struct yamaha_mc1n2_audio_pdata *pdata,
 	int command, struct mc1n2_ctrl_args *hw_ctrl);
@@ -91,21 +360,105 @@ int yamaha_mc1n2_audio_ioctl_set_ctrl(struct yamaha_mc1n2_audio_pdata *pdata,
 int yamaha_mc1n2_audio_ioctl_notify(struct yamaha_mc1n2_audio_pdata *pdata,
 	unsigned long command);
 
+// Stats
+int64_t yamaha_mc1n2_audio_stats_time(void);
+void yamaha_mc1n2_audio_stats_record(struct yamaha_mc1n2_audio_pdata *pdata,
+	int command, struct mc1n2_ctrl_args *hw_ctrl, int64_t duration, int rc);
+void yamaha_mc1n2_audio_stats_dump(struct yamaha_mc1n2_audio_pdata *pdata, int fd);
+
+// Shadow
+void yamaha_mc1n2_audio_shadow_reset(struct yamaha_mc1n2_audio_pdata *pdata);
+int yamaha_mc1n2_audio_shadow_set_ae(struct yamaha_mc1n2_audio_pdata *pdata,
+	MCDRV_AE_INFO *ae_info);
+int yamaha_mc1n2_audio_shadow_set_path(struct yamaha_mc1n2_audio_pdata *pdata,
+	MCDRV_PATH_INFO *path_info);
+int yamaha_mc1n2_audio_shadow_set_dac(struct yamaha_mc1n2_audio_pdata *pdata,
+	MCDRV_DAC_INFO *dac_info);
+
+// Params image
+int yamaha_mc1n2_audio_params_image_check(void *data, size_t size);
+struct yamaha_mc1n2_audio_pdata *yamaha_mc1n2_audio_params_image_load(char *device_name);
+void yamaha_mc1n2_audio_params_image_unload(struct yamaha_mc1n2_audio_pdata *pdata);
+
+// Route table
+int yamaha_mc1n2_audio_route_table_init(struct yamaha_mc1n2_audio_pdata *pdata);
+void yamaha_mc1n2_audio_route_table_deinit(struct yamaha_mc1n2_audio_pdata *pdata);
+void yamaha_mc1n2_audio_routes_update(struct yamaha_mc1n2_audio_pdata *pdata);
+int yamaha_mc1n2_audio_route_slot(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_params_route *params_route, int state);
+struct yamaha_mc1n2_audio_params_route *
+	yamaha_mc1n2_audio_route_table_get(struct yamaha_mc1n2_audio_pdata *pdata);
+
 // Routines
+int yamaha_mc1n2_audio_init_apply(struct yamaha_mc1n2_audio_pdata *pdata);
 int yamaha_mc1n2_audio_init(struct yamaha_mc1n2_audio_pdata *pdata);
+struct yamaha_mc1n2_audio_params_route *
+	yamaha_mc1n2_audio_params_route_find(struct yamaha_mc1n2_audio_pdata *pdata,
+	audio_devices_t device, enum yamaha_mc1n2_audio_direction direction);
+int yamaha_mc1n2_audio_route_build(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_params_route *params);
+void yamaha_mc1n2_audio_mic_mute_path(MCDRV_PATH_INFO *path_info);
+int yamaha_mc1n2_audio_route_start(struct yamaha_mc1n2_audio_pdata *pdata);
+int yamaha_mc1n2_audio_request(struct yamaha_mc1n2_audio_pdata *pdata,
+	enum yamaha_mc1n2_audio_request request, audio_devices_t device);
 int yamaha_mc1n2_audio_output_start(struct yamaha_mc1n2_audio_pdata *pdata);
 int yamaha_mc1n2_audio_output_stop(struct yamaha_mc1n2_audio_pdata *pdata);
 int yamaha_mc1n2_audio_input_start(struct yamaha_mc1n2_audio_pdata *pdata);
 int yamaha_mc1n2_audio_input_stop(struct yamaha_mc1n2_audio_pdata *pdata);
 int yamaha_mc1n2_audio_modem_start(struct yamaha_mc1n2_audio_pdata *pdata);
 int yamaha_mc1n2_audio_modem_stop(struct yamaha_mc1n2_audio_pdata *pdata);
+int yamaha_mc1n2_audio_output_warm_start(struct yamaha_mc1n2_audio_pdata *pdata);
+int yamaha_mc1n2_audio_output_warm_stop(struct yamaha_mc1n2_audio_pdata *pdata);
 
 // Values configuration
 int yamaha_mc1n2_audio_set_route(struct yamaha_mc1n2_audio_pdata *pdata,
 	audio_devices_t device);
+int yamaha_mc1n2_audio_set_mic_mute(struct yamaha_mc1n2_audio_pdata *pdata,
+	int mute);
 char *yamaha_mc1n2_audio_get_hw_node(struct yamaha_mc1n2_audio_pdata *pdata);
+int yamaha_mc1n2_audio_set_standby_delay(struct yamaha_mc1n2_audio_pdata *pdata,
+	int delay);
+struct yamaha_mc1n2_audio_pcm_config *yamaha_mc1n2_audio_get_output_config(
+	struct yamaha_mc1n2_audio_pdata *pdata, enum yamaha_mc1n2_audio_output_profile profile);
+
+// State
+int yamaha_mc1n2_audio_state_generation_before(unsigned int a, unsigned int b);
+uint32_t yamaha_mc1n2_audio_state_load(volatile uint32_t *value);
+unsigned int yamaha_mc1n2_audio_state_generation(struct yamaha_mc1n2_audio_pdata *pdata);
+uint32_t yamaha_mc1n2_audio_state_update(struct yamaha_mc1n2_audio_pdata *pdata,
+	uint32_t set, uint32_t clear, uint32_t *previous);
+int yamaha_mc1n2_audio_state_set_device(struct yamaha_mc1n2_audio_pdata *pdata,
+	audio_devices_t device);
+void yamaha_mc1n2_audio_state_reset(struct yamaha_mc1n2_audio_pdata *pdata);
+void yamaha_mc1n2_audio_state_snapshot(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_state *state);
+int yamaha_mc1n2_audio_state_request(enum yamaha_mc1n2_audio_request request,
+	uint32_t *set, uint32_t *clear);
+int yamaha_mc1n2_audio_state_apply(struct yamaha_mc1n2_audio_pdata *pdata,
+	enum yamaha_mc1n2_audio_request request, audio_devices_t device);
+
+// Worker
+int64_t yamaha_mc1n2_audio_worker_time(void);
+void yamaha_mc1n2_audio_worker_standby(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_state *state, int64_t time);
+int yamaha_mc1n2_audio_worker_apply(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_state *state);
+void *yamaha_mc1n2_audio_worker_thread(void *data);
+int yamaha_mc1n2_audio_worker_start(struct yamaha_mc1n2_audio_pdata *pdata);
+void yamaha_mc1n2_audio_worker_stop(struct yamaha_mc1n2_audio_pdata *pdata);
+int yamaha_mc1n2_audio_request_post(struct yamaha_mc1n2_audio_pdata *pdata,
+	enum yamaha_mc1n2_audio_request request, audio_devices_t device);
+int yamaha_mc1n2_audio_request_wait(struct yamaha_mc1n2_audio_pdata *pdata,
+	int generation);
+
+// Dump
+void yamaha_mc1n2_audio_dump_printf(int fd, const char *format, ...);
+int yamaha_mc1n2_audio_dump(struct yamaha_mc1n2_audio_pdata *pdata, int fd);
 
 // Init/Deinit
+struct yamaha_mc1n2_audio_pdata *yamaha_mc1n2_audio_platform_get(
+	char *device_name);
+struct yamaha_mc1n2_audio_pdata *yamaha_mc1n2_audio_get_started(void);
 int yamaha_mc1n2_audio_start(struct yamaha_mc1n2_audio_pdata **pdata_p,
 	char *device_name);
 int yamaha_mc1n2_audio_stop(struct yamaha_mc1n2_audio_pdata *pdata);
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2012 Paul Kocialkowski <contact@paulk.fr>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include <linux/ioctl.h>
+
+#include <yamaha-mc1n2-audio.h>
+
+/*
+ * Params image generator: writes the params of a platform, as described in
+ * device/, to an image that the library maps at start instead of using its
+ * built-in params. Images can also be checked and listed.
+ */
+
+#define IMAGE_ALIGN(offset)	(((offset) + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1))
+
+char *image_direction_name(enum yamaha_mc1n2_audio_direction direction)
+{
+	switch(direction) {
+		case YAMAHA_MC1N2_AUDIO_DIRECTION_OUTPUT:
+			return "output";
+		case YAMAHA_MC1N2_AUDIO_DIRECTION_INPUT:
+			return "input";
+		case YAMAHA_MC1N2_AUDIO_DIRECTION_MODEM:
+			return "modem";
+		default:
+			return "unknown";
+	}
+}
+
+int image_write(struct yamaha_mc1n2_audio_pdata *pdata, char *path)
+{
+	struct yamaha_mc1n2_audio_params_image *image = NULL;
+	size_t routes_size;
+	size_t size;
+	void *data = NULL;
+	FILE *file = NULL;
+	int rc = -1;
+
+	if(pdata == NULL || pdata->ops == NULL || pdata->ops->params.init == NULL ||
+		pdata->ops->params.routes == NULL || path == NULL)
+		return -1;
+
+	if(strlen(pdata->name) >= sizeof(image->name) ||
+		strlen(pdata->ops->hw_node) >= sizeof(image->hw_node)) {
+		printf("Platform name or hw_node too long\n");
+		return -1;
+	}
+
+	routes_size = pdata->ops->params.routes_count * sizeof(struct yamaha_mc1n2_audio_params_route);
+
+	size = IMAGE_ALIGN(sizeof(struct yamaha_mc1n2_audio_params_image));
+	size = IMAGE_ALIGN(size + sizeof(struct yamaha_mc1n2_audio_params_init));
+	size += routes_size;
+
+	data = calloc(1, size);
+	if(data == NULL)
+		return -1;
+
+	image = (struct yamaha_mc1n2_audio_params_image *) data;
+	image->magic = YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_MAGIC;
+	image->version = YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_VERSION;
+	image->size = size;
+	image->params_init_size = sizeof(struct yamaha_mc1n2_audio_params_init);
+	image->params_route_size = sizeof(struct yamaha_mc1n2_audio_params_route);
+
+	strncpy(image->name, pdata->name, sizeof(image->name) - 1);
+	strncpy(image->hw_node, pdata->ops->hw_node, sizeof(image->hw_node) - 1);
+	image->standby_delay = pdata->ops->standby_delay;
+	memcpy(image->output_configs, pdata->ops->output_configs, sizeof(image->output_configs));
+
+	image->init_offset = IMAGE_ALIGN(sizeof(struct yamaha_mc1n2_audio_params_image));
+	image->routes_offset = IMAGE_ALIGN(image->init_offset + sizeof(struct yamaha_mc1n2_audio_params_init));
+	image->routes_count = pdata->ops->params.routes_count;
+
+	memcpy((unsigned char *) data + image->init_offset, pdata->ops->params.init,
+		sizeof(struct yamaha_mc1n2_audio_params_init));
+	memcpy((unsigned char *) data + image->routes_offset, pdata->ops->params.routes,
+		routes_size);
+
+	if(yamaha_mc1n2_audio_params_image_check(data, size) < 0) {
+		printf("Generated image is invalid\n");
+		goto complete;
+	}
+
+	file = fopen(path, "wb");
+	if(file == NULL) {
+		printf("Unable to open %s\n", path);
+		goto complete;
+	}
+
+	if(fwrite(data, 1, size, file) != size) {
+		printf("Unable to write %s\n", path);
+		fclose(file);
+		goto complete;
+	}
+
+	fclose(file);
+
+	printf("Wrote %s: %s, %d routes, %d bytes\n", path, image->name,
+		image->routes_count, (int) size);
+
+	rc = 0;
+
+complete:
+	free(data);
+
+	return rc;
+}
+
+int image_list(char *path)
+{
+	struct yamaha_mc1n2_audio_params_image *image = NULL;
+	struct yamaha_mc1n2_audio_params_route *routes = NULL;
+	struct stat image_stat;
+	void *data = NULL;
+	int fd = -1;
+	int rc = -1;
+	int i;
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		printf("Unable to open %s\n", path);
+		return -1;
+	}
+
+	if(fstat(fd, &image_stat) < 0 || image_stat.st_size <= 0) {
+		close(fd);
+		return -1;
+	}
+
+	data = mmap(NULL, image_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if(data == MAP_FAILED)
+		return -1;
+
+	if(yamaha_mc1n2_audio_params_image_check(data, image_stat.st_size) < 0) {
+		printf("%s: invalid image\n", path);
+		goto complete;
+	}
+
+	image = (struct yamaha_mc1n2_audio_params_image *) data;
+	routes = (struct yamaha_mc1n2_audio_params_route *)
+		((unsigned char *) data + image->routes_offset);
+
+	printf("%s: %s, hw_node %s, standby delay %d ms, %d routes\n", path, image->name,
+		image->hw_node, image->standby_delay, image->routes_count);
+
+	for(i=0 ; i < YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_MAX ; i++)
+		printf("  %s output: %d Hz, %dx%d frames\n",
+			i == YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_FAST ? "fast" : "deep buffer",
+			image->output_configs[i].rate, image->output_configs[i].period_size,
+			image->output_configs[i].period_count);
+
+	for(i=0 ; i < (int) image->routes_count ; i++)
+		printf("  %s device 0x%x\n", image_direction_name(routes[i].direction),
+			routes[i].device);
+
+	rc = 0;
+
+complete:
+	munmap(data, image_stat.st_size);
+
+	return rc;
+}
+
+void image_usage(char *name)
+{
+	printf("Usage: %s [-p platform] -o image\n", name);
+	printf("       %s -l image\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct yamaha_mc1n2_audio_pdata *pdata = NULL;
+	char *platform = "galaxys2";
+	char *output = NULL;
+	char *list = NULL;
+	int opt;
+	int rc;
+
+	while((opt = getopt(argc, argv, "p:o:l:h")) != -1) {
+		switch(opt) {
+			case 'p':
+				platform = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'l':
+				list = optarg;
+				break;
+			default:
+				image_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if(list != NULL) {
+		rc = image_list(list);
+		return rc < 0 ? 1 : 0;
+	}
+
+	if(output == NULL) {
+		image_usage(argv[0]);
+		return 1;
+	}
+
+	// Always the built-in params, whatever image is installed
+	pdata = yamaha_mc1n2_audio_platform_get(platform);
+	if(pdata == NULL) {
+		printf("Unknown platform: %s\n", platform);
+		return 1;
+	}
+
+	rc = image_write(pdata, output);
+
+	return rc < 0 ? 1 : 0;
+}
@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2012 Paul Kocialkowski <contact@paulk.fr>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <linux/ioctl.h>
+
+#include <tinyalsa/asoundlib.h>
+
+#include <yamaha-mc1n2-audio.h>
+
+/*
+ * Round-trip latency measurement: clicks are played on the output with the
+ * deep buffer or fast profile and detected on the input, through the speaker
+ * and built-in mic or a loopback plug. Frames are counted on both sides,
+ * they are clocked by the same codec. The audio HAL has to be stopped.
+ *
+ * With -w, the output start is timed instead, on a cold codec and with the
+ * output path held warm, without any PCM.
+ */
+
+#define LATENCY_CHANNELS	2
+#define LATENCY_CLICK_FRAMES	32
+
+#ifndef YAMAHA_MC1N2_AUDIO_DEVICE
+#define YAMAHA_MC1N2_AUDIO_DEVICE	NULL
+#endif
+
+void latency_usage(char *name)
+{
+	printf("Usage: %s [-d device] [-f] [-w] [-p period_size] [-c period_count] [-n clicks] [-t threshold]\n", name);
+	printf("  -d: codec platform, defaults to the board one\n");
+	printf("  -f: fast output profile instead of the deep buffer one\n");
+	printf("  -w: time cold and warm output starts, -n times each\n");
+}
+
+int64_t latency_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+int latency_output_start(struct yamaha_mc1n2_audio_pdata *pdata, int count, int64_t *start_time,
+	int64_t *stop_time)
+{
+	int64_t time;
+	int rc;
+	int i;
+
+	*start_time = 0;
+	*stop_time = 0;
+
+	for(i=0 ; i < count ; i++) {
+		time = latency_time();
+		rc = yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_output_start(pdata));
+		*start_time += latency_time() - time;
+		if(rc < 0)
+			return -1;
+
+		time = latency_time();
+		rc = yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_output_stop(pdata));
+		*stop_time += latency_time() - time;
+		if(rc < 0)
+			return -1;
+	}
+
+	*start_time /= count;
+	*stop_time /= count;
+
+	return 0;
+}
+
+int latency_warm(struct yamaha_mc1n2_audio_pdata *pdata, int count)
+{
+	int64_t cold_start, cold_stop;
+	int64_t warm_start, warm_stop;
+	int64_t hold, release;
+	int rc;
+
+	// Without a standby delay, a stopped output path is really released
+	yamaha_mc1n2_audio_set_standby_delay(pdata, 0);
+
+	rc = latency_output_start(pdata, count, &cold_start, &cold_stop);
+	if(rc < 0) {
+		printf("Cold output start failed\n");
+		return -1;
+	}
+
+	hold = latency_time();
+	rc = yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_output_warm_start(pdata));
+	hold = latency_time() - hold;
+	if(rc < 0) {
+		printf("Warm output start failed\n");
+		return -1;
+	}
+
+	rc = latency_output_start(pdata, count, &warm_start, &warm_stop);
+
+	release = latency_time();
+	yamaha_mc1n2_audio_request_wait(pdata, yamaha_mc1n2_audio_output_warm_stop(pdata));
+	release = latency_time() - release;
+
+	if(rc < 0) {
+		printf("Output start with a warm path failed\n");
+		return -1;
+	}
+
+	printf("Cold output: start %lld us, stop %lld us\n", (long long) cold_start, (long long) cold_stop);
+	printf("Warm output: start %lld us, stop %lld us, held in %lld us, released in %lld us\n",
+		(long long) warm_start, (long long) warm_stop, (long long) hold, (long long) release);
+
+	return 0;
+}
+
+int latency_detect(short *buffer, int frames, int threshold)
+{
+	int i;
+
+	for(i=0 ; i < frames * LATENCY_CHANNELS ; i++)
+		if(buffer[i] > threshold || buffer[i] < -threshold)
+			return i / LATENCY_CHANNELS;
+
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct yamaha_mc1n2_audio_pdata *pdata = NULL;
+	struct yamaha_mc1n2_audio_pcm_config *profile_config = NULL;
+	enum yamaha_mc1n2_audio_output_profile profile = YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_DEEP_BUFFER;
+	struct pcm_config config;
+	struct pcm *pcm_out = NULL;
+	struct pcm *pcm_in = NULL;
+	char *device_name = YAMAHA_MC1N2_AUDIO_DEVICE;
+	int warm = 0;
+	short *buffer_out = NULL;
+	short *buffer_in = NULL;
+	int period_size = 0;
+	int period_count = 0;
+	int clicks = 10;
+	int threshold = 8000;
+	int click_frame = -1;
+	int interval;
+	int detected = 0;
+	int missed = 0;
+	int latency;
+	int latency_min = 0;
+	int latency_max = 0;
+	int latency_total = 0;
+	int frame;
+	int size;
+	int opt;
+	int rc;
+	int i;
+
+	while((opt = getopt(argc, argv, "d:fwp:c:n:t:h")) != -1) {
+		switch(opt) {
+			case 'd':
+				device_name = optarg;
+				break;
+			case 'w':
+				warm = 1;
+				break;
+			case 'f':
+				profile = YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_FAST;
+				break;
+			case 'p':
+				period_size = atoi(optarg);
+				break;
+			case 'c':
+				period_count = atoi(optarg);
+				break;
+			case 'n':
+				clicks = atoi(optarg);
+				break;
+			case 't':
+				threshold = atoi(optarg);
+				break;
+			default:
+				latency_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if(device_name == NULL) {
+		latency_usage(argv[0]);
+		return 1;
+	}
+
+	rc = yamaha_mc1n2_audio_start(&pdata, device_name);
+	if(rc < 0 || pdata == NULL) {
+		printf("Unable to start yamaha-mc1n2-audio\n");
+		return 1;
+	}
+
+	profile_config = yamaha_mc1n2_audio_get_output_config(pdata, profile);
+	if(profile_config == NULL) {
+		printf("No such output profile\n");
+		goto complete;
+	}
+
+	memset(&config, 0, sizeof(config));
+	config.channels = LATENCY_CHANNELS;
+	config.rate = profile_config->rate;
+	config.period_size = period_size > 0 ? period_size : profile_config->period_size;
+	config.period_count = period_count > 0 ? period_count : profile_config->period_count;
+	config.format = PCM_FORMAT_S16_LE;
+
+	if(clicks <= 0 || threshold <= 0 || config.period_size < LATENCY_CLICK_FRAMES) {
+		latency_usage(argv[0]);
+		goto complete;
+	}
+
+	yamaha_mc1n2_audio_init(pdata);
+	yamaha_mc1n2_audio_set_route(pdata, AUDIO_DEVICE_OUT_SPEAKER);
+	yamaha_mc1n2_audio_set_route(pdata, AUDIO_DEVICE_IN_BUILTIN_MIC);
+
+	if(warm) {
+		rc = latency_warm(pdata, clicks);
+		yamaha_mc1n2_audio_stop(pdata);
+
+		return rc < 0 ? 1 : 0;
+	}
+
+	yamaha_mc1n2_audio_output_start(pdata);
+	rc = yamaha_mc1n2_audio_input_start(pdata);
+
+	// The codec has to be configured before the first click
+	yamaha_mc1n2_audio_request_wait(pdata, rc);
+
+	// Same periods on both sides, so that a write and a read take as long
+	pcm_in = pcm_open(0, 0, PCM_IN, &config);
+	if(pcm_in == NULL || !pcm_is_ready(pcm_in)) {
+		printf("Unable to open input: %s\n", pcm_in != NULL ? pcm_get_error(pcm_in) : "");
+		goto complete;
+	}
+
+	pcm_out = pcm_open(0, 0, PCM_OUT, &config);
+	if(pcm_out == NULL || !pcm_is_ready(pcm_out)) {
+		printf("Unable to open output: %s\n", pcm_out != NULL ? pcm_get_error(pcm_out) : "");
+		goto complete;
+	}
+
+	size = config.period_size * LATENCY_CHANNELS * sizeof(short);
+	buffer_out = (short *) calloc(1, size);
+	buffer_in = (short *) calloc(1, size);
+	if(buffer_out == NULL || buffer_in == NULL)
+		goto complete;
+
+	// Half a second between clicks, to let echoes die out
+	interval = config.rate / 2 / config.period_size;
+	if(interval < config.period_count * 2)
+		interval = config.period_count * 2;
+
+	printf("Output: %d Hz, %dx%d frames, %.1f ms buffered\n", config.rate, config.period_size,
+		config.period_count, config.period_size * config.period_count * 1000.0f / config.rate);
+
+	for(i=0 ; detected + missed < clicks ; i++) {
+		frame = i * config.period_size;
+
+		memset(buffer_out, 0, size);
+
+		if(i % interval == interval - 1) {
+			if(click_frame >= 0)
+				missed++;
+
+			memset(buffer_out, 0x70, LATENCY_CLICK_FRAMES * LATENCY_CHANNELS * sizeof(short));
+			click_frame = frame;
+		}
+
+		rc = pcm_write(pcm_out, buffer_out, size);
+		if(rc != 0) {
+			printf("Output write failed: %s\n", pcm_get_error(pcm_out));
+			break;
+		}
+
+		rc = pcm_read(pcm_in, buffer_in, size);
+		if(rc != 0) {
+			printf("Input read failed: %s\n", pcm_get_error(pcm_in));
+			break;
+		}
+
+		if(click_frame < 0)
+			continue;
+
+		rc = latency_detect(buffer_in, config.period_size, threshold);
+		if(rc < 0)
+			continue;
+
+		latency = frame + rc - click_frame;
+		click_frame = -1;
+
+		if(detected == 0 || latency < latency_min)
+			latency_min = latency;
+		if(detected == 0 || latency > latency_max)
+			latency_max = latency;
+		latency_total += latency;
+		detected++;
+
+		printf("Click %d: %d frames, %.2f ms\n", detected, latency,
+			latency * 1000.0f / config.rate);
+	}
+
+	if(detected > 0) {
+		// The input period is only counted once read by a client
+		printf("Round trip: min %.2f ms, avg %.2f ms, max %.2f ms, plus %.2f ms input period\n",
+			latency_min * 1000.0f / config.rate,
+			latency_total * 1000.0f / detected / config.rate,
+			latency_max * 1000.0f / config.rate,
+			config.period_size * 1000.0f / config.rate);
+	}
+
+	if(missed > 0)
+		printf("Missed %d clicks, try a lower threshold\n", missed);
+
+complete:
+	if(pcm_out != NULL)
+		pcm_close(pcm_out);
+	if(pcm_in != NULL)
+		pcm_close(pcm_in);
+
+	if(buffer_out != NULL)
+		free(buffer_out);
+	if(buffer_in != NULL)
+		free(buffer_in);
+
+	yamaha_mc1n2_audio_input_stop(pdata);
+	yamaha_mc1n2_audio_output_stop(pdata);
+	yamaha_mc1n2_audio_stop(pdata);
+
+	return detected > 0 ? 0 : 1;
+}
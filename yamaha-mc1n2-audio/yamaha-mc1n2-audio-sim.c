@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2012 Paul Kocialkowski <contact@paulk.fr>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <linux/ioctl.h>
+
+#define LOG_TAG "Yamaha-MC1N2-Audio-Sim"
+#include <cutils/log.h>
+
+#include <yamaha-mc1n2-audio.h>
+
+/*
+ * Simulated codec driver: the submitted MCDRV_* structures are recorded and
+ * each ioctl takes the configured delay, to stand for the register writes
+ * and analog settling of the real codec.
+ */
+
+#define YAMAHA_MC1N2_AUDIO_HW_SIM_FD	0x4d43
+
+struct yamaha_mc1n2_audio_hw_sim_config yamaha_mc1n2_audio_hw_sim_config = {
+	.set_ctrl_delays = {
+		[MCDRV_SET_PATH] = 3000,
+		[MCDRV_SET_VOLUME] = 200,
+		[MCDRV_SET_DAC] = 200,
+		[MCDRV_SET_ADC] = 200,
+		[MCDRV_SET_SP] = 200,
+		[MCDRV_SET_DNG] = 300,
+		[MCDRV_SET_AUDIOENGINE] = 500,
+		[MCDRV_SET_PDM] = 200,
+		[MCDRV_SET_SYSEQ] = 500,
+	},
+	.notify_delay = 1000,
+};
+
+struct yamaha_mc1n2_audio_hw_sim yamaha_mc1n2_audio_hw_sim;
+
+pthread_mutex_t yamaha_mc1n2_audio_hw_sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int yamaha_mc1n2_audio_hw_sim_length(unsigned long command)
+{
+	switch(command) {
+		case MCDRV_SET_AUDIOENGINE:
+			return sizeof(MCDRV_AE_INFO);
+		case MCDRV_SET_PATH:
+			return sizeof(MCDRV_PATH_INFO);
+		case MCDRV_SET_DAC:
+			return sizeof(MCDRV_DAC_INFO);
+		case MCDRV_SET_ADC:
+			return sizeof(MCDRV_ADC_INFO);
+		case MCDRV_SET_SP:
+			return sizeof(MCDRV_SP_INFO);
+		case MCDRV_SET_PDM:
+			return sizeof(MCDRV_PDM_INFO);
+		case MCDRV_SET_DNG:
+			return sizeof(MCDRV_DNG_INFO);
+		case MCDRV_SET_SYSEQ:
+			return sizeof(MCDRV_SYSEQ_INFO);
+		default:
+			return 0;
+	}
+}
+
+void yamaha_mc1n2_audio_hw_sim_reset(void)
+{
+	pthread_mutex_lock(&yamaha_mc1n2_audio_hw_sim_mutex);
+	memset(&yamaha_mc1n2_audio_hw_sim, 0, sizeof(yamaha_mc1n2_audio_hw_sim));
+	pthread_mutex_unlock(&yamaha_mc1n2_audio_hw_sim_mutex);
+}
+
+int yamaha_mc1n2_audio_hw_sim_open(char *node)
+{
+	ALOGD("%s(%s)", __func__, node);
+
+	return YAMAHA_MC1N2_AUDIO_HW_SIM_FD;
+}
+
+int yamaha_mc1n2_audio_hw_sim_close(int fd)
+{
+	if(fd != YAMAHA_MC1N2_AUDIO_HW_SIM_FD)
+		return -1;
+
+	return 0;
+}
+
+int yamaha_mc1n2_audio_hw_sim_ioctl(int fd, int request, void *data)
+{
+	struct yamaha_mc1n2_audio_hw_sim_record *record = NULL;
+	struct mc1n2_ctrl_args *hw_ctrl = NULL;
+	int length = 0;
+	int delay = 0;
+
+	if(fd != YAMAHA_MC1N2_AUDIO_HW_SIM_FD || data == NULL)
+		return -1;
+
+	hw_ctrl = (struct mc1n2_ctrl_args *) data;
+
+	if(request == (int) MC1N2_IOCTL_SET_CTRL) {
+		length = yamaha_mc1n2_audio_hw_sim_length(hw_ctrl->dCmd);
+		if(length == 0 || hw_ctrl->pvPrm == NULL) {
+			ALOGE("%s: error, unsupported command %ld!", __func__, hw_ctrl->dCmd);
+			return -1;
+		}
+
+		if(hw_ctrl->dCmd < YAMAHA_MC1N2_AUDIO_COMMANDS_COUNT)
+			delay = yamaha_mc1n2_audio_hw_sim_config.set_ctrl_delays[hw_ctrl->dCmd];
+	} else if(request == (int) MC1N2_IOCTL_NOTIFY) {
+		delay = yamaha_mc1n2_audio_hw_sim_config.notify_delay;
+	} else {
+		ALOGE("%s: error, unsupported request %x!", __func__, request);
+		return -1;
+	}
+
+	pthread_mutex_lock(&yamaha_mc1n2_audio_hw_sim_mutex);
+
+	record = &yamaha_mc1n2_audio_hw_sim.records[yamaha_mc1n2_audio_hw_sim.records_count %
+		YAMAHA_MC1N2_AUDIO_HW_SIM_RECORDS_COUNT];
+	memset(record, 0, sizeof(struct yamaha_mc1n2_audio_hw_sim_record));
+
+	record->request = request;
+	record->command = hw_ctrl->dCmd;
+	record->update_info = hw_ctrl->dPrm;
+	record->length = length;
+
+	if(length > 0)
+		memcpy(&record->data, hw_ctrl->pvPrm, length);
+
+	yamaha_mc1n2_audio_hw_sim.records_count++;
+
+	if(request == (int) MC1N2_IOCTL_SET_CTRL)
+		yamaha_mc1n2_audio_hw_sim.set_ctrl_count++;
+	else
+		yamaha_mc1n2_audio_hw_sim.notify_count++;
+
+	pthread_mutex_unlock(&yamaha_mc1n2_audio_hw_sim_mutex);
+
+	if(delay > 0)
+		usleep(delay);
+
+	return 0;
+}
+
+struct yamaha_mc1n2_audio_hw_ops yamaha_mc1n2_audio_hw_sim_ops = {
+	.open = yamaha_mc1n2_audio_hw_sim_open,
+	.close = yamaha_mc1n2_audio_hw_sim_close,
+	.ioctl = yamaha_mc1n2_audio_hw_sim_ioctl,
+};
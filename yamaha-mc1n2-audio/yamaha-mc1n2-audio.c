@@ -17,10 +17,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #include <linux/ioctl.h>
@@ -39,6 +46,39 @@ struct yamaha_mc1n2_audio_pdata *yamaha_mc1n2_audio_platforms[] = {
 int yamaha_mc1n2_audio_platforms_count = sizeof(yamaha_mc1n2_audio_platforms) /
 	sizeof(struct yamaha_mc1n2_audio_pdata *);
 
+/*
+ * Hardware
+ */
+
+int yamaha_mc1n2_audio_hw_kernel_open(char *node)
+{
+	return open(node, O_RDWR);
+}
+
+int yamaha_mc1n2_audio_hw_kernel_close(int fd)
+{
+	return close(fd);
+}
+
+int yamaha_mc1n2_audio_hw_kernel_ioctl(int fd, int request, void *data)
+{
+	return ioctl(fd, request, data);
+}
+
+struct yamaha_mc1n2_audio_hw_ops yamaha_mc1n2_audio_hw_kernel_ops = {
+	.open = yamaha_mc1n2_audio_hw_kernel_open,
+	.close = yamaha_mc1n2_audio_hw_kernel_close,
+	.ioctl = yamaha_mc1n2_audio_hw_kernel_ioctl,
+};
+
+struct yamaha_mc1n2_audio_hw_ops *yamaha_mc1n2_audio_hw_ops(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	if(pdata == NULL || pdata->hw_ops == NULL)
+		return &yamaha_mc1n2_audio_hw_kernel_ops;
+
+	return pdata->hw_ops;
+}
+
 /*
  * IOCTL
  */
@@ -46,7 +86,9 @@ int yamaha_mc1n2_audio_platforms_count = sizeof(yamaha_mc1n2_audio_platforms) /
 int yamaha_mc1n2_audio_ioctl(struct yamaha_mc1n2_audio_pdata *pdata,
 	int command, struct mc1n2_ctrl_args *hw_ctrl)
 {
+	struct yamaha_mc1n2_audio_hw_ops *hw_ops = NULL;
 	char *hw_node = NULL;
+	int64_t time;
 	int hw_fd = -1;
 	int rc = -1;
 
@@ -59,8 +101,10 @@ int yamaha_mc1n2_audio_ioctl(struct yamaha_mc1n2_audio_pdata *pdata,
 		return -1;
 	}
 
+	hw_ops = yamaha_mc1n2_audio_hw_ops(pdata);
+
 	if(pdata->ops->hw_fd <= 0) {
-		hw_fd = open(hw_node, O_RDWR);
+		hw_fd = hw_ops->open(hw_node);
 		if(hw_fd < 0) {
 			ALOGE("%s: error, unable to open hw_node (fd is %d)!", __func__, hw_fd);
 			return -1;
@@ -69,7 +113,12 @@ int yamaha_mc1n2_audio_ioctl(struct yamaha_mc1n2_audio_pdata *pdata,
 		pdata->ops->hw_fd = hw_fd;
 	}
 
-	rc = ioctl(pdata->ops->hw_fd, command, hw_ctrl);
+	time = yamaha_mc1n2_audio_stats_time();
+	rc = hw_ops->ioctl(pdata->ops->hw_fd, command, hw_ctrl);
+	time = yamaha_mc1n2_audio_stats_time() - time;
+
+	yamaha_mc1n2_audio_stats_record(pdata, command, hw_ctrl, time, rc);
+
 	if(rc < 0) {
 		ALOGE("%s: error, ioctl on hw_node failed (rc is %d)!", __func__, rc);
 		return -1;
@@ -108,11 +157,540 @@ int yamaha_mc1n2_audio_ioctl_notify(struct yamaha_mc1n2_audio_pdata *pdata,
 	return yamaha_mc1n2_audio_ioctl(pdata, MC1N2_IOCTL_NOTIFY, &hw_ctrl);
 }
 
+/*
+ * Stats
+ */
+
+char *yamaha_mc1n2_audio_set_ctrl_names[YAMAHA_MC1N2_AUDIO_COMMANDS_COUNT] = {
+	[MCDRV_SET_PATH] = "SET_PATH",
+	[MCDRV_SET_VOLUME] = "SET_VOLUME",
+	[MCDRV_SET_DIGITALIO] = "SET_DIGITALIO",
+	[MCDRV_SET_DAC] = "SET_DAC",
+	[MCDRV_SET_ADC] = "SET_ADC",
+	[MCDRV_SET_SP] = "SET_SP",
+	[MCDRV_SET_DNG] = "SET_DNG",
+	[MCDRV_SET_AUDIOENGINE] = "SET_AUDIOENGINE",
+	[MCDRV_SET_PDM] = "SET_PDM",
+	[MCDRV_SET_SYSEQ] = "SET_SYSEQ",
+};
+
+char *yamaha_mc1n2_audio_notify_names[YAMAHA_MC1N2_AUDIO_NOTIFY_COUNT] = {
+	[MCDRV_NOTIFY_CALL_START] = "NOTIFY_CALL_START",
+	[MCDRV_NOTIFY_CALL_STOP] = "NOTIFY_CALL_STOP",
+	[MCDRV_NOTIFY_MEDIA_PLAY_START] = "NOTIFY_MEDIA_PLAY_START",
+	[MCDRV_NOTIFY_MEDIA_PLAY_STOP] = "NOTIFY_MEDIA_PLAY_STOP",
+	[MCDRV_NOTIFY_VOICE_REC_START] = "NOTIFY_VOICE_REC_START",
+	[MCDRV_NOTIFY_VOICE_REC_STOP] = "NOTIFY_VOICE_REC_STOP",
+};
+
+// Upper bounds of the buckets, in us, the last one being unbounded
+int yamaha_mc1n2_audio_stats_buckets[YAMAHA_MC1N2_AUDIO_STATS_BUCKETS_COUNT - 1] = {
+	100, 250, 500, 1000, 2500, 5000, 10000
+};
+
+int64_t yamaha_mc1n2_audio_stats_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+void yamaha_mc1n2_audio_stats_record(struct yamaha_mc1n2_audio_pdata *pdata,
+	int command, struct mc1n2_ctrl_args *hw_ctrl, int64_t duration, int rc)
+{
+	struct yamaha_mc1n2_audio_stats_command *stats = NULL;
+	int i;
+
+	if(pdata == NULL || hw_ctrl == NULL)
+		return;
+
+	if(command == (int) MC1N2_IOCTL_SET_CTRL && hw_ctrl->dCmd < YAMAHA_MC1N2_AUDIO_COMMANDS_COUNT)
+		stats = &pdata->stats.set_ctrl[hw_ctrl->dCmd];
+	else if(command == (int) MC1N2_IOCTL_NOTIFY && hw_ctrl->dCmd < YAMAHA_MC1N2_AUDIO_NOTIFY_COUNT)
+		stats = &pdata->stats.notify[hw_ctrl->dCmd];
+	else
+		return;
+
+	stats->count++;
+	if(rc < 0)
+		stats->failures++;
+
+	stats->duration += duration;
+	if(duration > stats->duration_max)
+		stats->duration_max = duration;
+
+	for(i=0 ; i < YAMAHA_MC1N2_AUDIO_STATS_BUCKETS_COUNT - 1 ; i++)
+		if(duration < yamaha_mc1n2_audio_stats_buckets[i])
+			break;
+
+	stats->buckets[i]++;
+}
+
+void yamaha_mc1n2_audio_stats_dump_command(int fd, char *name,
+	struct yamaha_mc1n2_audio_stats_command *stats)
+{
+	char buckets[128];
+	int length = 0;
+	int i;
+
+	if(stats->count == 0)
+		return;
+
+	for(i=0 ; i < YAMAHA_MC1N2_AUDIO_STATS_BUCKETS_COUNT ; i++)
+		length += snprintf(buckets + length, sizeof(buckets) - length, " %6d", stats->buckets[i]);
+
+	yamaha_mc1n2_audio_dump_printf(fd, "    %-24s %6d %4d %8lld %8lld%s\n", name,
+		stats->count, stats->failures, (long long) (stats->duration / stats->count),
+		(long long) stats->duration_max, buckets);
+}
+
+void yamaha_mc1n2_audio_stats_dump(struct yamaha_mc1n2_audio_pdata *pdata, int fd)
+{
+	char name[32];
+	int i;
+
+	if(pdata == NULL)
+		return;
+
+	yamaha_mc1n2_audio_dump_printf(fd, "  IOCTLs:\n");
+	yamaha_mc1n2_audio_dump_printf(fd, "    %-24s %6s %4s %8s %8s %6s %6s %6s %6s %6s %6s %6s %6s\n",
+		"Command", "Count", "Err", "Avg us", "Max us", "<100", "<250", "<500", "<1m",
+		"<2.5m", "<5m", "<10m", ">10m");
+
+	for(i=0 ; i < YAMAHA_MC1N2_AUDIO_COMMANDS_COUNT ; i++) {
+		if(yamaha_mc1n2_audio_set_ctrl_names[i] == NULL)
+			snprintf(name, sizeof(name), "SET_CTRL %d", i);
+
+		yamaha_mc1n2_audio_stats_dump_command(fd, yamaha_mc1n2_audio_set_ctrl_names[i] != NULL ?
+			yamaha_mc1n2_audio_set_ctrl_names[i] : name, &pdata->stats.set_ctrl[i]);
+	}
+
+	for(i=0 ; i < YAMAHA_MC1N2_AUDIO_NOTIFY_COUNT ; i++) {
+		if(yamaha_mc1n2_audio_notify_names[i] == NULL)
+			snprintf(name, sizeof(name), "NOTIFY %d", i);
+
+		yamaha_mc1n2_audio_stats_dump_command(fd, yamaha_mc1n2_audio_notify_names[i] != NULL ?
+			yamaha_mc1n2_audio_notify_names[i] : name, &pdata->stats.notify[i]);
+	}
+}
+
+/*
+ * Shadow
+ */
+
+void yamaha_mc1n2_audio_shadow_reset(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	if(pdata == NULL)
+		return;
+
+	pdata->shadow.ae_valid = 0;
+	pdata->shadow.path_valid = 0;
+	pdata->shadow.dac_valid = 0;
+}
+
+int yamaha_mc1n2_audio_shadow_set_ae(struct yamaha_mc1n2_audio_pdata *pdata,
+	MCDRV_AE_INFO *ae_info)
+{
+	struct yamaha_mc1n2_audio_shadow *shadow = NULL;
+	unsigned long update_info = 0x0f;
+	int rc;
+
+	if(pdata == NULL || ae_info == NULL)
+		return -1;
+
+	shadow = &pdata->shadow;
+
+	// Only the on/off bits are updated, their flags match the bits
+	if(shadow->ae_valid)
+		update_info = (shadow->ae_info.bOnOff ^ ae_info->bOnOff) & 0x0f;
+
+	if(update_info == 0) {
+		shadow->avoided++;
+		return 0;
+	}
+
+	rc = yamaha_mc1n2_audio_ioctl_set_ctrl(pdata, MCDRV_SET_AUDIOENGINE,
+		ae_info, update_info);
+	shadow->sent++;
+	if(rc < 0) {
+		shadow->ae_valid = 0;
+		return -1;
+	}
+
+	memcpy(&shadow->ae_info, ae_info, sizeof(MCDRV_AE_INFO));
+	shadow->ae_valid = 1;
+
+	return 0;
+}
+
+int yamaha_mc1n2_audio_shadow_set_path(struct yamaha_mc1n2_audio_pdata *pdata,
+	MCDRV_PATH_INFO *path_info)
+{
+	struct yamaha_mc1n2_audio_shadow *shadow = NULL;
+	int rc;
+
+	if(pdata == NULL || path_info == NULL)
+		return -1;
+
+	shadow = &pdata->shadow;
+
+	// The path has no update flags, it is either sent as a whole or not at all
+	if(shadow->path_valid && memcmp(&shadow->path_info, path_info, sizeof(MCDRV_PATH_INFO)) == 0) {
+		shadow->avoided++;
+		return 0;
+	}
+
+	rc = yamaha_mc1n2_audio_ioctl_set_ctrl(pdata, MCDRV_SET_PATH,
+		path_info, 0x00);
+	shadow->sent++;
+	if(rc < 0) {
+		shadow->path_valid = 0;
+		return -1;
+	}
+
+	memcpy(&shadow->path_info, path_info, sizeof(MCDRV_PATH_INFO));
+	shadow->path_valid = 1;
+
+	return 0;
+}
+
+int yamaha_mc1n2_audio_shadow_set_dac(struct yamaha_mc1n2_audio_pdata *pdata,
+	MCDRV_DAC_INFO *dac_info)
+{
+	struct yamaha_mc1n2_audio_shadow *shadow = NULL;
+	unsigned long update_info = 0x07;
+	int rc;
+
+	if(pdata == NULL || dac_info == NULL)
+		return -1;
+
+	shadow = &pdata->shadow;
+
+	if(shadow->dac_valid) {
+		update_info = 0;
+		if(shadow->dac_info.bMasterSwap != dac_info->bMasterSwap)
+			update_info |= MCDRV_DAC_MSWP_UPDATE_FLAG;
+		if(shadow->dac_info.bVoiceSwap != dac_info->bVoiceSwap)
+			update_info |= MCDRV_DAC_VSWP_UPDATE_FLAG;
+		if(shadow->dac_info.bDcCut != dac_info->bDcCut)
+			update_info |= MCDRV_DAC_HPF_UPDATE_FLAG;
+	}
+
+	if(update_info == 0) {
+		shadow->avoided++;
+		return 0;
+	}
+
+	rc = yamaha_mc1n2_audio_ioctl_set_ctrl(pdata, MCDRV_SET_DAC,
+		dac_info, update_info);
+	shadow->sent++;
+	if(rc < 0) {
+		shadow->dac_valid = 0;
+		return -1;
+	}
+
+	memcpy(&shadow->dac_info, dac_info, sizeof(MCDRV_DAC_INFO));
+	shadow->dac_valid = 1;
+
+	return 0;
+}
+
+/*
+ * Params image
+ */
+
+struct yamaha_mc1n2_audio_device_ops yamaha_mc1n2_audio_image_ops;
+struct yamaha_mc1n2_audio_pdata yamaha_mc1n2_audio_image_pdata;
+
+int yamaha_mc1n2_audio_params_image_check(void *data, size_t size)
+{
+	struct yamaha_mc1n2_audio_params_image *image = NULL;
+	size_t routes_size;
+
+	if(data == NULL || size < sizeof(struct yamaha_mc1n2_audio_params_image))
+		return -1;
+
+	image = (struct yamaha_mc1n2_audio_params_image *) data;
+
+	if(image->magic != YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_MAGIC ||
+		image->version != YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_VERSION) {
+		ALOGE("%s: error, bad magic or version!", __func__);
+		return -1;
+	}
+
+	if(image->size != size ||
+		image->params_init_size != sizeof(struct yamaha_mc1n2_audio_params_init) ||
+		image->params_route_size != sizeof(struct yamaha_mc1n2_audio_params_route)) {
+		ALOGE("%s: error, image made for another layout!", __func__);
+		return -1;
+	}
+
+	if(image->routes_count == 0 || image->routes_count > size / sizeof(struct yamaha_mc1n2_audio_params_route))
+		return -1;
+
+	routes_size = image->routes_count * sizeof(struct yamaha_mc1n2_audio_params_route);
+
+	if((image->init_offset % sizeof(uint32_t)) != 0 || image->init_offset > size ||
+		size - image->init_offset < sizeof(struct yamaha_mc1n2_audio_params_init))
+		return -1;
+
+	if((image->routes_offset % sizeof(uint32_t)) != 0 || image->routes_offset > size ||
+		size - image->routes_offset < routes_size)
+		return -1;
+
+	if(memchr(image->name, 0, sizeof(image->name)) == NULL ||
+		memchr(image->hw_node, 0, sizeof(image->hw_node)) == NULL)
+		return -1;
+
+	return 0;
+}
+
+struct yamaha_mc1n2_audio_pdata *yamaha_mc1n2_audio_params_image_load(char *device_name)
+{
+	struct yamaha_mc1n2_audio_params_image *image = NULL;
+	struct yamaha_mc1n2_audio_pdata *pdata = NULL;
+	struct yamaha_mc1n2_audio_device_ops *ops = NULL;
+	struct stat image_stat;
+	char path[PATH_MAX];
+	void *data = NULL;
+	int fd = -1;
+	int rc;
+
+	if(device_name == NULL)
+		return NULL;
+
+	snprintf(path, sizeof(path), YAMAHA_MC1N2_AUDIO_PARAMS_IMAGE_PATH, device_name);
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	rc = fstat(fd, &image_stat);
+	if(rc < 0 || image_stat.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, image_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if(data == MAP_FAILED) {
+		ALOGE("%s: error, unable to map %s!", __func__, path);
+		return NULL;
+	}
+
+	rc = yamaha_mc1n2_audio_params_image_check(data, image_stat.st_size);
+	if(rc < 0) {
+		ALOGE("%s: error, invalid image %s!", __func__, path);
+		goto error;
+	}
+
+	image = (struct yamaha_mc1n2_audio_params_image *) data;
+	if(strcmp(image->name, device_name) != 0) {
+		ALOGE("%s: error, image %s is for %s!", __func__, path, image->name);
+		goto error;
+	}
+
+	ops = &yamaha_mc1n2_audio_image_ops;
+	memset(ops, 0, sizeof(struct yamaha_mc1n2_audio_device_ops));
+	ops->hw_node = image->hw_node;
+	ops->hw_fd = -1;
+	ops->standby_delay = image->standby_delay;
+	memcpy(ops->output_configs, image->output_configs, sizeof(ops->output_configs));
+	ops->params.init = (struct yamaha_mc1n2_audio_params_init *)
+		((unsigned char *) data + image->init_offset);
+	ops->params.routes = (struct yamaha_mc1n2_audio_params_route *)
+		((unsigned char *) data + image->routes_offset);
+	ops->params.routes_count = image->routes_count;
+
+	pdata = &yamaha_mc1n2_audio_image_pdata;
+	memset(pdata, 0, sizeof(struct yamaha_mc1n2_audio_pdata));
+	pdata->name = image->name;
+	pdata->ops = ops;
+	pdata->params_image = data;
+	pdata->params_image_size = image_stat.st_size;
+
+	ALOGD("Loaded %d routes from %s", image->routes_count, path);
+
+	return pdata;
+
+error:
+	munmap(data, image_stat.st_size);
+
+	return NULL;
+}
+
+void yamaha_mc1n2_audio_params_image_unload(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	if(pdata == NULL || pdata->params_image == NULL)
+		return;
+
+	munmap(pdata->params_image, pdata->params_image_size);
+
+	pdata->params_image = NULL;
+	pdata->params_image_size = 0;
+	pdata->ops = NULL;
+}
+
+/*
+ * Route table
+ */
+
+int yamaha_mc1n2_audio_route_table_init(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	struct yamaha_mc1n2_audio_route_table *table = NULL;
+	struct yamaha_mc1n2_audio_params_route *params = NULL;
+	int params_count = 0;
+	int direction;
+	int i;
+
+	if(pdata == NULL || pdata->ops == NULL)
+		return -1;
+
+	table = &pdata->route_table;
+	memset(table, 0, sizeof(struct yamaha_mc1n2_audio_route_table));
+
+	params = pdata->ops->params.routes;
+	params_count = pdata->ops->params.routes_count;
+	if(params == NULL || params_count <= 0)
+		return -1;
+
+	table->routes_slots = calloc(params_count, sizeof(int));
+	if(table->routes_slots == NULL)
+		return -1;
+
+	for(i=0 ; i < YAMAHA_MC1N2_AUDIO_DIRECTION_MAX ; i++)
+		table->slots_count[i] = 1;
+
+	for(i=0 ; i < params_count ; i++) {
+		direction = params[i].direction;
+		if(direction < 0 || direction >= YAMAHA_MC1N2_AUDIO_DIRECTION_MAX)
+			continue;
+
+		table->routes_slots[i] = table->slots_count[direction]++;
+	}
+
+	table->entries_count = 1;
+	for(i=0 ; i < YAMAHA_MC1N2_AUDIO_DIRECTION_MAX ; i++)
+		table->entries_count *= table->slots_count[i];
+
+	// Entries are only allocated for the combinations that get used
+	table->entries = calloc(table->entries_count,
+		sizeof(struct yamaha_mc1n2_audio_params_route *));
+	if(table->entries == NULL) {
+		free(table->routes_slots);
+		table->routes_slots = NULL;
+		return -1;
+	}
+
+	ALOGD("%s: %d route combinations", __func__, table->entries_count);
+
+	return 0;
+}
+
+void yamaha_mc1n2_audio_route_table_deinit(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	struct yamaha_mc1n2_audio_route_table *table = NULL;
+	int i;
+
+	if(pdata == NULL)
+		return;
+
+	table = &pdata->route_table;
+
+	if(table->entries != NULL) {
+		for(i=0 ; i < table->entries_count ; i++) {
+			if(table->entries[i] != NULL)
+				free(table->entries[i]);
+		}
+
+		free(table->entries);
+	}
+
+	if(table->routes_slots != NULL)
+		free(table->routes_slots);
+
+	memset(table, 0, sizeof(struct yamaha_mc1n2_audio_route_table));
+}
+
+void yamaha_mc1n2_audio_routes_update(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	if(pdata == NULL)
+		return;
+
+	pdata->output_route = yamaha_mc1n2_audio_params_route_find(pdata,
+		pdata->output_device, YAMAHA_MC1N2_AUDIO_DIRECTION_OUTPUT);
+	pdata->input_route = yamaha_mc1n2_audio_params_route_find(pdata,
+		pdata->input_device, YAMAHA_MC1N2_AUDIO_DIRECTION_INPUT);
+	pdata->modem_route = yamaha_mc1n2_audio_params_route_find(pdata,
+		pdata->output_device, YAMAHA_MC1N2_AUDIO_DIRECTION_MODEM);
+}
+
+int yamaha_mc1n2_audio_route_slot(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_params_route *params_route, int state)
+{
+	if(!state || params_route == NULL)
+		return 0;
+
+	return pdata->route_table.routes_slots[params_route - pdata->ops->params.routes];
+}
+
+struct yamaha_mc1n2_audio_params_route *
+	yamaha_mc1n2_audio_route_table_get(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	struct yamaha_mc1n2_audio_route_table *table = NULL;
+	struct yamaha_mc1n2_audio_params_route *params = NULL;
+	int output_slot, input_slot, modem_slot;
+	int key;
+	int rc;
+
+	if(pdata == NULL || pdata->ops == NULL)
+		return NULL;
+
+	table = &pdata->route_table;
+	if(table->entries == NULL || table->routes_slots == NULL)
+		return NULL;
+
+	output_slot = yamaha_mc1n2_audio_route_slot(pdata, pdata->output_route,
+		pdata->output_state);
+	input_slot = yamaha_mc1n2_audio_route_slot(pdata, pdata->input_route,
+		pdata->input_state);
+	modem_slot = yamaha_mc1n2_audio_route_slot(pdata, pdata->modem_route,
+		pdata->modem_state);
+
+	key = output_slot + table->slots_count[YAMAHA_MC1N2_AUDIO_DIRECTION_OUTPUT] *
+		(input_slot + table->slots_count[YAMAHA_MC1N2_AUDIO_DIRECTION_INPUT] * modem_slot);
+	if(key < 0 || key >= table->entries_count)
+		return NULL;
+
+	if(table->entries[key] != NULL) {
+		table->hits++;
+		return table->entries[key];
+	}
+
+	params = calloc(1, sizeof(struct yamaha_mc1n2_audio_params_route));
+	if(params == NULL)
+		return NULL;
+
+	rc = yamaha_mc1n2_audio_route_build(pdata, params);
+	if(rc < 0) {
+		free(params);
+		return NULL;
+	}
+
+	table->entries[key] = params;
+	table->misses++;
+
+	return params;
+}
+
 /*
  * Routines
  */
 
-int yamaha_mc1n2_audio_init(struct yamaha_mc1n2_audio_pdata *pdata)
+int yamaha_mc1n2_audio_init_apply(struct yamaha_mc1n2_audio_pdata *pdata)
 {
 	struct yamaha_mc1n2_audio_params_init *params = NULL;
 	int rc = -1;
@@ -124,8 +702,10 @@ int yamaha_mc1n2_audio_init(struct yamaha_mc1n2_audio_pdata *pdata)
 	if(params == NULL)
 		return -1;
 
-	rc = yamaha_mc1n2_audio_ioctl_set_ctrl(pdata, MCDRV_SET_DAC,
-		&params->dac_info, 0x07);
+	// The codec is reset to the init params, everything has to be sent again
+	yamaha_mc1n2_audio_shadow_reset(pdata);
+
+	rc = yamaha_mc1n2_audio_shadow_set_dac(pdata, &params->dac_info);
 	if(rc < 0) {
 		ALOGE("SET_DAC IOCTL failed, aborting!");
 		return -1;
@@ -169,6 +749,21 @@ int yamaha_mc1n2_audio_init(struct yamaha_mc1n2_audio_pdata *pdata)
 	return 0;
 }
 
+int yamaha_mc1n2_audio_init(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	int rc;
+
+	if(pdata == NULL)
+		return -1;
+
+	// The worker may be configuring the codec at the same time
+	pthread_mutex_lock(&pdata->worker.codec_mutex);
+	rc = yamaha_mc1n2_audio_init_apply(pdata);
+	pthread_mutex_unlock(&pdata->worker.codec_mutex);
+
+	return rc;
+}
+
 struct yamaha_mc1n2_audio_params_route *
 	yamaha_mc1n2_audio_params_route_find(struct yamaha_mc1n2_audio_pdata *pdata,
 	audio_devices_t device, enum yamaha_mc1n2_audio_direction direction)
@@ -317,294 +912,950 @@ int yamaha_mc1n2_audio_params_route_merge(
 	yamaha_mc1n2_audio_params_route_path_array_merge(sizeof(params_src->path_info.asBias[0].abSrcOnOff),
 		params_src->path_info.asBias[0].abSrcOnOff, params_dst->path_info.asBias[0].abSrcOnOff);
 
-	// dac_info
-	yamaha_mc1n2_audio_params_route_simple_array_merge(sizeof(params_src->dac_info.bMasterSwap),
-		&params_src->dac_info.bMasterSwap, &params_dst->dac_info.bMasterSwap);
-	yamaha_mc1n2_audio_params_route_simple_array_merge(sizeof(params_src->dac_info.bVoiceSwap),
-		&params_src->dac_info.bVoiceSwap, &params_dst->dac_info.bVoiceSwap);
-	yamaha_mc1n2_audio_params_route_simple_array_merge(sizeof(params_src->dac_info.bDcCut),
-		&params_src->dac_info.bDcCut, &params_dst->dac_info.bDcCut);
+	// dac_info
+	yamaha_mc1n2_audio_params_route_simple_array_merge(sizeof(params_src->dac_info.bMasterSwap),
+		&params_src->dac_info.bMasterSwap, &params_dst->dac_info.bMasterSwap);
+	yamaha_mc1n2_audio_params_route_simple_array_merge(sizeof(params_src->dac_info.bVoiceSwap),
+		&params_src->dac_info.bVoiceSwap, &params_dst->dac_info.bVoiceSwap);
+	yamaha_mc1n2_audio_params_route_simple_array_merge(sizeof(params_src->dac_info.bDcCut),
+		&params_src->dac_info.bDcCut, &params_dst->dac_info.bDcCut);
+
+	return 0;
+}
+
+int yamaha_mc1n2_audio_route_build(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_params_route *params)
+{
+	struct yamaha_mc1n2_audio_params_route *params_route = NULL;
+	struct yamaha_mc1n2_audio_params_init *params_init = NULL;
+	struct yamaha_mc1n2_audio_params_route params_dst;
+
+	if(pdata == NULL || pdata->ops == NULL || params == NULL)
+		return -1;
+
+	params_init = pdata->ops->params.init;
+	if(params_init == NULL)
+		return -1;
+
+	// Copy the init params
+	memcpy(&params->ae_info, &params_init->ae_info, sizeof(params->ae_info));
+	memcpy(&params->path_info, &params_init->path_info, sizeof(params->path_info));
+	memcpy(&params->dac_info, &params_init->dac_info, sizeof(params->dac_info));
+
+	params_route = pdata->output_route;
+	if(pdata->output_state && params_route != NULL) {
+		memcpy(&params_dst, params_route, sizeof(params_dst));
+		yamaha_mc1n2_audio_params_route_merge(params, &params_dst);
+		memcpy(params, &params_dst, sizeof(params_dst));
+	}
+
+	params_route = pdata->input_route;
+	if(pdata->input_state && params_route != NULL) {
+		memcpy(&params_dst, params_route, sizeof(params_dst));
+		yamaha_mc1n2_audio_params_route_merge(params, &params_dst);
+		memcpy(params, &params_dst, sizeof(params_dst));
+	}
+
+	params_route = pdata->modem_route;
+	if(pdata->modem_state && params_route != NULL) {
+		memcpy(&params_dst, params_route, sizeof(params_dst));
+		yamaha_mc1n2_audio_params_route_merge(params, &params_dst);
+		memcpy(params, &params_dst, sizeof(params_dst));
+	}
+
+	return 0;
+}
+
+void yamaha_mc1n2_audio_mic_mute_path(MCDRV_PATH_INFO *path_info)
+{
+	MCDRV_CHANNEL *channels = NULL;
+	UINT8 sources;
+	int count;
+	int i;
+
+	if(path_info == NULL)
+		return;
+
+	// All the channels but the mic bias ones, left on for a quick unmute
+	channels = (MCDRV_CHANNEL *) path_info;
+	count = offsetof(MCDRV_PATH_INFO, asBias) / sizeof(MCDRV_CHANNEL);
+
+	for(i=0 ; i < count ; i++) {
+		sources = channels[i].abSrcOnOff[MCDRV_SRC_MIC1_BLOCK];
+
+		if(sources & MCDRV_SRC0_MIC1_ON)
+			sources = (sources & ~MCDRV_SRC0_MIC1_ON) | MCDRV_SRC0_MIC1_OFF;
+		if(sources & MCDRV_SRC0_MIC2_ON)
+			sources = (sources & ~MCDRV_SRC0_MIC2_ON) | MCDRV_SRC0_MIC2_OFF;
+		if(sources & MCDRV_SRC0_MIC3_ON)
+			sources = (sources & ~MCDRV_SRC0_MIC3_ON) | MCDRV_SRC0_MIC3_OFF;
+
+		channels[i].abSrcOnOff[MCDRV_SRC_MIC1_BLOCK] = sources;
+	}
+}
+
+int yamaha_mc1n2_audio_route_start(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	struct yamaha_mc1n2_audio_params_route *params = NULL;
+	struct yamaha_mc1n2_audio_params_route params_src;
+	MCDRV_PATH_INFO *path_info = NULL;
+	MCDRV_PATH_INFO path_info_muted;
+
+	int rc;
+
+	ALOGD("%s()", __func__);
+
+	if(pdata == NULL || pdata->ops == NULL)
+		return -1;
+
+	params = yamaha_mc1n2_audio_route_table_get(pdata);
+	if(params == NULL) {
+		// Without the table, the route is merged every time
+		rc = yamaha_mc1n2_audio_route_build(pdata, &params_src);
+		if(rc < 0)
+			return -1;
+
+		params = &params_src;
+	}
+
+	path_info = &params->path_info;
+
+	// Muted mics are gated in a copy, memoized routes are left as merged
+	if(pdata->mic_mute) {
+		memcpy(&path_info_muted, path_info, sizeof(MCDRV_PATH_INFO));
+		yamaha_mc1n2_audio_mic_mute_path(&path_info_muted);
+		path_info = &path_info_muted;
+	}
+
+	// Blocks already applied to the codec are not sent again
+	rc = yamaha_mc1n2_audio_shadow_set_ae(pdata, &params->ae_info);
+	if(rc < 0) {
+		ALOGE("SET_AUDIOENGINE IOCTL failed, aborting!");
+		return -1;
+	}
+
+	rc = yamaha_mc1n2_audio_shadow_set_path(pdata, path_info);
+	if(rc < 0) {
+		ALOGE("SET_PATH IOCTL failed, aborting!");
+		return -1;
+	}
+
+	rc = yamaha_mc1n2_audio_shadow_set_dac(pdata, &params->dac_info);
+	if(rc < 0) {
+		ALOGE("SET_DAC IOCTL failed, aborting!");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Requests are posted to the worker without waiting for the codec: the
+ * returned generation can be passed to yamaha_mc1n2_audio_request_wait by
+ * the callers that need the codec configured. Without the worker, requests
+ * are applied right away and 0 is returned.
+ */
+
+int yamaha_mc1n2_audio_request(struct yamaha_mc1n2_audio_pdata *pdata,
+	enum yamaha_mc1n2_audio_request request, audio_devices_t device)
+{
+	int rc;
+
+	if(pdata == NULL || pdata->ops == NULL)
+		return -1;
+
+	if(pdata->worker.running) {
+		rc = yamaha_mc1n2_audio_request_post(pdata, request, device);
+		if(rc >= 0)
+			return rc;
+	}
+
+	return yamaha_mc1n2_audio_state_apply(pdata, request, device);
+}
+
+int yamaha_mc1n2_audio_output_start(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	ALOGD("%s()", __func__);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_START, 0);
+}
+
+int yamaha_mc1n2_audio_output_stop(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	ALOGD("%s()", __func__);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_STOP, 0);
+}
+
+int yamaha_mc1n2_audio_input_start(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	ALOGD("%s()", __func__);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_INPUT_START, 0);
+}
+
+int yamaha_mc1n2_audio_input_stop(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	ALOGD("%s()", __func__);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_INPUT_STOP, 0);
+}
+
+int yamaha_mc1n2_audio_modem_start(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	ALOGD("%s()", __func__);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_MODEM_START, 0);
+}
+
+int yamaha_mc1n2_audio_modem_stop(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	ALOGD("%s()", __func__);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_MODEM_STOP, 0);
+}
+
+int yamaha_mc1n2_audio_output_warm_start(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	ALOGD("%s()", __func__);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_WARM_START, 0);
+}
+
+int yamaha_mc1n2_audio_output_warm_stop(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	ALOGD("%s()", __func__);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_WARM_STOP, 0);
+}
+
+/*
+ * Values configuration
+ */
+
+int yamaha_mc1n2_audio_set_route(struct yamaha_mc1n2_audio_pdata *pdata,
+	audio_devices_t device)
+{
+	ALOGD("%s(%x)", __func__, device);
+
+	return yamaha_mc1n2_audio_request(pdata, YAMAHA_MC1N2_AUDIO_REQUEST_SET_ROUTE, device);
+}
+
+int yamaha_mc1n2_audio_set_mic_mute(struct yamaha_mc1n2_audio_pdata *pdata,
+	int mute)
+{
+	ALOGD("%s(%d)", __func__, mute);
+
+	// Only the path block changes, the other blocks are kept by the shadow
+	return yamaha_mc1n2_audio_request(pdata, mute ? YAMAHA_MC1N2_AUDIO_REQUEST_MIC_MUTE :
+		YAMAHA_MC1N2_AUDIO_REQUEST_MIC_UNMUTE, 0);
+}
+
+char *yamaha_mc1n2_audio_get_hw_node(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	if(pdata == NULL)
+		return NULL;
+
+	return pdata->ops->hw_node;
+}
+
+int yamaha_mc1n2_audio_set_standby_delay(struct yamaha_mc1n2_audio_pdata *pdata,
+	int delay)
+{
+	ALOGD("%s(%d)", __func__, delay);
+
+	if(pdata == NULL || pdata->ops == NULL || delay < 0)
+		return -1;
+
+	pdata->ops->standby_delay = delay;
+
+	if(!pdata->worker.running)
+		return 0;
+
+	// Paths already held keep their current deadline
+	pthread_mutex_lock(&pdata->worker.mutex);
+	pdata->worker.standby.delay = delay;
+	pthread_mutex_unlock(&pdata->worker.mutex);
 
 	return 0;
 }
 
-int yamaha_mc1n2_audio_route_start(struct yamaha_mc1n2_audio_pdata *pdata)
+struct yamaha_mc1n2_audio_pcm_config *yamaha_mc1n2_audio_get_output_config(
+	struct yamaha_mc1n2_audio_pdata *pdata, enum yamaha_mc1n2_audio_output_profile profile)
 {
-	struct yamaha_mc1n2_audio_params_route *params_route = NULL;
-	struct yamaha_mc1n2_audio_params_init *params_init = NULL;
-	struct yamaha_mc1n2_audio_params_route *params = NULL;
-	struct yamaha_mc1n2_audio_params_route params_src;
-	struct yamaha_mc1n2_audio_params_route params_dst;
+	struct yamaha_mc1n2_audio_pcm_config *config = NULL;
 
-	int rc;
+	if(pdata == NULL || pdata->ops == NULL)
+		return NULL;
 
-	ALOGD("%s()", __func__);
+	if(profile < 0 || profile >= YAMAHA_MC1N2_AUDIO_OUTPUT_PROFILE_MAX)
+		return NULL;
 
-	if(pdata == NULL || pdata->ops == NULL)
-		return -1;
+	config = &pdata->ops->output_configs[profile];
 
-	params_init = pdata->ops->params.init;
-	if(params_init == NULL)
-		return -1;
+	// Platforms without a fast profile only have the deep buffer one
+	if(config->period_size <= 0 || config->period_count <= 0)
+		return NULL;
 
-	// Copy the init params
-	memcpy(&params_src.ae_info, &params_init->ae_info, sizeof(params_src.ae_info));
-	memcpy(&params_src.path_info, &params_init->path_info, sizeof(params_src.path_info));
-	memcpy(&params_src.dac_info, &params_init->dac_info, sizeof(params_src.dac_info));
+	return config;
+}
+
+/*
+ * State
+ */
 
-output_merge:
-	if(pdata->output_state) {
-		params_route = yamaha_mc1n2_audio_params_route_find(pdata,
-			pdata->output_device, YAMAHA_MC1N2_AUDIO_DIRECTION_OUTPUT);
-		if(params_route == NULL)
-			goto input_merge;
+int yamaha_mc1n2_audio_state_generation_before(unsigned int a, unsigned int b)
+{
+	// Wraps along with the generation bits of the state word
+	return (int32_t) ((a - b) << YAMAHA_MC1N2_AUDIO_STATE_GENERATION_SHIFT) < 0;
+}
 
-		memcpy(&params_dst, params_route, sizeof(params_dst));
-		yamaha_mc1n2_audio_params_route_merge(&params_src, &params_dst);
-		memcpy(&params_src, &params_dst, sizeof(params_src));
-	}
+uint32_t yamaha_mc1n2_audio_state_load(volatile uint32_t *value)
+{
+	// Atomic read with a full barrier, the value may be changed concurrently
+	return __sync_fetch_and_or(value, 0);
+}
 
-input_merge:
-	if(pdata->input_state) {
-		params_route = yamaha_mc1n2_audio_params_route_find(pdata,
-			pdata->input_device, YAMAHA_MC1N2_AUDIO_DIRECTION_INPUT);
-		if(params_route == NULL)
-			goto modem_merge;
+unsigned int yamaha_mc1n2_audio_state_generation(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	return yamaha_mc1n2_audio_state_load(&pdata->state_word) >>
+		YAMAHA_MC1N2_AUDIO_STATE_GENERATION_SHIFT;
+}
 
-		memcpy(&params_dst, params_route, sizeof(params_dst));
-		yamaha_mc1n2_audio_params_route_merge(&params_src, &params_dst);
-		memcpy(&params_src, &params_dst, sizeof(params_src));
-	}
+uint32_t yamaha_mc1n2_audio_state_update(struct yamaha_mc1n2_audio_pdata *pdata,
+	uint32_t set, uint32_t clear, uint32_t *previous)
+{
+	uint32_t generation;
+	uint32_t word;
+	uint32_t update;
 
-modem_merge:
-	if(pdata->modem_state) {
-		params_route = yamaha_mc1n2_audio_params_route_find(pdata,
-			pdata->output_device, YAMAHA_MC1N2_AUDIO_DIRECTION_MODEM);
-		if(params_route == NULL)
-			goto route_start;
+	do {
+		word = yamaha_mc1n2_audio_state_load(&pdata->state_word);
 
-		memcpy(&params_dst, params_route, sizeof(params_dst));
-		yamaha_mc1n2_audio_params_route_merge(&params_src, &params_dst);
-		memcpy(&params_src, &params_dst, sizeof(params_src));
-	}
+		// Generation 0 is left for the state as it was at start
+		generation = ((word >> YAMAHA_MC1N2_AUDIO_STATE_GENERATION_SHIFT) + 1) &
+			YAMAHA_MC1N2_AUDIO_STATE_GENERATION_MASK;
+		if(generation == 0)
+			generation = 1;
 
-route_start:
-	params = &(params_src);
+		update = (((word & ~clear) | set) & YAMAHA_MC1N2_AUDIO_STATE_FLAGS) |
+			(generation << YAMAHA_MC1N2_AUDIO_STATE_GENERATION_SHIFT);
+	} while(__sync_val_compare_and_swap(&pdata->state_word, word, update) != word);
 
-	rc = yamaha_mc1n2_audio_ioctl_set_ctrl(pdata, MCDRV_SET_AUDIOENGINE,
-		&params->ae_info, 0x0f);
-	if(rc < 0) {
-		ALOGE("SET_AUDIOENGINE IOCTL failed, aborting!");
-		return -1;
-	}
+	if(previous != NULL)
+		*previous = word;
 
-	rc = yamaha_mc1n2_audio_ioctl_set_ctrl(pdata, MCDRV_SET_PATH,
-		&params->path_info, 0x00);
-	if(rc < 0) {
-		ALOGE("SET_PATH IOCTL failed, aborting!");
-		return -1;
-	}
+	return update;
+}
 
-	rc = yamaha_mc1n2_audio_ioctl_set_ctrl(pdata, MCDRV_SET_DAC,
-		&params->dac_info, 0x07);
-	if(rc < 0) {
-		ALOGE("SET_DAC IOCTL failed, aborting!");
+int yamaha_mc1n2_audio_state_set_device(struct yamaha_mc1n2_audio_pdata *pdata,
+	audio_devices_t device)
+{
+	// Only taken into account with the next generation
+	if(audio_is_output_device(device))
+		__sync_lock_test_and_set(&pdata->state_output_device, device);
+	else if(audio_is_input_device(device))
+		__sync_lock_test_and_set(&pdata->state_input_device, device);
+	else
 		return -1;
-	}
 
 	return 0;
 }
 
-int yamaha_mc1n2_audio_output_start(struct yamaha_mc1n2_audio_pdata *pdata)
+void yamaha_mc1n2_audio_state_reset(struct yamaha_mc1n2_audio_pdata *pdata)
 {
-	int rc;
-
-	ALOGD("%s()", __func__);
+	uint32_t word = 0;
 
-	if(pdata == NULL || pdata->ops == NULL)
-		return -1;
+	if(pdata == NULL)
+		return;
+
+	// The wanted state starts as the applied one
+	if(pdata->output_state)
+		word |= YAMAHA_MC1N2_AUDIO_STATE_OUTPUT;
+	if(pdata->input_state)
+		word |= YAMAHA_MC1N2_AUDIO_STATE_INPUT;
+	if(pdata->modem_state)
+		word |= YAMAHA_MC1N2_AUDIO_STATE_MODEM;
+	if(pdata->mic_mute)
+		word |= YAMAHA_MC1N2_AUDIO_STATE_MIC_MUTE;
+
+	pdata->state_output_device = pdata->output_device;
+	pdata->state_input_device = pdata->input_device;
+	pdata->state_word = word;
+	pdata->generation = 0;
+
+	__sync_synchronize();
+}
 
-	pdata->output_state = 1;
+void yamaha_mc1n2_audio_state_snapshot(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_state *state)
+{
+	uint32_t word;
+
+	if(pdata == NULL || state == NULL)
+		return;
+
+	// Devices are set before the generation they belong to is published
+	do {
+		word = yamaha_mc1n2_audio_state_load(&pdata->state_word);
+		state->output_device = yamaha_mc1n2_audio_state_load(&pdata->state_output_device);
+		state->input_device = yamaha_mc1n2_audio_state_load(&pdata->state_input_device);
+	} while(yamaha_mc1n2_audio_state_load(&pdata->state_word) != word);
+
+	state->output_state = !!(word & YAMAHA_MC1N2_AUDIO_STATE_OUTPUT);
+	state->input_state = !!(word & YAMAHA_MC1N2_AUDIO_STATE_INPUT);
+	state->modem_state = !!(word & YAMAHA_MC1N2_AUDIO_STATE_MODEM);
+	state->output_warm = !!(word & YAMAHA_MC1N2_AUDIO_STATE_OUTPUT_WARM);
+	state->mic_mute = !!(word & YAMAHA_MC1N2_AUDIO_STATE_MIC_MUTE);
+	state->generation = word >> YAMAHA_MC1N2_AUDIO_STATE_GENERATION_SHIFT;
+}
 
-	rc = yamaha_mc1n2_audio_route_start(pdata);
-	if(rc < 0) {
-		ALOGE("Route start failed, aborting!");
+int yamaha_mc1n2_audio_state_request(enum yamaha_mc1n2_audio_request request,
+	uint32_t *set, uint32_t *clear)
+{
+	if(set == NULL || clear == NULL)
 		return -1;
-	}
 
-	rc = yamaha_mc1n2_audio_ioctl_notify(pdata, MCDRV_NOTIFY_MEDIA_PLAY_START);
-	if(rc < 0) {
-		ALOGE("NOTIFY_MEDIA_PLAY_START IOCTL failed, aborting!");
-		return -1;
+	*set = 0;
+	*clear = 0;
+
+	switch(request) {
+		case YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_START:
+			*set = YAMAHA_MC1N2_AUDIO_STATE_OUTPUT;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_STOP:
+			*clear = YAMAHA_MC1N2_AUDIO_STATE_OUTPUT;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_INPUT_START:
+			*set = YAMAHA_MC1N2_AUDIO_STATE_INPUT;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_INPUT_STOP:
+			*clear = YAMAHA_MC1N2_AUDIO_STATE_INPUT;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_MODEM_START:
+			*set = YAMAHA_MC1N2_AUDIO_STATE_MODEM;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_MODEM_STOP:
+			*clear = YAMAHA_MC1N2_AUDIO_STATE_MODEM;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_SET_ROUTE:
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_WARM_START:
+			*set = YAMAHA_MC1N2_AUDIO_STATE_OUTPUT_WARM;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_OUTPUT_WARM_STOP:
+			*clear = YAMAHA_MC1N2_AUDIO_STATE_OUTPUT_WARM;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_MIC_MUTE:
+			*set = YAMAHA_MC1N2_AUDIO_STATE_MIC_MUTE;
+			break;
+		case YAMAHA_MC1N2_AUDIO_REQUEST_MIC_UNMUTE:
+			*clear = YAMAHA_MC1N2_AUDIO_STATE_MIC_MUTE;
+			break;
+		default:
+			return -1;
 	}
 
 	return 0;
 }
 
-int yamaha_mc1n2_audio_output_stop(struct yamaha_mc1n2_audio_pdata *pdata)
+int yamaha_mc1n2_audio_state_apply(struct yamaha_mc1n2_audio_pdata *pdata,
+	enum yamaha_mc1n2_audio_request request, audio_devices_t device)
 {
-	int rc;
+	struct yamaha_mc1n2_audio_state state;
+	uint32_t set, clear;
+	int rc = 0;
 
-	ALOGD("%s()", __func__);
+	if(pdata == NULL)
+		return -1;
 
-	if(pdata == NULL || pdata->ops == NULL)
+	rc = yamaha_mc1n2_audio_state_request(request, &set, &clear);
+	if(rc < 0)
 		return -1;
 
-	pdata->output_state = 0;
+	if(request == YAMAHA_MC1N2_AUDIO_REQUEST_SET_ROUTE)
+		yamaha_mc1n2_audio_state_set_device(pdata, device);
 
-	rc = yamaha_mc1n2_audio_route_start(pdata);
-	if(rc < 0) {
-		ALOGE("Route start failed, aborting!");
+	yamaha_mc1n2_audio_state_update(pdata, set, clear, NULL);
+
+	pthread_mutex_lock(&pdata->worker.codec_mutex);
+
+	// Taken with the codec mutex held, nothing newer can be applied meanwhile
+	yamaha_mc1n2_audio_state_snapshot(pdata, &state);
+
+	// Another caller may have applied this generation along with its own
+	if(yamaha_mc1n2_audio_state_generation_before(pdata->generation, state.generation))
+		rc = yamaha_mc1n2_audio_worker_apply(pdata, &state);
+
+	pthread_mutex_unlock(&pdata->worker.codec_mutex);
+
+	return rc;
+}
+
+/*
+ * Worker
+ */
+
+int yamaha_mc1n2_audio_worker_apply(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_state *state)
+{
+	int output_changed, input_changed, modem_changed;
+	int devices_changed = 0;
+	int mute_changed;
+	int rc;
+
+	if(pdata == NULL || state == NULL)
 		return -1;
+
+	pdata->generation = state->generation;
+
+	// A warm output is configured as a started one, without the stream
+	if(state->output_warm)
+		state->output_state = 1;
+
+	if(pdata->output_device != state->output_device || pdata->input_device != state->input_device) {
+		pdata->output_device = state->output_device;
+		pdata->input_device = state->input_device;
+		yamaha_mc1n2_audio_routes_update(pdata);
+		devices_changed = 1;
 	}
 
-	rc = yamaha_mc1n2_audio_ioctl_notify(pdata, MCDRV_NOTIFY_MEDIA_PLAY_STOP);
-	if(rc < 0) {
-		ALOGE("NOTIFY_MEDIA_PLAY_STOP IOCTL failed, aborting!");
-		return -1;
+	output_changed = pdata->output_state != state->output_state;
+	input_changed = pdata->input_state != state->input_state;
+	modem_changed = pdata->modem_state != state->modem_state;
+	mute_changed = pdata->mic_mute != state->mic_mute;
+
+	pdata->output_state = state->output_state;
+	pdata->input_state = state->input_state;
+	pdata->modem_state = state->modem_state;
+	pdata->mic_mute = state->mic_mute;
+
+	// A mute change alone ends up in a single SET_PATH, thanks to the shadow
+	if(output_changed || input_changed || modem_changed ||
+		((devices_changed || mute_changed) &&
+		(pdata->output_state || pdata->input_state || pdata->modem_state))) {
+		rc = yamaha_mc1n2_audio_route_start(pdata);
+		if(rc < 0) {
+			ALOGE("Route start failed, aborting!");
+			return -1;
+		}
+	}
+
+	if(output_changed) {
+		rc = yamaha_mc1n2_audio_ioctl_notify(pdata, pdata->output_state ?
+			MCDRV_NOTIFY_MEDIA_PLAY_START : MCDRV_NOTIFY_MEDIA_PLAY_STOP);
+		if(rc < 0) {
+			ALOGE("NOTIFY_MEDIA_PLAY IOCTL failed, aborting!");
+			return -1;
+		}
+	}
+
+	if(input_changed) {
+		rc = yamaha_mc1n2_audio_ioctl_notify(pdata, pdata->input_state ?
+			MCDRV_NOTIFY_VOICE_REC_START : MCDRV_NOTIFY_VOICE_REC_STOP);
+		if(rc < 0) {
+			ALOGE("NOTIFY_VOICE_REC IOCTL failed, aborting!");
+			return -1;
+		}
+	}
+
+	if(modem_changed) {
+		rc = yamaha_mc1n2_audio_ioctl_notify(pdata, pdata->modem_state ?
+			MCDRV_NOTIFY_CALL_START : MCDRV_NOTIFY_CALL_STOP);
+		if(rc < 0) {
+			ALOGE("NOTIFY_CALL IOCTL failed, aborting!");
+			return -1;
+		}
 	}
 
 	return 0;
 }
 
-int yamaha_mc1n2_audio_input_start(struct yamaha_mc1n2_audio_pdata *pdata)
+int64_t yamaha_mc1n2_audio_worker_time(void)
 {
-	int rc;
+	struct timespec ts;
 
-	ALOGD("%s()", __func__);
+	// Realtime, as expected by pthread_cond_timedwait
+	clock_gettime(CLOCK_REALTIME, &ts);
 
-	if(pdata == NULL || pdata->ops == NULL)
-		return -1;
+	return (int64_t) ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
 
-	pdata->input_state = 1;
+void yamaha_mc1n2_audio_worker_standby(struct yamaha_mc1n2_audio_pdata *pdata,
+	struct yamaha_mc1n2_audio_state *state, int64_t time)
+{
+	struct yamaha_mc1n2_audio_standby *standby = NULL;
+	int64_t delay;
 
-	rc = yamaha_mc1n2_audio_route_start(pdata);
-	if(rc < 0) {
-		ALOGE("Route start failed, aborting!");
-		return -1;
-	}
+	if(pdata == NULL || state == NULL)
+		return;
 
-	rc = yamaha_mc1n2_audio_ioctl_notify(pdata, MCDRV_NOTIFY_VOICE_REC_START);
-	if(rc < 0) {
-		ALOGE("NOTIFY_VOICE_REC_START IOCTL failed, aborting!");
-		return -1;
+	standby = &pdata->worker.standby;
+	standby->deadline = 0;
+	standby->output_held = 0;
+	standby->input_held = 0;
+
+	// Everything is stopped right away when the worker stops
+	if(!pdata->worker.running || standby->delay <= 0)
+		return;
+
+	delay = (int64_t) standby->delay * 1000LL;
+
+	// Only paths that are still powered are held, a warm output needs not be
+	if(!state->output_state && !state->output_warm && pdata->output_state && time < standby->output_stop_time + delay) {
+		state->output_state = 1;
+		standby->output_held = 1;
+		standby->deadline = standby->output_stop_time + delay;
 	}
 
-	return 0;
+	if(!state->input_state && pdata->input_state && time < standby->input_stop_time + delay) {
+		state->input_state = 1;
+		standby->input_held = 1;
+		if(standby->deadline == 0 || standby->input_stop_time + delay < standby->deadline)
+			standby->deadline = standby->input_stop_time + delay;
+	}
 }
 
-int yamaha_mc1n2_audio_input_stop(struct yamaha_mc1n2_audio_pdata *pdata)
+void *yamaha_mc1n2_audio_worker_thread(void *data)
 {
+	struct yamaha_mc1n2_audio_pdata *pdata = NULL;
+	struct yamaha_mc1n2_audio_worker *worker = NULL;
+	struct yamaha_mc1n2_audio_standby *standby = NULL;
+	struct yamaha_mc1n2_audio_state state;
+	struct timespec ts;
+	unsigned int generation;
+	int64_t time;
+	int cold;
 	int rc;
 
-	ALOGD("%s()", __func__);
+	pdata = (struct yamaha_mc1n2_audio_pdata *) data;
+	if(pdata == NULL)
+		return NULL;
 
-	if(pdata == NULL || pdata->ops == NULL)
-		return -1;
+	worker = &pdata->worker;
+	standby = &worker->standby;
 
-	pdata->input_state = 0;
+	pthread_mutex_lock(&worker->mutex);
 
-	rc = yamaha_mc1n2_audio_route_start(pdata);
-	if(rc < 0) {
-		ALOGE("Route start failed, aborting!");
-		return -1;
-	}
+	while(1) {
+		generation = yamaha_mc1n2_audio_state_generation(pdata);
 
-	rc = yamaha_mc1n2_audio_ioctl_notify(pdata, MCDRV_NOTIFY_VOICE_REC_STOP);
-	if(rc < 0) {
-		ALOGE("NOTIFY_VOICE_REC_START IOCTL failed, aborting!");
-		return -1;
+		// Pending requests are still applied when stopping
+		if(worker->complete_generation == generation) {
+			if(standby->deadline == 0) {
+				if(!worker->running)
+					break;
+
+				pthread_cond_wait(&worker->request_cond, &worker->mutex);
+				continue;
+			}
+
+			// Held paths are stopped once their standby delay is over
+			time = yamaha_mc1n2_audio_worker_time();
+			if(worker->running && time < standby->deadline) {
+				ts.tv_sec = standby->deadline / 1000000LL;
+				ts.tv_nsec = (standby->deadline % 1000000LL) * 1000;
+
+				pthread_cond_timedwait(&worker->request_cond, &worker->mutex, &ts);
+				continue;
+			}
+		}
+
+		yamaha_mc1n2_audio_state_snapshot(pdata, &state);
+
+		yamaha_mc1n2_audio_worker_standby(pdata, &state, yamaha_mc1n2_audio_worker_time());
+
+		cold = (state.output_state && !pdata->output_state) ||
+			(state.input_state && !pdata->input_state);
+
+		pthread_mutex_unlock(&worker->mutex);
+
+		pthread_mutex_lock(&worker->codec_mutex);
+
+		// Requests posted meanwhile make the snapshot stale, a new one is taken
+		generation = yamaha_mc1n2_audio_state_generation(pdata);
+		if(yamaha_mc1n2_audio_state_generation_before(state.generation, generation)) {
+			pthread_mutex_unlock(&worker->codec_mutex);
+
+			pthread_mutex_lock(&worker->mutex);
+			worker->dropped++;
+			continue;
+		}
+
+		time = yamaha_mc1n2_audio_worker_time();
+		rc = yamaha_mc1n2_audio_worker_apply(pdata, &state);
+		time = yamaha_mc1n2_audio_worker_time() - time;
+		pthread_mutex_unlock(&worker->codec_mutex);
+
+		pthread_mutex_lock(&worker->mutex);
+
+		if(rc < 0) {
+			worker->failed_generation_start = worker->complete_generation + 1;
+			worker->failed_generation_end = state.generation;
+		} else if(cold && time >= 0) {
+			standby->cold_starts++;
+			standby->cold_starts_duration += time;
+		}
+
+		worker->complete_generation = state.generation;
+		worker->passes++;
+
+		pthread_cond_broadcast(&worker->complete_cond);
 	}
 
-	return 0;
+	pthread_mutex_unlock(&worker->mutex);
+
+	return NULL;
 }
 
-int yamaha_mc1n2_audio_modem_start(struct yamaha_mc1n2_audio_pdata *pdata)
+int yamaha_mc1n2_audio_worker_start(struct yamaha_mc1n2_audio_pdata *pdata)
 {
+	struct yamaha_mc1n2_audio_worker *worker = NULL;
 	int rc;
 
-	ALOGD("%s()", __func__);
-
-	if(pdata == NULL || pdata->ops == NULL)
+	if(pdata == NULL)
 		return -1;
 
-	pdata->modem_state = 1;
+	worker = &pdata->worker;
+	if(worker->running)
+		return 0;
 
-	rc = yamaha_mc1n2_audio_route_start(pdata);
-	if(rc < 0) {
-		ALOGE("Route start failed, aborting!");
-		return -1;
-	}
+	worker->complete_generation = yamaha_mc1n2_audio_state_generation(pdata);
+	worker->failed_generation_start = 0;
+	worker->failed_generation_end = 0;
+	worker->requests = 0;
+	worker->passes = 0;
+	worker->dropped = 0;
 
-	rc = yamaha_mc1n2_audio_ioctl_notify(pdata, MCDRV_NOTIFY_CALL_START);
-	if(rc < 0) {
-		ALOGE("NOTIFY_CALL_START IOCTL failed, aborting!");
+	memset(&worker->standby, 0, sizeof(struct yamaha_mc1n2_audio_standby));
+	worker->standby.delay = pdata->ops != NULL ? pdata->ops->standby_delay : 0;
+
+	pthread_mutex_init(&worker->mutex, NULL);
+	pthread_cond_init(&worker->request_cond, NULL);
+	pthread_cond_init(&worker->complete_cond, NULL);
+
+	worker->running = 1;
+
+	rc = pthread_create(&worker->thread, NULL, yamaha_mc1n2_audio_worker_thread, pdata);
+	if(rc != 0) {
+		ALOGE("%s: error, unable to create worker thread!", __func__);
+		worker->running = 0;
+
+		pthread_cond_destroy(&worker->complete_cond);
+		pthread_cond_destroy(&worker->request_cond);
+		pthread_mutex_destroy(&worker->mutex);
 		return -1;
 	}
 
 	return 0;
 }
 
-int yamaha_mc1n2_audio_modem_stop(struct yamaha_mc1n2_audio_pdata *pdata)
+void yamaha_mc1n2_audio_worker_stop(struct yamaha_mc1n2_audio_pdata *pdata)
+{
+	struct yamaha_mc1n2_audio_worker *worker = NULL;
+
+	if(pdata == NULL)
+		return;
+
+	worker = &pdata->worker;
+	if(!worker->running)
+		return;
+
+	pthread_mutex_lock(&worker->mutex);
+	worker->running = 0;
+	pthread_cond_signal(&worker->request_cond);
+	pthread_mutex_unlock(&worker->mutex);
+
+	pthread_join(worker->thread, NULL);
+
+	ALOGD("Worker: %d requests applied in %d passes, %d snapshots dropped",
+		worker->requests, worker->passes, worker->dropped);
+	ALOGD("Standby: %d warm starts, %d cold starts, %lld us saved",
+		worker->standby.warm_starts, worker->standby.cold_starts,
+		worker->standby.cold_starts > 0 ? worker->standby.warm_starts *
+		worker->standby.cold_starts_duration / worker->standby.cold_starts : 0LL);
+
+	pthread_cond_destroy(&worker->complete_cond);
+	pthread_cond_destroy(&worker->request_cond);
+	pthread_mutex_destroy(&worker->mutex);
+}
+
+int yamaha_mc1n2_audio_request_post(struct yamaha_mc1n2_audio_pdata *pdata,
+	enum yamaha_mc1n2_audio_request request, audio_devices_t device)
 {
+	struct yamaha_mc1n2_audio_worker *worker = NULL;
+	struct yamaha_mc1n2_audio_standby *standby = NULL;
+	uint32_t set, clear;
+	uint32_t previous;
+	uint32_t word;
+	int64_t time;
 	int rc;
 
-	ALOGD("%s()", __func__);
+	if(pdata == NULL)
+		return -1;
 
-	if(pdata == NULL || pdata->ops == NULL)
+	rc = yamaha_mc1n2_audio_state_request(request, &set, &clear);
+	if(rc < 0)
 		return -1;
 
-	pdata->modem_state = 0;
+	worker = &pdata->worker;
+	standby = &worker->standby;
 
-	rc = yamaha_mc1n2_audio_route_start(pdata);
-	if(rc < 0) {
-		ALOGE("Route start failed, aborting!");
+	time = yamaha_mc1n2_audio_worker_time();
+
+	pthread_mutex_lock(&worker->mutex);
+
+	if(!worker->running) {
+		pthread_mutex_unlock(&worker->mutex);
 		return -1;
 	}
 
-	rc = yamaha_mc1n2_audio_ioctl_notify(pdata, MCDRV_NOTIFY_CALL_STOP);
-	if(rc < 0) {
-		ALOGE("NOTIFY_CALL_START IOCTL failed, aborting!");
+	if(request == YAMAHA_MC1N2_AUDIO_REQUEST_SET_ROUTE)
+		yamaha_mc1n2_audio_state_set_device(pdata, device);
+
+	word = yamaha_mc1n2_audio_state_update(pdata, set, clear, &previous);
+
+	if((set & YAMAHA_MC1N2_AUDIO_STATE_OUTPUT) && !(previous & YAMAHA_MC1N2_AUDIO_STATE_OUTPUT) &&
+		(standby->output_held || (previous & YAMAHA_MC1N2_AUDIO_STATE_OUTPUT_WARM)))
+		standby->warm_starts++;
+	if((clear & YAMAHA_MC1N2_AUDIO_STATE_OUTPUT) && (previous & YAMAHA_MC1N2_AUDIO_STATE_OUTPUT))
+		standby->output_stop_time = time;
+
+	if((set & YAMAHA_MC1N2_AUDIO_STATE_INPUT) && !(previous & YAMAHA_MC1N2_AUDIO_STATE_INPUT) &&
+		standby->input_held)
+		standby->warm_starts++;
+	if((clear & YAMAHA_MC1N2_AUDIO_STATE_INPUT) && (previous & YAMAHA_MC1N2_AUDIO_STATE_INPUT))
+		standby->input_stop_time = time;
+
+	worker->requests++;
+
+	pthread_cond_signal(&worker->request_cond);
+	pthread_mutex_unlock(&worker->mutex);
+
+	return (int) (word >> YAMAHA_MC1N2_AUDIO_STATE_GENERATION_SHIFT);
+}
+
+int yamaha_mc1n2_audio_request_wait(struct yamaha_mc1n2_audio_pdata *pdata,
+	int generation)
+{
+	struct yamaha_mc1n2_audio_worker *worker = NULL;
+	int rc = 0;
+
+	if(pdata == NULL || generation < 0)
 		return -1;
-	}
 
-	return 0;
+	// Applied synchronously, without the worker
+	if(generation == 0)
+		return 0;
+
+	worker = &pdata->worker;
+
+	pthread_mutex_lock(&worker->mutex);
+
+	while(yamaha_mc1n2_audio_state_generation_before(worker->complete_generation, generation))
+		pthread_cond_wait(&worker->complete_cond, &worker->mutex);
+
+	// Only the last failed pass is remembered
+	if(!yamaha_mc1n2_audio_state_generation_before(generation, worker->failed_generation_start) &&
+		!yamaha_mc1n2_audio_state_generation_before(worker->failed_generation_end, generation))
+		rc = -1;
+
+	pthread_mutex_unlock(&worker->mutex);
+
+	return rc;
 }
 
 /*
- * Values configuration
+ * Dump
  */
 
-int yamaha_mc1n2_audio_set_route(struct yamaha_mc1n2_audio_pdata *pdata,
-	audio_devices_t device)
+void yamaha_mc1n2_audio_dump_printf(int fd, const char *format, ...)
 {
-	int changed = 0;
-
-	ALOGD("%s(%x)", __func__, device);
+	char buffer[256];
+	va_list ap;
+	int length;
 
-	if(pdata == NULL)
-		return -1;
+	va_start(ap, format);
+	length = vsnprintf(buffer, sizeof(buffer), format, ap);
+	va_end(ap);
 
-	if(audio_is_output_device(device) && pdata->output_device != device) {
-		pdata->output_device = device;
-		changed = 1;
-	} else if(audio_is_input_device(device) && pdata->input_device != device) {
-		pdata->input_device = device;
-		changed = 1;
-	}
+	if(length <= 0)
+		return;
 
-	if(changed && (pdata->output_state || pdata->input_state || pdata->modem_state))
-		return yamaha_mc1n2_audio_route_start(pdata);
+	if(length >= (int) sizeof(buffer))
+		length = sizeof(buffer) - 1;
 
-	return 0;
+	write(fd, buffer, length);
 }
 
-char *yamaha_mc1n2_audio_get_hw_node(struct yamaha_mc1n2_audio_pdata *pdata)
+int yamaha_mc1n2_audio_dump(struct yamaha_mc1n2_audio_pdata *pdata, int fd)
 {
-	if(pdata == NULL)
-		return NULL;
+	struct yamaha_mc1n2_audio_shadow *shadow = NULL;
+	struct yamaha_mc1n2_audio_standby *standby = NULL;
+	struct yamaha_mc1n2_audio_state state;
+	int locked = 0;
 
-	return pdata->ops->hw_node;
+	if(pdata == NULL || pdata->ops == NULL || fd < 0)
+		return -1;
+
+	shadow = &pdata->shadow;
+	standby = &pdata->worker.standby;
+
+	yamaha_mc1n2_audio_dump_printf(fd, "Yamaha MC1N2 audio (%s):\n", pdata->name);
+
+	// Never wait on a stuck codec from a dump
+	locked = pthread_mutex_trylock(&pdata->worker.codec_mutex) == 0;
+	if(!locked)
+		yamaha_mc1n2_audio_dump_printf(fd, "  Codec is being configured, state may be inconsistent\n");
+
+	yamaha_mc1n2_audio_state_snapshot(pdata, &state);
+
+	yamaha_mc1n2_audio_dump_printf(fd, "  Wanted: output 0x%x %s%s, input 0x%x %s, modem %s, "
+		"mic %s, generation %u (applied %u)\n", state.output_device,
+		state.output_state ? "started" : "stopped", state.output_warm ? " (warm)" : "",
+		state.input_device, state.input_state ? "started" : "stopped",
+		state.modem_state ? "started" : "stopped", state.mic_mute ? "muted" : "on",
+		state.generation, pdata->generation);
+
+	yamaha_mc1n2_audio_dump_printf(fd, "  Output: device 0x%x, %s, route %s\n",
+		pdata->output_device, pdata->output_state ? "started" : "stopped",
+		pdata->output_route != NULL ? "found" : "none");
+	yamaha_mc1n2_audio_dump_printf(fd, "  Input: device 0x%x, %s, route %s\n",
+		pdata->input_device, pdata->input_state ? "started" : "stopped",
+		pdata->input_route != NULL ? "found" : "none");
+	yamaha_mc1n2_audio_dump_printf(fd, "  Modem: %s, route %s\n",
+		pdata->modem_state ? "started" : "stopped",
+		pdata->modem_route != NULL ? "found" : "none");
+
+	yamaha_mc1n2_audio_dump_printf(fd, "  Route table: %d combinations, %d hits, %d misses\n",
+		pdata->route_table.entries_count, pdata->route_table.hits,
+		pdata->route_table.misses);
+
+	yamaha_mc1n2_audio_dump_printf(fd, "  Shadow: %d control blocks sent, %d avoided\n",
+		shadow->sent, shadow->avoided);
+	if(shadow->ae_valid)
+		yamaha_mc1n2_audio_dump_printf(fd, "    AE: on/off 0x%02x\n", shadow->ae_info.bOnOff);
+	if(shadow->path_valid)
+		yamaha_mc1n2_audio_dump_printf(fd, "    PATH: applied\n");
+	if(shadow->dac_valid)
+		yamaha_mc1n2_audio_dump_printf(fd, "    DAC: master swap %d, voice swap %d, DC cut %d\n",
+			shadow->dac_info.bMasterSwap, shadow->dac_info.bVoiceSwap,
+			shadow->dac_info.bDcCut);
+
+	if(pdata->worker.running)
+		yamaha_mc1n2_audio_dump_printf(fd, "  Worker: %d requests in %d passes, %d dropped, "
+			"standby %d ms, %d warm starts, %d cold starts\n", pdata->worker.requests,
+			pdata->worker.passes, pdata->worker.dropped, standby->delay,
+			standby->warm_starts, standby->cold_starts);
+	else
+		yamaha_mc1n2_audio_dump_printf(fd, "  Worker: stopped\n");
+
+	yamaha_mc1n2_audio_stats_dump(pdata, fd);
+
+	if(locked)
+		pthread_mutex_unlock(&pdata->worker.codec_mutex);
+
+	return 0;
 }
 
 /*
@@ -634,6 +1885,13 @@ struct yamaha_mc1n2_audio_pdata *yamaha_mc1n2_audio_platform_get(
 	return NULL;
 }
 
+// Started platform, for the other libraries of the audio HAL process
+struct yamaha_mc1n2_audio_pdata *yamaha_mc1n2_audio_started_pdata = NULL;
+
+struct yamaha_mc1n2_audio_pdata *yamaha_mc1n2_audio_get_started(void)
+{
+	return __sync_fetch_and_add(&yamaha_mc1n2_audio_started_pdata, 0);
+}
 
 int yamaha_mc1n2_audio_start(struct yamaha_mc1n2_audio_pdata **pdata_p,
 	char *device_name)
@@ -646,7 +1904,11 @@ int yamaha_mc1n2_audio_start(struct yamaha_mc1n2_audio_pdata **pdata_p,
 	if(pdata_p == NULL || device_name == NULL)
 		return -1;
 
-	pdata = yamaha_mc1n2_audio_platform_get(device_name);
+	// Built-in params are only used without an image
+	pdata = yamaha_mc1n2_audio_params_image_load(device_name);
+	if(pdata == NULL)
+		pdata = yamaha_mc1n2_audio_platform_get(device_name);
+
 	if(pdata == NULL || pdata->ops == NULL) {
 		ALOGE("Unable to find requested platform: %s", device_name);
 		return -1;
@@ -654,6 +1916,25 @@ int yamaha_mc1n2_audio_start(struct yamaha_mc1n2_audio_pdata **pdata_p,
 
 	pdata->ops->hw_fd = -1;
 
+	memset(&pdata->shadow, 0, sizeof(struct yamaha_mc1n2_audio_shadow));
+	memset(&pdata->stats, 0, sizeof(struct yamaha_mc1n2_audio_stats));
+
+	yamaha_mc1n2_audio_routes_update(pdata);
+	yamaha_mc1n2_audio_state_reset(pdata);
+
+	// Held while the codec is configured, with or without the worker
+	pthread_mutex_init(&pdata->worker.codec_mutex, NULL);
+
+	rc = yamaha_mc1n2_audio_route_table_init(pdata);
+	if(rc < 0)
+		ALOGE("Unable to init route table, routes will be merged every time");
+
+	rc = yamaha_mc1n2_audio_worker_start(pdata);
+	if(rc < 0)
+		ALOGE("Unable to start worker, routing will be synchronous");
+
+	(void) __sync_lock_test_and_set(&yamaha_mc1n2_audio_started_pdata, pdata);
+
 	*pdata_p = pdata;
 
 	return 0;
@@ -666,9 +1947,23 @@ int yamaha_mc1n2_audio_stop(struct yamaha_mc1n2_audio_pdata *pdata)
 	if(pdata == NULL || pdata->ops == NULL)
 		return -1;
 
+	(void) __sync_val_compare_and_swap(&yamaha_mc1n2_audio_started_pdata, pdata, NULL);
+
+	yamaha_mc1n2_audio_worker_stop(pdata);
+
 	if(pdata->ops->hw_fd >= 0) {
-		close(pdata->ops->hw_fd);
+		yamaha_mc1n2_audio_hw_ops(pdata)->close(pdata->ops->hw_fd);
 	}
 
+	ALOGD("Route table: %d hits, %d misses", pdata->route_table.hits,
+		pdata->route_table.misses);
+	ALOGD("Shadow: %d control blocks sent, %d avoided", pdata->shadow.sent,
+		pdata->shadow.avoided);
+
+	yamaha_mc1n2_audio_route_table_deinit(pdata);
+	yamaha_mc1n2_audio_params_image_unload(pdata);
+
+	pthread_mutex_destroy(&pdata->worker.codec_mutex);
+
 	return 0;
 }